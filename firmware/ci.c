@@ -29,11 +29,11 @@
 #include "bist.h"
 #include "ci.h"
 #include "config.h"
+#include "dram_monitor.h"
 #include "edid.h"
 #include "encoder.h"
 #include "fx2.h"
-#include "hdmi_in0.h"
-#include "hdmi_in1.h"
+#include "hdmi_in.h"
 #include "hdmi_out0.h"
 #include "hdmi_out1.h"
 #include "heartbeat.h"
@@ -43,7 +43,10 @@
 #include "pattern.h"
 #include "pll.h"
 #include "processor.h"
+#include "rawvideo.h"
+#include "scaler.h"
 #include "reboot.h"
+#include "rtp.h"
 #include "stdio_wrap.h"
 #include "telnet.h"
 #include "tofe_eeprom.h"
@@ -97,6 +100,24 @@ static void help_heartbeat(void)
 	wputs("  heartbeat <on/off>             - Turn on/off heartbeat feature");
 }
 
+#ifdef CSR_SCALER_BASE
+static void help_scaler(void)
+{
+	wputs("scaler commands");
+	wputs("  scaler <source>                - scale <source> to the video mode,");
+	wputs("                                   shown by the 'scaler' source");
+}
+#endif
+
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+static void help_compression(void)
+{
+	wputs("compression commands");
+	wputs("  compression <on/off>           - store the inputs only shown by the");
+	wputs("                                   outputs compressed");
+}
+#endif
+
 static void heartbeat_enable(void)
 {
 	hb_status(true);
@@ -128,20 +149,25 @@ static void help_output1(void)
 #endif
 
 #ifdef CSR_HDMI_IN0_BASE
-static void help_input0(void)
+static void help_input(int n)
 {
-	wputs("input0 commands (alias: 'i0')");
-	wputs("  input0 on                     - enable input0");
-	wputs("  input0 off                    - disable input0");
+	wprintf("input%d commands (alias: 'i%d')\n", n, n);
+	wprintf("  input%d on                     - enable input%d\n", n, n);
+	wprintf("  input%d off                    - disable input%d\n", n, n);
 }
-#endif
 
-#ifdef CSR_HDMI_IN1_BASE
-static void help_input1(void)
+/* Number of the input named "<prefix><n>", -1 if there is no such input */
+static int input_index(const char *token, const char *prefix)
 {
-	wputs("input1 commands (alias: 'i1')");
-	wputs("  input1 on                     - enable input1");
-	wputs("  input1 off                    - disable input1");
+	int len = strlen(prefix);
+	int n;
+
+	if(strncmp(token, prefix, len) != 0)
+		return -1;
+	if(token[len] < '0' || token[len] > '9' || token[len + 1] != '\0')
+		return -1;
+	n = token[len] - '0';
+	return hdmi_in_present(n) ? n : -1;
 }
 #endif
 
@@ -156,23 +182,62 @@ static void help_encoder(void)
 }
 #endif
 
+#ifdef CSR_RTP_BASE
+static void help_rtp(void)
+{
+	wputs("rtp commands");
+	wputs("  rtp on                         - enable RTP/JPEG streaming");
+	wputs("  rtp off                        - disable RTP/JPEG streaming");
+	wputs("  rtp dest <ip> [port] [mac]     - configure destination");
+	wputs("  rtp payload <size>             - configure RTP payload size");
+}
+#endif
+
+#ifdef CSR_RAWVIDEO_BASE
+static void help_rawvideo(void)
+{
+	wputs("rawvideo commands (alias: 'r')");
+	wputs("  rawvideo on                    - enable raw video streaming");
+	wputs("  rawvideo off                   - disable raw video streaming");
+	wputs("  rawvideo fps <fps>             - configure target fps");
+	wputs("  rawvideo dest <ip> [port] [mac] - configure destination");
+	wputs("  rawvideo payload <size>        - configure UDP payload size");
+}
+#endif
+
 static void help_debug(void)
 {
+#ifdef CSR_HDMI_IN0_BASE
+	int n;
+#endif
 	wputs("debug commands (alias 'd')");
 #ifdef CSR_GENERATOR_BASE
 	wputs("  debug sdram_test               - run a memory test");
 #endif
 	wputs("  debug clocks                   - dump pll/mmcm configuration");
 #ifdef CSR_HDMI_IN0_BASE
-	wputs("  debug input0 <on/off>          - debug dvisampler0");
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	wputs("  debug input1 <on/off>          - debug dvisampler1");
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_present(n))
+			continue;
+		wprintf("  debug input%d <on/off>          - debug dvisampler%d\n", n, n);
+		wprintf("  debug input%d eye               - rescan the dvisampler%d eye\n", n, n);
+	}
 #endif
 #ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
 	wputs("  debug ddr                      - show DDR bandwidth");
+#endif
+#ifdef CSR_DRAM_MONITOR_BASE
+	wputs("  debug ddr <on/off>             - show DDR bandwidth per port every second");
+#endif
+#ifdef CSR_DRAM_QOS_BASE
+	wputs("  debug ddr qos <port> <p> <b>   - DDR priority 0-3 and budget % (0: none) of a port");
 #endif
 	wputs("  debug dna                      - show Board's DNA");
+	wputs("  debug stdio                    - show console output buffers");
+#ifdef CSR_HDMI_IN0_BASE
+	wputs("  debug isr                      - show HDMI input interrupt timing");
+#endif
+	wputs("  debug config <erase>           - show/reset the saved config");
 	wputs("  debug edid <port>              - dump monitor EDID");
 #ifdef CSR_CAS_BASE
 	wputs("  debug cas leds <value>         - change the status LEDs");
@@ -184,6 +249,10 @@ static void help_debug(void)
 
 static void ci_help(void)
 {
+#ifdef CSR_HDMI_IN0_BASE
+	int n;
+#endif
+
 	wputs("help        - this command");
 	wputs("reboot      - reboot CPU");
 #ifdef CSR_ETHPHY_MDIO_W_ADDR
@@ -203,6 +272,14 @@ static void ci_help(void)
 	wputs("");
 	help_hdp_toggle();
 	wputs("");
+#ifdef CSR_SCALER_BASE
+	help_scaler();
+	wputs("");
+#endif
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	help_compression();
+	wputs("");
+#endif
 #ifdef CSR_HDMI_OUT0_BASE
 	help_output0();
 	wputs("");
@@ -212,15 +289,23 @@ static void ci_help(void)
 	wputs("");
 #endif
 #ifdef CSR_HDMI_IN0_BASE
-	help_input0();
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_present(n))
+			continue;
+		help_input(n);
+		wputs("");
+	}
+#endif
+#ifdef ENCODER_BASE
+	help_encoder();
 	wputs("");
 #endif
-#ifdef CSR_HDMI_IN1_BASE
-	help_input1();
+#ifdef CSR_RTP_BASE
+	help_rtp();
 	wputs("");
 #endif
-#ifdef ENCODER_BASE
-	help_encoder();
+#ifdef CSR_RAWVIDEO_BASE
+	help_rawvideo();
 	wputs("");
 #endif
 	help_debug();
@@ -359,33 +444,32 @@ static void status_short_disable(void)
 	status_short_enabled = 0;
 }
 
-
+#ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
 static void debug_ddr(void);
+#endif
+#ifdef CSR_DRAM_MONITOR_BASE
+static int debug_ddr_live;
+#endif
 
 static void status_short_print(void)
 {
 	wprintf("status1: ");
 	unsigned int underflows;
 #ifdef CSR_HDMI_IN0_BASE
-	wprintf(
-		"in0: %dx%d",
-		hdmi_in0_resdetection_hres_read(),
-		hdmi_in0_resdetection_vres_read());
-#ifdef CSR_HDMI_IN0_FREQ_BASE
-	wprintf("@" REFRESH_RATE_PRINTF "MHz, ",
-		REFRESH_RATE_PRINTF_ARGS(hdmi_in0_freq_value_read() / 10000));
-#endif
-#endif
+	int n;
 
-#ifdef CSR_HDMI_IN1_BASE
-	wprintf(
-		"in1: %dx%d",
-		hdmi_in1_resdetection_hres_read(),
-		hdmi_in1_resdetection_vres_read());
-#ifdef CSR_HDMI_IN1_FREQ_BASE
-	wprintf("@" REFRESH_RATE_PRINTF "MHz, ",
-		REFRESH_RATE_PRINTF_ARGS(hdmi_in1_freq_value_read() / 10000));
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_present(n))
+			continue;
+		wprintf(
+			"in%d: %dx%d", n,
+			hdmi_in_hres(n),
+			hdmi_in_vres(n));
+#ifdef CSR_HDMI_IN0_FREQ_BASE
+		wprintf("@" REFRESH_RATE_PRINTF "MHz, ",
+			REFRESH_RATE_PRINTF_ARGS(hdmi_in_freq(n) / 10000));
 #endif
+	}
 #endif
 
 #ifdef CSR_HDMI_OUT0_BASE
@@ -466,37 +550,26 @@ static void status_print(void)
 {
 	unsigned int underflows;
 #ifdef CSR_HDMI_IN0_BASE
-	wprintf(
-		"input0:  %dx%d",
-		hdmi_in0_resdetection_hres_read(),
-		hdmi_in0_resdetection_vres_read());
-#ifdef CSR_HDMI_IN0_FREQ_BASE
-	wprintf(" (@" REFRESH_RATE_PRINTF " MHz)",
-		REFRESH_RATE_PRINTF_ARGS(hdmi_in0_freq_value_read() / 10000));
-	if(hdmi_in0_status()) {
-		wprintf(" (capturing)");
-	} else {
-		wprintf(" (disabled)");
-	}
-#endif
-	wputchar('\n');
-#endif
+	int n;
 
-#ifdef CSR_HDMI_IN1_BASE
-	wprintf(
-		"input1:  %dx%d",
-		hdmi_in1_resdetection_hres_read(),
-		hdmi_in1_resdetection_vres_read());
-#ifdef CSR_HDMI_IN1_FREQ_BASE
-	wprintf(" (@" REFRESH_RATE_PRINTF " MHz)",
-		REFRESH_RATE_PRINTF_ARGS(hdmi_in1_freq_value_read() / 10000));
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_present(n))
+			continue;
+		wprintf(
+			"input%d:  %dx%d", n,
+			hdmi_in_hres(n),
+			hdmi_in_vres(n));
+#ifdef CSR_HDMI_IN0_FREQ_BASE
+		wprintf(" (@" REFRESH_RATE_PRINTF " MHz)",
+			REFRESH_RATE_PRINTF_ARGS(hdmi_in_freq(n) / 10000));
 #endif
-	if(hdmi_in1_status()) {
-		wprintf(" (capturing)");
-	} else {
-		wprintf(" (disabled)");
+		if(hdmi_in_status(n)) {
+			wprintf(" (capturing)");
+		} else {
+			wprintf(" (disabled)");
+		}
+		wputchar('\n');
 	}
-	wputchar('\n');
 #endif
 
 #ifdef CSR_HDMI_OUT0_BASE
@@ -571,6 +644,19 @@ static void status_print(void)
 		wprintf("off");
 	wputchar('\n');
 #endif
+#ifdef CSR_RTP_BASE
+	rtp_status();
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+	rawvideo_status();
+#endif
+#ifdef CSR_SCALER_BASE
+	wprintf("scaler:  from %s, ", processor_get_source_name(processor_scaler_source));
+	scaler_print_status();
+#endif
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	processor_print_compression();
+#endif
 #ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
 	wprintf("ddr: ");
 	debug_ddr();
@@ -590,30 +676,17 @@ static void status_service(void)
 		if(status_short_enabled) {
 		    status_short_print();
 		}
-	}
-}
-
-#ifdef CSR_HDMI_IN0_BASE
-#ifndef HDMI_IN0_MNEMONIC
-#warning "Missing HDMI IN0 mnemonic!"
-#define HDMI_IN0_MNEMONIC ""
-#endif
-#ifndef HDMI_IN0_DESCRIPTION
-#warning "Missing HDMI IN0 description!"
-#define HDMI_IN0_DESCRIPTION ""
-#endif
-#endif
-
-#ifdef CSR_HDMI_IN1_BASE
-#ifndef HDMI_IN1_MNEMONIC
-#warning "Missing HDMI IN1 mnemonic!"
-#define HDMI_IN1_MNEMONIC ""
-#endif
-#ifndef HDMI_IN1_DESCRIPTION
-#warning "Missing HDMI IN1 description!"
-#define HDMI_IN1_DESCRIPTION ""
+#ifdef CSR_DRAM_MONITOR_BASE
+		if(debug_ddr_live) {
+#ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
+			debug_ddr();
+			wputchar('\n');
 #endif
+			dram_monitor_print();
+		}
 #endif
+	}
+}
 
 #ifdef CSR_HDMI_OUT0_BASE
 #ifndef HDMI_OUT0_MNEMONIC
@@ -639,17 +712,24 @@ static void status_service(void)
 
 static void video_matrix_list(void)
 {
-	wprintf("Video sources:\n");
 #ifdef CSR_HDMI_IN0_BASE
-	wprintf("input0 (0): %s\n", HDMI_IN0_MNEMONIC);
-	wputs(HDMI_IN0_DESCRIPTION);
+	int n;
 #endif
-#ifdef CSR_HDMI_IN1_BASE
-	wprintf("input1 (1): %s\n", HDMI_IN1_MNEMONIC);
-	wputs(HDMI_IN1_DESCRIPTION);
+	wprintf("Video sources:\n");
+#ifdef CSR_HDMI_IN0_BASE
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_present(n))
+			continue;
+		wprintf("input%d (%d): %s\n", n, n, hdmi_in_mnemonic(n));
+		wputs(hdmi_in_description(n));
+	}
 #endif
 	wprintf("pattern (p):\n");
 	wprintf("  Video pattern\n");
+#ifdef CSR_SCALER_BASE
+	wprintf("scaler (s):\n");
+	wprintf("  %s scaled to the video mode\n", processor_get_source_name(processor_scaler_source));
+#endif
 	wputs(" ");
 	wprintf("Video sinks:\n");
 #ifdef CSR_HDMI_OUT0_BASE
@@ -663,25 +743,54 @@ static void video_matrix_list(void)
 #ifdef ENCODER_BASE
 	wprintf("encoder (e):\n");
 	wprintf("  JPEG encoder (USB output)\n");
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+	wprintf("rawvideo (r):\n");
+	wprintf("  Raw YCbCr 4:2:2 over UDP\n");
 #endif
 	wputs(" ");
 }
 
+/* Video source named by 'token', -1 if there is no such source */
+static int video_source_index(const char *token)
+{
+#ifdef CSR_HDMI_IN0_BASE
+	int n;
+
+	if(((n = input_index(token, "input")) >= 0) || ((n = input_index(token, "")) >= 0))
+		return processor_hdmi_in_source(n);
+#endif
+	if((strcmp(token, "pattern") == 0) || (strcmp(token, "p") == 0))
+		return VIDEO_IN_PATTERN;
+#ifdef CSR_SCALER_BASE
+	if((strcmp(token, "scaler") == 0) || (strcmp(token, "s") == 0))
+		return VIDEO_IN_SCALER;
+#endif
+	wprintf("Unknown video source: '%s'\n", token);
+	return -1;
+}
+
 static void video_matrix_connect(int source, int sink)
 {
-	if(source >= 0 && source <= VIDEO_IN_PATTERN)
+	if(source >= 0 && source <= VIDEO_IN_SCALER)
 	{
 		if(sink >= 0 && sink <= VIDEO_OUT_HDMI_OUT1) {
 			wprintf("Connecting %s to output%d\n", processor_get_source_name(source), sink);
 			if(sink == VIDEO_OUT_HDMI_OUT0)
 #ifdef CSR_HDMI_OUT0_BASE
+			{
 				processor_set_hdmi_out0_source(source);
+				config_set(CONFIG_KEY_OUTPUT0_SOURCE, source);
+			}
 #else
 				wprintf("hdmi_out0 is missing.\n");
 #endif
 			else if(sink == VIDEO_OUT_HDMI_OUT1)
 #ifdef CSR_HDMI_OUT1_BASE
+			{
 				processor_set_hdmi_out1_source(source);
+				config_set(CONFIG_KEY_OUTPUT1_SOURCE, source);
+			}
 #else
 				wprintf("hdmi_out1 is missing.\n");
 #endif
@@ -691,6 +800,14 @@ static void video_matrix_connect(int source, int sink)
 		else if(sink == VIDEO_OUT_ENCODER) {
 			wprintf("Connecting %s to encoder\n", processor_get_source_name(source));
 			processor_set_encoder_source(source);
+			config_set(CONFIG_KEY_ENCODER_SOURCE, source);
+			processor_update();
+		}
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+		else if(sink == VIDEO_OUT_RAWVIDEO) {
+			wprintf("Connecting %s to rawvideo\n", processor_get_source_name(source));
+			processor_set_rawvideo_source(source);
 			processor_update();
 		}
 #endif
@@ -876,55 +993,31 @@ static void video_mode_custom(char* str)
 
 static void hdp_toggle(int source)
 {
-#if defined(CSR_HDMI_IN0_BASE) || defined(CSR_HDMI_IN1_BASE)
+#ifdef CSR_HDMI_IN0_BASE
 	int i;
 #endif
 	wprintf("Toggling HDP on output%d\n", source);
 #ifdef CSR_HDMI_IN0_BASE
-	if(source == VIDEO_IN_HDMI_IN0) {
-		hdmi_in0_edid_hpd_en_write(0);
+	if(hdmi_in_present(source)) {
+		hdmi_in_set_hpd(source, 0);
 		for(i=0; i<65536; i++);
-		hdmi_in0_edid_hpd_en_write(1);
-	}
-#else
-	wprintf("hdmi_in0 is missing.\n");
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	if(source == VIDEO_IN_HDMI_IN1) {
-		hdmi_in1_edid_hpd_en_write(0);
-		for(i=0; i<65536; i++);
-		hdmi_in1_edid_hpd_en_write(1);
-	}
-#else
-	wprintf("hdmi_in1 is missing.\n");
+		hdmi_in_set_hpd(source, 1);
+	} else
 #endif
+	wprintf("hdmi_in%d is missing.\n", source);
 }
 
 #ifdef CSR_HDMI_IN0_BASE
-void input0_on(void)
-{
-	wprintf("Enabling input0\n");
-	hdmi_in0_enable();
-}
-
-void input0_off(void)
+void input_on(int n)
 {
-	wprintf("Disabling input0\n");
-	hdmi_in0_disable();
+	wprintf("Enabling input%d\n", n);
+	hdmi_in_enable(n);
 }
-#endif
 
-#ifdef CSR_HDMI_IN1_BASE
-void input1_on(void)
+void input_off(int n)
 {
-	wprintf("Enabling input1\n");
-	hdmi_in1_enable();
-}
-
-void input1_off(void)
-{
-	wprintf("Disabling input1\n");
-	hdmi_in1_disable();
+	wprintf("Disabling input%d\n", n);
+	hdmi_in_disable(n);
 }
 #endif
 
@@ -982,6 +1075,44 @@ void encoder_off(void)
 }
 #endif
 
+#if defined(CSR_RTP_BASE) || defined(CSR_RAWVIDEO_BASE)
+static int parse_addr(char *str, unsigned char *addr, int len, char sep, int base)
+{
+	char *c;
+
+	for(int i = 0; i < len; i++) {
+		addr[i] = strtoul(str, &c, base);
+		if(c == str || (i < len - 1 && *c != sep) || (i == len - 1 && *c != 0))
+			return 0;
+		str = c + 1;
+	}
+	return 1;
+}
+
+static void configure_destination(void (*set_destination)(const unsigned char *, unsigned short, const unsigned char *),
+	int port, char *ip_str, char *port_str, char *mac_str)
+{
+	unsigned char ip[4];
+	unsigned char mac[6];
+
+	if(!parse_addr(ip_str, ip, 4, '.', 10)) {
+		wprintf("Invalid IP address %s\n", ip_str);
+		return;
+	}
+	if(port_str[0] != 0)
+		port = atoi(port_str);
+	if(mac_str[0] != 0) {
+		if(!parse_addr(mac_str, mac, 6, ':', 16)) {
+			wprintf("Invalid MAC address %s\n", mac_str);
+			return;
+		}
+		set_destination(ip, port, mac);
+	} else
+		set_destination(ip, port, NULL);
+	wprintf("Streaming to %d.%d.%d.%d:%d\n", ip[0], ip[1], ip[2], ip[3], port);
+}
+#endif
+
 static void debug_clocks(void)
 {
 	// Only the active clock system will output anything
@@ -999,6 +1130,9 @@ static unsigned int log2(unsigned int v)
 #ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
 static void debug_ddr(void)
 {
+#ifdef CSR_DRAM_MONITOR_BASE
+	dram_monitor_print_total();
+#else
 	/*
 	unsigned long long int nr, nw;
 	unsigned long long int f;
@@ -1014,6 +1148,31 @@ static void debug_ddr(void)
 	wrb = (nw*f >> (24 - log2(burstbits)))/1000000ULL;
 	wprintf("read:%5dMbps  write:%5dMbps  all:%5dMbps\n", rdb, wrb, rdb + wrb);
 	*/
+#endif
+}
+#endif
+
+#ifdef CSR_DRAM_QOS_BASE
+static void debug_ddr_qos(char *str)
+{
+	char *token;
+	int port, priority, budget;
+
+	token = get_token(&str);
+	port = dram_monitor_port(token);
+	if(port < 0) {
+		wprintf("Unknown DDR port %s\n", token);
+		return;
+	}
+	token = get_token(&str);
+	if(*token == 0) {
+		wprintf("debug ddr qos <port> <priority> <budget>\n");
+		return;
+	}
+	priority = atoi(token);
+	budget = atoi(get_token(&str));
+	if(dram_qos_set(port, priority, budget) < 0)
+		wprintf("Invalid DDR priority %d or budget %d%%\n", priority, budget);
 }
 #endif
 
@@ -1026,6 +1185,9 @@ void ci_service(void)
 {
 	char *str;
 	char *token;
+#ifdef CSR_HDMI_IN0_BASE
+	int n;
+#endif
 
 	status_service();
 
@@ -1043,6 +1205,14 @@ void ci_service(void)
 			help_video_mode();
 		else if(strcmp(token, "hdp_toggle") == 0)
 			help_hdp_toggle();
+#ifdef CSR_SCALER_BASE
+		else if(strcmp(token, "scaler") == 0)
+			help_scaler();
+#endif
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+		else if(strcmp(token, "compression") == 0)
+			help_compression();
+#endif
 #ifdef CSR_HDMI_OUT0_BASE
 		else if(strcmp(token, "output0") == 0)
 			help_output0();
@@ -1052,16 +1222,20 @@ void ci_service(void)
 			help_output1();
 #endif
 #ifdef CSR_HDMI_IN0_BASE
-		else if(strcmp(token, "input0") == 0)
-			help_input0();
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-		else if(strcmp(token, "input1") == 0)
-			help_input1();
+		else if((n = input_index(token, "input")) >= 0)
+			help_input(n);
 #endif
 #ifdef ENCODER_BASE
 		else if(strcmp(token, "encoder") == 0)
 			help_encoder();
+#endif
+#ifdef CSR_RTP_BASE
+		else if(strcmp(token, "rtp") == 0)
+			help_rtp();
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+		else if(strcmp(token, "rawvideo") == 0)
+			help_rawvideo();
 #endif
 		else if(strcmp(token, "debug") == 0)
 			help_debug();
@@ -1087,19 +1261,7 @@ void ci_service(void)
 			int sink;
 			/* get video source */
 			token = get_token(&str);
-			source = -1;
-			if((strcmp(token, "input0") == 0) || (strcmp(token, "0") == 0)) {
-				source = VIDEO_IN_HDMI_IN0;
-			}
-			else if((strcmp(token, "input1") == 0) || (strcmp(token, "1") == 0)) {
-				source = VIDEO_IN_HDMI_IN1;
-			}
-			else if((strcmp(token, "pattern") == 0) || (strcmp(token, "p") == 0)) {
-				source = VIDEO_IN_PATTERN;
-			}
-			else {
-				wprintf("Unknown video source: '%s'\n", token);
-			}
+			source = video_source_index(token);
 
 			/* get video sink */
 			token = get_token(&str);
@@ -1113,6 +1275,9 @@ void ci_service(void)
 			else if((strcmp(token, "encoder") == 0) || (strcmp(token, "e") == 0)) {
 				sink = VIDEO_OUT_ENCODER;
 			}
+			else if((strcmp(token, "rawvideo") == 0) || (strcmp(token, "r") == 0)) {
+				sink = VIDEO_OUT_RAWVIDEO;
+			}
 			else
 				wprintf("Unknown video sink: '%s'\n", token);
 
@@ -1148,13 +1313,42 @@ void ci_service(void)
 		token = get_token(&str);
 		hdp_toggle(atoi(token));
 	}
+#ifdef CSR_SCALER_BASE
+	else if(strcmp(token, "scaler") == 0) {
+		int source;
+
+		token = get_token(&str);
+		source = video_source_index(token);
+		if(source == VIDEO_IN_SCALER)
+			wprintf("The scaler cannot scale itself\n");
+		else if(source >= 0) {
+			wprintf("Scaling %s\n", processor_get_source_name(source));
+			processor_set_scaler_source(source);
+		} else
+			help_scaler();
+	}
+#endif
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	else if(strcmp(token, "compression") == 0) {
+		token = get_token(&str);
+		if(strcmp(token, "on") == 0)
+			processor_set_compression(1);
+		else if(strcmp(token, "off") == 0)
+			processor_set_compression(0);
+		else
+			help_compression();
+	}
+#endif
 #ifdef CSR_HDMI_OUT0_BASE
 	else if((strcmp(token, "output0") == 0) || (strcmp(token, "o0") == 0)) {
 		token = get_token(&str);
-		if(strcmp(token, "on") == 0)
+		if(strcmp(token, "on") == 0) {
 			output0_on();
-		else if(strcmp(token, "off") == 0)
+			config_set(CONFIG_KEY_OUTPUT0_ENABLED, 1);
+		} else if(strcmp(token, "off") == 0) {
 			output0_off();
+			config_set(CONFIG_KEY_OUTPUT0_ENABLED, 0);
+		}
 		else
 			help_output0();
 	}
@@ -1162,50 +1356,100 @@ void ci_service(void)
 #ifdef CSR_HDMI_OUT1_BASE
 	else if((strcmp(token, "output1") == 0) || (strcmp(token, "o1") == 0)) {
 		token = get_token(&str);
-		if(strcmp(token, "on") == 0)
+		if(strcmp(token, "on") == 0) {
 			output1_on();
-		else if(strcmp(token, "off") == 0)
+			config_set(CONFIG_KEY_OUTPUT1_ENABLED, 1);
+		} else if(strcmp(token, "off") == 0) {
 			output1_off();
+			config_set(CONFIG_KEY_OUTPUT1_ENABLED, 0);
+		}
 		else
 			help_output1();
 	}
 #endif
 #ifdef CSR_HDMI_IN0_BASE
-	else if((strcmp(token, "input0") == 0) || (strcmp(token, "i0") == 0)) {
-		token = get_token(&str);
-		if(strcmp(token, "on") == 0)
-			input0_on();
-		else if(strcmp(token, "off") == 0)
-			input0_off();
-		else
-			help_input0();
-	}
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	else if((strcmp(token, "input1") == 0) || (strcmp(token, "i1") == 0)) {
+	else if(((n = input_index(token, "input")) >= 0) || ((n = input_index(token, "i")) >= 0)) {
 		token = get_token(&str);
-		if(strcmp(token, "on") == 0)
-			input1_on();
-		else if(strcmp(token, "off") == 0)
-			input1_off();
+		if(strcmp(token, "on") == 0) {
+			input_on(n);
+			if(hdmi_in_enabled_key(n) >= 0)
+				config_set(hdmi_in_enabled_key(n), 1);
+		} else if(strcmp(token, "off") == 0) {
+			input_off(n);
+			if(hdmi_in_enabled_key(n) >= 0)
+				config_set(hdmi_in_enabled_key(n), 0);
+		}
 		else
-			help_input1();
+			help_input(n);
 	}
 #endif
 #ifdef ENCODER_BASE
 	else if((strcmp(token, "encoder") == 0) || (strcmp(token, "e") == 0)) {
 		token = get_token(&str);
-		if(strcmp(token, "on") == 0)
+		if(strcmp(token, "on") == 0) {
 			encoder_on();
-		else if(strcmp(token, "off") == 0)
+			config_set(CONFIG_KEY_ENCODER_ENABLED, 1);
+		} else if(strcmp(token, "off") == 0) {
 			encoder_off();
-		else if(strcmp(token, "quality") == 0)
+			config_set(CONFIG_KEY_ENCODER_ENABLED, 0);
+		} else if(strcmp(token, "quality") == 0) {
 			encoder_configure_quality(atoi(get_token(&str)));
-		else if(strcmp(token, "fps") == 0)
+			config_set(CONFIG_KEY_ENCODER_QUALITY, encoder_quality);
+		} else if(strcmp(token, "fps") == 0) {
 			encoder_configure_fps(atoi(get_token(&str)));
+			config_set(CONFIG_KEY_ENCODER_FPS, encoder_target_fps);
+		}
 		else
 			help_encoder();
 	}
+#endif
+#ifdef CSR_RTP_BASE
+	else if(strcmp(token, "rtp") == 0) {
+		token = get_token(&str);
+		if(strcmp(token, "on") == 0) {
+			wprintf("Enabling RTP streaming\n");
+			rtp_enable(1);
+		}
+		else if(strcmp(token, "off") == 0) {
+			wprintf("Disabling RTP streaming\n");
+			rtp_enable(0);
+		}
+		else if(strcmp(token, "dest") == 0) {
+			char *ip_str = get_token(&str);
+			char *port_str = get_token(&str);
+			configure_destination(rtp_set_destination, RTP_DEFAULT_PORT,
+				ip_str, port_str, get_token(&str));
+		}
+		else if(strcmp(token, "payload") == 0)
+			rtp_set_payload_size(atoi(get_token(&str)));
+		else
+			help_rtp();
+	}
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+	else if((strcmp(token, "rawvideo") == 0) || (strcmp(token, "r") == 0)) {
+		token = get_token(&str);
+		if(strcmp(token, "on") == 0) {
+			wprintf("Enabling raw video streaming\n");
+			rawvideo_enable(1);
+		}
+		else if(strcmp(token, "off") == 0) {
+			wprintf("Disabling raw video streaming\n");
+			rawvideo_enable(0);
+		}
+		else if(strcmp(token, "fps") == 0)
+			rawvideo_set_fps(atoi(get_token(&str)));
+		else if(strcmp(token, "dest") == 0) {
+			char *ip_str = get_token(&str);
+			char *port_str = get_token(&str);
+			configure_destination(rawvideo_set_destination, RAWVIDEO_DEFAULT_PORT,
+				ip_str, port_str, get_token(&str));
+		}
+		else if(strcmp(token, "payload") == 0)
+			rawvideo_set_payload_size(atoi(get_token(&str)));
+		else
+			help_rawvideo();
+	}
 #endif
 	else if((strcmp(token, "pattern") == 0) || (strcmp(token, "p") == 0)) {
 		pattern_next();
@@ -1237,35 +1481,59 @@ void ci_service(void)
 		else if(strcmp(token, "sdram_test") == 0) bist_test();
 #endif
 #ifdef CSR_HDMI_IN0_BASE
-		else if(strcmp(token, "input0") == 0) {
+		else if((n = input_index(token, "input")) >= 0) {
 			token = get_token(&str);
-			if(strcmp(token, "off") == 0)
-				hdmi_in0_debug = 0;
-			else if(strcmp(token, "on") == 0)
-				hdmi_in0_debug = 1;
-			else
-				hdmi_in0_debug = !hdmi_in0_debug;
-			wprintf("HDMI Input 0 debug %s\n", hdmi_in0_debug ? "on" : "off");
-		}
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-		else if(strcmp(token, "input1") == 0) {
-			token = get_token(&str);
-			if(strcmp(token, "off") == 0)
-				hdmi_in1_debug = 0;
-			else if(strcmp(token, "on") == 0)
-				hdmi_in1_debug = 1;
-			else
-				hdmi_in1_debug = !hdmi_in1_debug;
-			wprintf("HDMI Input 1 debug %s\n", hdmi_in1_debug ? "on" : "off");
+			if(strcmp(token, "eye") == 0) {
+				hdmi_in_eye_scan(n);
+				wprintf("HDMI Input %d eye scan requested\n", n);
+			} else {
+				if(strcmp(token, "off") == 0)
+					hdmi_in_set_debug(n, 0);
+				else if(strcmp(token, "on") == 0)
+					hdmi_in_set_debug(n, 1);
+				else
+					hdmi_in_set_debug(n, !hdmi_in_get_debug(n));
+				wprintf("HDMI Input %d debug %s\n", n, hdmi_in_get_debug(n) ? "on" : "off");
+			}
 		}
 #endif
 #ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
 		else if(strcmp(token, "ddr") == 0) {
+#ifdef CSR_DRAM_MONITOR_BASE
+			token = get_token(&str);
+			if(strcmp(token, "on") == 0)
+				debug_ddr_live = 1;
+			else if(strcmp(token, "off") == 0)
+				debug_ddr_live = 0;
+#ifdef CSR_DRAM_QOS_BASE
+			else if(strcmp(token, "qos") == 0)
+				debug_ddr_qos(str);
+#endif
+			else {
+				debug_ddr();
+				wputchar('\n');
+				dram_monitor_print();
+			}
+#else
 			debug_ddr();
 			wputchar('\n');
+#endif
 		}
 #endif
+		else if(strcmp(token, "stdio") == 0)
+			stdio_print_status();
+#ifdef CSR_HDMI_IN0_BASE
+		else if(strcmp(token, "isr") == 0)
+			hdmi_in_print_isr_status();
+#endif
+		else if(strcmp(token, "config") == 0) {
+			token = get_token(&str);
+			if(strcmp(token, "erase") == 0) {
+				config_erase();
+				wprintf("Config erased, defaults apply on next boot\n");
+			}
+			config_print_status();
+		}
 #ifdef CSR_INFO_DNA_ID_ADDR
 		else if(strcmp(token, "dna") == 0) {
 			print_board_dna();
@@ -15,13 +15,8 @@ void output1_off(void);
 #endif
 
 #ifdef CSR_HDMI_IN0_BASE
-void input0_on(void);
-void input0_off(void);
-#endif
-
-#ifdef CSR_HDMI_IN1_BASE
-void input1_on(void);
-void input1_off(void);
+void input_on(int n);
+void input_off(int n);
 #endif
 
 #ifdef ENCODER_BASE
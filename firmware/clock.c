@@ -0,0 +1,141 @@
+#include "clock.h"
+#include "clock_tables.h"
+
+#define CLOCK_TABLE_SIZE(t)	(sizeof(t)/sizeof(t[0]))
+
+static int clock_table_lookup(const struct clock_setting *table, int size,
+	unsigned int pixel_clock, struct clock_setting *s)
+{
+	int i;
+
+	for(i = 0; i < size; i++)
+		if(table[i].pixel_clock == pixel_clock) {
+			*s = table[i];
+			return 1;
+		}
+	return 0;
+}
+
+/* |m/d - p/q| * d*q */
+static unsigned long long clock_error(unsigned int p, unsigned int q,
+	unsigned int m, unsigned int d)
+{
+	unsigned long long a = (unsigned long long)m*q;
+	unsigned long long b = (unsigned long long)d*p;
+
+	return a > b ? a - b : b - a;
+}
+
+/*
+ * Best approximation m/d of p/q with m <= max_m and d <= max_d: the last
+ * convergent of the continued fraction of p/q within the limits, or the
+ * largest semiconvergent after it when that is closer. d is 0 when p/q
+ * is over max_m.
+ */
+static void clock_approximate(unsigned int p, unsigned int q,
+	unsigned int max_m, unsigned int max_d, unsigned int *m, unsigned int *d)
+{
+	unsigned int m0 = 0, d0 = 1, m1 = 1, d1 = 0;
+	unsigned int x = p, y = q;
+	unsigned int a, k, r, sm, sd;
+
+	while(y) {
+		a = x / y;
+		if(a*m1 + m0 > max_m || a*d1 + d0 > max_d) {
+			/* largest k keeping k*m1 + m0 and k*d1 + d0 in the limits */
+			k = a;
+			if(m1 && (max_m - m0)/m1 < k)
+				k = (max_m - m0)/m1;
+			if(d1 && (max_d - d0)/d1 < k)
+				k = (max_d - d0)/d1;
+			/* only semiconvergents from a/2 on can be closer */
+			if(k && 2*k >= a) {
+				sm = k*m1 + m0;
+				sd = k*d1 + d0;
+				if(d1 == 0 ||
+				   clock_error(p, q, sm, sd)*d1 < clock_error(p, q, m1, d1)*sd) {
+					m1 = sm;
+					d1 = sd;
+				}
+			}
+			break;
+		}
+		sm = a*m1 + m0;
+		sd = a*d1 + d0;
+		m0 = m1;
+		d0 = d1;
+		m1 = sm;
+		d1 = sd;
+		r = x % y;
+		x = y;
+		y = r;
+	}
+	*m = m1;
+	*d = d1;
+}
+
+int clock_clkgen_setting(unsigned int pixel_clock, struct clock_setting *s)
+{
+	unsigned int m, d;
+
+	if(clock_table_lookup(clock_clkgen_table, CLOCK_TABLE_SIZE(clock_clkgen_table),
+			pixel_clock, s))
+		return 1;
+
+	/* pixel clock / 50MHz */
+	clock_approximate(pixel_clock, 5000, 256, 256, &m, &d);
+	if(d == 0)
+		return 0;
+	if(m < 2) {
+		if(2*d > 256)
+			return 0;
+		m *= 2;
+		d *= 2;
+	}
+	s->pixel_clock = pixel_clock;
+	s->m = m;
+	s->d = d;
+	s->o = 1;
+	return 1;
+}
+
+int clock_mmcm_setting(unsigned int pixel_clock, struct clock_setting *s)
+{
+	unsigned int m, d, o;
+	unsigned long long error, best_error = 0;
+	int found = 0;
+
+	if(clock_table_lookup(clock_mmcm_table, CLOCK_TABLE_SIZE(clock_mmcm_table),
+			pixel_clock, s))
+		return 1;
+
+	for(o = 5; o <= 125; o += 5) {
+		/* VCO / 100MHz = pixel clock * o / 100MHz, from 6 to 12: out of
+		 * that range, the closest VCO is the limit itself */
+		if(pixel_clock*o <= 6*10000) {
+			m = 6;
+			d = 1;
+		} else if(pixel_clock*o >= 12*10000) {
+			m = 12;
+			d = 1;
+		} else {
+			clock_approximate(pixel_clock*o, 10000, 64, 10, &m, &d);
+			if(d == 0 || m < 6*d || m > 12*d)
+				continue;
+		}
+		/* the error of the pixel clock is error / (d*o) */
+		error = clock_error(pixel_clock*o, 10000, m, d);
+		if(!found ||
+		   error*s->d*s->o < best_error*d*o ||
+		   /* equally close: the highest VCO wins */
+		   (error*s->d*s->o == best_error*d*o && m*s->d > s->m*d)) {
+			found = 1;
+			best_error = error;
+			s->pixel_clock = pixel_clock;
+			s->m = m;
+			s->d = d;
+			s->o = o;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,29 @@
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+/*
+ * Synthesis of the pixel clock of the HDMI outputs, given in units of
+ * 10kHz like in struct video_timing:
+ *
+ * Spartan-6 DCM_CLKGEN: pixel clock = 50MHz * m / d
+ *	2 <= m <= 256, 1 <= d <= 256
+ * Artix-7 MMCM: VCO = 100MHz * m / d, pixel clock = VCO / o, and the
+ * serial clock VCO / (o/5)
+ *	2 <= m <= 64, 1 <= d <= 10 (PFD of at least 10MHz),
+ *	600MHz <= VCO <= 1200MHz, o a multiple of 5 up to 125
+ *
+ * The settings of the video modes of processor.c are computed at build
+ * time by clock_tables.py, the others (custom modes) from a best rational
+ * approximation.
+ */
+
+struct clock_setting {
+	unsigned int pixel_clock;
+	unsigned short m, d, o;
+};
+
+/* Both return 0 when no setting is within the limits */
+int clock_clkgen_setting(unsigned int pixel_clock, struct clock_setting *s);
+int clock_mmcm_setting(unsigned int pixel_clock, struct clock_setting *s);
+
+#endif /* __CLOCK_H */
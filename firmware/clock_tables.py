@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""
+Generates the clock settings of the video modes (see clock.h).
+
+Reads the pixel clocks of the video_modes table of processor.c and finds,
+by exhaustive search, the setting closest to each of them for the Spartan-6
+DCM_CLKGEN and for the Artix-7 MMCM of the HDMI outputs, preferring the
+highest VCO frequency (lowest jitter) between equally close MMCM settings.
+
+Usage: clock_tables.py processor.c clock_tables.h
+"""
+
+import re
+import sys
+from fractions import Fraction
+
+
+def video_mode_clocks(source):
+    """Pixel clocks (10kHz) of the video_modes table, in order"""
+    table = re.search(r"video_modes\[PROCESSOR_MODE_COUNT\] = \{(.*?)\n\};",
+        source, re.DOTALL)
+    if not table:
+        raise SystemExit("video_modes table not found")
+    return [int(c) for c in re.findall(r"\.pixel_clock = (\d+),", table.group(1))]
+
+
+def nearest(target, lo, hi):
+    """Integers of [lo, hi] around target, the closest is one of them"""
+    n = target.numerator//target.denominator
+    return [m for m in (n, n + 1) if lo <= m <= hi] or [min(max(n, lo), hi)]
+
+
+def clkgen_setting(pixel_clock):
+    """pixel clock = 50MHz * m / d"""
+    target = Fraction(pixel_clock, 5000)
+    best = None
+    for d in range(1, 257):
+        for m in nearest(target*d, 2, 256):
+            error = abs(Fraction(m, d) - target)
+            if best is None or error < best[0]:
+                best = (error, m, d)
+    error, m, d = best
+    return m, d, 1
+
+
+def mmcm_setting(pixel_clock):
+    """VCO = 100MHz * m / d, pixel clock = VCO / o"""
+    target = Fraction(pixel_clock, 10000)
+    best = None
+    for o in range(5, 126, 5):
+        for d in range(1, 11):
+            # VCO within 600MHz - 1200MHz
+            for m in nearest(target*d*o, max(2, 6*d), min(64, 12*d)):
+                vco = Fraction(100*m, d)
+                key = (abs(Fraction(m, d*o) - target), -vco)
+                if best is None or key < best[0]:
+                    best = (key, m, d, o)
+    if best is None:
+        return 0, 0, 0
+    key, m, d, o = best
+    return m, d, o
+
+
+def table(name, settings):
+    lines = ["static const struct clock_setting {}[] = {{".format(name)]
+    for pixel_clock, (m, d, o), frequency in settings:
+        lines.append("\t{{ {:5d}, {:3d}, {:3d}, {:3d} }}, /* {:.2f}MHz, {:.4f}MHz */".format(
+            pixel_clock, m, d, o, pixel_clock/100, frequency))
+    lines.append("};")
+    return lines
+
+
+def main():
+    if len(sys.argv) != 3:
+        raise SystemExit(__doc__)
+    with open(sys.argv[1]) as f:
+        clocks = sorted(set(video_mode_clocks(f.read())))
+
+    clkgen = []
+    mmcm = []
+    for pixel_clock in clocks:
+        m, d, o = clkgen_setting(pixel_clock)
+        clkgen.append((pixel_clock, (m, d, o), 50*m/d))
+        m, d, o = mmcm_setting(pixel_clock)
+        if m:
+            mmcm.append((pixel_clock, (m, d, o), 100*m/(d*o)))
+        else:
+            print("{}: no MMCM setting for {:.2f}MHz".format(sys.argv[0], pixel_clock/100),
+                file=sys.stderr)
+
+    lines = [
+        "/* Generated by clock_tables.py from the video modes of processor.c */",
+        "#ifndef __CLOCK_TABLES_H",
+        "#define __CLOCK_TABLES_H",
+        "",
+        "/* { pixel clock, m, d, o }, requested and synthesised frequencies */",
+    ]
+    lines += table("clock_clkgen_table", clkgen)
+    lines.append("")
+    lines += table("clock_mmcm_table", mmcm)
+    lines += [
+        "",
+        "#endif /* __CLOCK_TABLES_H */",
+    ]
+    with open(sys.argv[2], "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
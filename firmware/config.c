@@ -1,4 +1,5 @@
 #include <generated/csr.h>
+#include <generated/mem.h>
 #include <stdbool.h>
 #include <string.h>
 
@@ -12,6 +13,15 @@
 
 #include "config.h"
 #include "processor.h"
+#include "stdio_wrap.h"
+
+#if defined(CONFIG_STORE_FLASH) && defined(CSR_SPIFLASH_BASE) && \
+	defined(SPIFLASH_BASE) && defined(SPIFLASH_SIZE) && \
+	defined(SPIFLASH_PAGE_SIZE) && defined(SPIFLASH_SECTOR_SIZE)
+#define CONFIG_STORE
+#include <spiflash.h>
+#include <system.h>
+#endif
 
 // Order of default;
 //   HDMI_IN1 (if it exists)
@@ -54,18 +64,202 @@ static const unsigned char config_defaults[CONFIG_KEY_COUNT] = {
 	LOCALIP1, LOCALIP2, LOCALIP3, LOCALIP4,
 	// Networking - DHCP
 	false,
+	// Input phases - none locked yet
+	0, 0, 0, 0, 0, // Input0
+	0, 0, 0, 0, 0, // Input1
 };
 static unsigned char config_values[CONFIG_KEY_COUNT];
 
-void config_init(void)
+#ifdef CONFIG_STORE
+
+#define CONFIG_STORE_MAGIC	0x48434647 /* "HCFG" */
+#define CONFIG_STORE_VERSION	1
+#define CONFIG_STORE_FORMAT	((CONFIG_STORE_VERSION << 16) | CONFIG_KEY_COUNT)
+
+/* flash offset of the first sector */
+#define CONFIG_STORE_OFFSET	(SPIFLASH_SIZE - CONFIG_STORE_SECTORS*SPIFLASH_SECTOR_SIZE)
+
+#define CONFIG_RECORD_TAG	0xa5
+
+struct config_store_header {
+	unsigned int magic;
+	unsigned int generation;
+	unsigned int format;
+	unsigned int reserved;
+};
+
+/* An erased record (all ones) ends the log. Records that were only
+ * partially programmed fail the check and are skipped. */
+struct config_record {
+	unsigned char tag;
+	unsigned char key;
+	unsigned char value;
+	unsigned char check;
+};
+
+static int config_store_sector = -1;
+static unsigned int config_store_generation;
+static unsigned int config_store_next; /* offset of the next record in the sector */
+
+static unsigned int config_store_addr(int sector)
+{
+	return CONFIG_STORE_OFFSET + sector*SPIFLASH_SECTOR_SIZE;
+}
+
+static const volatile void *config_store_read(int sector, unsigned int offset)
+{
+	return (const volatile void *)(SPIFLASH_BASE + config_store_addr(sector) + offset);
+}
+
+static unsigned char config_record_check(unsigned char key, unsigned char value)
+{
+	return ~(key ^ value ^ CONFIG_RECORD_TAG);
+}
+
+static void config_record_init(struct config_record *r, unsigned char key, unsigned char value)
+{
+	r->tag = CONFIG_RECORD_TAG;
+	r->key = key;
+	r->value = value;
+	r->check = config_record_check(key, value);
+}
+
+static void config_store_find(void)
+{
+	const volatile struct config_store_header *h;
+	int i;
+
+	config_store_sector = -1;
+	for(i = 0; i < CONFIG_STORE_SECTORS; i++) {
+		h = config_store_read(i, 0);
+		if(h->magic != CONFIG_STORE_MAGIC || h->format != CONFIG_STORE_FORMAT)
+			continue;
+		if(config_store_sector < 0 || h->generation > config_store_generation) {
+			config_store_sector = i;
+			config_store_generation = h->generation;
+		}
+	}
+}
+
+static void config_store_load(void)
+{
+	const volatile struct config_record *r;
+	unsigned int offset;
+
+	config_store_find();
+	if(config_store_sector < 0)
+		return;
+	for(offset = sizeof(struct config_store_header);
+	    offset < SPIFLASH_SECTOR_SIZE;
+	    offset += sizeof(struct config_record)) {
+		r = config_store_read(config_store_sector, offset);
+		if(r->tag == 0xff && r->key == 0xff && r->value == 0xff && r->check == 0xff)
+			break;
+		if(r->tag == CONFIG_RECORD_TAG && r->key < CONFIG_KEY_COUNT &&
+		   r->check == config_record_check(r->key, r->value))
+			config_values[r->key] = r->value;
+	}
+	config_store_next = offset;
+}
+
+static void config_store_append(unsigned char key, unsigned char value)
+{
+	struct config_record r;
+
+	if(config_store_sector < 0 ||
+	   config_store_next + sizeof(r) > SPIFLASH_SECTOR_SIZE) {
+		config_write_all();
+		return;
+	}
+	config_record_init(&r, key, value);
+	write_to_flash(config_store_addr(config_store_sector) + config_store_next,
+		(const unsigned char *)&r, sizeof(r));
+	flush_cpu_dcache();
+	config_store_next += sizeof(r);
+}
+
+void config_write_all(void)
 {
+	struct config_record records[CONFIG_KEY_COUNT];
+	struct config_store_header h;
+	unsigned int addr;
+	int sector, i, n;
+
+	sector = (config_store_sector + 1) % CONFIG_STORE_SECTORS;
+	addr = config_store_addr(sector);
+	erase_flash_sector(addr);
+
+	n = 0;
+	for(i = 0; i < CONFIG_KEY_COUNT; i++) {
+		if(config_values[i] != config_defaults[i])
+			config_record_init(&records[n++], i, config_values[i]);
+	}
+	if(n)
+		write_to_flash(addr + sizeof(h), (const unsigned char *)records, n*sizeof(records[0]));
+
+	/* the header goes last: the sector is only valid once complete */
+	h.magic = CONFIG_STORE_MAGIC;
+	h.generation = config_store_generation + 1;
+	h.format = CONFIG_STORE_FORMAT;
+	h.reserved = 0xffffffff;
+	write_to_flash(addr, (const unsigned char *)&h, sizeof(h));
+	flush_cpu_dcache();
+
+	config_store_sector = sector;
+	config_store_generation = h.generation;
+	config_store_next = sizeof(h) + n*sizeof(records[0]);
+}
+
+void config_erase(void)
+{
+	int i;
+
+	for(i = 0; i < CONFIG_STORE_SECTORS; i++)
+		erase_flash_sector(config_store_addr(i));
+	flush_cpu_dcache();
+	config_store_sector = -1;
+	config_store_generation = 0;
 	memcpy(config_values, config_defaults, CONFIG_KEY_COUNT);
 }
 
+void config_print_status(void)
+{
+	if(config_store_sector < 0) {
+		wprintf("config: defaults, nothing stored @0x%08x\n", CONFIG_STORE_OFFSET);
+		return;
+	}
+	wprintf("config: sector %d/%d @0x%08x, generation %u, %u/%u bytes used\n",
+		config_store_sector, CONFIG_STORE_SECTORS,
+		config_store_addr(config_store_sector),
+		config_store_generation, config_store_next, SPIFLASH_SECTOR_SIZE);
+}
+
+#else
+
 void config_write_all(void)
 {
 }
 
+void config_erase(void)
+{
+	memcpy(config_values, config_defaults, CONFIG_KEY_COUNT);
+}
+
+void config_print_status(void)
+{
+	wprintf("config: not persistent (no writable SPI flash)\n");
+}
+
+#endif
+
+void config_init(void)
+{
+	memcpy(config_values, config_defaults, CONFIG_KEY_COUNT);
+#ifdef CONFIG_STORE
+	config_store_load();
+#endif
+}
+
 unsigned char config_get(unsigned char key)
 {
 	return config_values[key];
@@ -73,4 +267,10 @@ unsigned char config_get(unsigned char key)
 
 void config_set(unsigned char key, unsigned char value)
 {
+	if(key >= CONFIG_KEY_COUNT || config_values[key] == value)
+		return;
+	config_values[key] = value;
+#ifdef CONFIG_STORE
+	config_store_append(key, value);
+#endif
 }
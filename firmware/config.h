@@ -50,12 +50,39 @@ enum {
 	CONFIG_KEY_NETWORK_IP3,
 	// Networking - DHCP enabled?
 	CONFIG_KEY_NETWORK_DHCP,
+	// Last locked input phases (signed IDELAY taps) and the pixel clock
+	// (10kHz units, 0 if none) they were locked at
+	CONFIG_KEY_HDMI_IN0_PHASE0,
+	CONFIG_KEY_HDMI_IN0_PHASE1,
+	CONFIG_KEY_HDMI_IN0_PHASE2,
+	CONFIG_KEY_HDMI_IN0_PHASE_FREQ_LO,
+	CONFIG_KEY_HDMI_IN0_PHASE_FREQ_HI,
+	CONFIG_KEY_HDMI_IN1_PHASE0,
+	CONFIG_KEY_HDMI_IN1_PHASE1,
+	CONFIG_KEY_HDMI_IN1_PHASE2,
+	CONFIG_KEY_HDMI_IN1_PHASE_FREQ_LO,
+	CONFIG_KEY_HDMI_IN1_PHASE_FREQ_HI,
 
 	CONFIG_KEY_COUNT
 };
 
+/*
+ * With COPY_TO_MAIN_RAM firmware, the configuration is kept in the last
+ * CONFIG_STORE_SECTORS sectors of the SPI flash as a log: config_set()
+ * appends a 4 byte record to the current sector. When it is full, the
+ * values that differ from the defaults are written to the next sector
+ * with a higher generation number, so sectors are erased in turn. At
+ * boot, the records of the sector with the highest generation are
+ * replayed over the defaults.
+ */
+#define CONFIG_STORE_SECTORS 2
+
 void config_init(void);
+/* Write a fresh copy of the configuration to the next sector */
 void config_write_all(void);
+/* Back to the defaults, in RAM and in flash */
+void config_erase(void);
+void config_print_status(void);
 unsigned char config_get(unsigned char key);
 void config_set(unsigned char key, unsigned char value);
 
@@ -0,0 +1,178 @@
+#include <generated/csr.h>
+#ifdef CSR_DRAM_MONITOR_BASE
+
+#include <string.h>
+
+#include "dram_monitor.h"
+#include "stdio_wrap.h"
+
+#if DRAM_MONITOR_PORTS > DRAM_MONITOR_MAX_PORTS
+#error "More DRAM ports than DRAM_MONITOR_MAX_PORTS"
+#endif
+
+static const char *dram_monitor_names[] = {
+#ifdef DRAM_MONITOR_PORT0_NAME
+	DRAM_MONITOR_PORT0_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT1_NAME
+	DRAM_MONITOR_PORT1_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT2_NAME
+	DRAM_MONITOR_PORT2_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT3_NAME
+	DRAM_MONITOR_PORT3_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT4_NAME
+	DRAM_MONITOR_PORT4_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT5_NAME
+	DRAM_MONITOR_PORT5_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT6_NAME
+	DRAM_MONITOR_PORT6_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT7_NAME
+	DRAM_MONITOR_PORT7_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT8_NAME
+	DRAM_MONITOR_PORT8_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT9_NAME
+	DRAM_MONITOR_PORT9_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT10_NAME
+	DRAM_MONITOR_PORT10_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT11_NAME
+	DRAM_MONITOR_PORT11_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT12_NAME
+	DRAM_MONITOR_PORT12_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT13_NAME
+	DRAM_MONITOR_PORT13_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT14_NAME
+	DRAM_MONITOR_PORT14_NAME,
+#endif
+#ifdef DRAM_MONITOR_PORT15_NAME
+	DRAM_MONITOR_PORT15_NAME,
+#endif
+};
+
+#define DRAM_MONITOR_NAMES \
+	(sizeof(dram_monitor_names)/sizeof(dram_monitor_names[0]))
+
+#ifdef CSR_DRAM_QOS_BASE
+/* the registers are write only */
+static int dram_qos_priority[DRAM_MONITOR_MAX_PORTS];
+static int dram_qos_budget[DRAM_MONITOR_MAX_PORTS];
+#endif
+
+/* one period, in microseconds */
+#define DRAM_MONITOR_PERIOD_US \
+	((1 << DRAM_MONITOR_PERIOD_BITS) / (SYSTEM_CLOCK_FREQUENCY/1000000))
+
+/* the counts are at most 2^DRAM_MONITOR_PERIOD_BITS words per period, so
+ * in bits they fit 32 bits for words of up to 128 bits */
+static unsigned int dram_monitor_mbps(unsigned int words)
+{
+	return words*DRAM_MONITOR_PORT_BYTES*8 / DRAM_MONITOR_PERIOD_US;
+}
+
+/* in tenths of a percent of the period */
+static unsigned int dram_monitor_permille(unsigned int cycles)
+{
+	return cycles / ((1 << DRAM_MONITOR_PERIOD_BITS) / 1000);
+}
+
+#ifdef CSR_SDRAM_CONTROLLER_BANDWIDTH_UPDATE_ADDR
+void dram_monitor_print_total(void)
+{
+	unsigned int nr, nw;
+
+	sdram_controller_bandwidth_update_write(1);
+	nr = sdram_controller_bandwidth_nreads_read();
+	nw = sdram_controller_bandwidth_nwrites_read();
+	wprintf("read:%5dMbps  write:%5dMbps  all:%5dMbps",
+		dram_monitor_mbps(nr), dram_monitor_mbps(nw), dram_monitor_mbps(nr + nw));
+}
+#endif
+
+int dram_monitor_port(const char *name)
+{
+	int i;
+
+	for(i = 0; i < DRAM_MONITOR_NAMES; i++)
+		if(strcmp(name, dram_monitor_names[i]) == 0)
+			return i;
+	return -1;
+}
+
+int dram_qos_set(int port, int priority, int budget)
+{
+#ifdef CSR_DRAM_QOS_BASE
+	if(port < 0 || port >= DRAM_MONITOR_PORTS)
+		return -1;
+	if(priority < 0 || priority > 3 || budget < 0 || budget > 100)
+		return -1;
+	dram_qos_priority[port] = priority;
+	dram_qos_budget[port] = budget;
+
+	dram_qos_sel_write(port);
+	dram_qos_priority_write(priority);
+	/* commands per window, at least one for a non zero budget */
+	dram_qos_budget_write(budget ?
+		((budget << DRAM_QOS_WINDOW_BITS) + 99) / 100 : 0);
+	dram_qos_write_write(1);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+void dram_monitor_print(void)
+{
+	unsigned int reads, writes, latency, stalls;
+	unsigned int cycles, busy, stalled;
+	int i;
+
+	dram_monitor_update_write(1);
+	wprintf("%-10s %10s %11s %7s %8s %9s",
+		"port", "read Mbps", "write Mbps", "busy", "latency", "stalled");
+#ifdef CSR_DRAM_QOS_BASE
+	wprintf(" %8s %6s", "priority", "budget");
+#endif
+	wputchar('\n');
+	for(i = 0; i < DRAM_MONITOR_PORTS; i++) {
+		dram_monitor_sel_write(i);
+		reads = dram_monitor_reads_read();
+		writes = dram_monitor_writes_read();
+		latency = dram_monitor_latency_read();
+		stalls = dram_monitor_stalls_read();
+
+		/* latency is counted in units of 256 cycles */
+		if(reads >= 256)
+			cycles = latency / (reads >> 8);
+		else
+			cycles = reads ? (latency << 8) / reads : 0;
+		busy = dram_monitor_permille(reads + writes);
+		stalled = dram_monitor_permille(stalls);
+		wprintf("%-10s %10u %11u %4u.%u%% %6uns %6u.%u%%",
+			i < DRAM_MONITOR_NAMES ? dram_monitor_names[i] : "?",
+			dram_monitor_mbps(reads), dram_monitor_mbps(writes),
+			busy/10, busy%10,
+			cycles*1000/(SYSTEM_CLOCK_FREQUENCY/1000000),
+			stalled/10, stalled%10);
+#ifdef CSR_DRAM_QOS_BASE
+		if(dram_qos_budget[i])
+			wprintf(" %8d %5d%%", dram_qos_priority[i], dram_qos_budget[i]);
+		else
+			wprintf(" %8d %6s", dram_qos_priority[i], "-");
+#endif
+		wputchar('\n');
+	}
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __DRAM_MONITOR_H
+#define __DRAM_MONITOR_H
+
+/*
+ * DRAM traffic per crossbar port (gateware/dram_monitor.py), over the
+ * last complete counting period of the gateware.
+ */
+
+#define DRAM_MONITOR_MAX_PORTS	16
+
+/* controller totals, on one line without a newline */
+void dram_monitor_print_total(void);
+/* one line per port */
+void dram_monitor_print(void);
+/* port number from its name, -1 if unknown */
+int dram_monitor_port(const char *name);
+
+/*
+ * Crossbar arbitration of the ports (gateware/dram_qos.py): ports of
+ * higher priority (0-3) are served first, a budget (percent of the DRAM
+ * commands, 0 for none) caps what a port gets while others are waiting.
+ * Returns 0, -1 if a parameter is out of range.
+ */
+int dram_qos_set(int port, int priority, int budget);
+
+#endif /* __DRAM_MONITOR_H */
@@ -181,6 +181,8 @@ void encoder_service(void) {
 		if(elapsed(&last_event, SYSTEM_CLOCK_FREQUENCY/encoder_target_fps))
 			can_start = 1;
 		if(can_start & encoder_done()) {
+			if(frame_cnt)
+				encoder_frame_size = encoder_read_reg(ENCODER_LENGTH_REG);
 			encoder_init(encoder_quality);
 			encoder_start(processor_h_active, processor_v_active);
 			can_start = 0;
@@ -26,6 +26,7 @@ char encoder_enabled;
 int encoder_target_fps;
 int encoder_fps;
 int encoder_quality;
+int encoder_frame_size;
 
 void encoder_write_reg(unsigned int adr, unsigned int value);
 unsigned int encoder_read_reg(unsigned int adr);
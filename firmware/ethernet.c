@@ -83,4 +83,38 @@ void ethernet_service(void) {
 	}
 }
 
+unsigned long long ethernet_mac_to_u64(const unsigned char *mac_addr)
+{
+	unsigned long long v = 0;
+	int i;
+
+	for(i = 0; i < 6; i++)
+		v = (v << 8) | mac_addr[i];
+	return v;
+}
+
+unsigned int ethernet_ip_to_u32(const unsigned char *ip_addr)
+{
+	return (ip_addr[0] << 24) | (ip_addr[1] << 16) | (ip_addr[2] << 8) | ip_addr[3];
+}
+
+/* Destination MAC for the hardware UDP streamers: RFC 1112 mapping for
+ * multicast addresses, broadcast for everything else. */
+void ethernet_ip_to_mac(const unsigned char *ip_addr, unsigned char *mac_addr)
+{
+	int i;
+
+	if((ip_addr[0] & 0xf0) == 0xe0) {
+		mac_addr[0] = 0x01;
+		mac_addr[1] = 0x00;
+		mac_addr[2] = 0x5e;
+		mac_addr[3] = ip_addr[1] & 0x7f;
+		mac_addr[4] = ip_addr[2];
+		mac_addr[5] = ip_addr[3];
+	} else {
+		for(i = 0; i < 6; i++)
+			mac_addr[i] = 0xff;
+	}
+}
+
 #endif
\ No newline at end of file
@@ -17,4 +17,8 @@ void uip_log(char *msg);
 void ethernet_init(const unsigned char * mac_addr, const unsigned char *ip_addr);
 void ethernet_service(void);
 
+unsigned long long ethernet_mac_to_u64(const unsigned char *mac_addr);
+unsigned int ethernet_ip_to_u32(const unsigned char *ip_addr);
+void ethernet_ip_to_mac(const unsigned char *ip_addr, unsigned char *mac_addr);
+
 #endif
@@ -16,31 +16,39 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include "generated/csr.h"
 #include "generated/mem.h"
 
 /**
- * Frame buffers must be aligned to XXX boundary.
+ * Each source has a 16MB slot of FRAMEBUFFER_COUNT frame buffers:
  *
- *  0x01000000 - Pattern Buffer - Frame Buffer n
- *
- * Each input then has 3 frame buffers spaced like this;
- *  // HDMI Input 0
- *  0x02000000 - HDMI Input 0 - Frame Buffer n
- *  0x02040000 - HDMI Input 0 - Frame Buffer n+1
- *  0x02080000 - HDMI Input 0 - Frame Buffer n+2
- *  // HDMI Input 1
- *  0x03000000 - HDMI Input 1 - Frame Buffer n
- *  0x03040000 - HDMI Input 1 - Frame Buffer n+1
- *  0x03080000 - HDMI Input 1 - Frame Buffer n+2
+ *  0x01000000 - Pattern Buffer
+ *  0x02000000 - HDMI Input 0 - Frame Buffers
+ *  0x03000000 - HDMI Input 1 - Frame Buffers
  *  ...
- *  // HDMI Input x
- *  0x0.000000 - HDMI Input x - Frame Buffer n
- *  0x0.040000 - HDMI Input x - Frame Buffer n+1
- *  0x0.080000 - HDMI Input x - Frame Buffer n+2
+ *  0x0.000000 - HDMI Input x - Frame Buffers
+ *
+ * followed by the scaler frame buffers, after room for
+ * FRAMEBUFFER_INPUTS inputs.
+ *
+ * The frame buffers are FRAMEBUFFER_SIZE apart in their slot, plus a
+ * stagger of a few DRAM rows: frame buffer fb of slot x starts in bank
+ * (x*FRAMEBUFFER_COUNT + fb) % FRAMEBUFFER_STAGGERS. Unstaggered, all the
+ * frame buffers would start in bank 0, and streams at the same line of
+ * different frame buffers (an input capturing the frame after the one an
+ * output shows, two inputs with the same timing) would keep opening
+ * different rows of the same bank. Staggered, they use different banks.
+ *
+ *  // HDMI Input 0, with 8 banks of 2048 byte rows
+ *  0x02002000 - HDMI Input 0 - Frame Buffer 0 (bank 4)
+ *  0x02402800 - HDMI Input 0 - Frame Buffer 1 (bank 5)
+ *  0x02803000 - HDMI Input 0 - Frame Buffer 2 (bank 6)
+ *  0x02c00000 - HDMI Input 0 - Frame Buffer 3 (bank 0)
  *
  */
 #define FRAMEBUFFER_OFFSET		0x01000000
 #define FRAMEBUFFER_PATTERNS		1
+#define FRAMEBUFFER_INPUTS		4
 
 #define FRAMEBUFFER_PIXELS_X		1920	// pixels
 #define FRAMEBUFFER_PIXELS_Y		1080	// pixels
@@ -49,6 +57,7 @@
 #define FRAMEBUFFER_BASE(x)			((x+1)*FRAMEBUFFER_OFFSET)
 #define FRAMEBUFFER_BASE_PATTERN		FRAMEBUFFER_BASE(0)
 #define FRAMEBUFFER_BASE_HDMI_INPUT(x)		FRAMEBUFFER_BASE(x+FRAMEBUFFER_PATTERNS)
+#define FRAMEBUFFER_BASE_SCALER			FRAMEBUFFER_BASE(FRAMEBUFFER_PATTERNS+FRAMEBUFFER_INPUTS)
 
 // Largest frame size at 16bpp (ish)
 #define FRAMEBUFFER_SIZE		0x400000 // bytes
@@ -56,8 +65,42 @@
 #error "Number of pixels don't fit in frame buffer"
 #endif
 
+/* Compressed frames (gateware/hdmi_in.py) keep a mask per line, flagging
+ * the blocks of 8 pixels which repeat the previous one, after the pixels */
+#define FRAMEBUFFER_BLOCK_PIXELS	8
+#define FRAMEBUFFER_INDEX_OFFSET	(FRAMEBUFFER_PIXELS_X*FRAMEBUFFER_PIXELS_Y*FRAMEBUFFER_PIXELS_BYTES)
+#define FRAMEBUFFER_INDEX_LINE_BYTES	32	// up to 256 blocks
+#if (FRAMEBUFFER_INDEX_OFFSET + FRAMEBUFFER_PIXELS_Y*FRAMEBUFFER_INDEX_LINE_BYTES) > FRAMEBUFFER_SIZE
+#error "Line index doesn't fit in frame buffer"
+#endif
+
 #define FRAMEBUFFER_COUNT 		4			// Must be a multiple of 2
 #define FRAMEBUFFER_MASK 		(FRAMEBUFFER_COUNT - 1)
+#if FRAMEBUFFER_COUNT*FRAMEBUFFER_SIZE > FRAMEBUFFER_OFFSET
+#error "Frame buffers don't fit in their slot"
+#endif
+
+/* DRAM geometry, from the gateware when it knows: the bank changes every
+ * SDRAM_ROW_BYTES of the address space */
+#ifndef SDRAM_ROW_BYTES
+#define SDRAM_ROW_BYTES			2048
+#endif
+#ifndef SDRAM_BANKS
+#define SDRAM_BANKS			8
+#endif
+
+/* banks the frame buffers are staggered over, as many as the end of the
+ * frame buffers left after the largest frame and its index allows */
+#define FRAMEBUFFER_USED		(FRAMEBUFFER_INDEX_OFFSET + FRAMEBUFFER_PIXELS_Y*FRAMEBUFFER_INDEX_LINE_BYTES)
+#define FRAMEBUFFER_STAGGER_ROOM	((FRAMEBUFFER_SIZE - FRAMEBUFFER_USED)/SDRAM_ROW_BYTES + 1)
+#define FRAMEBUFFER_STAGGERS		(FRAMEBUFFER_STAGGER_ROOM < SDRAM_BANKS ? FRAMEBUFFER_STAGGER_ROOM : SDRAM_BANKS)
+#define FRAMEBUFFER_STAGGER(n)		(((n) % FRAMEBUFFER_STAGGERS)*SDRAM_ROW_BYTES)
+
+/* frame buffer fb of slot x */
+#define FRAMEBUFFER(x, fb)		(FRAMEBUFFER_BASE(x) + (fb)*FRAMEBUFFER_SIZE + FRAMEBUFFER_STAGGER((x)*FRAMEBUFFER_COUNT + (fb)))
+#define FRAMEBUFFER_PATTERN		FRAMEBUFFER(0, 0)
+#define FRAMEBUFFER_HDMI_INPUT(x, fb)	FRAMEBUFFER((x)+FRAMEBUFFER_PATTERNS, fb)
+#define FRAMEBUFFER_SCALER(fb)		FRAMEBUFFER(FRAMEBUFFER_PATTERNS+FRAMEBUFFER_INPUTS, fb)
 
 typedef unsigned int fb_ptrdiff_t;
 // FIXME: typedef uint16_t framebuffer_t[FRAMEBUFFER_SIZE];
@@ -0,0 +1,1558 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <irq.h>
+#include <uart.h>
+#include <time.h>
+#include <system.h>
+#include <generated/csr.h>
+#include <generated/mem.h>
+#include <hw/flags.h>
+#include "extra-flags.h"
+
+#include "config.h"
+#include "stdio_wrap.h"
+#include "telemetry.h"
+
+#ifdef CSR_HDMI_IN0_BASE
+
+#include "hdmi_in.h"
+
+//#define CLEAN_COMMUTATION
+//#define DEBUG
+
+#ifndef HDMI_IN0_MNEMONIC
+#warning "Missing HDMI IN0 mnemonic!"
+#define HDMI_IN0_MNEMONIC ""
+#endif
+#ifndef HDMI_IN0_DESCRIPTION
+#warning "Missing HDMI IN0 description!"
+#define HDMI_IN0_DESCRIPTION ""
+#endif
+
+#ifdef CSR_HDMI_IN1_BASE
+#ifndef HDMI_IN1_MNEMONIC
+#warning "Missing HDMI IN1 mnemonic!"
+#define HDMI_IN1_MNEMONIC ""
+#endif
+#ifndef HDMI_IN1_DESCRIPTION
+#warning "Missing HDMI IN1 description!"
+#define HDMI_IN1_DESCRIPTION ""
+#endif
+#endif
+
+#ifdef CSR_HDMI_IN2_BASE
+#ifndef HDMI_IN2_MNEMONIC
+#define HDMI_IN2_MNEMONIC ""
+#endif
+#ifndef HDMI_IN2_DESCRIPTION
+#define HDMI_IN2_DESCRIPTION ""
+#endif
+#endif
+
+#ifdef CSR_HDMI_IN3_BASE
+#ifndef HDMI_IN3_MNEMONIC
+#define HDMI_IN3_MNEMONIC ""
+#endif
+#ifndef HDMI_IN3_DESCRIPTION
+#define HDMI_IN3_DESCRIPTION ""
+#endif
+#endif
+
+/*
+ * Registers are accessed from the CSR base of each input, at the offsets
+ * they have in hdmi_in0. CSRs are 8 bit wide: a register of SIZE words
+ * spans SIZE 32 bit aligned addresses, most significant byte first.
+ */
+#define HDMI_IN_REG(reg) \
+	(CSR_HDMI_IN0_##reg##_ADDR - CSR_HDMI_IN0_BASE), CSR_HDMI_IN0_##reg##_SIZE
+/* the three data channels are laid out in turn */
+#define HDMI_IN_DATA_STRIDE \
+	(CSR_HDMI_IN0_DATA1_CAP_DLY_CTL_ADDR - CSR_HDMI_IN0_DATA0_CAP_DLY_CTL_ADDR)
+
+#define hdmi_in_read(in, reg) \
+	hdmi_in_csr_read(in, HDMI_IN_REG(reg), 0)
+#define hdmi_in_write(in, reg, value) \
+	hdmi_in_csr_write(in, HDMI_IN_REG(reg), 0, value)
+#define hdmi_in_data_read(in, channel, reg) \
+	hdmi_in_csr_read(in, HDMI_IN_REG(DATA0_##reg), (channel)*HDMI_IN_DATA_STRIDE)
+#define hdmi_in_data_write(in, channel, reg, value) \
+	hdmi_in_csr_write(in, HDMI_IN_REG(DATA0_##reg), (channel)*HDMI_IN_DATA_STRIDE, value)
+
+#define HDMI_IN_CHANNELS	3
+
+/* Descriptor ring of the capture DMA (gateware/hdmi_in.py). All the frame
+ * buffers but the ones shown are kept loaded. */
+#define HDMI_IN_DMA_DESCRIPTORS		4
+#define HDMI_IN_DMA_DESCRIPTORS_MASK	(HDMI_IN_DMA_DESCRIPTORS-1)
+
+/* The capture follows the resolution of the source once resdetection has
+ * reported the same one this many times in a row, HDMI_IN_FOLLOW_PERIOD
+ * apart. */
+#define HDMI_IN_FOLLOW_COUNT	3
+#define HDMI_IN_FOLLOW_PERIOD	(SYSTEM_CLOCK_FREQUENCY/10)
+
+/* Eye scan range, in taps from the calibrated position */
+#ifdef CSR_HDMI_IN0_CLOCKING_MMCM_RESET_ADDR
+/* IDELAYE2: 32 taps, starting from 0 */
+#define HDMI_IN_EYE_FIRST	0
+#define HDMI_IN_EYE_LAST	31
+#else
+#define HDMI_IN_EYE_FIRST	-16
+#define HDMI_IN_EYE_LAST	16
+#endif
+#define HDMI_IN_EYE_TAPS	(HDMI_IN_EYE_LAST - HDMI_IN_EYE_FIRST + 1)
+/* Taps between the measurements of the coarse pass: narrower windows can
+ * be missed */
+#define HDMI_IN_EYE_COARSE	4
+/* A tap is open when its WER is at most the lowest WER of the channel
+ * plus 1/4 plus this: data islands and noise keep the lowest WER above
+ * zero with some sources. */
+#define HDMI_IN_EYE_WER_SLACK	8
+
+struct hdmi_in_desc {
+	int index;
+	unsigned int csr_base;
+	unsigned int edid_mem_base;
+	unsigned int freq_base;
+	int irq;
+	fb_ptrdiff_t framebuffers_base;
+	unsigned int fill_color; /* YCbCr, shown when there is no signal */
+	const char *mnemonic;
+	const char *description;
+	/* config keys, -1 if none */
+	int enabled_key;
+	int phase_key; /* PHASE0..2, PHASE_FREQ_LO, PHASE_FREQ_HI */
+};
+
+struct hdmi_in {
+	const struct hdmi_in_desc desc;
+
+	int debug;
+	int fb_index; /* last complete frame */
+	int fb_sink; /* frame shown to the direct sinks, -1 if none */
+	/* format of the frame in each buffer, 0x0 for the fill colour which
+	 * reads at any size, compressed or not */
+	struct {
+		short hres, vres;
+		char compressed;
+	} fb_frame[FRAMEBUFFER_COUNT];
+	/* format the direct sinks read the frames in */
+	struct {
+		int hres, vres;
+		int uncompressed;
+	} sink;
+	unsigned int frames;
+	unsigned int overflows;
+	unsigned int partial; /* frames of the wrong length */
+	unsigned int resized;
+	/* frame buffers shown or loaded in the ring */
+	unsigned int fb_busy;
+	int ring_fb[HDMI_IN_DMA_DESCRIPTORS];
+	int ring_head; /* next descriptor to complete */
+	int ring_tail; /* next descriptor to load */
+	int ring_count;
+	unsigned int frame_start; /* timestamp of the last frame */
+	unsigned int frame_period;
+	int hres, vres;
+	struct {
+		int requested;
+		int active; /* frames are being stored compressed */
+		unsigned int words, writes;
+		int writes_permille; /* of the words received, last period */
+		int last_event;
+	} compression;
+	/* resolution seen by resdetection, applied once stable */
+	struct {
+		int hres, vres;
+		int count;
+		int last_event;
+	} follow;
+
+	int connected;
+	int locked;
+	int lock_start_time;
+	int lock_status;
+	int last_event;
+	int d[HDMI_IN_CHANNELS];
+	int phase_cached;
+
+	struct {
+		int active;
+		int requested;
+		int freq;
+		int tap;
+		int fine; /* in the fine pass */
+		char todo[HDMI_IN_EYE_TAPS]; /* taps to measure in the fine pass */
+		int period;
+		int last_event;
+		/* time to lock, see hdmi_in_lock_time_update() */
+		unsigned int lock_last;
+		unsigned int lock_cycles;
+		unsigned int lock_ms;
+		unsigned int wer[HDMI_IN_CHANNELS][HDMI_IN_EYE_TAPS];
+		/* open window of each channel, valid after a scan */
+		int valid;
+		int min[HDMI_IN_CHANNELS];
+		int max[HDMI_IN_CHANNELS];
+	} eye;
+};
+
+#ifdef CSR_HDMI_IN0_FREQ_BASE
+#define HDMI_IN_FREQ_BASE(n)	CSR_HDMI_IN##n##_FREQ_BASE
+#else
+#define HDMI_IN_FREQ_BASE(n)	0
+#endif
+
+#define HDMI_IN_INSTANCE(n, color, enabled, phase) { .desc = { \
+	.index = n, \
+	.csr_base = CSR_HDMI_IN##n##_BASE, \
+	.edid_mem_base = CSR_HDMI_IN##n##_EDID_MEM_BASE, \
+	.freq_base = HDMI_IN_FREQ_BASE(n), \
+	.irq = HDMI_IN##n##_INTERRUPT, \
+	.framebuffers_base = FRAMEBUFFER_BASE_HDMI_INPUT(n), \
+	.fill_color = color, \
+	.mnemonic = HDMI_IN##n##_MNEMONIC, \
+	.description = HDMI_IN##n##_DESCRIPTION, \
+	.enabled_key = enabled, \
+	.phase_key = phase, \
+} }
+
+static struct hdmi_in hdmi_ins[] = {
+	HDMI_IN_INSTANCE(0, 0x8254d554, /* Debian Red */
+		CONFIG_KEY_INPUT0_ENABLED, CONFIG_KEY_HDMI_IN0_PHASE0),
+#ifdef CSR_HDMI_IN1_BASE
+	HDMI_IN_INSTANCE(1, 0x536fc56f,
+		CONFIG_KEY_INPUT1_ENABLED, CONFIG_KEY_HDMI_IN1_PHASE0),
+#endif
+#ifdef CSR_HDMI_IN2_BASE
+	HDMI_IN_INSTANCE(2, 0x80808080, -1, -1), /* grey */
+#endif
+#ifdef CSR_HDMI_IN3_BASE
+	HDMI_IN_INSTANCE(3, 0x80108010, -1, -1), /* black */
+#endif
+};
+
+#define HDMI_IN_COUNT	(sizeof(hdmi_ins)/sizeof(hdmi_ins[0]))
+
+#if defined(CSR_HDMI_IN4_BASE)
+#error "More HDMI inputs than HDMI_IN_MAX"
+#endif
+
+static unsigned int hdmi_in_csr_read(struct hdmi_in *in, unsigned int offset, int size, unsigned int stride)
+{
+	unsigned int addr = in->desc.csr_base + offset + stride;
+	unsigned int r = 0;
+	int i;
+
+	for(i = 0; i < size; i++)
+		r = (r << 8) | MMPTR(addr + 4*i);
+	return r;
+}
+
+static void hdmi_in_csr_write(struct hdmi_in *in, unsigned int offset, int size, unsigned int stride, unsigned int value)
+{
+	unsigned int addr = in->desc.csr_base + offset + stride;
+	int i;
+
+	for(i = 0; i < size; i++)
+		MMPTR(addr + 4*i) = value >> (8*(size - 1 - i));
+}
+
+static struct hdmi_in *hdmi_in_get(int n)
+{
+	int i;
+
+	for(i = 0; i < HDMI_IN_COUNT; i++) {
+		if(hdmi_ins[i].desc.index == n)
+			return &hdmi_ins[i];
+	}
+	return NULL;
+}
+
+int hdmi_in_present(int n)
+{
+	return hdmi_in_get(n) != NULL;
+}
+
+const char *hdmi_in_mnemonic(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->desc.mnemonic : "";
+}
+
+const char *hdmi_in_description(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->desc.description : "";
+}
+
+int hdmi_in_enabled_key(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->desc.enabled_key : -1;
+}
+
+int hdmi_in_get_debug(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->debug : 0;
+}
+
+void hdmi_in_set_debug(int n, int debug)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(in)
+		in->debug = debug;
+}
+
+static fb_ptrdiff_t hdmi_in_fb_base(struct hdmi_in *in, int fb)
+{
+	return FRAMEBUFFER_HDMI_INPUT(in->desc.index, fb);
+}
+
+fb_ptrdiff_t hdmi_in_framebuffer_base(int n, int fb)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? hdmi_in_fb_base(in, fb) : 0;
+}
+
+static void hdmi_in_frame_get(struct hdmi_in *in, int fb, struct hdmi_in_frame *f)
+{
+	f->base = hdmi_in_fb_base(in, fb);
+	f->hres = in->fb_frame[fb].hres;
+	f->vres = in->fb_frame[fb].vres;
+	f->compressed = in->fb_frame[fb].compressed;
+}
+
+int hdmi_in_current_frame(int n, struct hdmi_in_frame *f)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(!in)
+		return 0;
+	hdmi_in_frame_get(in, in->fb_index, f);
+	return 1;
+}
+
+int hdmi_in_sink_frame(int n, struct hdmi_in_frame *f)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+	int fb;
+
+	if(!in)
+		return 0;
+	fb = in->fb_sink;
+	if(fb < 0)
+		return 0;
+	hdmi_in_frame_get(in, fb, f);
+	return 1;
+}
+
+static int hdmi_in_sink_match(struct hdmi_in *in, int fb)
+{
+	return (in->fb_frame[fb].hres == 0 && in->fb_frame[fb].vres == 0)
+		|| (in->fb_frame[fb].hres == in->sink.hres
+		    && in->fb_frame[fb].vres == in->sink.vres
+		    && !(in->fb_frame[fb].compressed && in->sink.uncompressed));
+}
+
+/* Keep the frame shown to the direct sinks while it has their format,
+ * else show them the last frame if it does, or none */
+static void hdmi_in_sink_check(struct hdmi_in *in)
+{
+	int fb = in->fb_sink;
+
+	if(fb >= 0 && hdmi_in_sink_match(in, fb))
+		return;
+	in->fb_sink = hdmi_in_sink_match(in, in->fb_index) ? in->fb_index : -1;
+	if(fb >= 0 && fb != in->fb_sink && fb != in->fb_index)
+		in->fb_busy &= ~(1 << fb);
+}
+
+static void hdmi_in_clocking_reset(struct hdmi_in *in, int reset)
+{
+#ifdef CSR_HDMI_IN0_CLOCKING_PLL_RESET_ADDR
+	hdmi_in_write(in, CLOCKING_PLL_RESET, reset);
+#elif CSR_HDMI_IN0_CLOCKING_MMCM_RESET_ADDR
+	hdmi_in_write(in, CLOCKING_MMCM_RESET, reset);
+#endif
+}
+
+static void hdmi_in_irq_mask(struct hdmi_in *in, int enable)
+{
+	unsigned int mask;
+
+	mask = irq_getmask();
+	if(enable)
+		mask |= 1 << in->desc.irq;
+	else
+		mask &= ~(1 << in->desc.irq);
+	irq_setmask(mask);
+}
+
+/*
+ * Interrupt handling is kept short: the completed descriptors are taken
+ * back, the ring is refilled and the buffers are swapped. Anything else
+ * (logging, pointing the sinks at the new frame) is queued as an event
+ * for hdmi_in_service().
+ */
+enum {
+	HDMI_IN_EVENT_FRAME,
+	HDMI_IN_EVENT_BAD_LENGTH,
+	HDMI_IN_EVENT_RES_MISMATCH,
+};
+
+struct hdmi_in_event {
+	unsigned char input;
+	unsigned char type;
+	unsigned char desc;
+	unsigned int value;
+};
+
+#define HDMI_IN_EVENTS		32
+#define HDMI_IN_EVENTS_MASK	(HDMI_IN_EVENTS-1)
+
+/* written by the ISR only, read by the main loop */
+static struct hdmi_in_event hdmi_in_events[HDMI_IN_EVENTS];
+static volatile unsigned int hdmi_in_events_produce;
+static unsigned int hdmi_in_events_consume;
+static volatile unsigned int hdmi_in_events_dropped;
+
+static struct {
+	unsigned int count;
+	unsigned int cycles;
+	unsigned int max;
+} hdmi_in_isr_stats;
+
+/* free running system clock cycles, as used by elapsed() */
+static unsigned int hdmi_in_ticks(void)
+{
+	timer0_update_value_write(1);
+	return timer0_reload_read() - timer0_value_read();
+}
+
+static void hdmi_in_event_queue(struct hdmi_in *in, int type, int desc, unsigned int value)
+{
+	unsigned int produce = hdmi_in_events_produce;
+	struct hdmi_in_event *ev;
+
+	if(((produce + 1) & HDMI_IN_EVENTS_MASK) == hdmi_in_events_consume) {
+		hdmi_in_events_dropped++;
+		return;
+	}
+	ev = &hdmi_in_events[produce];
+	ev->input = in->desc.index;
+	ev->type = type;
+	ev->desc = desc;
+	ev->value = value;
+	hdmi_in_events_produce = (produce + 1) & HDMI_IN_EVENTS_MASK;
+}
+
+/* Load free frame buffers into the ring, all at once */
+static void hdmi_in_ring_fill(struct hdmi_in *in)
+{
+	int fb;
+
+	for(fb = 0; fb < FRAMEBUFFER_COUNT && in->ring_count < HDMI_IN_DMA_DESCRIPTORS; fb++) {
+		if(in->fb_busy & (1 << fb))
+			continue;
+		hdmi_in_write(in, DMA_DESC_INDEX, in->ring_tail);
+		hdmi_in_write(in, DMA_DESC_ADDRESS, hdmi_in_fb_base(in, fb));
+		hdmi_in_write(in, DMA_DESC_LOAD, 1);
+		in->ring_fb[in->ring_tail] = fb;
+		in->fb_busy |= 1 << fb;
+		in->ring_tail = (in->ring_tail + 1) & HDMI_IN_DMA_DESCRIPTORS_MASK;
+		in->ring_count++;
+	}
+}
+
+static void hdmi_in_ring_reset(struct hdmi_in *in)
+{
+	hdmi_in_write(in, DMA_RING_RESET, 1);
+	in->ring_head = in->ring_tail = in->ring_count = 0;
+	in->fb_busy = 1 << in->fb_index;
+	if(in->fb_sink >= 0)
+		in->fb_busy |= 1 << in->fb_sink;
+}
+
+/* Take the completed descriptors back from the DMA, the last good frame and
+ * the last one of the size of the direct sinks are shown and the other
+ * buffers are loaded again */
+static void hdmi_in_irq(struct hdmi_in *in)
+{
+	int fb_index = -1, fb_sink = -1;
+	unsigned int release = 0;
+	int desc, fb, head;
+	unsigned int length, start;
+#ifdef CLEAN_COMMUTATION
+	int mismatch;
+#endif
+
+	hdmi_in_write(in, DMA_EV_PENDING, 1);
+#ifdef CLEAN_COMMUTATION
+	/* Dump frames until we get the expected resolution */
+	mismatch = (hdmi_in_read(in, RESDETECTION_HRES) != in->hres)
+		|| (hdmi_in_read(in, RESDETECTION_VRES) != in->vres);
+#endif
+	head = hdmi_in_read(in, DMA_HEAD);
+	while(in->ring_count && in->ring_head != head) {
+		desc = in->ring_head;
+		fb = in->ring_fb[desc];
+		in->ring_head = (desc + 1) & HDMI_IN_DMA_DESCRIPTORS_MASK;
+		in->ring_count--;
+
+		/* the frames captured while the eye scan moves the delays
+		 * are not shown */
+		if(in->eye.active) {
+			in->fb_busy &= ~(1 << fb);
+			continue;
+		}
+		hdmi_in_write(in, DMA_DESC_INDEX, desc);
+		length = hdmi_in_read(in, DMA_DESC_LENGTH);
+		start = hdmi_in_read(in, DMA_DESC_TIMESTAMP);
+#ifdef CLEAN_COMMUTATION
+		if(mismatch) {
+			in->fb_busy &= ~(1 << fb);
+			hdmi_in_event_queue(in, HDMI_IN_EVENT_RES_MISMATCH, desc, 0);
+			continue;
+		}
+#endif
+		if(length != in->hres*in->vres*2) {
+			in->fb_busy &= ~(1 << fb);
+			in->partial++;
+#ifdef DEBUG
+			hdmi_in_event_queue(in, HDMI_IN_EVENT_BAD_LENGTH, desc, length);
+#endif
+			continue;
+		}
+		in->fb_frame[fb].hres = in->hres;
+		in->fb_frame[fb].vres = in->vres;
+#ifdef CSR_HDMI_IN0_DMA_DESC_COMPRESSED_ADDR
+		in->fb_frame[fb].compressed = hdmi_in_read(in, DMA_DESC_COMPRESSED);
+#endif
+		release |= 1 << fb;
+		fb_index = fb;
+		if(hdmi_in_sink_match(in, fb))
+			fb_sink = fb;
+		in->frame_period = start - in->frame_start;
+		in->frame_start = start;
+		in->frames++;
+	}
+
+	if(fb_index != -1) {
+		release |= 1 << in->fb_index;
+		in->fb_index = fb_index;
+		hdmi_in_event_queue(in, HDMI_IN_EVENT_FRAME, 0, fb_index);
+	}
+	if(fb_sink != -1) {
+		if(in->fb_sink >= 0)
+			release |= 1 << in->fb_sink;
+		in->fb_sink = fb_sink;
+	}
+	release &= ~(1 << in->fb_index);
+	if(in->fb_sink >= 0)
+		release &= ~(1 << in->fb_sink);
+	in->fb_busy &= ~release;
+	hdmi_in_ring_fill(in);
+}
+
+/* System clock cycles for the ISR statistics, from the DMA cycle counter of
+ * the first input: the main loop shares timer0, whose latch-then-read an
+ * interrupt could tear. Free running over 32 bits, so differences wrap
+ * correctly. */
+static unsigned int hdmi_in_isr_cycles(void)
+{
+	hdmi_in_write(&hdmi_ins[0], DMA_CYCLES_UPDATE, 1);
+	return hdmi_in_read(&hdmi_ins[0], DMA_CYCLES);
+}
+
+void hdmi_in_isr(unsigned int irqs)
+{
+	unsigned int start, cycles;
+	int i, handled = 0;
+
+	start = hdmi_in_isr_cycles();
+	for(i = 0; i < HDMI_IN_COUNT; i++) {
+		if(irqs & (1 << hdmi_ins[i].desc.irq)) {
+			hdmi_in_irq(&hdmi_ins[i]);
+			handled = 1;
+		}
+	}
+	if(!handled)
+		return;
+	cycles = hdmi_in_isr_cycles() - start;
+	hdmi_in_isr_stats.count++;
+	hdmi_in_isr_stats.cycles += cycles;
+	if(cycles > hdmi_in_isr_stats.max)
+		hdmi_in_isr_stats.max = cycles;
+}
+
+/* Handle the events queued by the ISR, returns the number of new frames */
+static int hdmi_in_events_service(void)
+{
+	struct hdmi_in_event *ev;
+	int frames = 0;
+
+	while(hdmi_in_events_consume != hdmi_in_events_produce) {
+		ev = &hdmi_in_events[hdmi_in_events_consume];
+		switch(ev->type) {
+			case HDMI_IN_EVENT_FRAME:
+				frames++;
+				break;
+			case HDMI_IN_EVENT_BAD_LENGTH:
+				wprintf("dvisampler%d: desc%d: unexpected frame length: %d\n", ev->input, ev->desc, (int)ev->value);
+				break;
+			case HDMI_IN_EVENT_RES_MISMATCH:
+				if(hdmi_in_get_debug(ev->input))
+					wprintf("dvisampler%d: desc%d: frame dropped, resolution mismatch\n", ev->input, ev->desc);
+				break;
+		}
+		hdmi_in_events_consume = (hdmi_in_events_consume + 1) & HDMI_IN_EVENTS_MASK;
+	}
+	return frames;
+}
+
+void hdmi_in_print_isr_status(void)
+{
+	unsigned int count, cycles, max, dropped;
+	unsigned int ie;
+
+	ie = irq_getie();
+	irq_setie(0);
+	count = hdmi_in_isr_stats.count;
+	cycles = hdmi_in_isr_stats.cycles;
+	max = hdmi_in_isr_stats.max;
+	dropped = hdmi_in_events_dropped;
+	hdmi_in_isr_stats.count = hdmi_in_isr_stats.cycles = hdmi_in_isr_stats.max = 0;
+	hdmi_in_events_dropped = 0;
+	irq_setie(ie);
+
+	wprintf("hdmi_in isr: %u calls, avg %u cycles, max %u cycles (%uus), %u events dropped\n",
+		count, count ? cycles/count : 0, max,
+		max/(SYSTEM_CLOCK_FREQUENCY/1000000), dropped);
+}
+
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+/* Compression needs lines of whole blocks which fit the line index */
+static void hdmi_in_compression_apply(struct hdmi_in *in)
+{
+	int blocks = in->hres / FRAMEBUFFER_BLOCK_PIXELS;
+
+	in->compression.active = in->compression.requested
+		&& (in->hres % FRAMEBUFFER_BLOCK_PIXELS) == 0
+		&& blocks <= FRAMEBUFFER_INDEX_LINE_BYTES*8;
+	hdmi_in_write(in, DMA_COMPRESSION_BLOCKS, blocks);
+	hdmi_in_write(in, DMA_COMPRESSION_INDEX, FRAMEBUFFER_INDEX_OFFSET);
+	hdmi_in_write(in, DMA_COMPRESSION_ENABLE, in->compression.active);
+}
+
+/* Measure the writes saved by compression once per period */
+static void hdmi_in_compression_service(struct hdmi_in *in)
+{
+	unsigned int words, writes;
+
+	if(!elapsed(&in->compression.last_event, SYSTEM_CLOCK_FREQUENCY))
+		return;
+	words = hdmi_in_read(in, DMA_COMPRESSION_WORDS) - in->compression.words;
+	writes = hdmi_in_read(in, DMA_COMPRESSION_WRITES) - in->compression.writes;
+	in->compression.words += words;
+	in->compression.writes += writes;
+	in->compression.writes_permille = words >= 1000 ? writes/(words/1000) : 1000;
+}
+#endif
+
+void hdmi_in_set_compression(int n, int enable)
+{
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(!in || in->compression.requested == enable)
+		return;
+	in->compression.requested = enable;
+	hdmi_in_compression_apply(in);
+#endif
+}
+
+int hdmi_in_compressed(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->compression.active : 0;
+}
+
+int hdmi_in_compression_writes(int n)
+{
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(in)
+		return in->compression.writes_permille;
+#endif
+	return 1000;
+}
+
+static void hdmi_in_start(struct hdmi_in *in)
+{
+	hdmi_in_clocking_reset(in, 1);
+	in->connected = in->locked = 0;
+
+	hdmi_in_write(in, DMA_FRAME_SIZE, in->hres*in->vres*2);
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	hdmi_in_compression_apply(in);
+#endif
+	in->follow.hres = in->follow.vres = in->follow.count = 0;
+	in->fb_index = FRAMEBUFFER_COUNT - 1;
+	in->fb_sink = -1;
+	hdmi_in_sink_check(in);
+	hdmi_in_ring_reset(in);
+	hdmi_in_ring_fill(in);
+
+	hdmi_in_write(in, DMA_EV_PENDING, hdmi_in_read(in, DMA_EV_PENDING));
+	hdmi_in_write(in, DMA_EV_ENABLE, 0x1);
+	hdmi_in_irq_mask(in, 1);
+}
+
+void hdmi_in_init_video(int n, int hres, int vres)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(!in)
+		return;
+	in->hres = hres; in->vres = vres;
+	in->sink.hres = hres; in->sink.vres = vres;
+
+	hdmi_in_start(in);
+}
+
+void hdmi_in_enable(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(in)
+		hdmi_in_start(in);
+}
+
+bool hdmi_in_status(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(!in)
+		return false;
+	return (irq_getmask() & (1 << in->desc.irq)) != 0;
+}
+
+void hdmi_in_disable(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(!in)
+		return;
+	hdmi_in_irq_mask(in, 0);
+
+	hdmi_in_ring_reset(in);
+	hdmi_in_clocking_reset(in, 1);
+}
+
+static void hdmi_in_fill(struct hdmi_in *in)
+{
+	int i, fb;
+	flush_l2_cache();
+	volatile unsigned int *framebuffer = (unsigned int *)(MAIN_RAM_BASE + in->desc.framebuffers_base);
+	for(i=0; i<(FRAMEBUFFER_SIZE*FRAMEBUFFER_COUNT)/4; i++) {
+		framebuffer[i] = in->desc.fill_color;
+	}
+	/* no repeated blocks, so that the fill also reads as a compressed frame */
+	for(fb=0; fb<FRAMEBUFFER_COUNT; fb++) {
+		framebuffer = (unsigned int *)(MAIN_RAM_BASE + hdmi_in_fb_base(in, fb) + FRAMEBUFFER_INDEX_OFFSET);
+		for(i=0; i<(FRAMEBUFFER_PIXELS_Y*FRAMEBUFFER_INDEX_LINE_BYTES)/4; i++)
+			framebuffer[i] = 0;
+		in->fb_frame[fb].hres = in->fb_frame[fb].vres = 0;
+		in->fb_frame[fb].compressed = 0;
+	}
+}
+
+void hdmi_in_clear_framebuffers(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(in)
+		hdmi_in_fill(in);
+}
+
+void hdmi_in_set_sink_format(int n, int hres, int vres, int uncompressed)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+	unsigned int mask;
+
+	if(!in || (in->sink.hres == hres && in->sink.vres == vres
+	           && in->sink.uncompressed == uncompressed))
+		return;
+	mask = irq_getmask();
+	irq_setmask(mask & ~(1 << in->desc.irq));
+	in->sink.hres = hres;
+	in->sink.vres = vres;
+	in->sink.uncompressed = uncompressed;
+	hdmi_in_sink_check(in);
+	if(mask & (1 << in->desc.irq))
+		hdmi_in_ring_fill(in);
+	irq_setmask(mask);
+}
+
+void hdmi_in_set_hpd(int n, int hpd)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(in)
+		hdmi_in_write(in, EDID_HPD_EN, hpd);
+}
+
+void hdmi_in_load_edid(int n, const unsigned char *edid, int len)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+	int i;
+
+	if(!in)
+		return;
+	for(i = 0; i < len; i++)
+		MMPTR(in->desc.edid_mem_base + 4*i) = edid[i];
+}
+
+int hdmi_in_hres(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? hdmi_in_read(in, RESDETECTION_HRES) : 0;
+}
+
+int hdmi_in_vres(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? hdmi_in_read(in, RESDETECTION_VRES) : 0;
+}
+
+int hdmi_in_capture_hres(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->hres : 0;
+}
+
+int hdmi_in_capture_vres(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	return in ? in->vres : 0;
+}
+
+unsigned int hdmi_in_freq(int n)
+{
+#ifdef CSR_HDMI_IN0_FREQ_BASE
+	struct hdmi_in *in = hdmi_in_get(n);
+	unsigned int r = 0;
+	int i;
+
+	if(!in)
+		return 0;
+	/* the frequency meter has a CSR bank of its own */
+	for(i = 0; i < CSR_HDMI_IN0_FREQ_VALUE_SIZE; i++)
+		r = (r << 8) | MMPTR(in->desc.freq_base +
+			(CSR_HDMI_IN0_FREQ_VALUE_ADDR - CSR_HDMI_IN0_FREQ_BASE) + 4*i);
+	return r;
+#else
+	return 0;
+#endif
+}
+
+static void hdmi_in_wer_update(struct hdmi_in *in)
+{
+	int c;
+
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		hdmi_in_data_write(in, c, WER_UPDATE, 1);
+}
+
+void hdmi_in_print_status(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(!in)
+		return;
+	hdmi_in_wer_update(in);
+	wprintf("dvisampler%d: ph:%4d %4d %4d // charsync:%d%d%d [%d %d %d] // WER:%3d %3d %3d // chansync:%d // res:%dx%d // frame:%uus dropped:%u partial:%u resized:%u\n",
+		in->desc.index,
+		in->d[0], in->d[1], in->d[2],
+		hdmi_in_data_read(in, 0, CHARSYNC_CHAR_SYNCED),
+		hdmi_in_data_read(in, 1, CHARSYNC_CHAR_SYNCED),
+		hdmi_in_data_read(in, 2, CHARSYNC_CHAR_SYNCED),
+		hdmi_in_data_read(in, 0, CHARSYNC_CTL_POS),
+		hdmi_in_data_read(in, 1, CHARSYNC_CTL_POS),
+		hdmi_in_data_read(in, 2, CHARSYNC_CTL_POS),
+		hdmi_in_data_read(in, 0, WER_VALUE),
+		hdmi_in_data_read(in, 1, WER_VALUE),
+		hdmi_in_data_read(in, 2, WER_VALUE),
+		hdmi_in_read(in, CHANSYNC_CHANNELS_SYNCED),
+		hdmi_in_read(in, RESDETECTION_HRES),
+		hdmi_in_read(in, RESDETECTION_VRES),
+		in->frame_period/(SYSTEM_CLOCK_FREQUENCY/1000000),
+		hdmi_in_read(in, DMA_DROPPED), in->partial, in->resized);
+}
+
+void hdmi_in_telemetry(int n, volatile struct telemetry_input *t)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+	int c;
+
+	if(!in)
+		return;
+	t->flags = TELEMETRY_PRESENT;
+	if(hdmi_in_status(n))
+		t->flags |= TELEMETRY_ENABLED;
+	t->hres = hdmi_in_read(in, RESDETECTION_HRES);
+	t->vres = hdmi_in_read(in, RESDETECTION_VRES);
+	t->freq_khz = hdmi_in_freq(n) / 1000;
+	hdmi_in_wer_update(in);
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		t->wer[c] = hdmi_in_data_read(in, c, WER_VALUE);
+		t->phase[c] = in->d[c];
+	}
+	t->frames = in->frames;
+	t->overflows = in->overflows;
+	t->dropped = hdmi_in_read(in, DMA_DROPPED);
+	t->partial = in->partial;
+	t->resized = in->resized;
+}
+
+#ifdef CSR_HDMI_IN0_CLOCKING_PLL_RESET_ADDR
+static int hdmi_in_idelays_busy(struct hdmi_in *in)
+{
+	return hdmi_in_data_read(in, 0, CAP_DLY_BUSY)
+	  || hdmi_in_data_read(in, 1, CAP_DLY_BUSY)
+	  || hdmi_in_data_read(in, 2, CAP_DLY_BUSY);
+}
+
+static int wait_idelays(struct hdmi_in *in)
+{
+	int ev;
+
+	ev = 0;
+	elapsed(&ev, 1);
+	while(hdmi_in_idelays_busy(in)) {
+		if(elapsed(&ev, SYSTEM_CLOCK_FREQUENCY >> 6) == 0) {
+			wprintf("dvisampler%d: IDELAY busy timeout (%hhx %hhx %hhx)\n",
+				in->desc.index,
+				hdmi_in_data_read(in, 0, CAP_DLY_BUSY),
+				hdmi_in_data_read(in, 1, CAP_DLY_BUSY),
+				hdmi_in_data_read(in, 2, CAP_DLY_BUSY));
+			return 0;
+		}
+	}
+	return 1;
+}
+#endif
+
+static void hdmi_in_phase_reset(struct hdmi_in *in)
+{
+	int c;
+
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		hdmi_in_data_write(in, c, CAP_PHASE_RESET, 1);
+}
+
+static int hdmi_in_calibrate_delays(struct hdmi_in *in, int freq)
+{
+	int c;
+#ifdef CSR_HDMI_IN0_CLOCKING_PLL_RESET_ADDR
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		hdmi_in_data_write(in, c, CAP_DLY_CTL, DVISAMPLER_DELAY_MASTER_CAL|DVISAMPLER_DELAY_SLAVE_CAL);
+	if(!wait_idelays(in))
+		return 0;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		hdmi_in_data_write(in, c, CAP_DLY_CTL, DVISAMPLER_DELAY_MASTER_RST|DVISAMPLER_DELAY_SLAVE_RST);
+	hdmi_in_phase_reset(in);
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		in->d[c] = 0;
+	in->eye.valid = 0;
+#elif CSR_HDMI_IN0_CLOCKING_MMCM_RESET_ADDR
+	int i, phase_detector_delay;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		hdmi_in_data_write(in, c, CAP_DLY_CTL, DVISAMPLER_DELAY_RST);
+	hdmi_in_phase_reset(in);
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		in->d[c] = 0;
+	in->eye.valid = 0;
+
+	/* preload slave phase detector idelay with 90° phase shift
+	  (78 ps taps on 7-series) */
+	phase_detector_delay = 10000000/(4*freq*78);
+	for(i=0; i<phase_detector_delay; i++) {
+		for(c = 0; c < HDMI_IN_CHANNELS; c++)
+			hdmi_in_data_write(in, c, CAP_DLY_CTL, DVISAMPLER_DELAY_SLAVE_INC);
+	}
+#endif
+	return 1;
+}
+
+/* Move the delays of a channel by one tap */
+static int hdmi_in_step_delay(struct hdmi_in *in, int channel, int inc)
+{
+	unsigned int ctl = 0;
+
+#ifdef CSR_HDMI_IN0_CLOCKING_PLL_RESET_ADDR
+	ctl = inc ? DVISAMPLER_DELAY_INC : DVISAMPLER_DELAY_DEC;
+#elif CSR_HDMI_IN0_CLOCKING_MMCM_RESET_ADDR
+	ctl = inc ? (DVISAMPLER_DELAY_MASTER_INC | DVISAMPLER_DELAY_SLAVE_INC) :
+	            (DVISAMPLER_DELAY_MASTER_DEC | DVISAMPLER_DELAY_SLAVE_DEC);
+#endif
+	hdmi_in_data_write(in, channel, CAP_DLY_CTL, ctl);
+#ifdef CSR_HDMI_IN0_CLOCKING_PLL_RESET_ADDR
+	return wait_idelays(in);
+#else
+	return 1;
+#endif
+}
+
+/* Move the delays of a channel to the given tap */
+static int hdmi_in_move_delay(struct hdmi_in *in, int channel, int target)
+{
+	int *d = &in->d[channel];
+
+	while(*d != target) {
+		if(!hdmi_in_step_delay(in, channel, target > *d))
+			return 0;
+		*d += (target > *d) ? 1 : -1;
+	}
+	return 1;
+}
+
+static int hdmi_in_adjust_phase(struct hdmi_in *in)
+{
+	int c;
+
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		switch(hdmi_in_data_read(in, c, CAP_PHASE)) {
+			case DVISAMPLER_TOO_LATE:
+				if(!hdmi_in_step_delay(in, c, 0))
+					return 0;
+				in->d[c]--;
+				hdmi_in_data_write(in, c, CAP_PHASE_RESET, 1);
+				break;
+			case DVISAMPLER_TOO_EARLY:
+				if(!hdmi_in_step_delay(in, c, 1))
+					return 0;
+				in->d[c]++;
+				hdmi_in_data_write(in, c, CAP_PHASE_RESET, 1);
+				break;
+		}
+	}
+	return 1;
+}
+
+static int hdmi_in_init_phase(struct hdmi_in *in)
+{
+	int o_d[HDMI_IN_CHANNELS];
+	int i, j, c, settled;
+
+	for(i=0;i<100;i++) {
+		for(c = 0; c < HDMI_IN_CHANNELS; c++)
+			o_d[c] = in->d[c];
+		for(j=0;j<1000;j++) {
+			if(!hdmi_in_adjust_phase(in))
+				return 0;
+		}
+		settled = 1;
+		for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+			if(abs(in->d[c] - o_d[c]) >= 4)
+				settled = 0;
+		}
+		if(settled)
+			return 1;
+	}
+	return 0;
+}
+
+static int hdmi_in_phase_freq(struct hdmi_in *in)
+{
+	return config_get(in->desc.phase_key + 3) |
+	       (config_get(in->desc.phase_key + 4) << 8);
+}
+
+/* Start from the phases locked last time at this pixel clock (saved in
+ * the config), so that the phase init converges in its first round */
+static int hdmi_in_restore_phase(struct hdmi_in *in, int freq)
+{
+	int c;
+
+	if((in->desc.phase_key < 0) || (freq != hdmi_in_phase_freq(in)))
+		return 0;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		if(!hdmi_in_move_delay(in, c, (signed char)config_get(in->desc.phase_key + c)))
+			return 0;
+	}
+	hdmi_in_phase_reset(in);
+	if(in->debug)
+		wprintf("dvisampler%d: restored phases %d %d %d\n",
+			in->desc.index, in->d[0], in->d[1], in->d[2]);
+	return 1;
+}
+
+/* Phases drift by a tap or so while locked: only save real changes to
+ * limit the flash writes */
+static void hdmi_in_save_phase(struct hdmi_in *in, int freq)
+{
+	int c, changed;
+
+	if(in->desc.phase_key < 0)
+		return;
+	changed = (freq != hdmi_in_phase_freq(in));
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		if(abs(in->d[c] - (signed char)config_get(in->desc.phase_key + c)) > 1)
+			changed = 1;
+	}
+	if(!changed)
+		return;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		config_set(in->desc.phase_key + c, (unsigned char)in->d[c]);
+	config_set(in->desc.phase_key + 3, freq & 0xff);
+	config_set(in->desc.phase_key + 4, (freq >> 8) & 0xff);
+}
+
+static int hdmi_in_phase_startup(struct hdmi_in *in, int freq)
+{
+	int ret;
+	int attempts;
+
+	attempts = 0;
+	while(1) {
+		attempts++;
+		hdmi_in_calibrate_delays(in, freq);
+		if(in->debug)
+			wprintf("dvisampler%d: delays calibrated\n", in->desc.index);
+		in->phase_cached = (attempts == 1) && hdmi_in_restore_phase(in, freq);
+		ret = hdmi_in_init_phase(in);
+		if(ret) {
+			if(in->debug)
+				wprintf("dvisampler%d: phase init OK\n", in->desc.index);
+			return 1;
+		} else {
+			wprintf("dvisampler%d: phase init failed\n", in->desc.index);
+			if(attempts > 3) {
+				wprintf("dvisampler%d: giving up\n", in->desc.index);
+				hdmi_in_calibrate_delays(in, freq);
+				return 0;
+			}
+		}
+	}
+}
+
+static void hdmi_in_lock_time_start(struct hdmi_in *in)
+{
+	in->eye.lock_last = hdmi_in_ticks();
+	in->eye.lock_cycles = 0;
+	in->eye.lock_ms = 0;
+}
+
+/* Count the time to lock in milliseconds from the main loop: timer0
+ * reloads every few seconds, so like elapsed() a negative difference
+ * takes one reload, which needs an update per reload period at least */
+static void hdmi_in_lock_time_update(struct hdmi_in *in)
+{
+	unsigned int now = hdmi_in_ticks();
+	int cycles = now - in->eye.lock_last;
+
+	if(cycles < 0)
+		cycles += timer0_reload_read();
+	in->eye.lock_last = now;
+	in->eye.lock_cycles += cycles;
+	in->eye.lock_ms += in->eye.lock_cycles/(SYSTEM_CLOCK_FREQUENCY/1000);
+	in->eye.lock_cycles %= SYSTEM_CLOCK_FREQUENCY/1000;
+}
+
+static void hdmi_in_report_lock(struct hdmi_in *in, const char *how)
+{
+	hdmi_in_lock_time_update(in);
+	wprintf("dvisampler%d: locked in %ums (%s), ph:%d %d %d\n",
+		in->desc.index, in->eye.lock_ms,
+		how, in->d[0], in->d[1], in->d[2]);
+}
+
+/*
+ * Eye scan: sweep the delays of the three channels together over the
+ * scan range, measure the WER at each tap and centre each channel in
+ * its widest open window. The WER counters latch every 2^24 pixel
+ * clocks, and the first period after a move still includes the previous
+ * tap, so each tap takes two periods: the scan runs step by step from
+ * hdmi_in_service() to keep the main loop going. A coarse pass measures
+ * every HDMI_IN_EYE_COARSE taps, then a fine pass measures the taps in
+ * between only where a window opens or closes. The capture is not shown
+ * meanwhile, the sinks keep the last frame.
+ */
+static void hdmi_in_eye_scan_start(struct hdmi_in *in, int freq)
+{
+	int c;
+
+	in->eye.requested = 0;
+	if(freq <= 0)
+		return;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		if(!hdmi_in_move_delay(in, c, HDMI_IN_EYE_FIRST))
+			return;
+	}
+	in->eye.freq = freq;
+	in->eye.tap = HDMI_IN_EYE_FIRST;
+	in->eye.fine = 0;
+	memset(in->eye.todo, 0, sizeof(in->eye.todo));
+	/* freq is in 10kHz, plus 10ms for the WER latching */
+	in->eye.period = 2*(SYSTEM_CLOCK_FREQUENCY/10000)*((1 << 24)/freq)
+		+ SYSTEM_CLOCK_FREQUENCY/100;
+	elapsed(&in->eye.last_event, -1);
+	in->eye.active = 1;
+	if(in->debug)
+		wprintf("dvisampler%d: eye scan, taps %d to %d by %d, %dms per tap\n",
+			in->desc.index, HDMI_IN_EYE_FIRST, HDMI_IN_EYE_LAST,
+			HDMI_IN_EYE_COARSE, in->eye.period/(SYSTEM_CLOCK_FREQUENCY/1000));
+}
+
+/* Highest WER of an open tap of a channel */
+static unsigned int hdmi_in_eye_threshold(struct hdmi_in *in, int channel)
+{
+	unsigned int *wer = in->eye.wer[channel];
+	unsigned int threshold;
+	int i;
+
+	threshold = wer[0];
+	for(i = 1; i < HDMI_IN_EYE_TAPS; i++) {
+		if(wer[i] < threshold)
+			threshold = wer[i];
+	}
+	return threshold + threshold/4 + HDMI_IN_EYE_WER_SLACK;
+}
+
+/* After the coarse pass: the taps between two measured taps are to be
+ * measured if a channel opens or closes between them, else they take the
+ * WER of the worse of the two */
+static void hdmi_in_eye_refine(struct hdmi_in *in)
+{
+	unsigned int threshold[HDMI_IN_CHANNELS];
+	unsigned int *wer;
+	int a, b, c, i, edge;
+
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		threshold[c] = hdmi_in_eye_threshold(in, c);
+	for(a = 0; a < HDMI_IN_EYE_TAPS - 1; a = b) {
+		b = a + HDMI_IN_EYE_COARSE;
+		if(b > HDMI_IN_EYE_TAPS - 1)
+			b = HDMI_IN_EYE_TAPS - 1;
+		edge = 0;
+		for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+			wer = in->eye.wer[c];
+			if((wer[a] <= threshold[c]) != (wer[b] <= threshold[c]))
+				edge = 1;
+			for(i = a + 1; i < b; i++)
+				wer[i] = wer[a] > wer[b] ? wer[a] : wer[b];
+		}
+		for(i = a + 1; i < b; i++)
+			in->eye.todo[i] = edge;
+	}
+}
+
+/* Next tap to measure, past HDMI_IN_EYE_LAST when the scan is done */
+static int hdmi_in_eye_next(struct hdmi_in *in)
+{
+	int tap = in->eye.tap;
+
+	if(!in->eye.fine) {
+		if(tap < HDMI_IN_EYE_LAST) {
+			tap += HDMI_IN_EYE_COARSE;
+			return tap < HDMI_IN_EYE_LAST ? tap : HDMI_IN_EYE_LAST;
+		}
+		hdmi_in_eye_refine(in);
+		in->eye.fine = 1;
+		tap = HDMI_IN_EYE_FIRST;
+	}
+	for(tap++; tap <= HDMI_IN_EYE_LAST; tap++) {
+		if(in->eye.todo[tap - HDMI_IN_EYE_FIRST])
+			break;
+	}
+	return tap;
+}
+
+/* Widest run of open taps of a channel, returns its width */
+static int hdmi_in_eye_window(struct hdmi_in *in, int channel, int *first)
+{
+	unsigned int *wer = in->eye.wer[channel];
+	unsigned int threshold;
+	int i, start, width;
+
+	threshold = hdmi_in_eye_threshold(in, channel);
+	width = 0;
+	start = -1;
+	for(i = 0; i <= HDMI_IN_EYE_TAPS; i++) {
+		if((i < HDMI_IN_EYE_TAPS) && (wer[i] <= threshold)) {
+			if(start < 0)
+				start = i;
+		} else if(start >= 0) {
+			if(i - start > width) {
+				width = i - start;
+				*first = HDMI_IN_EYE_FIRST + start;
+			}
+			start = -1;
+		}
+	}
+	return width;
+}
+
+static void hdmi_in_eye_scan_done(struct hdmi_in *in)
+{
+	int c, first, width;
+
+	in->eye.active = 0;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		width = hdmi_in_eye_window(in, c, &first);
+		in->eye.min[c] = first;
+		in->eye.max[c] = first + width - 1;
+		if(!hdmi_in_move_delay(in, c, first + (width - 1)/2))
+			return;
+	}
+	in->eye.valid = 1;
+	hdmi_in_phase_reset(in);
+
+	hdmi_in_report_lock(in, "eye scan");
+	wprintf("dvisampler%d: eye margins (taps): %d/%d %d/%d %d/%d\n",
+		in->desc.index,
+		in->d[0] - in->eye.min[0], in->eye.max[0] - in->d[0],
+		in->d[1] - in->eye.min[1], in->eye.max[1] - in->d[1],
+		in->d[2] - in->eye.min[2], in->eye.max[2] - in->d[2]);
+	hdmi_in_save_phase(in, in->eye.freq);
+}
+
+static void hdmi_in_eye_scan_service(struct hdmi_in *in)
+{
+	int c, i, next;
+
+	if(!elapsed(&in->eye.last_event, in->eye.period))
+		return;
+
+	hdmi_in_wer_update(in);
+	i = in->eye.tap - HDMI_IN_EYE_FIRST;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++)
+		in->eye.wer[c][i] = hdmi_in_data_read(in, c, WER_VALUE);
+	if(in->debug)
+		wprintf("dvisampler%d: tap %3d WER:%6u %6u %6u\n",
+			in->desc.index, in->eye.tap,
+			in->eye.wer[0][i], in->eye.wer[1][i], in->eye.wer[2][i]);
+
+	next = hdmi_in_eye_next(in);
+	if(next > HDMI_IN_EYE_LAST) {
+		hdmi_in_eye_scan_done(in);
+		return;
+	}
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		if(!hdmi_in_move_delay(in, c, next)) {
+			in->eye.active = 0;
+			return;
+		}
+	}
+	in->eye.tap = next;
+}
+
+/* Keep the phase tracking within the windows found by the last scan */
+static void hdmi_in_eye_clamp(struct hdmi_in *in)
+{
+	int c;
+
+	if(!in->eye.valid)
+		return;
+	for(c = 0; c < HDMI_IN_CHANNELS; c++) {
+		if(in->d[c] < in->eye.min[c])
+			hdmi_in_move_delay(in, c, in->eye.min[c]);
+		else if(in->d[c] > in->eye.max[c])
+			hdmi_in_move_delay(in, c, in->eye.max[c]);
+	}
+}
+
+void hdmi_in_eye_scan(int n)
+{
+	struct hdmi_in *in = hdmi_in_get(n);
+
+	if(in)
+		in->eye.requested = 1;
+}
+
+static void hdmi_in_check_overflow(struct hdmi_in *in)
+{
+	if(hdmi_in_read(in, FRAME_OVERFLOW)) {
+		wprintf("dvisampler%d: FIFO overflow\n", in->desc.index);
+		hdmi_in_write(in, FRAME_OVERFLOW, 1);
+		in->overflows++;
+	}
+}
+
+static int hdmi_in_clocking_locked_filtered(struct hdmi_in *in)
+{
+	if(hdmi_in_read(in, CLOCKING_LOCKED)) {
+		switch(in->lock_status) {
+			case 0:
+				elapsed(&in->lock_start_time, -1);
+				in->lock_status = 1;
+				break;
+			case 1:
+				if(elapsed(&in->lock_start_time, SYSTEM_CLOCK_FREQUENCY/4))
+					in->lock_status = 2;
+				break;
+			case 2:
+				return 1;
+		}
+	} else
+		in->lock_status = 0;
+	return 0;
+}
+
+/* Capture frames of another size, the frames in flight are dropped */
+static void hdmi_in_resize(struct hdmi_in *in, int hres, int vres)
+{
+	unsigned int mask;
+
+	mask = irq_getmask();
+	irq_setmask(mask & ~(1 << in->desc.irq));
+	in->hres = hres;
+	in->vres = vres;
+	hdmi_in_write(in, DMA_FRAME_SIZE, hres*vres*2);
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	hdmi_in_compression_apply(in);
+#endif
+	hdmi_in_ring_reset(in);
+	hdmi_in_ring_fill(in);
+	hdmi_in_write(in, DMA_EV_PENDING, hdmi_in_read(in, DMA_EV_PENDING));
+	irq_setmask(mask);
+	in->resized++;
+}
+
+/* Debounce the resolution reported by resdetection and capture at that
+ * resolution when it is stable, without touching the other inputs or the
+ * outputs */
+static void hdmi_in_follow(struct hdmi_in *in)
+{
+	int hres, vres;
+
+	if(!hdmi_in_status(in->desc.index))
+		return;
+	if(!elapsed(&in->follow.last_event, HDMI_IN_FOLLOW_PERIOD))
+		return;
+	hres = hdmi_in_read(in, RESDETECTION_HRES);
+	vres = hdmi_in_read(in, RESDETECTION_VRES);
+	if(hres != in->follow.hres || vres != in->follow.vres) {
+		in->follow.hres = hres;
+		in->follow.vres = vres;
+		in->follow.count = 0;
+		return;
+	}
+	if(in->follow.count < HDMI_IN_FOLLOW_COUNT)
+		in->follow.count++;
+	if(in->follow.count != HDMI_IN_FOLLOW_COUNT)
+		return;
+	/* once per new resolution */
+	in->follow.count++;
+
+	if(hres == in->hres && vres == in->vres)
+		return;
+	if(hres == 0 || vres == 0)
+		return;
+	if(hres > FRAMEBUFFER_PIXELS_X || vres > FRAMEBUFFER_PIXELS_Y) {
+		wprintf("dvisampler%d: %dx%d does not fit the frame buffers\n",
+			in->desc.index, hres, vres);
+		return;
+	}
+	wprintf("dvisampler%d: capture resolution %dx%d -> %dx%d\n",
+		in->desc.index, in->hres, in->vres, hres, vres);
+	hdmi_in_resize(in, hres, vres);
+}
+
+static void hdmi_in_service_one(struct hdmi_in *in, int freq)
+{
+	int n = in->desc.index;
+
+	hdmi_in_lock_time_update(in);
+	if(in->connected) {
+		if(!hdmi_in_read(in, EDID_HPD_NOTIF)) {
+			if(in->debug)
+				wprintf("dvisampler%d: disconnected\n", n);
+			in->connected = 0;
+			in->locked = 0;
+			in->eye.active = 0;
+			hdmi_in_clocking_reset(in, 1);
+			hdmi_in_fill(in);
+		} else {
+			if(in->locked) {
+				if(hdmi_in_clocking_locked_filtered(in)) {
+					if(in->eye.requested) {
+						hdmi_in_lock_time_start(in);
+						hdmi_in_eye_scan_start(in, freq);
+					}
+					if(in->eye.active)
+						hdmi_in_eye_scan_service(in);
+					else {
+						hdmi_in_follow(in);
+						if(elapsed(&in->last_event, SYSTEM_CLOCK_FREQUENCY/2)) {
+							hdmi_in_adjust_phase(in);
+							hdmi_in_eye_clamp(in);
+							if(in->debug)
+								hdmi_in_print_status(n);
+						}
+					}
+				} else {
+					if(in->debug)
+						wprintf("dvisampler%d: lost PLL lock\n", n);
+					in->locked = 0;
+					in->eye.active = 0;
+					hdmi_in_fill(in);
+				}
+			} else {
+				if(hdmi_in_clocking_locked_filtered(in)) {
+					if(in->debug)
+						wprintf("dvisampler%d: PLL locked\n", n);
+					hdmi_in_lock_time_start(in);
+					hdmi_in_phase_startup(in, freq);
+					if(in->debug)
+						hdmi_in_print_status(n);
+					in->locked = 1;
+					/* the eye scan is only needed for new pixel clocks */
+					if(in->phase_cached) {
+						hdmi_in_report_lock(in, "cached phases");
+						hdmi_in_save_phase(in, freq);
+					} else
+						hdmi_in_eye_scan_start(in, freq);
+				}
+			}
+		}
+	} else {
+		if(hdmi_in_read(in, EDID_HPD_NOTIF)) {
+			if(in->debug)
+				wprintf("dvisampler%d: connected\n", n);
+			in->connected = 1;
+			hdmi_in_clocking_reset(in, 0);
+		}
+	}
+	hdmi_in_check_overflow(in);
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	hdmi_in_compression_service(in);
+#endif
+}
+
+int hdmi_in_service(int freq)
+{
+	int i;
+
+	for(i = 0; i < HDMI_IN_COUNT; i++)
+		hdmi_in_service_one(&hdmi_ins[i], freq);
+	return hdmi_in_events_service();
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __HDMI_IN_H
+#define __HDMI_IN_H
+
+#include <stdbool.h>
+#include "framebuffer.h"
+
+/*
+ * Driver for the HDMI inputs hdmi_in0 .. hdmi_in<HDMI_IN_MAX-1> found in
+ * the gateware. All the inputs share the CSR layout of hdmi_in0, so the
+ * driver is built when CSR_HDMI_IN0_BASE is defined; the instances are
+ * described by a table in hdmi_in.c. Functions taking an input number
+ * do nothing for inputs which are not present.
+ */
+
+#define HDMI_IN_MAX	FRAMEBUFFER_INPUTS
+
+struct telemetry_input;
+
+int hdmi_in_present(int n);
+const char *hdmi_in_mnemonic(int n);
+const char *hdmi_in_description(int n);
+/* config key of the enabled state, -1 if not persisted */
+int hdmi_in_enabled_key(int n);
+
+int hdmi_in_get_debug(int n);
+void hdmi_in_set_debug(int n, int debug);
+
+fb_ptrdiff_t hdmi_in_framebuffer_base(int n, int fb);
+
+/* a captured frame, 0x0 for the fill colour shown without signal, which
+ * reads at any size, compressed or not */
+struct hdmi_in_frame {
+	fb_ptrdiff_t base;
+	int hres, vres;
+	int compressed;
+};
+/* last complete frame, returns 0 if the input is not present */
+int hdmi_in_current_frame(int n, struct hdmi_in_frame *f);
+/*
+ * The direct sinks (outputs, encoder, raw video) read the frames at their
+ * own size, and some of them only uncompressed: they are shown the last
+ * complete frame of that format, and keep it while the input captures
+ * another. hdmi_in_sink_frame() returns 0 when there is no such frame.
+ */
+void hdmi_in_set_sink_format(int n, int hres, int vres, int uncompressed);
+int hdmi_in_sink_frame(int n, struct hdmi_in_frame *f);
+
+/* called from isr() with the pending interrupts: swaps the frame buffers
+ * and defers the rest to hdmi_in_service() */
+void hdmi_in_isr(unsigned int irqs);
+void hdmi_in_print_isr_status(void);
+/* start capturing at hres x vres, the capture then follows the source */
+void hdmi_in_init_video(int n, int hres, int vres);
+void hdmi_in_enable(int n);
+bool hdmi_in_status(int n);
+void hdmi_in_disable(int n);
+void hdmi_in_clear_framebuffers(int n);
+/* store frames compressed when the capture resolution allows it, the
+ * frames already captured keep their format */
+void hdmi_in_set_compression(int n, int enable);
+int hdmi_in_compressed(int n);
+/* DRAM writes per 1000 words captured, over the last second */
+int hdmi_in_compression_writes(int n);
+void hdmi_in_set_hpd(int n, int hpd);
+void hdmi_in_load_edid(int n, const unsigned char *edid, int len);
+
+int hdmi_in_hres(int n);
+int hdmi_in_vres(int n);
+/* resolution of the frames in the frame buffers */
+int hdmi_in_capture_hres(int n);
+int hdmi_in_capture_vres(int n);
+/* pixel clock in Hz, 0 without frequency meter */
+unsigned int hdmi_in_freq(int n);
+
+void hdmi_in_print_status(int n);
+void hdmi_in_telemetry(int n, volatile struct telemetry_input *t);
+void hdmi_in_eye_scan(int n);
+/* returns the number of frames captured since the last call */
+int hdmi_in_service(int freq);
+
+#endif /* __HDMI_IN_H */
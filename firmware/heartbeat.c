@@ -5,8 +5,7 @@
 #include <system.h>
 #include <time.h>
 
-#include "hdmi_in0.h"
-#include "hdmi_in1.h"
+#include "hdmi_in.h"
 #include "heartbeat.h"
 #include "processor.h"
 #include "pattern.h"
@@ -22,6 +21,11 @@ void hb_status(bool val)
 	heartbeat_status = val;
 }
 
+bool hb_get_status(void)
+{
+	return heartbeat_status;
+}
+
 void hb_service(fb_ptrdiff_t fb_offset)
 {
 	static int last_event;
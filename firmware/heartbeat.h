@@ -5,6 +5,7 @@
 #include "framebuffer.h"
 
 void hb_status(bool val);
+bool hb_get_status(void);
 void hb_service(fb_ptrdiff_t fb_offset) ;
 void hb_fill(bool color_v, fb_ptrdiff_t fb_offset);
 
@@ -2,8 +2,7 @@
 #include <irq.h>
 #include <uart.h>
 
-#include "hdmi_in0.h"
-#include "hdmi_in1.h"
+#include "hdmi_in.h"
 
 void isr(void);
 void isr(void)
@@ -15,11 +14,6 @@ void isr(void)
 	if(irqs & (1 << UART_INTERRUPT))
 		uart_isr();
 #ifdef CSR_HDMI_IN0_BASE
-	if(irqs & (1 << HDMI_IN0_INTERRUPT))
-		hdmi_in0_isr();
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	if(irqs & (1 << HDMI_IN1_INTERRUPT))
-		hdmi_in1_isr();
+	hdmi_in_isr(irqs);
 #endif
 }
@@ -17,6 +17,7 @@
 #include "etherbone.h"
 #include "ethernet.h"
 #include "fx2.h"
+#include "hdmi_in.h"
 #include "hdmi_out0.h"
 #include "hdmi_out1.h"
 #include "mdio.h"
@@ -24,7 +25,10 @@
 #include "opsis_eeprom.h"
 #include "pattern.h"
 #include "processor.h"
+#include "rawvideo.h"
+#include "rtp.h"
 #include "stdio_wrap.h"
+#include "telemetry.h"
 #include "telnet.h"
 #include "tofe_eeprom.h"
 #include "uptime.h"
@@ -51,6 +55,9 @@ static unsigned char ip_addr[4] = {0x00, 0x00, 0x00, 0x00};
 
 int main(void)
 {
+#ifdef CSR_HDMI_IN0_BASE
+	int i;
+#endif
 #ifdef ETHMAC_BASE
 	telnet_active = 0;
 #endif
@@ -66,6 +73,7 @@ int main(void)
 
 	config_init();
 	time_init();
+	telemetry_init();
 
 	print_version();
 
@@ -99,6 +107,12 @@ int main(void)
 	etherbone_init();
 	telnet_init();
 #endif
+#ifdef CSR_RTP_BASE
+	rtp_init(mac_addr, ip_addr);
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+	rawvideo_init(mac_addr, ip_addr);
+#endif
 
 	// Reboot the FX2 chip into HDMI2USB mode
 #ifdef CSR_OPSIS_I2C_FX2_RESET_OUT_ADDR
@@ -114,16 +128,13 @@ int main(void)
 	processor_service();
 
 #ifdef CSR_HDMI_IN0_BASE
-	input0_off();
-	if (config_get(CONFIG_KEY_INPUT0_ENABLED)) {
-		input0_on();
-	}
-#endif
-
-#ifdef CSR_HDMI_IN1_BASE
-	input1_off();
-	if (config_get(CONFIG_KEY_INPUT1_ENABLED)) {
-		input1_on();
+	for(i = 0; i < HDMI_IN_MAX; i++) {
+		if(!hdmi_in_present(i))
+			continue;
+		input_off(i);
+		if (hdmi_in_enabled_key(i) < 0 || config_get(hdmi_in_enabled_key(i))) {
+			input_on(i);
+		}
 	}
 #endif
 
@@ -156,9 +167,11 @@ int main(void)
 	encoder_set_fps(config_get(CONFIG_KEY_ENCODER_FPS));
 #endif
 
+	stdio_async_enable();
 	ci_prompt();
 	while(1) {
 		uptime_service();
+		stdio_service();
 		processor_service();
 		ci_service();
 
@@ -168,6 +181,9 @@ int main(void)
 #ifdef ETHMAC_BASE
 		ethernet_service();
 #endif
+#ifdef CSR_RTP_BASE
+		rtp_service();
+#endif
 #ifdef CSR_FRONT_PANEL_BASE
 		front_panel_service();
 #endif
@@ -176,6 +192,7 @@ int main(void)
 #endif
 
 		pattern_service();
+		telemetry_service();
 	}
 
 	return 0;
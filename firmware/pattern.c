@@ -13,7 +13,7 @@
 #include "version_data.h"
 
 unsigned int pattern_framebuffer_base(void) {
-	return FRAMEBUFFER_BASE_PATTERN;
+	return FRAMEBUFFER_PATTERN;
 }
 
 #ifdef MAIN_RAM_BASE
@@ -24,13 +24,15 @@
 #include <hw/flags.h>
 #include <time.h>
 
-#include "hdmi_in0.h"
-#include "hdmi_in1.h"
+#include "hdmi_in.h"
 #include "pattern.h"
 #include "encoder.h"
+#include "rawvideo.h"
+#include "scaler.h"
 #include "edid.h"
 #include "pll.h"
 #include "mmcm.h"
+#include "clock.h"
 #include "processor.h"
 #include "heartbeat.h"
 
@@ -408,37 +410,33 @@ static void fb_clkgen_write(int cmd, int data)
 }
 #elif CSR_HDMI_OUT0_DRIVER_CLOCKING_MMCM_RESET_ADDR
 // Artix-7 MMCM clocking
-static void fb_clkgen_write(int m, int d)
+/*
+ * ClkReg1: high and low times. ClkReg2: no count (bit 6) for a divide by
+ * 1, and edge (bit 7) for an odd divider, whose high time is then half a
+ * VCO cycle longer for a 50% duty cycle.
+ */
+static void fb_mmcm_divider_write(int adr, int div)
 {
-	/* MMCM VCO range for slowest speed grade Artix-7 is 600MHz-1200MHz
-	   Warn if the VCO strays outside these limits.
-	*/
-	if ((((m*100)/d) > 1200) || (((m*100)/d) < 600)) {
-		wprintf(
-			"WARNING: VCO freq (%uMHz) outside 600MHz-1200MHz range\n"
-			"          M: %d, D: %d\n",
-			(m*100)/d, m, d);
-	} else {
-		wprintf(
-			"INFO: VCO freq: %uMHz, M: %d, D: %d\n", (m*100)/d, m, d);
-	}
+	hdmi_out0_driver_clocking_mmcm_write(adr, 0x1000 | ((div/2)<<6) | (div - div/2));
+	hdmi_out0_driver_clocking_mmcm_write(adr + 1, (div == 1 ? (1<<6) : 0) | ((div & 1)<<7));
+}
+
+static void fb_clkgen_write(int m, int d, int o)
+{
+	wprintf("INFO: VCO freq: %uMHz, M: %d, D: %d, O: %d\n", (m*100)/d, m, d, o);
 
 	/* clkfbout_mult = m */
-	if(m%2)
-		hdmi_out0_driver_clocking_mmcm_write(0x14, 0x1000 | ((m/2)<<6) | (m/2 + 1));
+	fb_mmcm_divider_write(0x14, m);
+	/* divclk_divide = d, a single register: edge (bit 13), no count
+	 * (bit 12), high and low times */
+	if(d == 1)
+		hdmi_out0_driver_clocking_mmcm_write(0x16, 1<<12);
 	else
-		hdmi_out0_driver_clocking_mmcm_write(0x14, 0x1000 | ((m/2)<<6) | m/2);
-	/* divclk_divide = d */
-	if (d == 1)
-		hdmi_out0_driver_clocking_mmcm_write(0x16, 0x1000);
-	else if(d%2)
-		hdmi_out0_driver_clocking_mmcm_write(0x16, ((d/2)<<6) | (d/2 + 1));
-	else
-		hdmi_out0_driver_clocking_mmcm_write(0x16, ((d/2)<<6) | d/2);
-	/* clkout0_divide = 10 */
-	hdmi_out0_driver_clocking_mmcm_write(0x8, 0x1000 | (5<<6) | 5);
-	/* clkout1_driver_clocking_divide = 2 */
-	hdmi_out0_driver_clocking_mmcm_write(0xa, 0x1000 | (1<<6) | 1);
+		hdmi_out0_driver_clocking_mmcm_write(0x16, ((d & 1)<<13) | ((d/2)<<6) | (d - d/2));
+	/* clkout0_divide = o, the pixel clock */
+	fb_mmcm_divider_write(0x8, o);
+	/* clkout1_divide = o/5, the serial clock */
+	fb_mmcm_divider_write(0xa, o/5);
 }
 #else
 
@@ -449,76 +447,38 @@ static void fb_clkgen_write(int m, int d)
 }
 #endif
 
-// Work out the multiplier and divider values for a given pixel clock.
-static void fb_get_clock_md(unsigned int pixel_clock, unsigned int *best_m, unsigned int *best_d)
+static void fb_set_clock(unsigned int pixel_clock)
 {
-	unsigned int max_m, max_d;
-	unsigned int ideal_m, ideal_d;
-	unsigned int bm, bd;
-	unsigned int m, d;
-	unsigned int diff_current;
-	unsigned int diff_tested;
-
-	ideal_m = pixel_clock;
-
-	bm = 1;
-	bd = 0;
-
 #ifdef CSR_HDMI_OUT0_DRIVER_CLOCKING_PLL_RESET_ADDR
-	// Spartan 6
-	ideal_d = 5000;
-	max_d = 256;
-	max_m = 256;
-#elif CSR_HDMI_OUT0_DRIVER_CLOCKING_MMCM_RESET_ADDR
-	// Artix 7
-	pixel_clock = pixel_clock * 10;
-	ideal_d = 1000;
-	max_d = 128;
-	max_m = 128;
-#else
-	assert(false);
-	return;
-#endif
-
-	for(d=1;d<=max_d;d++)
-		for(m=2;m<=max_m;m++) {
-			/* common denominator is d*bd*ideal_d */
-			diff_current = abs(d*ideal_d*bm - d*bd*ideal_m);
-			diff_tested = abs(bd*ideal_d*m - d*bd*ideal_m);
-			if(diff_tested < diff_current) {
-				bm = m;
-				bd = d;
-			}
-		}
-	*best_m = bm;
-	*best_d = bd;
+	struct clock_setting clock;
+
+	if(!clock_clkgen_setting(pixel_clock, &clock)) {
+		wprintf("No clock setting for %u.%02uMHz\n", pixel_clock/100, pixel_clock%100);
+		return;
+	}
 
 	/* Check the resultant frequency */
-#ifdef CSR_HDMI_OUT0_DRIVER_CLOCKING_PLL_RESET_ADDR
-	unsigned int md1000 = (bm * 1000) / bd;
+	unsigned int md1000 = (clock.m * 1000) / clock.d;
 	if (md1000 > hdmi_out0_driver_clocking_clkfx_md_max_1000_read()) {
 		wprintf(
 			"WARNING: md1000 (%d) > (%d)\n",
 			md1000,
 			hdmi_out0_driver_clocking_clkfx_md_max_1000_read());
 	}
-#endif
-}
-
-static void fb_set_clock(unsigned int pixel_clock)
-{
-	unsigned int clock_m, clock_d;
-
-	fb_get_clock_md(pixel_clock, &clock_m, &clock_d);
 
-#ifdef CSR_HDMI_OUT0_DRIVER_CLOCKING_PLL_RESET_ADDR
-	fb_clkgen_write(0x1, clock_d-1);
-	fb_clkgen_write(0x3, clock_m-1);
+	fb_clkgen_write(0x1, clock.d-1);
+	fb_clkgen_write(0x3, clock.m-1);
 	hdmi_out0_driver_clocking_send_go_write(1);
 	while(!(hdmi_out0_driver_clocking_status_read() & CLKGEN_STATUS_PROGDONE));
 	while(!(hdmi_out0_driver_clocking_status_read() & CLKGEN_STATUS_LOCKED));
 #elif CSR_HDMI_OUT0_DRIVER_CLOCKING_MMCM_RESET_ADDR
-	fb_clkgen_write(clock_m, clock_d);
+	struct clock_setting clock;
+
+	if(!clock_mmcm_setting(pixel_clock, &clock)) {
+		wprintf("No clock setting for %u.%02uMHz\n", pixel_clock/100, pixel_clock%100);
+		return;
+	}
+	fb_clkgen_write(clock.m, clock.d, clock.o);
 #endif
 }
 
@@ -571,19 +531,18 @@ static void fb_set_mode(const struct video_timing *mode)
 
 static void edid_set_mode(const struct video_timing *mode, const struct video_timing *sec_mode)
 {
-#if defined(CSR_HDMI_IN0_BASE) || defined(CSR_HDMI_IN1_BASE)
-	unsigned char edid[128];
-	int i;
-#endif
 #ifdef CSR_HDMI_IN0_BASE
-	generate_edid(&edid, "OHW", "TV", 2015, "HDMI2USB-1", mode, sec_mode);
-	for(i=0;i<sizeof(edid);i++)
-		MMPTR(CSR_HDMI_IN0_EDID_MEM_BASE+4*i) = edid[i];
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	generate_edid(&edid, "OHW", "TV", 2015, "HDMI2USB-2", mode, sec_mode);
-	for(i=0;i<sizeof(edid);i++)
-		MMPTR(CSR_HDMI_IN1_EDID_MEM_BASE+4*i) = edid[i];
+	unsigned char edid[128];
+	char name[16];
+	int n;
+
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_present(n))
+			continue;
+		snprintf(name, sizeof(name), "HDMI2USB-%d", n + 1);
+		generate_edid(&edid, "OHW", "TV", 2015, name, mode, sec_mode);
+		hdmi_in_load_edid(n, edid, sizeof(edid));
+	}
 #endif
 }
 
@@ -595,6 +554,12 @@ void processor_init(int sec_mode)
 	processor_hdmi_out0_source = VIDEO_IN_HDMI_IN0;
 	processor_hdmi_out1_source = VIDEO_IN_HDMI_IN0;
 	processor_encoder_source = VIDEO_IN_HDMI_IN0;
+	processor_rawvideo_source = VIDEO_IN_HDMI_IN0;
+	processor_scaler_source = VIDEO_IN_HDMI_IN0;
+	processor_compression = 0;
+#ifdef CSR_SCALER_BASE
+	scaler_init();
+#endif
 #ifdef ENCODER_BASE
 		encoder_enable(0);
 		encoder_target_fps = 30;
@@ -607,6 +572,9 @@ void processor_start(int mode)
 {
 	const struct video_timing *m;
 	const struct video_timing *sec_mode = NULL;
+#ifdef CSR_HDMI_IN0_BASE
+	int n;
+#endif
 	if (processor_secondary_mode != EDID_SECONDARY_MODE_OFF &&
 			processor_secondary_mode != mode)
 		sec_mode = &video_modes[processor_secondary_mode];
@@ -636,19 +604,13 @@ void processor_start(int mode)
 	hdmi_out0_driver_clocking_pll_reset_write(1);
 #endif
 #ifdef CSR_HDMI_IN0_BASE
-	hdmi_in0_edid_hpd_en_write(0);
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	hdmi_in1_edid_hpd_en_write(0);
-#endif
+	for(n = 0; n < HDMI_IN_MAX; n++)
+		hdmi_in_set_hpd(n, 0);
 
-#ifdef CSR_HDMI_IN0_BASE
-	hdmi_in0_disable();
-	hdmi_in0_clear_framebuffers();
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	hdmi_in1_disable();
-	hdmi_in1_clear_framebuffers();
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		hdmi_in_disable(n);
+		hdmi_in_clear_framebuffers(n);
+	}
 #endif
 #ifndef SIMULATION
 	pattern_fill_framebuffer(m->h_active, m->v_active);
@@ -664,10 +626,8 @@ void processor_start(int mode)
 	edid_set_mode(m, sec_mode);
 
 #ifdef CSR_HDMI_IN0_BASE
-	hdmi_in0_init_video(m->h_active, m->v_active);
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	hdmi_in1_init_video(m->h_active, m->v_active);
+	for(n = 0; n < HDMI_IN_MAX; n++)
+		hdmi_in_init_video(n, m->h_active, m->v_active);
 #endif
 
 #ifdef CSR_HDMI_OUT0_DRIVER_CLOCKING_PLL_RESET_ADDR
@@ -682,11 +642,10 @@ void processor_start(int mode)
 	hdmi_out1_core_initiator_enable_write(1);
 #endif
 #ifdef CSR_HDMI_IN0_BASE
-	hdmi_in0_edid_hpd_en_write(1);
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	hdmi_in1_edid_hpd_en_write(1);
+	for(n = 0; n < HDMI_IN_MAX; n++)
+		hdmi_in_set_hpd(n, 1);
 #endif
+	processor_update();
 }
 
 void processor_set_hdmi_out0_source(int source) {
@@ -701,85 +660,346 @@ void processor_set_encoder_source(int source) {
 	processor_encoder_source = source;
 }
 
+void processor_set_rawvideo_source(int source) {
+	processor_rawvideo_source = source;
+}
+
+void processor_set_scaler_source(int source) {
+	processor_scaler_source = source;
+}
+
+int processor_source_hdmi_in(int source) {
+	if(source == VIDEO_IN_HDMI_IN0 || source == VIDEO_IN_HDMI_IN1)
+		return source;
+	if(source == VIDEO_IN_HDMI_IN2 || source == VIDEO_IN_HDMI_IN3)
+		return source - VIDEO_IN_HDMI_IN2 + 2;
+	return -1;
+}
+
+int processor_hdmi_in_source(int n) {
+	return n < 2 ? VIDEO_IN_HDMI_IN0 + n : VIDEO_IN_HDMI_IN2 + n - 2;
+}
+
 char * processor_get_source_name(int source) {
 	memset(processor_buffer, 0, 16);
 	if(source == VIDEO_IN_PATTERN)
 		sprintf(processor_buffer, "pattern");
+	else if(source == VIDEO_IN_SCALER)
+		sprintf(processor_buffer, "scaler");
 	else
-		sprintf(processor_buffer, "input%d", source);
+		sprintf(processor_buffer, "input%d", processor_source_hdmi_in(source));
 	return processor_buffer;
 }
 
-void processor_update(void)
+/* Frame buffer to show for a video source and whether it is stored
+ * compressed, returns 0 if the source does not exist */
+static int processor_source_framebuffer(int source, fb_ptrdiff_t *fb, int *compressed)
 {
-#ifdef CSR_HDMI_OUT0_BASE
-	/*  hdmi_out0 */
 #ifdef CSR_HDMI_IN0_BASE
-	if(processor_hdmi_out0_source == VIDEO_IN_HDMI_IN0)
-		hdmi_out0_core_initiator_base_write(hdmi_in0_framebuffer_base(hdmi_in0_fb_index));
+	struct hdmi_in_frame f;
+	int n;
 #endif
-#ifdef CSR_HDMI_IN1_BASE
-	if(processor_hdmi_out0_source == VIDEO_IN_HDMI_IN1)
-		hdmi_out0_core_initiator_base_write(hdmi_in1_framebuffer_base(hdmi_in1_fb_index));
+
+	*compressed = 0;
+	if(source == VIDEO_IN_PATTERN) {
+		*fb = pattern_framebuffer_base();
+		return 1;
+	}
+#ifdef CSR_SCALER_BASE
+	if(source == VIDEO_IN_SCALER) {
+		*fb = scaler_framebuffer();
+		return 1;
+	}
 #endif
-	if(processor_hdmi_out0_source == VIDEO_IN_PATTERN)
-		hdmi_out0_core_initiator_base_write(pattern_framebuffer_base());
+#ifdef CSR_HDMI_IN0_BASE
+	n = processor_source_hdmi_in(source);
+	if(hdmi_in_present(n)) {
+		/* the sinks read at the output mode: the pattern until the
+		 * input has a frame of that size */
+		if(hdmi_in_sink_frame(n, &f)) {
+			*fb = f.base;
+			*compressed = f.compressed;
+		} else
+			*fb = pattern_framebuffer_base();
+		return 1;
+	}
 #endif
+	return 0;
+}
 
-#ifdef CSR_HDMI_OUT1_BASE
-	/*  hdmi_out1 */
+static void processor_heartbeat(void)
+{
 #ifdef CSR_HDMI_IN0_BASE
-	if(processor_hdmi_out1_source == VIDEO_IN_HDMI_IN0)
-		hdmi_out1_core_initiator_base_write(hdmi_in0_framebuffer_base(hdmi_in0_fb_index));
-#endif
-#ifdef CSR_HDMI_IN1_BASE
-	if(processor_hdmi_out1_source == VIDEO_IN_HDMI_IN1)
-		hdmi_out1_core_initiator_base_write(hdmi_in1_framebuffer_base(hdmi_in1_fb_index));
+	struct hdmi_in_frame f;
+	int n;
+
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(hdmi_in_sink_frame(n, &f) && !f.compressed)
+			hb_service(f.base);
+	}
 #endif
-	if(processor_hdmi_out1_source == VIDEO_IN_PATTERN)
-		hdmi_out1_core_initiator_base_write(pattern_framebuffer_base());
+	hb_service(pattern_framebuffer_base());
+}
+
+#ifdef CSR_SCALER_BASE
+static int processor_scaler_used(void)
+{
+	return processor_hdmi_out0_source == VIDEO_IN_SCALER
+		|| processor_hdmi_out1_source == VIDEO_IN_SCALER
+		|| processor_encoder_source == VIDEO_IN_SCALER
+		|| processor_rawvideo_source == VIDEO_IN_SCALER;
+}
 #endif
 
+void processor_set_compression(int enable) {
+	processor_compression = enable;
+}
 
+#ifdef CSR_HDMI_IN0_BASE
+/* Only the HDMI outputs decode compressed frames: the other direct sinks,
+ * and the heartbeat drawing into the frames, read them as they are */
+static int processor_input_uncompressed(int n)
+{
+	int source = processor_hdmi_in_source(n);
+
+	if(hb_get_status())
+		return 1;
 #ifdef ENCODER_BASE
-	/*  encoder */
+	if(encoder_enabled && processor_encoder_source == source)
+		return 1;
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+	if(rawvideo_enabled && processor_rawvideo_source == source)
+		return 1;
+#endif
+	return 0;
+}
+#endif
+
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+/* The scaler does not decode them either */
+static int processor_input_compressible(int n)
+{
+	if(!processor_compression || processor_input_uncompressed(n))
+		return 0;
+#ifdef CSR_SCALER_BASE
+	if(processor_scaler_used()
+	   && processor_scaler_source == processor_hdmi_in_source(n))
+		return 0;
+#endif
+	return 1;
+}
+#endif
+
+#if defined(CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR) || defined(CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR)
+/* Blocks per line to decode a frame with, 0 to read it as it is. The
+ * inputs only show the sinks frames of the output mode, so that the
+ * output reads exactly one frame of pixels. */
+static int processor_frame_blocks(int compressed)
+{
+	return compressed ? processor_h_active / FRAMEBUFFER_BLOCK_PIXELS : 0;
+}
+
+struct processor_bandwidth {
+	unsigned int reads, pixels;
+	int reads_permille; /* of the pixels output, last second */
+};
+
+static void processor_bandwidth_sample(struct processor_bandwidth *b, unsigned int reads, unsigned int pixels)
+{
+	unsigned int r = reads - b->reads;
+	unsigned int p = pixels - b->pixels;
+
+	b->reads = reads;
+	b->pixels = pixels;
+	b->reads_permille = p >= 1000 ? r/(p/1000) : 1000;
+}
+#endif
+
+#ifdef CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR
+static struct processor_bandwidth processor_hdmi_out0_bandwidth;
+#endif
+#ifdef CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR
+static struct processor_bandwidth processor_hdmi_out1_bandwidth;
+#endif
+
+static void processor_compression_service(void)
+{
+#if defined(CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR) || defined(CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR)
+	static int last_event;
+
+	if(!elapsed(&last_event, SYSTEM_CLOCK_FREQUENCY))
+		return;
+#endif
+#ifdef CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR
+	processor_bandwidth_sample(&processor_hdmi_out0_bandwidth,
+		hdmi_out0_compression_reads_read(), hdmi_out0_compression_pixels_read());
+#endif
+#ifdef CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR
+	processor_bandwidth_sample(&processor_hdmi_out1_bandwidth,
+		hdmi_out1_compression_reads_read(), hdmi_out1_compression_pixels_read());
+#endif
+}
+
+void processor_print_compression(void)
+{
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	int n, permille;
+#endif
+
+	wprintf("compression: %s", processor_compression ? "on" : "off");
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		if(!hdmi_in_compressed(n))
+			continue;
+		permille = hdmi_in_compression_writes(n);
+		wprintf(", input%d writes %d.%d%%", n, permille/10, permille%10);
+	}
+#endif
+#ifdef CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR
+	if(hdmi_out0_compression_enable_read())
+		wprintf(", output0 reads %d.%d%%",
+			processor_hdmi_out0_bandwidth.reads_permille/10,
+			processor_hdmi_out0_bandwidth.reads_permille%10);
+#endif
+#ifdef CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR
+	if(hdmi_out1_compression_enable_read())
+		wprintf(", output1 reads %d.%d%%",
+			processor_hdmi_out1_bandwidth.reads_permille/10,
+			processor_hdmi_out1_bandwidth.reads_permille%10);
+#endif
+	wputchar('\n');
+}
+
+void processor_update(void)
+{
+	fb_ptrdiff_t fb;
+	int compressed;
+#if defined(CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR) || defined(CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR)
+	int blocks;
+#endif
 #ifdef CSR_HDMI_IN0_BASE
-	if(processor_encoder_source == VIDEO_IN_HDMI_IN0) {
-		encoder_reader_base_write(hdmi_in0_framebuffer_base(hdmi_in0_fb_index));
+	int n;
+
+	for(n = 0; n < HDMI_IN_MAX; n++) {
+		hdmi_in_set_sink_format(n, processor_h_active, processor_v_active,
+			processor_input_uncompressed(n));
+#ifdef CSR_HDMI_IN0_DMA_COMPRESSION_ENABLE_ADDR
+		hdmi_in_set_compression(n, processor_input_compressible(n));
+#endif
 	}
 #endif
-#ifdef CSR_HDMI_IN1_BASE
-	if(processor_encoder_source == VIDEO_IN_HDMI_IN1) {
-		encoder_reader_base_write(hdmi_in1_framebuffer_base(hdmi_in1_fb_index));
+
+#ifdef CSR_HDMI_OUT0_BASE
+	/*  hdmi_out0 */
+	if(processor_source_framebuffer(processor_hdmi_out0_source, &fb, &compressed)) {
+		hdmi_out0_core_initiator_base_write(fb);
+#ifdef CSR_HDMI_OUT0_COMPRESSION_ENABLE_ADDR
+		blocks = processor_frame_blocks(compressed);
+		hdmi_out0_compression_blocks_write(blocks);
+		hdmi_out0_compression_index_write(FRAMEBUFFER_INDEX_OFFSET);
+		hdmi_out0_compression_enable_write(blocks != 0);
+#endif
 	}
 #endif
-	if(processor_encoder_source == VIDEO_IN_PATTERN)
-		encoder_reader_base_write(pattern_framebuffer_base());
+
+#ifdef CSR_HDMI_OUT1_BASE
+	/*  hdmi_out1 */
+	if(processor_source_framebuffer(processor_hdmi_out1_source, &fb, &compressed)) {
+		hdmi_out1_core_initiator_base_write(fb);
+#ifdef CSR_HDMI_OUT1_COMPRESSION_ENABLE_ADDR
+		blocks = processor_frame_blocks(compressed);
+		hdmi_out1_compression_blocks_write(blocks);
+		hdmi_out1_compression_index_write(FRAMEBUFFER_INDEX_OFFSET);
+		hdmi_out1_compression_enable_write(blocks != 0);
+#endif
+	}
+#endif
+
+
+#ifdef ENCODER_BASE
+	/*  encoder */
+	if(processor_source_framebuffer(processor_encoder_source, &fb, &compressed)
+	   && !compressed)
+		encoder_reader_base_write(fb);
+#endif
+
+#ifdef CSR_RAWVIDEO_BASE
+	/*  raw video */
+	if(processor_source_framebuffer(processor_rawvideo_source, &fb, &compressed)
+	   && !compressed)
+		rawvideo_base_write(fb);
 #endif
 
+	processor_heartbeat();
+}
+
+#ifdef CSR_SCALER_BASE
+/* Scale the frames of the scaler source to the output mode while a sink
+ * shows them, returns 1 on a new scaled frame */
+static int processor_scaler_service(void)
+{
+	fb_ptrdiff_t fb;
+	int compressed;
+	int hres = processor_h_active;
+	int vres = processor_v_active;
 #ifdef CSR_HDMI_IN0_BASE
-	hb_service(hdmi_in0_framebuffer_base(hdmi_in0_fb_index));
+	struct hdmi_in_frame f;
+	int n;
 #endif
-#ifdef CSR_HDMI_IN1_BASE
-	hb_service(hdmi_in1_framebuffer_base(hdmi_in1_fb_index));
+
+	if(!processor_scaler_used() || processor_scaler_source == VIDEO_IN_SCALER)
+		return 0;
+#ifdef CSR_HDMI_IN0_BASE
+	/* the scaler reads the last frame at the size it was captured at,
+	 * once it is stored uncompressed */
+	n = processor_source_hdmi_in(processor_scaler_source);
+	if(n >= 0) {
+		if(!hdmi_in_current_frame(n, &f) || f.compressed)
+			return 0;
+		fb = f.base;
+		if(f.hres != 0 && f.vres != 0) {
+			hres = f.hres;
+			vres = f.vres;
+		}
+	} else
 #endif
-	hb_service(pattern_framebuffer_base());
+	if(!processor_source_framebuffer(processor_scaler_source, &fb, &compressed))
+		return 0;
+	return scaler_service(fb, hres, vres, processor_h_active, processor_v_active);
 }
+#endif
 
 void processor_service(void)
 {
 	const struct video_timing *m = &video_modes[processor_mode];
+#if defined(CSR_HDMI_IN0_BASE) || defined(CSR_SCALER_BASE)
+	int frames = 0;
+#endif
+
 #ifdef CSR_HDMI_IN0_BASE
-	hdmi_in0_service(m->pixel_clock);
+	frames += hdmi_in_service(m->pixel_clock);
 #endif
-#ifdef CSR_HDMI_IN1_BASE
-	hdmi_in1_service(m->pixel_clock);
+#ifdef CSR_SCALER_BASE
+	frames += processor_scaler_service();
 #endif
+#if defined(CSR_HDMI_IN0_BASE) || defined(CSR_SCALER_BASE)
+	/* the sinks only need to move on to a new frame, the input ISR
+	 * and the scaler leave that to us */
+	if(frames)
+		processor_update();
+	else
+		processor_heartbeat();
+#else
 	processor_update();
+#endif
 #ifdef ENCODER_BASE
 	encoder_service();
 #endif
-
+#ifdef CSR_RAWVIDEO_BASE
+	rawvideo_service();
+#endif
+	processor_compression_service();
 }
 
 struct video_timing* processor_get_custom_mode(void)
@@ -47,13 +47,18 @@ enum {
 enum {
 	VIDEO_IN_HDMI_IN0=0,
 	VIDEO_IN_HDMI_IN1,
-	VIDEO_IN_PATTERN
+	VIDEO_IN_PATTERN,
+	/* after the pattern, so that saved sources keep their meaning */
+	VIDEO_IN_HDMI_IN2,
+	VIDEO_IN_HDMI_IN3,
+	VIDEO_IN_SCALER
 };
 
 enum {
 	VIDEO_OUT_HDMI_OUT0=0,
 	VIDEO_OUT_HDMI_OUT1,
-	VIDEO_OUT_ENCODER
+	VIDEO_OUT_ENCODER,
+	VIDEO_OUT_RAWVIDEO
 };
 
 extern int processor_mode;
@@ -64,6 +69,9 @@ int processor_refresh;
 int processor_hdmi_out0_source;
 int processor_hdmi_out1_source;
 int processor_encoder_source;
+int processor_rawvideo_source;
+int processor_scaler_source;
+int processor_compression;
 char processor_buffer[16];
 
 void processor_list_modes(char *mode_descriptors);
@@ -73,7 +81,15 @@ void processor_start(int mode);
 void processor_set_hdmi_out0_source(int source);
 void processor_set_hdmi_out1_source(int source);
 void processor_set_encoder_source(int source);
+void processor_set_rawvideo_source(int source);
+void processor_set_scaler_source(int source);
+/* store the HDMI inputs compressed while only the HDMI outputs read them */
+void processor_set_compression(int enable);
+void processor_print_compression(void);
 char* processor_get_source_name(int source);
+/* HDMI input number of a video source, -1 if it is not an HDMI input */
+int processor_source_hdmi_in(int source);
+int processor_hdmi_in_source(int n);
 void processor_update(void);
 void processor_service(void);
 struct video_timing* processor_get_custom_mode(void);
@@ -0,0 +1,110 @@
+#include <generated/csr.h>
+#ifdef CSR_RAWVIDEO_BASE
+
+#include <stdio.h>
+#include <time.h>
+
+#include "ethernet.h"
+#include "processor.h"
+#include "rawvideo.h"
+#include "stdio_wrap.h"
+
+void rawvideo_init(const unsigned char *mac_addr, const unsigned char *ip_addr)
+{
+	const unsigned char broadcast_ip[4] = {255, 255, 255, 255};
+
+	rawvideo_enable(0);
+	rawvideo_set_fps(30);
+	rawvideo_src_mac_write(ethernet_mac_to_u64(mac_addr));
+	rawvideo_src_ip_write(ethernet_ip_to_u32(ip_addr));
+	rawvideo_src_port_write(RAWVIDEO_DEFAULT_PORT);
+	rawvideo_set_destination(broadcast_ip, RAWVIDEO_DEFAULT_PORT, NULL);
+	rawvideo_set_payload_size(RAWVIDEO_PAYLOAD_SIZE_DEFAULT);
+}
+
+void rawvideo_enable(char enable)
+{
+	rawvideo_enabled = enable;
+}
+
+int rawvideo_set_fps(int fps)
+{
+	if(fps <= 0 || fps > 60) {
+		wprintf("Unsupported raw video fps (1 to 60)\n");
+		return 0;
+	}
+	rawvideo_target_fps = fps;
+	return 1;
+}
+
+void rawvideo_set_destination(const unsigned char *ip_addr, unsigned short port, const unsigned char *mac_addr)
+{
+	unsigned char mac[6];
+
+	if(!mac_addr) {
+		ethernet_ip_to_mac(ip_addr, mac);
+		mac_addr = mac;
+	}
+	rawvideo_dst_mac_write(ethernet_mac_to_u64(mac_addr));
+	rawvideo_dst_ip_write(ethernet_ip_to_u32(ip_addr));
+	rawvideo_dst_port_write(port);
+}
+
+int rawvideo_set_payload_size(int size)
+{
+	if(size < 64 || size > RAWVIDEO_PAYLOAD_SIZE_MAX || (size & 3)) {
+		wprintf("Unsupported raw video payload size (multiple of 4, 64 to %d)\n",
+			RAWVIDEO_PAYLOAD_SIZE_MAX);
+		return 0;
+	}
+	rawvideo_payload_size_write(size);
+	return 1;
+}
+
+/* Frames are sent back to back up to the target fps. The framebuffer base
+ * follows the video matrix (see processor_update). */
+void rawvideo_service(void)
+{
+	static int last_event;
+	static int last_fps_event;
+	static int frame_cnt;
+	static int can_start;
+
+	if(!rawvideo_enabled)
+		return;
+
+	if(elapsed(&last_event, SYSTEM_CLOCK_FREQUENCY/rawvideo_target_fps))
+		can_start = 1;
+	if(can_start && rawvideo_done_read()) {
+		rawvideo_h_active_write(processor_h_active);
+		rawvideo_v_active_write(processor_v_active);
+		rawvideo_start_write(1);
+		can_start = 0;
+		frame_cnt++;
+	}
+	if(elapsed(&last_fps_event, SYSTEM_CLOCK_FREQUENCY)) {
+		rawvideo_fps = frame_cnt;
+		frame_cnt = 0;
+	}
+}
+
+void rawvideo_status(void)
+{
+	unsigned int ip = rawvideo_dst_ip_read();
+
+	wprintf("rawvideo: ");
+	if(rawvideo_enabled)
+		wprintf("%dx%d@%dfps from %s to %d.%d.%d.%d:%d, %d frames, %d packets\n",
+			processor_h_active,
+			processor_v_active,
+			rawvideo_fps,
+			processor_get_source_name(processor_rawvideo_source),
+			(ip >> 24) & 0xff, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff,
+			rawvideo_dst_port_read(),
+			rawvideo_frames_read(),
+			rawvideo_packets_read());
+	else
+		wprintf("off\n");
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __RAWVIDEO_H
+#define __RAWVIDEO_H
+
+#define RAWVIDEO_DEFAULT_PORT 6000
+
+/* Payload sizes must be a multiple of 4 bytes and fit a 1500 byte MTU
+ * with the IP/UDP and raw video headers (20 + 8 + 14). */
+#define RAWVIDEO_PAYLOAD_SIZE_DEFAULT 1280
+#define RAWVIDEO_PAYLOAD_SIZE_MAX 1456
+
+char rawvideo_enabled;
+int rawvideo_target_fps;
+int rawvideo_fps;
+
+void rawvideo_init(const unsigned char *mac_addr, const unsigned char *ip_addr);
+void rawvideo_enable(char enable);
+int rawvideo_set_fps(int fps);
+void rawvideo_set_destination(const unsigned char *ip_addr, unsigned short port, const unsigned char *mac_addr);
+int rawvideo_set_payload_size(int size);
+void rawvideo_service(void);
+void rawvideo_status(void);
+
+#endif
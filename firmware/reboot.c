@@ -6,6 +6,7 @@
 #include <uart.h>
 
 #include "reboot.h"
+#include "stdio_wrap.h"
 
 #ifndef CONFIG_CPU_RESET_ADDR
 #define CONFIG_CPU_RESET_ADDR 0
@@ -21,6 +22,7 @@ void reboot(void)
 
 void __attribute__((noreturn)) boot(unsigned int r1, unsigned int r2, unsigned int r3, unsigned int addr)
 {
+	stdio_flush();
 	printf("Booting program at 0x%x.\n", addr);
 	uart_sync();
 	irq_setmask(0);
@@ -0,0 +1,78 @@
+#include <generated/csr.h>
+#ifdef CSR_RTP_BASE
+
+#include <stdio.h>
+
+#include "encoder.h"
+#include "ethernet.h"
+#include "processor.h"
+#include "rtp.h"
+#include "stdio_wrap.h"
+
+void rtp_init(const unsigned char *mac_addr, const unsigned char *ip_addr)
+{
+	const unsigned char broadcast_ip[4] = {255, 255, 255, 255};
+
+	rtp_enable(0);
+	rtp_src_mac_write(ethernet_mac_to_u64(mac_addr));
+	rtp_src_ip_write(ethernet_ip_to_u32(ip_addr));
+	rtp_src_port_write(RTP_DEFAULT_PORT);
+	rtp_set_destination(broadcast_ip, RTP_DEFAULT_PORT, NULL);
+	rtp_set_payload_size(RTP_PAYLOAD_SIZE_DEFAULT);
+	/* Baseline 4:2:2, quantization tables sent in-band */
+	rtp_jpeg_type_write(0);
+	rtp_jpeg_q_write(255);
+}
+
+void rtp_enable(char enable)
+{
+	rtp_enabled = enable;
+	rtp_enable_write(enable);
+}
+
+void rtp_set_destination(const unsigned char *ip_addr, unsigned short port, const unsigned char *mac_addr)
+{
+	unsigned char mac[6];
+
+	if(!mac_addr) {
+		ethernet_ip_to_mac(ip_addr, mac);
+		mac_addr = mac;
+	}
+	rtp_dst_mac_write(ethernet_mac_to_u64(mac_addr));
+	rtp_dst_ip_write(ethernet_ip_to_u32(ip_addr));
+	rtp_dst_port_write(port);
+}
+
+int rtp_set_payload_size(int size)
+{
+	if(size < 64 || size > RTP_PAYLOAD_SIZE_MAX) {
+		wprintf("Unsupported RTP payload size (64 to %d)\n", RTP_PAYLOAD_SIZE_MAX);
+		return 0;
+	}
+	rtp_payload_size_write(size);
+	return 1;
+}
+
+void rtp_service(void)
+{
+	/* RFC 2435 encodes the frame size in 8 pixel blocks */
+	rtp_jpeg_width_write(processor_h_active/8);
+	rtp_jpeg_height_write(processor_v_active/8);
+}
+
+void rtp_status(void)
+{
+	unsigned int ip = rtp_dst_ip_read();
+
+	wprintf("rtp: ");
+	if(rtp_enabled)
+		wprintf("%d.%d.%d.%d:%d, %d frames, %d packets\n",
+			(ip >> 24) & 0xff, (ip >> 16) & 0xff, (ip >> 8) & 0xff, ip & 0xff,
+			rtp_dst_port_read(),
+			rtp_frames_read(),
+			rtp_packets_read());
+	else
+		wprintf("off\n");
+}
+
+#endif
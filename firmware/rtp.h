@@ -0,0 +1,20 @@
+#ifndef __RTP_H
+#define __RTP_H
+
+#define RTP_DEFAULT_PORT 5004
+
+/* RTP/JPEG payload sizes must fit a 1500 byte MTU with the IP/UDP/RTP,
+ * RTP/JPEG and quantization table headers (20 + 8 + 12 + 8 + 132). */
+#define RTP_PAYLOAD_SIZE_DEFAULT 1024
+#define RTP_PAYLOAD_SIZE_MAX 1320
+
+char rtp_enabled;
+
+void rtp_init(const unsigned char *mac_addr, const unsigned char *ip_addr);
+void rtp_enable(char enable);
+void rtp_set_destination(const unsigned char *ip_addr, unsigned short port, const unsigned char *mac_addr);
+int rtp_set_payload_size(int size);
+void rtp_service(void);
+void rtp_status(void);
+
+#endif
@@ -0,0 +1,98 @@
+#include <generated/csr.h>
+#ifdef CSR_SCALER_BASE
+
+#include "scaler.h"
+#include "stdio_wrap.h"
+
+static int scaler_busy;
+static int scaler_fb; /* frame buffer shown */
+static unsigned int scaler_frames;
+
+/* last pass */
+static fb_ptrdiff_t scaler_src;
+static int scaler_hres, scaler_vres;
+static int scaler_dst_hres, scaler_dst_vres;
+
+static fb_ptrdiff_t scaler_fb_base(int fb)
+{
+	return FRAMEBUFFER_SCALER(fb);
+}
+
+void scaler_set_coefficients(int phase, int tap0, int tap1)
+{
+	scaler_coeff_index_write(phase);
+	scaler_coeff_tap0_write(tap0);
+	scaler_coeff_tap1_write(tap1);
+	scaler_coeff_write_write(1);
+}
+
+void scaler_load_bilinear(void)
+{
+	int phase, tap1;
+
+	for(phase = 0; phase < SCALER_PHASES; phase++) {
+		tap1 = phase*SCALER_TAP_ONE/SCALER_PHASES;
+		scaler_set_coefficients(phase, SCALER_TAP_ONE - tap1, tap1);
+	}
+}
+
+void scaler_init(void)
+{
+	scaler_load_bilinear();
+	scaler_busy = 0;
+	scaler_fb = 0;
+	scaler_src = 0;
+	scaler_hres = scaler_vres = 0;
+}
+
+int scaler_service(fb_ptrdiff_t src, int hres, int vres, int dst_hres, int dst_vres)
+{
+	int ready = 0;
+
+	if(scaler_busy) {
+		if(!scaler_done_read())
+			return 0;
+		scaler_busy = 0;
+		scaler_fb = (scaler_fb + 1) % SCALER_FRAMEBUFFERS;
+		scaler_frames++;
+		ready = 1;
+	}
+
+	if(src == scaler_src && hres == scaler_hres && vres == scaler_vres
+	  && dst_hres == scaler_dst_hres && dst_vres == scaler_dst_vres)
+		return ready;
+	if(hres <= 0 || vres <= 0 || dst_hres <= 0 || dst_vres <= 0)
+		return ready;
+
+	scaler_src_base_write(src);
+	scaler_src_hres_write(hres);
+	scaler_src_vres_write(vres);
+	scaler_dst_base_write(scaler_fb_base((scaler_fb + 1) % SCALER_FRAMEBUFFERS));
+	scaler_dst_hres_write(dst_hres);
+	scaler_dst_vres_write(dst_vres);
+	scaler_h_step_write(((unsigned int)hres << 16)/dst_hres);
+	scaler_v_step_write(((unsigned int)vres << 16)/dst_vres);
+	scaler_start_write(1);
+	scaler_busy = 1;
+
+	scaler_src = src;
+	scaler_hres = hres;
+	scaler_vres = vres;
+	scaler_dst_hres = dst_hres;
+	scaler_dst_vres = dst_vres;
+	return ready;
+}
+
+fb_ptrdiff_t scaler_framebuffer(void)
+{
+	return scaler_fb_base(scaler_fb);
+}
+
+void scaler_print_status(void)
+{
+	wprintf("scaler:  %dx%d -> %dx%d, %u frames%s\n",
+		scaler_hres, scaler_vres, scaler_dst_hres, scaler_dst_vres,
+		scaler_frames, scaler_busy ? " (busy)" : "");
+}
+
+#endif
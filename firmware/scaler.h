@@ -0,0 +1,26 @@
+#ifndef __SCALER_H
+#define __SCALER_H
+
+#include "framebuffer.h"
+
+/*
+ * Frame buffer scaler (gateware/scaler.py). It scales the frames of one
+ * video source to the output mode into its own frame buffers, which the
+ * sinks show as the "scaler" video source.
+ */
+
+#define SCALER_PHASES		16
+#define SCALER_TAP_ONE		256
+#define SCALER_FRAMEBUFFERS	2
+
+void scaler_init(void);
+void scaler_set_coefficients(int phase, int tap0, int tap1);
+/* linear ramp: bilinear scaling */
+void scaler_load_bilinear(void);
+/* Starts scaling 'src' when the scaler is free and 'src' or the geometry
+ * changed since the last pass, returns 1 when a new frame is ready */
+int scaler_service(fb_ptrdiff_t src, int hres, int vres, int dst_hres, int dst_vres);
+fb_ptrdiff_t scaler_framebuffer(void);
+void scaler_print_status(void);
+
+#endif /* __SCALER_H */
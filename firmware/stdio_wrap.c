@@ -1,93 +1,234 @@
-#include <assert.h>
 #include <console.h>
+#include <irq.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <uart.h>
 
+#include <generated/csr.h>
 #include <generated/mem.h> // Needed for ETHMAC_BASE
 
 #include "telnet.h"
 
 #include "stdio_wrap.h"
 
-/* Transform LF -> CRLF in s, putting the result in stdio_write_buffer
- */
-char *translate_crlf(const char *s, int trailing_lf) {
-	assert(tailing_lf == 0 || trailing_lf == 1);
-	char *out = stdio_write_buffer;
-	char *end = stdio_write_buffer + STDIO_BUFFER_SIZE - 2 - trailing_lf;
-	while (*s != '\0' && out < end) {
-		if (*s == '\n') {
-			assert(out < end);
-			*out++ = '\r';
-		}
-		assert(out < end);
-		*out++ = *s++;
+#define STDIO_SINK_UART 0
+#ifdef ETHMAC_BASE
+#define STDIO_SINK_TELNET 1
+#define STDIO_SINKS (1 + TELNET_SESSIONS)
+/* so that a command's output fits in a ring and its socket's TX buffer
+ * before the main loop sends it */
+#if STDIO_SINK_BUFFER_SIZE < TELNET_BUFFER_SIZE_TX
+#error "STDIO_SINK_BUFFER_SIZE is smaller than TELNET_BUFFER_SIZE_TX"
+#endif
+#else
+#define STDIO_SINKS 1
+#endif
+
+#define STDIO_UART_CHUNK_PERIOD \
+	(SYSTEM_CLOCK_FREQUENCY/(STDIO_UART_BAUDRATE/10)*STDIO_UART_CHUNK)
+
+struct stdio_sink {
+	char buf[STDIO_SINK_BUFFER_SIZE];
+	unsigned int produce;
+	unsigned int consume;
+	unsigned int dropped;
+};
+
+static struct stdio_sink stdio_sinks[STDIO_SINKS];
+static int stdio_async;
+
+static int stdio_sink_active(int n)
+{
+#ifdef ETHMAC_BASE
+	if(n >= STDIO_SINK_TELNET)
+		return telnet_session_active(n - STDIO_SINK_TELNET);
+#endif
+	return 1;
+}
+
+static unsigned int stdio_sink_free(struct stdio_sink *sink)
+{
+	return STDIO_SINK_BUFFER_SIZE - 1 - ((sink->produce - sink->consume) & STDIO_SINK_BUFFER_MASK);
+}
+
+/* Hand out the UART data already queued, 'max' bytes at most */
+static void stdio_uart_drain(unsigned int max)
+{
+	struct stdio_sink *sink = &stdio_sinks[STDIO_SINK_UART];
+
+	while(max-- && sink->consume != sink->produce) {
+		putchar(sink->buf[sink->consume]);
+		sink->consume = (sink->consume + 1) & STDIO_SINK_BUFFER_MASK;
 	}
-	if (trailing_lf) {
-		*out++ = '\r';
+}
+
+#ifdef ETHMAC_BASE
+/* Send the contiguous data queued for a telnet session, the socket takes
+ * what fits in its TX buffer */
+static void stdio_telnet_drain(int n)
+{
+	struct stdio_sink *sink = &stdio_sinks[n];
+	unsigned int produce, len;
+	int sent;
+
+	if(!stdio_sink_active(n)) {
+		/* a new session starts with an empty buffer */
+		sink->consume = sink->produce;
+		return;
+	}
+	while(sink->consume != sink->produce) {
+		produce = sink->produce;
+		if(produce > sink->consume)
+			len = produce - sink->consume;
+		else
+			len = STDIO_SINK_BUFFER_SIZE - sink->consume;
+		sent = telnet_write(n - STDIO_SINK_TELNET, &sink->buf[sink->consume], len);
+		if(sent <= 0)
+			break;
+		sink->consume = (sink->consume + sent) & STDIO_SINK_BUFFER_MASK;
 	}
-	*out++ = '\0';
-	return stdio_write_buffer;
 }
+#endif
 
-int wputs(const char *s)
+/* Interrupt handlers may write too: queue with interrupts disabled. A
+ * full ring is drained to make room with interrupts enabled only, as the
+ * UART driver needs its interrupt and the network stack is not
+ * reentrant: the UART until there is room, a telnet session as far as
+ * its socket TX buffer takes it. */
+static void stdio_sink_put(int n, char c)
 {
-	char *s_crlf = translate_crlf(s, 1);
+	struct stdio_sink *sink = &stdio_sinks[n];
+	unsigned int ie;
+
+	ie = irq_getie();
+	if(n == STDIO_SINK_UART && ie) {
+		while(stdio_sink_free(sink) == 0)
+			stdio_uart_drain(STDIO_UART_CHUNK);
+	}
 #ifdef ETHMAC_BASE
-	if(telnet_active)
-		telnet_puts(s_crlf);
-	else
+	if(n >= STDIO_SINK_TELNET && ie && stdio_sink_free(sink) == 0)
+		stdio_telnet_drain(n);
 #endif
-		puts(s_crlf);
-	return 0;
+	irq_setie(0);
+	if(stdio_sink_free(sink) == 0) {
+		sink->dropped++;
+	} else {
+		sink->buf[sink->produce] = c;
+		sink->produce = (sink->produce + 1) & STDIO_SINK_BUFFER_MASK;
+	}
+	irq_setie(ie);
 }
 
-int wputchar(int c)
+/* Queue 'len' bytes (or up to the NUL if len < 0) to all the active
+ * sinks, with LF -> CRLF */
+static void stdio_write(const char *s, int len)
 {
-#ifdef ETHMAC_BASE
-	if(telnet_active) {
-		if(c == '\n') {
-			telnet_putchar('\r');
-		}
-		telnet_putchar(c);
-	} else {
-#endif
-		if(c == '\n') {
-			putchar('\r');
+	int i, n;
+
+	for(n = 0; n < STDIO_SINKS; n++) {
+		if(!stdio_sink_active(n))
+			continue;
+		for(i = 0; len < 0 ? s[i] != '\0' : i < len; i++) {
+			if(s[i] == '\n')
+				stdio_sink_put(n, '\r');
+			stdio_sink_put(n, s[i]);
 		}
-		putchar(c);
-#ifdef ETHMAC_BASE
 	}
-#endif
+	if(!stdio_async && irq_getie())
+		stdio_uart_drain(STDIO_SINK_BUFFER_SIZE);
+}
+
+int wputs(const char *s)
+{
+	stdio_write(s, -1);
+	stdio_write("\n", 1);
+	return 0;
+}
+
+int wputchar(int c)
+{
+	char ch = c;
+
+	stdio_write(&ch, 1);
 	return 0;
 }
 
-int wprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int wvprintf(const char *fmt, va_list args)
+{
+	char buf[STDIO_BUFFER_SIZE];
+	int len;
+
+	len = vscnprintf(buf, sizeof(buf), fmt, args);
+	stdio_write(buf, len);
+	return len;
+}
+
 int wprintf(const char *fmt, ...)
 {
 	int len;
 	va_list args;
-	va_start(args, fmt);
 
-	char *fmt_crlf = translate_crlf(fmt, 0);
-
-#ifdef ETHMAC_BASE
-	if(telnet_active)
-		len = telnet_vprintf(fmt_crlf, args);
-	else
-#endif
-		len = vprintf(fmt_crlf, args);
+	va_start(args, fmt);
+	len = wvprintf(fmt, args);
 	va_end(args);
 	return len;
 }
 
 void wputsnonl(const char *s)
 {
+	stdio_write(s, -1);
+}
+
+void stdio_async_enable(void)
+{
+	stdio_async = 1;
+}
+
+void stdio_service(void)
+{
+	static int last_event;
 #ifdef ETHMAC_BASE
-	if(telnet_active)
-		telnet_putsnonl(s);
-	else
+	int n;
+
+	for(n = STDIO_SINK_TELNET; n < STDIO_SINKS; n++)
+		stdio_telnet_drain(n);
 #endif
-		putsnonl(s);
+	/* at the line rate so the UART driver never makes us wait */
+	if(elapsed(&last_event, STDIO_UART_CHUNK_PERIOD))
+		stdio_uart_drain(STDIO_UART_CHUNK);
+}
+
+void stdio_flush(void)
+{
+	stdio_uart_drain(STDIO_SINK_BUFFER_SIZE);
+	uart_sync();
+}
+
+void stdio_print_status(void)
+{
+	unsigned int dropped[STDIO_SINKS];
+	unsigned int used[STDIO_SINKS];
+	unsigned int ie;
+	int n;
+
+	/* snapshot first: printing changes the rings */
+	ie = irq_getie();
+	irq_setie(0);
+	for(n = 0; n < STDIO_SINKS; n++) {
+		dropped[n] = stdio_sinks[n].dropped;
+		used[n] = STDIO_SINK_BUFFER_SIZE - 1 - stdio_sink_free(&stdio_sinks[n]);
+	}
+	irq_setie(ie);
+
+	for(n = 0; n < STDIO_SINKS; n++) {
+		if(n == STDIO_SINK_UART)
+			wprintf("uart:    ");
+		else
+			wprintf("telnet%d: ", n - 1);
+		wprintf("%s, %u/%u bytes queued, %u dropped\n",
+			stdio_sink_active(n) ? "active" : "inactive",
+			used[n], STDIO_SINK_BUFFER_SIZE - 1, dropped[n]);
+	}
 }
@@ -1,14 +1,38 @@
 #include <stdarg.h>
 
+/* Console output goes to every sink at once: the UART and each connected
+ * telnet session. wprintf() and friends format once, translate LF -> CRLF
+ * and queue the result in per-sink ring buffers, which stdio_service()
+ * drains from the main loop. Writes never wait for a sink, so they are
+ * safe from interrupt handlers: when a ring is full, the UART is drained
+ * synchronously and telnet rings are pushed into their socket outside of
+ * interrupt handlers, otherwise the data is dropped and counted.
+ */
+
 #define STDIO_BUFFER_SIZE 256
-char stdio_write_buffer[STDIO_BUFFER_SIZE];
 
-char *translate_crlf(const char *s, int trailing_lf);
+/* at least TELNET_BUFFER_SIZE_TX */
+#define STDIO_SINK_BUFFER_SIZE 4096
+#define STDIO_SINK_BUFFER_MASK (STDIO_SINK_BUFFER_SIZE-1)
+
+#define STDIO_UART_BAUDRATE 115200
+/* bytes handed to the UART driver per chunk period, at most the size of
+ * its TX ring so that putchar() never waits */
+#define STDIO_UART_CHUNK 32
 
 int wputs(const char *s);
 int wputchar(int c);
 int wprintf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int wvprintf(const char *fmt, va_list args);
 void wputsnonl(const char *s);
 
+/* Until this is called (when entering the main loop), the UART is drained
+ * on every write so early messages keep their order with printf(). */
+void stdio_async_enable(void);
+void stdio_service(void);
+/* Blocking drain of the UART, e.g. before a reboot */
+void stdio_flush(void);
+void stdio_print_status(void);
+
 int sprintf(char *str, const char *format, ...)  __attribute__((format(printf, 2, 3)));
 int snprintf(char *str, size_t size, const char *format, ...)  __attribute__((format(printf, 3, 4)));
@@ -0,0 +1,126 @@
+#include <string.h>
+#include <time.h>
+
+#include <generated/csr.h>
+#include <generated/mem.h>
+
+#include "encoder.h"
+#include "ethernet.h"
+#include "hdmi_in.h"
+#include "processor.h"
+#include "rawvideo.h"
+#include "rtp.h"
+#include "telemetry.h"
+#include "uptime.h"
+
+/* placed at ORIGIN(sram) by the linker scripts */
+volatile struct telemetry telemetry __attribute__((section(".telemetry")));
+
+#define TELEMETRY_PERIOD	(SYSTEM_CLOCK_FREQUENCY/10)
+
+void telemetry_init(void)
+{
+	memset((void *)&telemetry, 0, sizeof(telemetry));
+	telemetry.version = TELEMETRY_VERSION;
+	telemetry.size = sizeof(telemetry);
+#ifdef CSR_HDMI_OUT0_BASE
+	hdmi_out0_core_underflow_enable_write(1);
+#endif
+#ifdef CSR_HDMI_OUT1_BASE
+	hdmi_out1_core_underflow_enable_write(1);
+#endif
+	/* last, so a host never sees the magic with a stale layout */
+	telemetry.magic = TELEMETRY_MAGIC;
+}
+
+#if defined(CSR_HDMI_OUT0_BASE) || defined(CSR_HDMI_OUT1_BASE)
+static void telemetry_output(volatile struct telemetry_output *t, int enabled, int source)
+{
+	t->flags = TELEMETRY_PRESENT;
+	if(enabled)
+		t->flags |= TELEMETRY_ENABLED;
+	t->hres = processor_h_active;
+	t->vres = processor_v_active;
+	t->refresh = processor_refresh;
+	t->source = source;
+}
+#endif
+
+/* input frame rates, from the frame counters once per second */
+static void telemetry_update_fps(void)
+{
+	static unsigned int last_frames[TELEMETRY_INPUTS];
+	int i;
+
+	for(i = 0; i < TELEMETRY_INPUTS; i++) {
+		telemetry.input[i].fps = telemetry.input[i].frames - last_frames[i];
+		last_frames[i] = telemetry.input[i].frames;
+	}
+}
+
+static void telemetry_update(void)
+{
+#ifdef CSR_HDMI_IN0_BASE
+	int i;
+
+	for(i = 0; i < TELEMETRY_INPUTS; i++)
+		hdmi_in_telemetry(i, &telemetry.input[i]);
+#endif
+
+#ifdef CSR_HDMI_OUT0_BASE
+	telemetry_output(&telemetry.output[0],
+		hdmi_out0_core_initiator_enable_read(),
+		processor_hdmi_out0_source);
+	hdmi_out0_core_underflow_update_write(1);
+	telemetry.output[0].underflows = hdmi_out0_core_underflow_counter_read();
+#endif
+#ifdef CSR_HDMI_OUT1_BASE
+	telemetry_output(&telemetry.output[1],
+		hdmi_out1_core_initiator_enable_read(),
+		processor_hdmi_out1_source);
+	hdmi_out1_core_underflow_update_write(1);
+	telemetry.output[1].underflows = hdmi_out1_core_underflow_counter_read();
+#endif
+
+#ifdef ENCODER_BASE
+	telemetry.encoder.flags = TELEMETRY_PRESENT;
+	if(encoder_enabled)
+		telemetry.encoder.flags |= TELEMETRY_ENABLED;
+	telemetry.encoder.fps = encoder_fps;
+	telemetry.encoder.target_fps = encoder_target_fps;
+	telemetry.encoder.quality = encoder_quality;
+	telemetry.encoder.frame_size = encoder_frame_size;
+#endif
+
+#ifdef ETHMAC_BASE
+	telemetry.network.rx_packets = liteethmac_rx_packets;
+	telemetry.network.rx_bytes = liteethmac_rx_bytes;
+	telemetry.network.tx_packets = liteethmac_tx_packets;
+	telemetry.network.tx_bytes = liteethmac_tx_bytes;
+#endif
+#ifdef CSR_RTP_BASE
+	telemetry.network.rtp_frames = rtp_frames_read();
+	telemetry.network.rtp_packets = rtp_packets_read();
+#endif
+#ifdef CSR_RAWVIDEO_BASE
+	telemetry.network.rawvideo_frames = rawvideo_frames_read();
+	telemetry.network.rawvideo_packets = rawvideo_packets_read();
+#endif
+}
+
+void telemetry_service(void)
+{
+	static int last_event;
+	static int last_fps_event;
+
+	if(!elapsed(&last_event, TELEMETRY_PERIOD))
+		return;
+
+	telemetry.sequence++;
+	telemetry.uptime = uptime();
+	telemetry_update();
+	if(elapsed(&last_fps_event, SYSTEM_CLOCK_FREQUENCY))
+		telemetry_update_fps();
+	telemetry.sequence++;
+	telemetry.sequence_end = telemetry.sequence;
+}
@@ -0,0 +1,93 @@
+#ifndef __TELEMETRY_H
+#define __TELEMETRY_H
+
+#include "hdmi_in.h"
+
+/*
+ * Binary status block, kept up to date by telemetry_service().
+ *
+ * The linker puts it at the start of the "sram" memory region (SRAM_BASE
+ * in mem.h, "sram" in csr.csv), so a host reads everything with a single
+ * Etherbone burst of sizeof(struct telemetry) / 4 words (see
+ * test/test_telemetry.py).
+ *
+ * All fields are 32 bit words: there is no padding and the layout does
+ * not depend on the endianness of the reader. 'sequence' is odd while
+ * the firmware updates the block and 'sequence_end' is written last: a
+ * read is consistent if both are equal and even.
+ *
+ * Bump TELEMETRY_VERSION when the layout changes.
+ */
+
+#define TELEMETRY_MAGIC		0x544c4d59 /* "TLMY" */
+#define TELEMETRY_VERSION	3
+
+#define TELEMETRY_INPUTS	HDMI_IN_MAX
+#define TELEMETRY_OUTPUTS	2
+
+/* flags */
+#define TELEMETRY_PRESENT	0x01 /* in the gateware */
+#define TELEMETRY_ENABLED	0x02 /* capturing / outputting / encoding */
+
+struct telemetry_input {
+	unsigned int flags;
+	unsigned int hres;
+	unsigned int vres;
+	unsigned int freq_khz;
+	unsigned int wer[3];
+	int phase[3];
+	unsigned int frames;
+	unsigned int fps;
+	unsigned int overflows;
+	unsigned int dropped; /* no frame buffer loaded */
+	unsigned int partial; /* wrong length */
+	unsigned int resized; /* capture resolution changes */
+};
+
+struct telemetry_output {
+	unsigned int flags;
+	unsigned int hres;
+	unsigned int vres;
+	unsigned int refresh; /* 1/100 Hz */
+	unsigned int source;
+	unsigned int underflows; /* since the last "status" */
+};
+
+struct telemetry_encoder {
+	unsigned int flags;
+	unsigned int fps;
+	unsigned int target_fps;
+	unsigned int quality;
+	unsigned int frame_size; /* bytes */
+};
+
+struct telemetry_network {
+	unsigned int rx_packets;
+	unsigned int rx_bytes;
+	unsigned int tx_packets;
+	unsigned int tx_bytes;
+	unsigned int rtp_frames;
+	unsigned int rtp_packets;
+	unsigned int rawvideo_frames;
+	unsigned int rawvideo_packets;
+};
+
+struct telemetry {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int size;
+	unsigned int sequence;
+	unsigned int uptime;
+	struct telemetry_input input[TELEMETRY_INPUTS];
+	struct telemetry_output output[TELEMETRY_OUTPUTS];
+	struct telemetry_encoder encoder;
+	struct telemetry_network network;
+	unsigned int sequence_end;
+};
+
+extern volatile struct telemetry telemetry;
+
+void telemetry_init(void);
+void telemetry_service(void);
+
+#endif /* __TELEMETRY_H */
@@ -2,10 +2,10 @@
 // License: BSD
 
 #include <stdio.h>
-#include <stdarg.h>
 
-#include "telnet.h"
 #include "ethernet.h"
+#include "stdio_wrap.h"
+#include "telnet.h"
 
 #define TELNET_RINGBUFFER_SIZE_RX 128
 #define TELNET_RINGBUFFER_MASK_RX (TELNET_RINGBUFFER_SIZE_RX-1)
@@ -14,31 +14,53 @@ static char telnet_rx_buf[TELNET_RINGBUFFER_SIZE_RX];
 static volatile unsigned int telnet_rx_produce;
 static unsigned int telnet_rx_consume;
 
+struct telnet_session {
+	struct tcp_socket socket;
+	uint8_t rx_buffer[TELNET_BUFFER_SIZE_RX];
+	uint8_t tx_buffer[TELNET_BUFFER_SIZE_TX];
+	int connected;
+};
+
+static struct telnet_session telnet_sessions[TELNET_SESSIONS];
+
 void telnet_init(void)
 {
+	struct telnet_session *session;
+	int i;
+
 	telnet_active = 0;
-	tcp_socket_register(&telnet_socket, NULL,
-		telnet_rx_buffer, TELNET_BUFFER_SIZE_RX,
-		telnet_tx_buffer, TELNET_BUFFER_SIZE_TX,
-		(tcp_socket_data_callback_t) telnet_data_callback,
-		(tcp_socket_event_callback_t) telnet_event_callback);
-	tcp_socket_listen(&telnet_socket, TELNET_PORT);
-	printf("Telnet listening on port %d\r\n", TELNET_PORT);
+	/* every session listens on the same port and takes the next client */
+	for(i = 0; i < TELNET_SESSIONS; i++) {
+		session = &telnet_sessions[i];
+		tcp_socket_register(&session->socket, session,
+			session->rx_buffer, TELNET_BUFFER_SIZE_RX,
+			session->tx_buffer, TELNET_BUFFER_SIZE_TX,
+			(tcp_socket_data_callback_t) telnet_data_callback,
+			(tcp_socket_event_callback_t) telnet_event_callback);
+		tcp_socket_listen(&session->socket, TELNET_PORT);
+	}
+	printf("Telnet listening on port %d (%d sessions)\r\n", TELNET_PORT, TELNET_SESSIONS);
 }
 
 int telnet_event_callback(struct tcp_socket *s, void *ptr, tcp_socket_event_t event)
 {
+	struct telnet_session *session = ptr;
+
 	switch(event)
 	{
 		case TCP_SOCKET_CONNECTED:
-			printf("\r\nTelnet connected.\r\n");
-			telnet_active = 1;
+			session->connected = 1;
+			telnet_active++;
+			wprintf("\nTelnet connected (session %d).\n", (int)(session - telnet_sessions));
 			break;
 		case TCP_SOCKET_CLOSED:
 		case TCP_SOCKET_TIMEDOUT:
 		case TCP_SOCKET_ABORTED:
-			printf("\r\nTelnet disconnected.\r\n");
-			telnet_active = 0;
+			if(session->connected) {
+				session->connected = 0;
+				telnet_active--;
+				wprintf("\nTelnet disconnected (session %d).\n", (int)(session - telnet_sessions));
+			}
 		default:
 			break;
 	}
@@ -78,50 +100,12 @@ int telnet_readchar_nonblock(void)
 	return (telnet_rx_consume != telnet_rx_produce);
 }
 
-int telnet_putchar(char c)
+int telnet_session_active(int session)
 {
-	tcp_socket_send(&telnet_socket, (unsigned char *)&c, 1);
-	return c;
+	return telnet_sessions[session].connected;
 }
 
-int telnet_puts(const char *s)
+int telnet_write(int session, const char *buf, int len)
 {
-	while(*s) {
-		telnet_putchar(*s);
-		s++;
-	}
-	telnet_putchar('\n');
-	return 1;
-}
-
-void telnet_putsnonl(const char *s)
-{
-	while(*s) {
-		telnet_putchar(*s);
-		s++;
-	}
-}
-
-#define TELNET_PRINTF_BUFFER_SIZE 256
-
-int telnet_printf(const char *fmt, ...)
-{
-	int len = 0;
-	va_list args;
-	va_start(args, fmt);
-	len = telnet_vprintf(fmt, args);
-	va_end(args);
-	return len;
-}
-
-int telnet_vprintf(const char *fmt, va_list args)
-{
-	int len;
-	char outbuf[TELNET_PRINTF_BUFFER_SIZE];
-
-	len = vscnprintf(outbuf, sizeof(outbuf), fmt, args);
-	outbuf[len] = 0;
-	telnet_putsnonl(outbuf);
-
-	return len;
+	return tcp_socket_send(&telnet_sessions[session].socket, (const uint8_t *)buf, len);
 }
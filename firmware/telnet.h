@@ -4,8 +4,6 @@
 #ifndef __TELNET_H
 #define __TELNET_H
 
-#include <stdarg.h>
-
 #include "contiki.h"
 #include "contiki-net.h"
 
@@ -18,15 +16,13 @@
 #endif
 
 #define TELNET_PORT 23
-#define TELNET_BUFFER_SIZE_RX 4096
+#define TELNET_SESSIONS 2
+#define TELNET_BUFFER_SIZE_RX 1024
 #define TELNET_BUFFER_SIZE_TX 4096
 
+/* number of connected sessions */
 int telnet_active;
 
-struct tcp_socket telnet_socket;
-uint8_t telnet_rx_buffer[TELNET_BUFFER_SIZE_RX];
-uint8_t telnet_tx_buffer[TELNET_BUFFER_SIZE_TX];
-
 void telnet_init(void);
 int telnet_event_callback(struct tcp_socket *s, void *ptr, tcp_socket_event_t event);
 int telnet_data_callback(struct tcp_socket *s, void *ptr, const char *rxbuf, int rxlen);
@@ -34,11 +30,8 @@ int telnet_data_callback(struct tcp_socket *s, void *ptr, const char *rxbuf, int
 char telnet_readchar(void);
 int telnet_readchar_nonblock(void);
 
-int telnet_putchar(char c);
-int telnet_puts(const char *s);
-void telnet_putsnonl(const char *s);
-
-int telnet_vprintf(const char *fmt, va_list argp);
-int telnet_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+int telnet_session_active(int session);
+/* Non blocking, return the number of bytes queued to the session */
+int telnet_write(int session, const char *buf, int len);
 
 #endif
@@ -32,6 +32,11 @@ static ethernet_buffer *txbuffer;
 static ethernet_buffer *txbuffer0;
 static ethernet_buffer *txbuffer1;
 
+unsigned int liteethmac_rx_packets;
+unsigned int liteethmac_rx_bytes;
+unsigned int liteethmac_tx_packets;
+unsigned int liteethmac_tx_bytes;
+
 #ifdef ETHMAC_BASE
 
 #define ETHMAC_RX0_BASE ETHMAC_BASE
@@ -67,6 +72,8 @@ uint16_t liteethmac_poll(void)
       rxbuffer = rxbuffer0;
     memcpy(uip_buf, rxbuffer, rxlen);
     uip_len = rxlen;
+    liteethmac_rx_packets++;
+    liteethmac_rx_bytes += rxlen;
     ethmac_sram_writer_ev_pending_write(ETHMAC_EV_SRAM_WRITER);
     return rxlen;
   }
@@ -84,6 +91,8 @@ void liteethmac_send(void)
   ethmac_sram_reader_length_write(txlen);
   while(!(ethmac_sram_reader_ready_read()));
   ethmac_sram_reader_start_write(1);
+  liteethmac_tx_packets++;
+  liteethmac_tx_bytes += txlen;
 
   txslot = (txslot+1)%2;
   if (txslot)
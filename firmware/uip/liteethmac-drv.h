@@ -3,6 +3,11 @@
 #ifndef __LITEETHMAC_H__
 #define __LITEETHMAC_H__
 
+extern unsigned int liteethmac_rx_packets;
+extern unsigned int liteethmac_rx_bytes;
+extern unsigned int liteethmac_tx_packets;
+extern unsigned int liteethmac_tx_bytes;
+
 void liteethmac_init(void);
 uint16_t liteethmac_poll(void);
 void liteethmac_send(void);
@@ -0,0 +1,97 @@
+"""
+Per port DRAM bandwidth and latency counters.
+
+Watches the native ports of the LiteDRAM crossbar (on the controller side
+of any clock domain crossing or data width converter) and counts, over
+periods of 2^period_bits system clock cycles like the controller's
+bandwidth counters:
+
+    reads     read commands accepted (one DRAM word each)
+    writes    write commands accepted
+    latency   sum over the period of the reads waiting for their data,
+              in units of 256: divided by reads, the mean cycles from a
+              read command to its data (Little's law)
+    stalls    cycles with a command waiting for the crossbar
+
+update latches the counts of the last complete period of all the ports,
+sel then selects the port shown by the status registers.
+"""
+
+from migen import *
+
+from litex.soc.interconnect.csr import *
+
+
+class DRAMPortMonitor(Module):
+    def __init__(self, port, period_bits=24):
+        self.period_done = Signal()
+
+        self.reads = Signal(32)
+        self.writes = Signal(32)
+        self.latency = Signal(32)
+        self.stalls = Signal(32)
+
+        # # #
+
+        read = Signal()
+        write = Signal()
+        data = Signal()
+        self.comb += [
+            read.eq(port.cmd.valid & port.cmd.ready & ~port.cmd.we),
+            write.eq(port.cmd.valid & port.cmd.ready & port.cmd.we),
+            data.eq(port.rdata.valid & port.rdata.ready)
+        ]
+
+        outstanding = Signal(16)
+        self.sync += outstanding.eq(outstanding + read - data)
+
+        reads = Signal(period_bits + 1)
+        writes = Signal(period_bits + 1)
+        latency = Signal(period_bits + 16)
+        stalls = Signal(period_bits + 1)
+        self.sync += \
+            If(self.period_done,
+                self.reads.eq(reads),
+                self.writes.eq(writes),
+                self.latency.eq(latency[8:]),
+                self.stalls.eq(stalls),
+                reads.eq(read),
+                writes.eq(write),
+                latency.eq(outstanding),
+                stalls.eq(port.cmd.valid & ~port.cmd.ready)
+            ).Else(
+                reads.eq(reads + read),
+                writes.eq(writes + write),
+                latency.eq(latency + outstanding),
+                stalls.eq(stalls + (port.cmd.valid & ~port.cmd.ready))
+            )
+
+
+class DRAMMonitor(Module, AutoCSR):
+    def __init__(self, ports, period_bits=24):
+        self.update = CSR()
+        self.sel = CSRStorage(bits_for(len(ports) - 1))
+        self.reads = CSRStatus(32)
+        self.writes = CSRStatus(32)
+        self.latency = CSRStatus(32)
+        self.stalls = CSRStatus(32)
+
+        # # #
+
+        period = Signal(period_bits)
+        period_done = Signal()
+        self.sync += period.eq(period + 1)
+        self.comb += period_done.eq(period == 2**period_bits - 1)
+
+        fields = ["reads", "writes", "latency", "stalls"]
+        latched = {field: Array(Signal(32) for port in ports) for field in fields}
+        for i, port in enumerate(ports):
+            monitor = DRAMPortMonitor(port, period_bits)
+            self.submodules += monitor
+            self.comb += monitor.period_done.eq(period_done)
+            self.sync += \
+                If(self.update.re,
+                    [latched[field][i].eq(getattr(monitor, field)) for field in fields]
+                )
+        self.comb += [getattr(self, field).status.eq(latched[field][self.sel.storage])
+            for field in fields]
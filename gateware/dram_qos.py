@@ -0,0 +1,240 @@
+"""
+Priority arbitration of the LiteDRAM crossbar ports.
+
+The crossbar arbitrates each bank between its ports round-robin, so a
+burst of the CPU or the encoder delays the video outputs as much as any
+other port. PriorityRoundRobin is migen's RoundRobin granting the ports
+of the highest level first, round-robin between ports of the same level,
+and PriorityCrossbar is litedram's crossbar arbitrating its banks with
+it, the level of each port coming from its levels input: SoCs build
+PriorityDRAMCore, litedram's SDRAM core with a PriorityCrossbar. DRAMQoS
+computes these levels:
+
+    0                       port over its budget for the current window
+    1 + max(priority, urgency) otherwise
+
+priority is set by firmware, urgency (0-3) is driven by the port user:
+the video outputs raise it as their DMA FIFO drains. The budget caps the
+commands of a port per window of 2^window_bits cycles (0: no cap), past
+it the port is only served when no other port is waiting, which keeps
+the rest of the bandwidth for the others.
+
+Ports are configured one at a time: sel selects the port, write loads
+priority and budget into it.
+"""
+
+from migen import *
+from migen.genlib import roundrobin
+
+from litex.soc.interconnect.csr import *
+
+from litedram.core import LiteDRAMCore
+from litedram.core.crossbar import LiteDRAMCrossbar
+
+from gateware.rebind import rebind
+
+
+class PriorityRoundRobin(Module):
+    """migen's RoundRobin with a level per request, the requests of the
+    highest level are arbitrated round-robin, the others wait."""
+    def __init__(self, n, switch_policy=roundrobin.SP_WITHDRAW, level_bits=3):
+        self.request = Signal(n)
+        self.grant = Signal(max=max(2, n))
+        self.switch_policy = switch_policy
+        if self.switch_policy == roundrobin.SP_CE:
+            self.ce = Signal()
+        self.levels = [Signal(level_bits) for i in range(n)]
+
+        # # #
+
+        eligible = Signal(n)
+        self.comb += eligible.eq(self.request)
+        for level in range(2**level_bits):
+            at_level = Cat(*[self.request[i] & (self.levels[i] == level) for i in range(n)])
+            self.comb += If(at_level != 0, eligible.eq(at_level))
+
+        if n > 1:
+            cases = {}
+            for i in range(n):
+                switch = []
+                for j in reversed(range(i + 1, i + n)):
+                    t = j % n
+                    switch = [
+                        If(eligible[t],
+                            self.grant.eq(t)
+                        ).Else(
+                            *switch
+                        )
+                    ]
+                if self.switch_policy == roundrobin.SP_WITHDRAW:
+                    case = [If(~eligible[i], *switch)]
+                else:
+                    case = switch
+                cases[i] = case
+            statement = Case(self.grant, cases)
+            if self.switch_policy == roundrobin.SP_CE:
+                statement = If(self.ce, statement)
+            self.sync += statement
+        else:
+            self.comb += self.grant.eq(0)
+
+
+class PriorityCrossbar(LiteDRAMCrossbar):
+    """litedram's crossbar with a PriorityRoundRobin per bank.
+
+    Once finalized, levels has the level input of each master, in the
+    order of masters. do_finalize is litedram's with the arbiters built
+    here."""
+    def __init__(self, *args, level_bits=3, **kwargs):
+        LiteDRAMCrossbar.__init__(self, *args, **kwargs)
+        self.level_bits = level_bits
+        self.levels = []
+        self.arbiters = []
+
+    def do_finalize(self):
+        controller = self.controller
+        nmasters = len(self.masters)
+        self.levels = [Signal(self.level_bits) for nm in range(nmasters)]
+
+        m_ba, m_rca = self.split_master_addresses(self.bank_bits)
+
+        master_readys = [0]*nmasters
+        master_wdata_readys = [0]*nmasters
+        master_rdata_valids = [0]*nmasters
+
+        arbiters = [PriorityRoundRobin(nmasters, roundrobin.SP_CE, self.level_bits)
+            for n in range(self.nbanks)]
+        self.submodules += arbiters
+        self.arbiters = arbiters
+        for arbiter in arbiters:
+            self.comb += [level.eq(self.levels[nm]) for nm, level in enumerate(arbiter.levels)]
+
+        for nb, arbiter in enumerate(arbiters):
+            bank = getattr(controller, "bank"+str(nb))
+
+            # for each master, determine if another bank locks it
+            master_locked = []
+            for nm, master in enumerate(self.masters):
+                locked = 0
+                for other_nb, other_arbiter in enumerate(arbiters):
+                    if other_nb != nb:
+                        other_bank = getattr(controller, "bank"+str(other_nb))
+                        locked = locked | (other_bank.lock & (other_arbiter.grant == nm))
+                master_locked.append(locked)
+
+            # arbitrate
+            bank_selected = [(ba == nb) & ~locked for ba, locked in zip(m_ba, master_locked)]
+            bank_requested = [bs & master.cmd.valid for bs, master in zip(bank_selected, self.masters)]
+            self.comb += [
+                arbiter.request.eq(Cat(*bank_requested)),
+                arbiter.ce.eq(~bank.valid & ~bank.lock)
+            ]
+
+            # route requests
+            self.comb += [
+                bank.adr.eq(Array(m_rca)[arbiter.grant]),
+                bank.we.eq(Array(self.masters)[arbiter.grant].cmd.we),
+                bank.valid.eq(Array(bank_requested)[arbiter.grant])
+            ]
+            master_readys = [master_ready | ((arbiter.grant == nm) & bank_selected[nm] & bank.ready)
+                for nm, master_ready in enumerate(master_readys)]
+            master_wdata_readys = [master_wdata_ready | ((arbiter.grant == nm) & bank.wdata_ready)
+                for nm, master_wdata_ready in enumerate(master_wdata_readys)]
+            master_rdata_valids = [master_rdata_valid | ((arbiter.grant == nm) & bank.rdata_valid)
+                for nm, master_rdata_valid in enumerate(master_rdata_valids)]
+
+        for nm, master_wdata_ready in enumerate(master_wdata_readys):
+            for i in range(self.write_latency):
+                new_master_wdata_ready = Signal()
+                self.sync += new_master_wdata_ready.eq(master_wdata_ready)
+                master_wdata_ready = new_master_wdata_ready
+            master_wdata_readys[nm] = master_wdata_ready
+
+        for nm, master_rdata_valid in enumerate(master_rdata_valids):
+            for i in range(self.read_latency):
+                new_master_rdata_valid = Signal()
+                self.sync += new_master_rdata_valid.eq(master_rdata_valid)
+                master_rdata_valid = new_master_rdata_valid
+            master_rdata_valids[nm] = master_rdata_valid
+
+        for master, master_ready in zip(self.masters, master_readys):
+            self.comb += master.cmd.ready.eq(master_ready)
+        for master, master_wdata_ready in zip(self.masters, master_wdata_readys):
+            self.comb += master.wdata.ready.eq(master_wdata_ready)
+        for master, master_rdata_valid in zip(self.masters, master_rdata_valids):
+            self.comb += master.rdata.valid.eq(master_rdata_valid)
+
+        # route data writes
+        wdata_cases = {}
+        for nm, master in enumerate(self.masters):
+            wdata_cases[2**nm] = [
+                controller.wdata.eq(master.wdata.data),
+                controller.wdata_we.eq(master.wdata.we)
+            ]
+        wdata_cases["default"] = [
+            controller.wdata.eq(0),
+            controller.wdata_we.eq(0)
+        ]
+        self.comb += Case(Cat(*master_wdata_readys), wdata_cases)
+
+        # route data reads
+        for master in self.masters:
+            self.comb += master.rdata.data.eq(controller.rdata)
+
+
+class PriorityDRAMCore(LiteDRAMCore):
+    """litedram's SDRAM core with a PriorityCrossbar.
+
+    The core builds its crossbar itself, amid the controller it wires it
+    to: its constructor runs as is, with PriorityCrossbar in place of
+    LiteDRAMCrossbar."""
+    def __init__(self, *args, **kwargs):
+        init = rebind(LiteDRAMCore.__init__, LiteDRAMCrossbar=PriorityCrossbar)
+        init(self, *args, **kwargs)
+
+
+class DRAMQoS(Module, AutoCSR):
+    def __init__(self, ports, window_bits=10):
+        n = len(ports)
+        self.urgency = [Signal(2) for i in range(n)]
+        self.levels = [Signal(3) for i in range(n)]
+
+        self.sel = CSRStorage(bits_for(n - 1))
+        self.priority = CSRStorage(2)
+        self.budget = CSRStorage(window_bits + 1)
+        self.write = CSR()
+
+        # # #
+
+        window = Signal(window_bits)
+        window_done = Signal()
+        self.sync += window.eq(window + 1)
+        self.comb += window_done.eq(window == 2**window_bits - 1)
+
+        for i, port in enumerate(ports):
+            priority = Signal(2)
+            budget = Signal(window_bits + 1)
+            self.sync += \
+                If(self.write.re & (self.sel.storage == i),
+                    priority.eq(self.priority.storage),
+                    budget.eq(self.budget.storage)
+                )
+
+            used = Signal(window_bits + 1)
+            over = Signal()
+            self.sync += \
+                If(window_done,
+                    used.eq(0)
+                ).Elif(port.cmd.valid & port.cmd.ready,
+                    used.eq(used + 1)
+                )
+            self.comb += over.eq((budget != 0) & (used >= budget))
+
+            self.comb += \
+                If(over,
+                    self.levels[i].eq(0)
+                ).Elif(priority > self.urgency[i],
+                    self.levels[i].eq(1 + priority)
+                ).Else(
+                    self.levels[i].eq(1 + self.urgency[i])
+                )
@@ -0,0 +1,65 @@
+"""
+LiteEth MAC with the CPU (wishbone) interface plus hardware TX ports.
+
+All received frames go to the CPU, exactly like LiteEthMAC in "wishbone"
+mode. Hardware blocks (RTP streamer, raw video streamer, ...) can request
+extra TX ports which are arbitrated with the CPU TX path at frame
+boundaries, so firmware networking (telnet, etherbone, DHCP) keeps working
+while gateware streams UDP at line rate.
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+from litex.soc.interconnect.packet import Arbiter
+
+from liteeth.common import eth_phy_description
+from liteeth.core.mac.core import LiteEthMACCore
+from liteeth.core.mac.wishbone import LiteEthMACWishboneInterface
+
+
+class LiteEthMACSharedTX(Module, AutoCSR):
+    def __init__(self, phy, dw=32, endianness="big",
+            nrxslots=2, ntxslots=2):
+        self.dw = dw
+        self.endianness = endianness
+        self.tx_ports = []
+
+        # # #
+
+        self.submodules.core = LiteEthMACCore(phy, dw, endianness,
+            with_preamble_crc=True)
+        self.submodules.interface = LiteEthMACWishboneInterface(
+            dw, nrxslots, ntxslots, endianness)
+        self.ev, self.bus = self.interface.sram.ev, self.interface.bus
+        self.csrs = self.interface.get_csrs() + self.core.get_csrs()
+
+        # RX: everything goes to the CPU.
+        self.comb += self.core.source.connect(self.interface.sink)
+
+    def get_tx_port(self, dw=8):
+        """Return a sink accepting complete Ethernet frames (without
+        preamble / CRC) in eth_phy_description(dw) format. dw can be 8 or
+        the MAC data width."""
+        port = stream.Endpoint(eth_phy_description(dw))
+        self.tx_ports.append(port)
+        return port
+
+    def get_csrs(self):
+        return self.csrs
+
+    def do_finalize(self):
+        masters = [self.interface.source]
+        for port in self.tx_ports:
+            if len(port.data) == self.dw:
+                masters.append(port)
+                continue
+            converter = stream.StrideConverter(
+                eth_phy_description(len(port.data)),
+                eth_phy_description(self.dw),
+                reverse=(self.endianness == "big"))
+            self.submodules += converter
+            self.comb += port.connect(converter.sink)
+            masters.append(converter.source)
+        self.submodules.arbiter = Arbiter(masters, self.core.sink)
@@ -0,0 +1,324 @@
+"""
+HDMI input with a descriptor ring capture DMA.
+
+litevideo's HDMIIn captures frames with two ping-pong slots: firmware has
+to reload a slot before the other one completes, i.e. within one frame.
+RingDMA takes frame buffers from an N entry descriptor ring instead, so
+firmware can keep several frames queued and refill the ring in batches.
+
+Descriptors live in the core and are accessed through CSRs:
+
+    desc_index      descriptor selected by the other desc_* registers
+    desc_address    frame buffer address, written to the descriptor by
+                    desc_load which also hands it to the DMA
+    desc_owner      1 while the DMA owns the descriptor
+    desc_length     bytes written to the frame buffer (completion status)
+    desc_timestamp  system clock cycle at the start of the frame
+    head            next descriptor the DMA will fill
+    dropped         frames dropped for lack of a loaded descriptor
+    ring_reset      takes all the descriptors back, head goes to 0
+    cycles          the system clock cycle counter of desc_timestamp,
+                    latched by cycles_update so that its bytes read
+                    consistently
+
+The "done" event fires whenever a descriptor completes. A frame is
+complete after frame_size bytes, a start of frame arriving earlier ends
+it with a shorter length.
+
+With compression=True, frames can also be stored losslessly compressed
+to save DRAM bandwidth (see gateware/hdmi_out.py for the reader). Lines
+are cut in blocks of one 128 bit word (8 pixels) and a block equal to
+the previous block of its line is not written: the other blocks of line
+y are packed from the start of line y. A per line index tells the blocks
+apart, a 32 byte mask per line at compression_index bytes from the frame
+buffer, as 16 halfwords in pixel order: bit b of halfword i is set when
+block 16*i + b repeats the previous block. The first block of a line is
+never a repeat. compression_enable is sampled at the start of each
+frame, and desc_compressed tells whether the frame of a completed
+descriptor was stored compressed. compression_blocks is the number of
+blocks per line (at most 256). desc_length counts the uncompressed bytes
+either way.
+
+    compression_words   words received, free running
+    compression_writes  words written to DRAM, masks included
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+from litex.soc.interconnect.csr_eventmanager import *
+
+from litedram.frontend.dma import LiteDRAMDMAWriter
+
+import litevideo.input
+from litevideo.input.analysis import FrameExtraction
+
+
+class RingDMA(Module, AutoCSR):
+    def __init__(self, dram_port, n_descriptors=4, compression=False):
+        bus_aw = dram_port.aw
+        bus_dw = dram_port.dw
+        alignment_bits = log2_int(bus_dw//8)
+        index_bits = log2_int(n_descriptors)
+        max_blocks = 256
+        if compression:
+            assert bus_dw == 128
+            mask_words = max_blocks//bus_dw
+
+        self.frame = stream.Endpoint([("sof", 1), ("pixels", bus_dw)])
+
+        self.frame_size = CSRStorage(bus_aw + alignment_bits, alignment_bits=alignment_bits)
+        self.desc_index = CSRStorage(index_bits)
+        self.desc_address = CSRStorage(bus_aw + alignment_bits, alignment_bits=alignment_bits)
+        self.desc_load = CSR()
+        self.desc_owner = CSRStatus()
+        self.desc_length = CSRStatus(bus_aw + alignment_bits)
+        self.desc_timestamp = CSRStatus(32)
+        self.head = CSRStatus(index_bits)
+        self.dropped = CSRStatus(32)
+        self.ring_reset = CSR()
+        self.cycles_update = CSR()
+        self.cycles = CSRStatus(32)
+
+        if compression:
+            self.compression_enable = CSRStorage()
+            self.compression_blocks = CSRStorage(bits_for(max_blocks))
+            self.compression_index = CSRStorage(bus_aw + alignment_bits, alignment_bits=alignment_bits)
+            self.compression_words = CSRStatus(32)
+            self.compression_writes = CSRStatus(32)
+            self.desc_compressed = CSRStatus()
+
+        self.submodules.ev = EventManager()
+        self.ev.done = EventSourcePulse()
+        self.ev.finalize()
+
+        # # #
+
+        # descriptors
+        address = Array(Signal(bus_aw) for i in range(n_descriptors))
+        owner = Array(Signal() for i in range(n_descriptors))
+        length = Array(Signal(bus_aw) for i in range(n_descriptors))
+        timestamp = Array(Signal(32) for i in range(n_descriptors))
+
+        head = Signal(index_bits)
+        sel = self.desc_index.storage
+        reset = self.ring_reset.re
+        self.comb += [
+            self.desc_owner.status.eq(owner[sel]),
+            self.desc_length.status.eq(Cat(Replicate(0, alignment_bits), length[sel])),
+            self.desc_timestamp.status.eq(timestamp[sel]),
+            self.head.status.eq(head)
+        ]
+
+        cycles = Signal(32)
+        self.sync += [
+            cycles.eq(cycles + 1),
+            If(self.cycles_update.re,
+                self.cycles.status.eq(cycles)
+            )
+        ]
+
+        # address generator
+        reset_words = Signal()
+        count_word = Signal()
+        complete = Signal()
+        drop = Signal()
+        current_address = Signal(bus_aw)
+        words = Signal(bus_aw)
+        start = Signal(32)
+        last_word = Signal()
+        repeat = Signal()
+        self.comb += last_word.eq(words == self.frame_size.storage - 1)
+        self.sync += [
+            If(reset_words,
+                current_address.eq(address[head]),
+                words.eq(0),
+                start.eq(cycles)
+            ).Elif(count_word,
+                If(~repeat,
+                    current_address.eq(current_address + 1)
+                ),
+                words.eq(words + 1)
+            ),
+            If(reset,
+                [owner[i].eq(0) for i in range(n_descriptors)],
+                head.eq(0)
+            ).Else(
+                If(self.desc_load.re,
+                    address[sel].eq(self.desc_address.storage),
+                    owner[sel].eq(1)
+                ),
+                If(complete,
+                    owner[head].eq(0),
+                    length[head].eq(words),
+                    timestamp[head].eq(start),
+                    head.eq(head + 1)
+                )
+            ),
+            If(drop,
+                self.dropped.status.eq(self.dropped.status + 1)
+            )
+        ]
+
+        # bus accessor
+        self.submodules.writer = writer = LiteDRAMDMAWriter(dram_port)
+        self.comb += [
+            writer.sink.address.eq(current_address),
+            writer.sink.data.eq(self.frame.pixels)
+        ]
+
+        # compression
+        if compression:
+            line_end = Signal()
+            write_mask = Signal()
+            compress = Signal()
+            previous = Signal(bus_dw)
+            has_previous = Signal()
+            block = Signal(bits_for(max_blocks))
+            mask = Array(Signal() for i in range(max_blocks))
+            mask_word = Signal(max(bits_for(mask_words - 1), 1))
+            line_base = Signal(bus_aw)
+            index_address = Signal(bus_aw)
+            compressed = Array(Signal() for i in range(n_descriptors))
+            blocks = self.compression_blocks.storage
+            self.comb += [
+                repeat.eq(compress & has_previous & (self.frame.pixels == previous)),
+                line_end.eq(compress & (block == blocks - 1)),
+                self.desc_compressed.status.eq(compressed[sel])
+            ]
+            self.sync += If(complete & ~reset, compressed[head].eq(compress))
+            self.sync += [
+                If(reset_words,
+                    compress.eq(self.compression_enable.storage),
+                    has_previous.eq(0),
+                    block.eq(0),
+                    mask_word.eq(0),
+                    line_base.eq(address[head]),
+                    index_address.eq(address[head] + self.compression_index.storage)
+                ).Elif(count_word,
+                    previous.eq(self.frame.pixels),
+                    has_previous.eq(1),
+                    mask[block].eq(repeat),
+                    block.eq(block + 1)
+                ),
+                If(write_mask & writer.sink.ready,
+                    mask_word.eq(mask_word + 1),
+                    If(mask_word == mask_words - 1,
+                        # next line
+                        mask_word.eq(0),
+                        index_address.eq(index_address + mask_words),
+                        line_base.eq(line_base + blocks),
+                        current_address.eq(line_base + blocks),
+                        has_previous.eq(0),
+                        block.eq(0)
+                    )
+                ),
+                If(count_word,
+                    self.compression_words.status.eq(self.compression_words.status + 1)
+                ),
+                If(writer.sink.valid & writer.sink.ready,
+                    self.compression_writes.status.eq(self.compression_writes.status + 1)
+                )
+            ]
+
+            # halfword i of a mask word is read i-th by the 16 bit
+            # reversed ports of the readers, as pixels are
+            halfwords = [Cat(*mask[16*i:16*(i + 1)]) for i in range(max_blocks//16)]
+            per_word = bus_dw//16
+            mask_data = Array(
+                Cat(*reversed(halfwords[per_word*w:per_word*(w + 1)]))
+                for w in range(mask_words))
+            self.comb += \
+                If(write_mask,
+                    writer.sink.address.eq(index_address + mask_word),
+                    writer.sink.data.eq(mask_data[mask_word])
+                )
+
+        # control FSM
+        fsm = FSM(reset_state="WAIT_SOF")
+        fsm = ResetInserter()(fsm)
+        self.submodules.fsm = fsm
+        self.comb += fsm.reset.eq(reset)
+        fsm.act("WAIT_SOF",
+            reset_words.eq(1),
+            # skip to the next frame, keep its first word when there is a
+            # descriptor to capture it
+            self.frame.ready.eq(~self.frame.sof | ~owner[head]),
+            If(self.frame.valid & self.frame.sof,
+                If(owner[head],
+                    NextState("TRANSFER_PIXELS")
+                ).Else(
+                    drop.eq(1)
+                )
+            )
+        )
+        next_word = If(last_word, NextState("EOF"))
+        if compression:
+            frame_end = Signal()
+            next_word = \
+                If(line_end,
+                    NextValue(frame_end, last_word),
+                    NextState("MASK")
+                ).Elif(last_word,
+                    NextState("EOF")
+                )
+        fsm.act("TRANSFER_PIXELS",
+            If(self.frame.valid & self.frame.sof & (words != 0),
+                # short frame, the start of the next one is kept
+                NextState("EOF")
+            ).Else(
+                If(repeat,
+                    self.frame.ready.eq(1)
+                ).Else(
+                    self.frame.ready.eq(writer.sink.ready),
+                    writer.sink.valid.eq(self.frame.valid)
+                ),
+                If(self.frame.valid & self.frame.ready,
+                    count_word.eq(1),
+                    next_word
+                )
+            )
+        )
+        if compression:
+            fsm.act("MASK",
+                write_mask.eq(1),
+                writer.sink.valid.eq(1),
+                If(writer.sink.ready & (mask_word == mask_words - 1),
+                    If(frame_end,
+                        NextState("EOF")
+                    ).Else(
+                        NextState("TRANSFER_PIXELS")
+                    )
+                )
+            )
+        fsm.act("EOF",
+            complete.eq(1),
+            self.ev.done.trigger.eq(1),
+            NextState("WAIT_SOF")
+        )
+
+
+class HDMIIn(litevideo.input.HDMIIn):
+    """litevideo's HDMIIn capturing with RingDMA.
+
+    litevideo's HDMIIn is built without a DRAM port, i.e. only its front
+    end up to the sync polarity stage, and the frame extraction and RingDMA
+    are added here the way litevideo adds its slot DMA."""
+    def __init__(self, pads, dram_port, *args, fifo_depth=512,
+                 n_descriptors=4, compression=False, **kwargs):
+        litevideo.input.HDMIIn.__init__(self, pads, None, *args, **kwargs)
+
+        self.submodules.frame = FrameExtraction(dram_port.dw, fifo_depth)
+        self.comb += [
+            self.frame.valid_i.eq(self.syncpol.valid_o),
+            self.frame.de.eq(self.syncpol.de),
+            self.frame.vsync.eq(self.syncpol.vsync),
+            self.frame.r.eq(self.syncpol.r),
+            self.frame.g.eq(self.syncpol.g),
+            self.frame.b.eq(self.syncpol.b)
+        ]
+
+        self.submodules.dma = RingDMA(dram_port, n_descriptors, compression)
+        self.comb += self.frame.frame.connect(self.dma.frame)
+        self.ev = self.dma.ev
@@ -0,0 +1,319 @@
+"""
+HDMI output reading compressed frame buffers.
+
+The capture DMA of the HDMI inputs can store frames compressed (see
+gateware/hdmi_in.py): blocks of 8 pixels repeating the previous block of
+their line are not written, the others are packed from the start of
+their line, and a 32 byte mask per line tells them apart. The outputs
+have to read these frames back: VideoOut is built here with a DMA reader
+decoding them, for frames read while compression_enable is set.
+
+Per line, the reader fetches the mask, then only the blocks which were
+written, and outputs the previous block again for each repeat: reads
+shrink by as much as writes did. The mask is fetched before the blocks
+of its line, the output FIFO of the reader covers the latency this adds
+at the start of each line.
+
+    compression_enable  frames read are compressed
+    compression_blocks  blocks per line of these frames
+    compression_index   offset of the masks from the frame buffer, bytes
+    compression_reads   words read from DRAM, free running
+    compression_pixels  pixels output, free running
+
+The reader also rates how urgently it needs DRAM, from the words it has
+requested but not yet output: urgency goes from 0 above half the FIFO
+to 3 below an eighth of it (see gateware/dram_qos.py).
+
+The configuration is quasi-static: it is only meant to change between
+frames, it is not resynchronised to them.
+"""
+
+from migen import *
+from migen.genlib.cdc import MultiReg, BusSynchronizer
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+
+from litedram.frontend.dma import LiteDRAMDMAReader
+
+import litevideo.output
+import litevideo.output.core
+
+from gateware.rebind import rebind
+
+
+class CompressedDMAReader(Module):
+    """Drop-in replacement of litevideo's frame DMAReader: reads length
+    bytes from base for each frame on sink, decoding compressed frames.
+    The configuration signals are synchronised to the domain the reader
+    is moved to."""
+    def __init__(self, dram_port, fifo_depth=512, max_blocks=256):
+        assert dram_port.dw == 16
+        aw = dram_port.aw
+        block_pixels = 8
+        mask_reads = max_blocks//16
+
+        self.sink = sink = stream.Endpoint([("base", 32), ("length", 32)])
+        self.source = source = stream.Endpoint([("data", dram_port.dw)])
+
+        self.enable = Signal()
+        self.blocks = Signal(bits_for(max_blocks))
+        self.index = Signal(32)
+        self.reads = Signal(32)
+        self.pixels = Signal(32)
+        self.urgency = Signal(2)
+
+        # # #
+
+        enable = Signal()
+        blocks = Signal(bits_for(max_blocks))
+        index = Signal(32)
+        self.specials += [
+            MultiReg(self.enable, enable),
+            MultiReg(self.blocks, blocks),
+            MultiReg(self.index, index)
+        ]
+
+        self.submodules.reader = reader = LiteDRAMDMAReader(dram_port, fifo_depth)
+        self.sync += [
+            If(reader.sink.valid & reader.sink.ready,
+                self.reads.eq(self.reads + 1)
+            ),
+            If(source.valid & source.ready,
+                self.pixels.eq(self.pixels + 1)
+            )
+        ]
+
+        # words requested and not output yet
+        level = Signal(max=fifo_depth + 1)
+        requested = Signal()
+        output = Signal()
+        self.comb += [
+            requested.eq(reader.sink.valid & reader.sink.ready),
+            output.eq(reader.source.valid & reader.source.ready)
+        ]
+        self.sync += [
+            level.eq(level + requested - output),
+            If(level < fifo_depth//8,
+                self.urgency.eq(3)
+            ).Elif(level < fifo_depth//4,
+                self.urgency.eq(2)
+            ).Elif(level < fifo_depth//2,
+                self.urgency.eq(1)
+            ).Else(
+                self.urgency.eq(0)
+            )
+        ]
+
+        # halfword addresses
+        base = Signal(aw)
+        length = Signal(aw)
+        self.comb += [
+            base.eq(sink.base[1:]),
+            length.eq(sink.length[1:])
+        ]
+
+        compressed = Signal()
+        offset = Signal(aw)
+        line_base = Signal(aw)
+        line_pixels = Signal(aw)
+        index_address = Signal(aw)
+        remaining = Signal(aw)
+        self.comb += line_pixels.eq(blocks*block_pixels)
+
+        # mask of the current line, loaded by the data path
+        mask_halfwords = Array(Signal(16) for i in range(mask_reads))
+        mask = Array(mask_halfwords[i//16][i%16] for i in range(max_blocks))
+        mask_count = Signal(max=mask_reads + 1)
+        mask_loaded = Signal()
+        self.comb += mask_loaded.eq(mask_count == mask_reads)
+
+        # blocks output by the data path
+        out_block = Signal(bits_for(max_blocks))
+        out_pixel = Signal(max=block_pixels)
+        line_done = Signal()
+        next_line = Signal()
+        self.comb += line_done.eq(mask_loaded & (out_block == blocks))
+
+        # request path
+        block = Signal(bits_for(max_blocks))
+        pixel = Signal(max=block_pixels)
+        fsm = FSM(reset_state="IDLE")
+        self.submodules.fsm = fsm
+        fsm.act("IDLE",
+            NextValue(offset, 0),
+            If(sink.valid,
+                next_line.eq(1),
+                NextValue(compressed, enable),
+                NextValue(line_base, base),
+                NextValue(index_address, base + index[1:]),
+                NextValue(remaining, length),
+                If(enable,
+                    NextState("MASK")
+                ).Else(
+                    NextState("READ")
+                )
+            )
+        )
+        fsm.act("READ",
+            reader.sink.valid.eq(1),
+            reader.sink.address.eq(base + offset),
+            If(reader.sink.ready,
+                NextValue(offset, offset + 1),
+                If(offset == length - 1,
+                    sink.ready.eq(1),
+                    NextState("IDLE")
+                )
+            )
+        )
+        fsm.act("MASK",
+            reader.sink.valid.eq(1),
+            reader.sink.address.eq(index_address + offset),
+            If(reader.sink.ready,
+                NextValue(offset, offset + 1),
+                If(offset == mask_reads - 1,
+                    NextValue(offset, line_base),
+                    NextValue(block, 0),
+                    NextValue(pixel, 0),
+                    NextState("MASK_WAIT")
+                )
+            )
+        )
+        fsm.act("MASK_WAIT",
+            If(mask_loaded,
+                NextState("BLOCKS")
+            )
+        )
+        fsm.act("BLOCKS",
+            If(block == blocks,
+                NextState("LINE_END")
+            ).Elif(mask[block],
+                NextValue(block, block + 1)
+            ).Else(
+                reader.sink.valid.eq(1),
+                reader.sink.address.eq(offset),
+                If(reader.sink.ready,
+                    NextValue(offset, offset + 1),
+                    NextValue(pixel, pixel + 1),
+                    If(pixel == block_pixels - 1,
+                        NextValue(pixel, 0),
+                        NextValue(block, block + 1)
+                    )
+                )
+            )
+        )
+        fsm.act("LINE_END",
+            If(line_done,
+                next_line.eq(1),
+                NextValue(offset, 0),
+                NextValue(line_base, line_base + line_pixels),
+                NextValue(index_address, index_address + mask_reads),
+                NextValue(remaining, remaining - line_pixels),
+                If(remaining <= line_pixels,
+                    sink.ready.eq(1),
+                    NextState("IDLE")
+                ).Else(
+                    NextState("MASK")
+                )
+            )
+        )
+
+        # data path
+        held = Array(Signal(16) for i in range(block_pixels))
+        literal = Signal()
+        self.comb += literal.eq(~mask[out_block])
+        self.sync += [
+            If(next_line,
+                mask_count.eq(0),
+                out_block.eq(0),
+                out_pixel.eq(0)
+            ).Elif(compressed,
+                If(~mask_loaded,
+                    If(reader.source.valid,
+                        mask_halfwords[mask_count].eq(reader.source.data),
+                        mask_count.eq(mask_count + 1)
+                    )
+                ).Elif(source.valid & source.ready,
+                    If(literal,
+                        held[out_pixel].eq(reader.source.data)
+                    ),
+                    out_pixel.eq(out_pixel + 1),
+                    If(out_pixel == block_pixels - 1,
+                        out_pixel.eq(0),
+                        out_block.eq(out_block + 1)
+                    )
+                )
+            )
+        ]
+        self.comb += \
+            If(~compressed,
+                reader.source.connect(source)
+            ).Elif(~mask_loaded,
+                reader.source.ready.eq(1)
+            ).Elif(out_block != blocks,
+                If(literal,
+                    source.valid.eq(reader.source.valid),
+                    source.data.eq(reader.source.data),
+                    reader.source.ready.eq(source.ready)
+                ).Else(
+                    source.valid.eq(1),
+                    source.data.eq(held[out_pixel])
+                )
+            )
+
+
+class VideoOutCore(litevideo.output.core.VideoOutCore):
+    """litevideo's VideoOutCore reading frames with the DMA reader built by
+    dma_reader(dram_port, fifo_depth).
+
+    VideoOutCore builds its reader itself, amid the timing generator and
+    underflow logic it wires around it: its constructor runs as is, with
+    dma_reader in place of DMAReader."""
+    def __init__(self, dram_port, *args, dma_reader, **kwargs):
+        init = rebind(litevideo.output.core.VideoOutCore.__init__,
+            DMAReader=dma_reader)
+        init(self, dram_port, *args, **kwargs)
+
+
+class VideoOut(litevideo.output.VideoOut):
+    """litevideo's VideoOut reading frames with CompressedDMAReader, through
+    the VideoOutCore above."""
+    def __init__(self, *args, **kwargs):
+        self.compression_enable = CSRStorage()
+        self.compression_blocks = CSRStorage(9)
+        self.compression_index = CSRStorage(32)
+        self.compression_reads = CSRStatus(32)
+        self.compression_pixels = CSRStatus(32)
+        # DRAM urgency of the reader, in the sys domain
+        self.urgency = Signal(2)
+
+        readers = []
+        def dma_reader(dram_port, *args, **kwargs):
+            reader = CompressedDMAReader(dram_port, *args, **kwargs)
+            readers.append((reader, dram_port.cd))
+            return reader
+
+        def video_out_core(*args, **kwargs):
+            return VideoOutCore(*args, dma_reader=dma_reader, **kwargs)
+
+        init = rebind(litevideo.output.VideoOut.__init__,
+            VideoOutCore=video_out_core)
+        init(self, *args, **kwargs)
+        (reader, cd), = readers
+
+        # # #
+
+        self.specials += MultiReg(reader.urgency, self.urgency)
+        self.comb += [
+            reader.enable.eq(self.compression_enable.storage),
+            reader.blocks.eq(self.compression_blocks.storage),
+            reader.index.eq(self.compression_index.storage)
+        ]
+        for counter, csr in [(reader.reads, self.compression_reads),
+                             (reader.pixels, self.compression_pixels)]:
+            sync = BusSynchronizer(32, cd, "sys")
+            self.submodules += sync
+            self.comb += [
+                sync.i.eq(counter),
+                csr.status.eq(sync.o)
+            ]
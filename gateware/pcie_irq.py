@@ -0,0 +1,119 @@
+"""
+LitePCIe interrupt handling: per source MSI vectors and DMA interrupt
+coalescing.
+
+LitePCIeMSIMultiVector is a drop-in replacement for LitePCIeMSI (same
+enable / clear / vector CSRs, so the driver interrupt handler is
+unchanged). When the driver managed to allocate one MSI vector per source
+it sets `multivector` and each interrupt source is sent with its own MSI
+data (its bit number), otherwise all sources share vector 0. The host
+only allocates several vectors if the PCIe PHY advertises Multiple
+Message Capable >= 2, which the 7-series PHY of litepcie does not.
+
+IRQCoalescer sits between a DMA irq pulse (one per buffer) and the MSI
+controller. It fires once `buffers` buffers completed, or `usecs`
+microseconds after the first unsignalled buffer, trading interrupt rate
+against latency. The reset values (1 buffer, no timeout) give one
+interrupt per buffer.
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+
+from litepcie.common import msi_layout
+
+
+class IRQCoalescer(Module, AutoCSR):
+    def __init__(self, clk_freq):
+        self.i = Signal()
+        self.o = Signal()
+
+        self.buffers = CSRStorage(16, reset=1)
+        self.usecs = CSRStorage(16)
+
+        # # #
+
+        count = Signal(16)
+        fire_count = Signal()
+        fire_timeout = Signal()
+
+        # 1us tick
+        us_cycles = int(clk_freq//1e6)
+        us_counter = Signal(max=us_cycles)
+        us_tick = Signal()
+        self.comb += us_tick.eq(us_counter == 0)
+        self.sync += \
+            If(us_tick,
+                us_counter.eq(us_cycles - 1)
+            ).Else(
+                us_counter.eq(us_counter - 1)
+            )
+
+        # Time since the first unsignalled buffer
+        usecs = Signal(16)
+        self.sync += \
+            If(self.o | (count == 0),
+                usecs.eq(0)
+            ).Elif(us_tick & (usecs != 0xffff),
+                usecs.eq(usecs + 1)
+            )
+
+        self.comb += [
+            fire_count.eq(self.i & (count + 1 >= self.buffers.storage)),
+            fire_timeout.eq((count != 0) & (self.usecs.storage != 0) &
+                            (usecs >= self.usecs.storage)),
+            self.o.eq(fire_count | fire_timeout)
+        ]
+        self.sync += \
+            If(self.o,
+                count.eq(0)
+            ).Elif(self.i,
+                count.eq(count + 1)
+            )
+
+
+class LitePCIeMSIMultiVector(Module, AutoCSR):
+    def __init__(self, width=32):
+        self.irqs = Signal(width)
+        self.source = source = stream.Endpoint(msi_layout())
+
+        self.enable = CSRStorage(width)
+        self.clear = CSR(width)
+        self.vector = CSRStatus(width)
+        self.multivector = CSRStorage()
+
+        # # #
+
+        enable = self.enable.storage
+        clear = Signal(width)
+        self.comb += If(self.clear.re, clear.eq(self.clear.r))
+
+        # Sticky vector, cleared by the driver
+        vector = Signal(width)
+        self.sync += vector.eq(enable & ((vector & ~clear) | self.irqs))
+        self.comb += self.vector.status.eq(vector)
+
+        # MSI messages still to send, lowest source first
+        pending = Signal(width)
+        index = Signal(max=max(width, 2))
+        for i in reversed(range(width)):
+            self.comb += If(pending[i], index.eq(i))
+        sent = Signal(width)
+        self.comb += [
+            source.valid.eq(pending != 0),
+            If(self.multivector.storage,
+                source.dat.eq(index),
+                sent.eq(1 << index)
+            ).Else(
+                source.dat.eq(0),
+                sent.eq(pending)
+            )
+        ]
+        self.sync += \
+            If(source.valid & source.ready,
+                pending.eq((pending & ~sent) | (self.irqs & enable))
+            ).Else(
+                pending.eq(pending | (self.irqs & enable))
+            )
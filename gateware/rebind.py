@@ -0,0 +1,20 @@
+"""
+Running the constructors of third party cores with some of the classes
+they build replaced by ours.
+"""
+
+import types
+
+
+def rebind(function, **names):
+    """A copy of function which finds the given global names in names,
+    leaving the module function comes from untouched."""
+    for name in names:
+        assert name in function.__code__.co_names, \
+            "{} does not use {}".format(function.__qualname__, name)
+    function_globals = dict(function.__globals__)
+    function_globals.update(names)
+    copy = types.FunctionType(function.__code__, function_globals,
+        function.__name__, function.__defaults__, function.__closure__)
+    copy.__kwdefaults__ = function.__kwdefaults__
+    return copy
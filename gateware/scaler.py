@@ -0,0 +1,322 @@
+"""
+Frame buffer to frame buffer video scaler.
+
+Reads a YCbCr 4:2:2 frame buffer from DRAM, resizes it and writes the
+result to another frame buffer, so every sink (VideoOut, the encoder...)
+reads frames at its own resolution whatever the resolution of the source.
+Firmware starts one pass per source frame.
+
+Scaling is separable polyphase with 2 taps: an output pixel at source
+position (sx, sy), in 16.16 fixed point, blends the 2x2 source pixels
+around it, first vertically with the coefficients of the phase of sy,
+then horizontally with those of the phase of sx. The 2^phase_bits phases
+have two 9 bit taps each (256 is 1.0), loaded by firmware: the linear
+ramp gives a bilinear scaler. Luma is filtered this way; chroma is taken
+from the neighbouring pixel carrying the right component (Cb on even,
+Cr on odd output pixels) and only filtered vertically.
+
+Pixels are 16 bit words as seen through the 16 bit DRAM ports VideoOut
+uses (luma in bits 0-7, chroma in bits 8-15). Two source lines are held
+in block RAM, split in even and odd pixels so that the two neighbours of
+a position are read in the same cycle: one output pixel per clock.
+Source lines are only fetched again when the line pair changes, which
+halves the reads when upscaling vertically.
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+
+from litedram.frontend.dma import LiteDRAMDMAReader, LiteDRAMDMAWriter
+
+
+class FramebufferScaler(Module, AutoCSR):
+    def __init__(self, reader_port, writer_port, max_hres=2048, phase_bits=4):
+        assert reader_port.dw == 16 and writer_port.dw == 16
+        aw = reader_port.aw
+        res_bits = bits_for(max_hres)
+        phases = 2**phase_bits
+
+        self.src_base = CSRStorage(32)
+        self.src_hres = CSRStorage(res_bits)
+        self.src_vres = CSRStorage(res_bits)
+        self.dst_base = CSRStorage(32)
+        self.dst_hres = CSRStorage(res_bits)
+        self.dst_vres = CSRStorage(res_bits)
+        self.h_step = CSRStorage(32)  # source pixels per output pixel, 16.16
+        self.v_step = CSRStorage(32)
+        self.start = CSR()
+        self.done = CSRStatus()
+
+        self.coeff_index = CSRStorage(phase_bits)
+        self.coeff_tap0 = CSRStorage(9)
+        self.coeff_tap1 = CSRStorage(9)
+        self.coeff_write = CSR()
+
+        # # #
+
+        src_hres = self.src_hres.storage
+        src_vres = self.src_vres.storage
+        dst_hres = self.dst_hres.storage
+        dst_vres = self.dst_vres.storage
+
+        # coefficients
+        tap0 = Array(Signal(9) for i in range(phases))
+        tap1 = Array(Signal(9) for i in range(phases))
+        self.sync += \
+            If(self.coeff_write.re,
+                tap0[self.coeff_index.storage].eq(self.coeff_tap0.storage),
+                tap1[self.coeff_index.storage].eq(self.coeff_tap1.storage)
+            )
+
+        # line buffers: [line][bank], bank 0 holds the even pixels
+        lines = [[Memory(16, max_hres//2) for bank in range(2)] for line in range(2)]
+        wrports = [[m.get_port(write_capable=True) for m in l] for l in lines]
+        rdports = [[m.get_port() for m in l] for l in lines]
+        self.specials += [m for l in lines for m in l]
+        self.specials += [p for l in wrports + rdports for p in l]
+
+        # DMAs, 16 bit words so DRAM addresses are pixel addresses
+        self.submodules.reader = reader = LiteDRAMDMAReader(reader_port)
+        self.submodules.writer = writer = LiteDRAMDMAWriter(writer_port)
+        fifo_depth = 16
+        self.submodules.fifo = fifo = stream.SyncFIFO([("address", aw), ("data", 16)], fifo_depth)
+        self.comb += [
+            writer.sink.valid.eq(fifo.source.valid),
+            writer.sink.address.eq(fifo.source.address),
+            writer.sink.data.eq(fifo.source.data),
+            fifo.source.ready.eq(writer.sink.ready)
+        ]
+
+        # output lines
+        y = Signal(res_bits)
+        sy = Signal(32)
+        line_a = Signal(res_bits)
+        line_b = Signal(res_bits)
+        loaded = Signal()
+        loaded_line = Signal(res_bits)
+        cv0 = Signal(9)
+        cv1 = Signal(9)
+        src_line_a = Signal(aw)
+        src_line_b = Signal(aw)
+        dst_line = Signal(aw)
+        self.comb += [
+            line_a.eq(sy[16:]),
+            If(line_a >= src_vres - 1,
+                line_b.eq(line_a)
+            ).Else(
+                line_b.eq(line_a + 1)
+            )
+        ]
+
+        # source line fetch: line a, then line b
+        issue_x = Signal(res_bits)
+        issue_b = Signal()
+        recv_x = Signal(res_bits)
+        recv_b = Signal()
+        recv_done = Signal()
+        fetch_start = Signal()
+        fetching = Signal()
+        self.comb += [
+            reader.sink.valid.eq(fetching & ~(issue_b & (issue_x == src_hres))),
+            reader.sink.address.eq(Mux(issue_b, src_line_b, src_line_a) + issue_x),
+            reader.source.ready.eq(1)
+        ]
+        for line in range(2):
+            for bank in range(2):
+                port = wrports[line][bank]
+                self.comb += [
+                    port.adr.eq(recv_x[1:]),
+                    port.dat_w.eq(reader.source.data),
+                    port.we.eq(reader.source.valid & (recv_b == line) & (recv_x[0] == bank))
+                ]
+        self.sync += [
+            If(fetch_start,
+                issue_x.eq(0),
+                issue_b.eq(0),
+                recv_x.eq(0),
+                recv_b.eq(0),
+                recv_done.eq(0)
+            ).Else(
+                If(reader.sink.valid & reader.sink.ready,
+                    If(issue_x == src_hres - 1,
+                        If(~issue_b,
+                            issue_x.eq(0),
+                            issue_b.eq(1)
+                        ).Else(
+                            issue_x.eq(src_hres)
+                        )
+                    ).Else(
+                        issue_x.eq(issue_x + 1)
+                    )
+                ),
+                If(reader.source.valid,
+                    If(recv_x == src_hres - 1,
+                        recv_x.eq(0),
+                        recv_b.eq(1),
+                        If(recv_b,
+                            recv_done.eq(1)
+                        )
+                    ).Else(
+                        recv_x.eq(recv_x + 1)
+                    )
+                )
+            )
+        ]
+
+        # output pixel pipeline:
+        # 0: read the line buffers, 1: select the pixels, 2: vertical
+        # taps, 3: horizontal taps, then into the write FIFO
+        x = Signal(res_bits)
+        sx = Signal(32)
+        issue = Signal()
+        room = Signal()
+        self.comb += room.eq(fifo.fifo.level < fifo_depth - 5)
+
+        i = Signal(res_bits)
+        i_next = Signal(res_bits + 1)
+        self.comb += [
+            i.eq(sx[16:]),
+            i_next.eq(i + 1)
+        ]
+        for line in range(2):
+            self.comb += [
+                rdports[line][0].adr.eq(i_next[1:]),
+                rdports[line][1].adr.eq(i[1:])
+            ]
+
+        valid = Signal(4)
+        odd1 = Signal()
+        clamp1 = Signal()
+        hphase1 = Signal(phase_bits)
+        chroma_q1 = Signal()
+        address1 = Signal(aw)
+        self.sync += [
+            valid[0].eq(issue),
+            odd1.eq(i[0]),
+            clamp1.eq(i >= src_hres - 1),
+            hphase1.eq(sx[16-phase_bits:16]),
+            # the pixel carrying the chroma of this output pixel
+            chroma_q1.eq(i[0] != x[0]),
+            address1.eq(dst_line + x)
+        ]
+
+        p = [Signal(16) for line in range(2)]
+        q = [Signal(16) for line in range(2)]
+        hphase2 = Signal(phase_bits)
+        chroma_q2 = Signal()
+        address2 = Signal(aw)
+        for line in range(2):
+            bank0 = rdports[line][0].dat_r
+            bank1 = rdports[line][1].dat_r
+            pixel_p = Mux(odd1, bank1, bank0)
+            self.sync += [
+                p[line].eq(pixel_p),
+                If(clamp1,
+                    q[line].eq(pixel_p)
+                ).Else(
+                    q[line].eq(Mux(odd1, bank0, bank1))
+                )
+            ]
+        self.sync += [
+            valid[1].eq(valid[0]),
+            hphase2.eq(hphase1),
+            chroma_q2.eq(chroma_q1 & ~clamp1),
+            address2.eq(address1)
+        ]
+
+        luma_p = Signal(18)
+        luma_q = Signal(18)
+        chroma = Signal(18)
+        hphase3 = Signal(phase_bits)
+        address3 = Signal(aw)
+        c0 = Mux(chroma_q2, q[0][8:], p[0][8:])
+        c1 = Mux(chroma_q2, q[1][8:], p[1][8:])
+        self.sync += [
+            valid[2].eq(valid[1]),
+            luma_p.eq(p[0][:8]*cv0 + p[1][:8]*cv1),
+            luma_q.eq(q[0][:8]*cv0 + q[1][:8]*cv1),
+            chroma.eq(c0*cv0 + c1*cv1),
+            hphase3.eq(hphase2),
+            address3.eq(address2)
+        ]
+
+        luma = Signal(28)
+        chroma4 = Signal(18)
+        address4 = Signal(aw)
+        self.sync += [
+            valid[3].eq(valid[2]),
+            luma.eq(luma_p*tap0[hphase3] + luma_q*tap1[hphase3]),
+            chroma4.eq(chroma),
+            address4.eq(address3)
+        ]
+
+        def saturate(v):
+            return Mux(v[8:] != 0, 0xff, v[:8])
+
+        self.comb += [
+            fifo.sink.valid.eq(valid[3]),
+            fifo.sink.address.eq(address4),
+            fifo.sink.data.eq(Cat(saturate(luma[16:]), saturate(chroma4[8:])))
+        ]
+
+        # control
+        fsm = FSM(reset_state="IDLE")
+        self.submodules.fsm = fsm
+        fsm.act("IDLE",
+            self.done.status.eq(1),
+            If(self.start.re,
+                NextValue(y, 0),
+                NextValue(sy, 0),
+                NextValue(loaded, 0),
+                NextState("LINE")
+            )
+        )
+        fsm.act("LINE",
+            NextValue(cv0, tap0[sy[16-phase_bits:16]]),
+            NextValue(cv1, tap1[sy[16-phase_bits:16]]),
+            NextValue(dst_line, self.dst_base.storage[1:] + y*dst_hres),
+            NextValue(x, 0),
+            NextValue(sx, 0),
+            If(loaded & (line_a == loaded_line),
+                NextState("OUTPUT")
+            ).Else(
+                NextValue(loaded_line, line_a),
+                NextValue(src_line_a, self.src_base.storage[1:] + line_a*src_hres),
+                NextValue(src_line_b, self.src_base.storage[1:] + line_b*src_hres),
+                fetch_start.eq(1),
+                NextState("FETCH")
+            )
+        )
+        fsm.act("FETCH",
+            fetching.eq(1),
+            If(recv_done,
+                NextValue(loaded, 1),
+                NextState("OUTPUT")
+            )
+        )
+        fsm.act("OUTPUT",
+            issue.eq(room),
+            If(issue,
+                NextValue(x, x + 1),
+                NextValue(sx, sx + self.h_step.storage),
+                If(x == dst_hres - 1,
+                    NextState("LINE_END")
+                )
+            )
+        )
+        fsm.act("LINE_END",
+            NextValue(y, y + 1),
+            NextValue(sy, sy + self.v_step.storage),
+            If(y == dst_vres - 1,
+                NextState("FLUSH")
+            ).Else(
+                NextState("LINE")
+            )
+        )
+        fsm.act("FLUSH",
+            If((valid == 0) & ~fifo.source.valid,
+                NextState("IDLE")
+            )
+        )
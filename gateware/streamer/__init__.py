@@ -1 +1,4 @@
 from gateware.streamer.core import USBStreamer
+from gateware.streamer.raw import RawVideoUDPStreamer
+from gateware.streamer.rtp import RTPJPEGStreamer
+from gateware.streamer.pcie import PCIeFrameStreamer, FramePatternGenerator
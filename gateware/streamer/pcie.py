@@ -0,0 +1,238 @@
+"""
+Frame oriented video over the LitePCIe DMA writer.
+
+Whole frames are written to the host DMA ring. Every frame starts at the
+beginning of a DMA buffer with a 32 byte header (little endian, as seen in
+host memory):
+
+    magic       (32) 0x4d524648 ("HFRM")
+    sequence    (32) frame sequence number
+    width       (16) frame width in pixels
+    height      (16) frame height in lines
+    format      (16) 1: YCbCr 4:2:2
+    header_size (16) 32
+    length      (32) payload length in bytes (width*height*2)
+    reserved    (32)
+    timestamp   (64) sys clock cycle counter at the start of the frame
+
+followed by the pixels and zero padding up to the next DMA buffer boundary
+(`buffer_size`, which must match the size programmed in the DMA table). The
+host finds frames by looking for the magic at buffer starts, so it can
+resynchronize after an overflow; see litepcie_frame_get() in
+software/pcie/user/litepcie_lib.c.
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+
+
+pcie_frame_magic = 0x4d524648
+pcie_frame_header_length = 32
+pcie_frame_format_ycbcr422 = 1
+
+
+class FramePatternGenerator(Module):
+    """YCbCr 4:2:2 colour bars, four pixels per 64 bit word.
+
+    Bars are 128 pixels wide and scroll by four pixels per frame so dropped
+    or repeated frames are easy to spot. `start` restarts at the first
+    pixel of a frame.
+    """
+    def __init__(self):
+        self.source = source = stream.Endpoint([("data", 64)])
+        self.start = Signal()
+        self.width = Signal(16)
+        self.sequence = Signal(32)
+
+        # # #
+
+        # 75% colour bars: Y, Cb, Cr
+        bars = [
+            (180, 128, 128),  # white
+            (162,  44, 142),  # yellow
+            (131, 156,  44),  # cyan
+            (112,  72,  58),  # green
+            ( 84, 184, 198),  # magenta
+            ( 65, 100, 212),  # red
+            ( 35, 212, 114),  # blue
+            ( 16, 128, 128),  # black
+        ]
+        bars = Array(Constant(y | (cb << 8) | (cr << 16), 24) for y, cb, cr in bars)
+
+        x = Signal(16)
+        position = Signal(16)
+        color = Signal(24)
+        y, cb, cr = color[0:8], color[8:16], color[16:24]
+        self.comb += [
+            position.eq(x + (self.sequence[:14] << 2)),
+            color.eq(bars[position[7:10]]),
+            source.valid.eq(1),
+            # 16 bit pixels, chroma in the low byte: Cb Y, Cr Y, ...
+            source.data.eq(Cat(cb, y, cr, y, cb, y, cr, y))
+        ]
+        self.sync += \
+            If(self.start,
+                x.eq(0)
+            ).Elif(source.ready,
+                If(x + 4 >= self.width,
+                    x.eq(0)
+                ).Else(
+                    x.eq(x + 4)
+                )
+            )
+
+
+class PCIeFrameStreamer(Module, AutoCSR):
+    """Packs frames from `sink` (64 bit words, four YCbCr 4:2:2 pixels) for
+    the LitePCIe DMA writer.
+
+    `frame_period` paces the frames (in sys clock cycles, 0: back to back).
+    A period expiring while the previous frame is still being written is
+    counted in `skipped`. `frame_start` pulses when a frame begins so the
+    pixel source can restart. Clearing `enable` aborts the current frame;
+    the DMA writer should be (re)started before setting it.
+    """
+    def __init__(self):
+        self.sink = sink = stream.Endpoint([("data", 64)])
+        self.source = source = stream.Endpoint([("data", 64)])
+        self.frame_start = Signal()
+        self.sequence = Signal(32)
+
+        self.enable = CSRStorage()
+        self.width = CSRStorage(16, reset=1280)
+        self.height = CSRStorage(16, reset=720)
+        self.buffer_size = CSRStorage(32, reset=32768)
+        self.frame_period = CSRStorage(32)
+        self.frames = CSRStatus(32)
+        self.skipped = CSRStatus(32)
+
+        # # #
+
+        enable = self.enable.storage
+
+        # Timestamp and frame pacing
+        timestamp = Signal(64)
+        period_counter = Signal(32)
+        pending = Signal()
+        back_to_back = Signal()
+        tick = Signal()
+        taken = Signal()
+        self.sync += timestamp.eq(timestamp + 1)
+        self.comb += [
+            back_to_back.eq(self.frame_period.storage == 0),
+            tick.eq(back_to_back | (period_counter == 0))
+        ]
+        self.sync += [
+            If(~enable,
+                period_counter.eq(0),
+                pending.eq(0)
+            ).Else(
+                If(tick,
+                    period_counter.eq(self.frame_period.storage - 1)
+                ).Else(
+                    period_counter.eq(period_counter - 1)
+                ),
+                If(tick,
+                    If(pending & ~taken & ~back_to_back,
+                        self.skipped.status.eq(self.skipped.status + 1)
+                    ),
+                    pending.eq(1)
+                ).Elif(taken,
+                    pending.eq(0)
+                )
+            )
+        ]
+
+        # Frame geometry, latched at the start of the frame
+        self.frame_width = width = Signal(16)
+        height = Signal(16)
+        length = Signal(32)
+        frame_timestamp = Signal(64)
+        payload_words = Signal(30)
+        self.comb += payload_words.eq(length[3:])
+
+        # Position in the current DMA buffer, frames start at word 0.
+        buffer_words = Signal(29)
+        buffer_word = Signal(29)
+        self.comb += buffer_words.eq(self.buffer_size.storage[3:])
+        self.sync += \
+            If(~enable,
+                buffer_word.eq(0)
+            ).Elif(source.valid & source.ready,
+                If(buffer_word == buffer_words - 1,
+                    buffer_word.eq(0)
+                ).Else(
+                    buffer_word.eq(buffer_word + 1)
+                )
+            )
+
+        header = Array([
+            Cat(Constant(pcie_frame_magic, 32), self.sequence),
+            Cat(width, height, Constant(pcie_frame_format_ycbcr422, 16),
+                Constant(pcie_frame_header_length, 16)),
+            Cat(length, Constant(0, 32)),
+            frame_timestamp
+        ])
+        header_words = pcie_frame_header_length//8
+
+        counter = Signal(30)
+        self.submodules.fsm = fsm = FSM(reset_state="IDLE")
+        fsm.act("IDLE",
+            NextValue(counter, 0),
+            If(enable & pending,
+                taken.eq(1),
+                self.frame_start.eq(1),
+                NextValue(width, self.width.storage),
+                NextValue(height, self.height.storage),
+                NextValue(frame_timestamp, timestamp),
+                NextState("SIZE")
+            )
+        )
+        fsm.act("SIZE",
+            # Let the multiplier settle out of the FSM critical path.
+            NextValue(length, width*height*2),
+            NextState("HEADER")
+        )
+        fsm.act("HEADER",
+            source.valid.eq(1),
+            source.data.eq(header[counter]),
+            If(source.ready,
+                NextValue(counter, counter + 1),
+                If(counter == header_words - 1,
+                    NextValue(counter, 0),
+                    NextState("PAYLOAD")
+                )
+            ),
+            If(~enable, NextState("IDLE"))
+        )
+        fsm.act("PAYLOAD",
+            source.valid.eq(sink.valid),
+            source.data.eq(sink.data),
+            sink.ready.eq(source.ready),
+            If(source.valid & source.ready,
+                NextValue(counter, counter + 1),
+                If(counter == payload_words - 1,
+                    If(buffer_word == buffer_words - 1,
+                        NextState("DONE")
+                    ).Else(
+                        NextState("PAD")
+                    )
+                )
+            ),
+            If(~enable, NextState("IDLE"))
+        )
+        fsm.act("PAD",
+            source.valid.eq(1),
+            source.data.eq(0),
+            If(source.ready & (buffer_word == buffer_words - 1),
+                NextState("DONE")
+            ),
+            If(~enable, NextState("IDLE"))
+        )
+        fsm.act("DONE",
+            NextValue(self.sequence, self.sequence + 1),
+            NextValue(self.frames.status, self.frames.status + 1),
+            NextState("IDLE")
+        )
@@ -0,0 +1,209 @@
+"""
+Raw (uncompressed) video over UDP.
+
+Reads a YCbCr 4:2:2 framebuffer from DRAM and sends it line by line as UDP
+datagrams on a 32 bit LiteEthMACSharedTX TX port. Lines longer than the
+configured payload size are split over several datagrams. Each datagram
+starts with a 14 byte header (big endian):
+
+    frame  (32) frame sequence number
+    line   (16) line number
+    offset (16) byte offset of the payload in the line
+    width  (16) frame width in pixels
+    height (16) frame height in lines
+    flags  (16) bit 0: last datagram of the frame, bits 8-15: format (1: YCbCr 4:2:2)
+
+followed by the pixels, in framebuffer memory order.
+
+With the 42 byte Ethernet/IPv4/UDP header, the 14 byte header keeps the
+payload 32 bit aligned so the streamer can feed the MAC one word per cycle.
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+
+from litedram.frontend.dma import LiteDRAMDMAReader
+
+from liteeth.common import eth_phy_description
+
+from gateware.streamer.udp import UDPHeader, header_bytes, udp_frame_header_length
+
+
+raw_video_header_length = 14
+raw_video_format_ycbcr422 = 1
+
+
+class RawVideoUDPStreamer(Module, AutoCSR):
+    def __init__(self, dram_port, fifo_depth=1024):
+        self.source = source = stream.Endpoint(eth_phy_description(32))
+
+        self.base = CSRStorage(32)
+        self.h_active = CSRStorage(16)
+        self.v_active = CSRStorage(16)
+        self.start = CSR()
+        self.done = CSRStatus()
+        self.dst_mac = CSRStorage(48)
+        self.dst_ip = CSRStorage(32)
+        self.dst_port = CSRStorage(16, reset=6000)
+        self.src_mac = CSRStorage(48)
+        self.src_ip = CSRStorage(32)
+        self.src_port = CSRStorage(16, reset=6000)
+        self.payload_size = CSRStorage(16, reset=1280)
+        self.frames = CSRStatus(32)
+        self.packets = CSRStatus(32)
+
+        # # #
+
+        start = self.start.r & self.start.re
+        h_active = self.h_active.storage
+        v_active = self.v_active.storage
+        active = Signal()
+        reading = Signal()
+        self.comb += self.done.status.eq(~active)
+
+        # DMA: read the whole framebuffer linearly
+        self.submodules.dma = dma = LiteDRAMDMAReader(dram_port)
+
+        bytes_per_word = dram_port.dw//8
+        alignment_bits = log2_int(bytes_per_word)
+        frame_bytes = Signal(32)
+        frame_words = Signal(32)
+        word = Signal(32)
+        base = Signal(32)
+        self.comb += [
+            frame_bytes.eq(h_active*v_active*2),
+            frame_words.eq(frame_bytes[alignment_bits:]),
+            dma.sink.valid.eq(reading),
+            dma.sink.address.eq(base[alignment_bits:] + word)
+        ]
+        self.sync += \
+            If(start & ~active,
+                base.eq(self.base.storage),
+                word.eq(0),
+                reading.eq(1)
+            ).Elif(dma.sink.valid & dma.sink.ready,
+                word.eq(word + 1),
+                If(word == frame_words - 1,
+                    reading.eq(0)
+                )
+            )
+
+        # DRAM words -> 32 bit words in memory byte order
+        converter = stream.StrideConverter([("data", dram_port.dw)], [("data", 32)])
+        self.submodules.fifo = fifo = stream.SyncFIFO([("data", 32)], fifo_depth)
+        self.submodules += converter
+        self.comb += [
+            dma.source.connect(converter.sink),
+            converter.source.connect(fifo.sink)
+        ]
+        level = fifo.fifo.level
+
+        # Packet state
+        line = Signal(16)
+        offset = Signal(16)
+        frame = Signal(32)
+        ip_id = Signal(16)
+        length = Signal(16)
+        last_packet = Signal()
+        line_bytes = Signal(16)
+        remaining = Signal(16)
+        next_length = Signal(16)
+        self.comb += [
+            line_bytes.eq(h_active << 1),
+            remaining.eq(line_bytes - offset),
+            If(remaining > self.payload_size.storage,
+                next_length.eq(self.payload_size.storage)
+            ).Else(
+                next_length.eq(remaining)
+            )
+        ]
+
+        self.submodules.udp = udp = UDPHeader(
+            self.dst_mac.storage, self.src_mac.storage,
+            self.dst_ip.storage, self.src_ip.storage,
+            self.dst_port.storage, self.src_port.storage)
+        self.comb += [
+            udp.length.eq(raw_video_header_length + length),
+            udp.ip_id.eq(ip_id)
+        ]
+
+        header_fields = udp.fields + [
+            (frame, 4),
+            (line, 2),
+            (offset, 2),
+            (h_active, 2),
+            (v_active, 2),
+            (Cat(last_packet, Constant(0, 7), Constant(raw_video_format_ycbcr422, 8)), 2),
+        ]
+        header = header_bytes(header_fields)
+        header_words = (udp_frame_header_length + raw_video_header_length)//4
+        assert len(header) == 4*header_words
+        # First transmitted byte in the MSBs (big endian MAC)
+        header = Array(Cat(*reversed(header[4*i:4*i+4])) for i in range(header_words))
+
+        counter = Signal(16)
+        length_words = Signal(14)
+        self.comb += length_words.eq(length[2:])
+
+        self.submodules.fsm = fsm = FSM(reset_state="IDLE")
+        fsm.act("IDLE",
+            NextValue(counter, 0),
+            If(start & ~active,
+                NextValue(line, 0),
+                NextValue(offset, 0),
+                NextValue(active, 1)
+            ).Elif(active & (level >= next_length[2:]),
+                NextValue(length, next_length),
+                NextValue(last_packet, (line == v_active - 1) &
+                                       (next_length == remaining)),
+                NextState("PREPARE")
+            )
+        )
+        fsm.act("PREPARE",
+            # Let the checksum settle for a cycle.
+            NextState("HEADER")
+        )
+        fsm.act("HEADER",
+            source.valid.eq(1),
+            source.data.eq(header[counter]),
+            If(source.ready,
+                NextValue(counter, counter + 1),
+                If(counter == header_words - 1,
+                    NextValue(counter, 0),
+                    NextState("PAYLOAD")
+                )
+            )
+        )
+        fsm.act("PAYLOAD",
+            source.valid.eq(fifo.source.valid),
+            source.data.eq(Cat(fifo.source.data[24:32], fifo.source.data[16:24],
+                               fifo.source.data[8:16], fifo.source.data[0:8])),
+            source.last.eq(counter == length_words - 1),
+            # All 4 bytes of the last word are valid (big endian)
+            source.last_be.eq(Mux(source.last, 0b0001, 0b0000)),
+            fifo.source.ready.eq(source.ready),
+            If(source.valid & source.ready,
+                NextValue(counter, counter + 1),
+                If(source.last,
+                    NextState("DONE")
+                )
+            )
+        )
+        fsm.act("DONE",
+            NextValue(ip_id, ip_id + 1),
+            NextValue(self.packets.status, self.packets.status + 1),
+            If(next_length == remaining,
+                NextValue(offset, 0),
+                NextValue(line, line + 1)
+            ).Else(
+                NextValue(offset, offset + length)
+            ),
+            If(last_packet,
+                NextValue(active, 0),
+                NextValue(frame, frame + 1),
+                NextValue(self.frames.status, self.frames.status + 1)
+            ),
+            NextState("IDLE")
+        )
@@ -1,158 +1,396 @@
-# RTP Proof of concept, metadata informations are missing (Sync, ...)
-# but this can be used as a basis to implement real RTP
+"""
+RFC 2435 JPEG-over-RTP hardware packetizer.
+
+Takes the JFIF byte stream produced by the JPEG encoder, strips the JFIF
+headers (keeping the quantization tables), and emits complete Ethernet /
+IPv4 / UDP / RTP frames suitable for a LiteEthMACSharedTX TX port.
+
+ - Quantization tables are sent in-band in the first packet of each frame
+   (Q >= 128, RFC 2435 section 3.1.8).
+ - The RTP timestamp is a 90kHz clock latched when the frame capture
+   starts (`frame_start`), so the timestamps follow the captured frames,
+   not the encoder output.
+ - The marker bit is set on the last packet of a frame.
+ - Destination MAC/IP/port, payload size and the JPEG type/geometry are
+   CSRs configured by firmware.
+
+Receive with ffmpeg/GStreamer using an SDP file such as
+test/hdmi2ethernet/rtp.sdp.
+"""
+
+from migen import *
+
+from litex.soc.interconnect import stream
+from litex.soc.interconnect.csr import *
+
+from liteeth.common import eth_phy_description
+
+from gateware.streamer.udp import UDPHeader, header_bytes, udp_frame_header_length
+
+
+JPEG_MARKER_SOI = 0xd8
+JPEG_MARKER_EOI = 0xd9
+JPEG_MARKER_SOS = 0xda
+JPEG_MARKER_DQT = 0xdb
+
+RTP_PAYLOAD_TYPE_JPEG = 26
 
 rtp_header_length = 12
-rtp_header_fields = {
-    "ver":              HeaderField(0,  6,  2),
-    "p":                HeaderField(0,  5,  1),
-    "x":                HeaderField(0,  4,  1),
-    "cc":               HeaderField(0,  0,  4),
-    "m":                HeaderField(1,  7,  1),
-    "pt":               HeaderField(1,  0,  7),
-    "sequence_number":  HeaderField(2,  0,  16),
-    "timestamp":        HeaderField(4,  0,  32),
-    "ssrc":             HeaderField(8,  0,  32)
-}
-rtp_header = Header(rtp_header_fields,
-                    rtp_header_length,
-                    swap_field_bytes=True)
-
-
-def eth_rtp_description(dw):
-    param_layout = rtp_header.get_layout()
-    payload_layout = [
-        ("data", dw),
-        ("error", dw//8)
-    ]
-    return EndpointDescription(payload_layout, param_layout, packetized=True)
-
-
-def eth_rtp_user_description(dw):
-    param_layout = [
-        ("src_port", 16),
-        ("dst_port", 16),
-        ("ip_address", 32),
-        ("length", 16)
-    ]
-    payload_layout = [
-        ("data", dw),
-        ("error", dw//8)
-    ]
-    return EndpointDescription(payload_layout, param_layout, packetized=True)
-
-
-class EncoderRTPGenerator(Module):
-    def __init__(self, ip_address, udp_port, fifo_depth=1024):
-        self.sink = sink = Sink([("data", 8)])
-        self.source = source = Source(eth_rtp_user_description(8))
+rtp_jpeg_main_header_length = 8
+# Ethernet + IPv4 + UDP + RTP + RTP/JPEG
+rtp_jpeg_header_length = (udp_frame_header_length + rtp_header_length +
+                          rtp_jpeg_main_header_length)
+# Quantization table header (4) + luma/chroma 8 bit tables (2*64)
+rtp_jpeg_qt_length = 4 + 128
+
+
+class JPEGScanExtractor(Module):
+    """Strip the JFIF headers from the encoder output.
+
+    The entropy coded scan data (up to and including the EOI marker) is
+    forwarded on `source`, with `first` set on the first byte and `last` on
+    the EOI byte. The luma/chroma quantization tables found in DQT segments
+    are written to `qt_port` (7 bit address: table << 6 | index).
+    """
+    def __init__(self):
+        self.sink = sink = stream.Endpoint([("data", 8)])
+        self.source = source = stream.Endpoint([("data", 8)])
+        self.pause = Signal()
+
+        self.qt_adr = Signal(7)
+        self.qt_dat = Signal(8)
+        self.qt_we = Signal()
 
         # # #
 
-        self.submodules.fifo = fifo = SyncFIFO([("data", 8)], fifo_depth)
-        self.comb += Record.connect(sink, fifo.sink)
+        data = sink.data
+        accept = Signal()
+        self.comb += accept.eq(sink.valid & sink.ready)
 
-        self.submodules.level = level = FlipFlop(max=fifo_depth+1)
-        self.comb += level.d.eq(fifo.fifo.level)
+        prev_ff = Signal()
+        self.sync += If(accept, prev_ff.eq(data == 0xff))
 
-        self.submodules.counter = counter = Counter(max=fifo_depth)
+        marker = Signal(8)
+        length_h = Signal(8)
+        remaining = Signal(16)
+        first = Signal()
 
-        self.submodules.flush_timer = WaitTimer(10000)
-        flush = Signal()
+        qt_table = Signal()
+        qt_index = Signal(6)
         self.comb += [
-            flush.eq((fifo.fifo.level > 0) & self.flush_timer.done)
+            self.qt_adr.eq(Cat(qt_index, qt_table)),
+            self.qt_dat.eq(data)
         ]
 
-        self.submodules.fsm = fsm = FSM(reset_state="IDLE")
-        fsm.act("IDLE",
-          self.flush_timer.wait.eq(fifo.fifo.level > 0),
-            If((fifo.fifo.level >= 256) | flush,
-                level.ce.eq(1),
-                counter.reset.eq(1),
-                NextState("SEND")
+        segment_done = Signal()
+        self.comb += segment_done.eq(remaining == 1)
+
+        self.submodules.fsm = fsm = FSM(reset_state="SOI")
+        fsm.act("SOI",
+            sink.ready.eq(~self.pause),
+            If(accept & prev_ff & (data == JPEG_MARKER_SOI),
+                NextState("MARKER")
             )
         )
-        fsm.act("SEND",
-            source.stb.eq(fifo.source.stb),
-            source.sop.eq(counter.value == 0),
-            If(level.q == 0,
-                source.eop.eq(1),
-            ).Else(
-                source.eop.eq(counter.value == (level.q-1)),
-            ),
-            source.src_port.eq(udp_port),
-            source.dst_port.eq(udp_port),
-            source.ip_address.eq(ip_address),
-            If(level.q == 0,
-                source.length.eq(1),
-            ).Else(
-                source.length.eq(level.q),
-            ),
-            source.data.eq(fifo.source.data),
-            fifo.source.ack.eq(source.ack),
-            If(source.stb & source.ack,
-                counter.ce.eq(1),
-                If(source.eop,
-                    NextState("IDLE")
+        fsm.act("MARKER",
+            sink.ready.eq(1),
+            If(accept & prev_ff & (data != 0xff) & (data != 0x00),
+                NextValue(marker, data),
+                If(data == JPEG_MARKER_EOI,
+                    NextState("SOI")
+                ).Else(
+                    NextState("LENGTH_H")
+                )
+            )
+        )
+        fsm.act("LENGTH_H",
+            sink.ready.eq(1),
+            If(accept,
+                NextValue(length_h, data),
+                NextState("LENGTH_L")
+            )
+        )
+        fsm.act("LENGTH_L",
+            sink.ready.eq(1),
+            If(accept,
+                NextValue(remaining, Cat(data, length_h) - 2),
+                If(Cat(data, length_h) == 2,
+                    If(marker == JPEG_MARKER_SOS,
+                        NextValue(first, 1),
+                        NextState("SCAN")
+                    ).Else(
+                        NextState("MARKER")
+                    )
+                ).Elif(marker == JPEG_MARKER_DQT,
+                    NextState("DQT_ID")
+                ).Else(
+                    NextState("SKIP")
+                )
+            )
+        )
+        fsm.act("SKIP",
+            sink.ready.eq(1),
+            If(accept,
+                NextValue(remaining, remaining - 1),
+                If(segment_done,
+                    If(marker == JPEG_MARKER_SOS,
+                        NextValue(first, 1),
+                        NextState("SCAN")
+                    ).Else(
+                        NextState("MARKER")
+                    )
+                )
+            )
+        )
+        fsm.act("DQT_ID",
+            sink.ready.eq(1),
+            If(accept,
+                # Pq (precision) is assumed to be 0 (8 bit tables)
+                NextValue(qt_table, data[0]),
+                NextValue(qt_index, 0),
+                NextValue(remaining, remaining - 1),
+                If(segment_done,
+                    NextState("MARKER")
+                ).Else(
+                    NextState("DQT_DATA")
+                )
+            )
+        )
+        fsm.act("DQT_DATA",
+            sink.ready.eq(1),
+            self.qt_we.eq(accept),
+            If(accept,
+                NextValue(qt_index, qt_index + 1),
+                NextValue(remaining, remaining - 1),
+                If(segment_done,
+                    NextState("MARKER")
+                ).Elif(qt_index == 63,
+                    NextState("DQT_ID")
+                )
+            )
+        )
+        fsm.act("SCAN",
+            source.valid.eq(sink.valid),
+            source.first.eq(first),
+            source.last.eq(prev_ff & (data == JPEG_MARKER_EOI)),
+            source.data.eq(data),
+            sink.ready.eq(source.ready),
+            If(accept,
+                NextValue(first, 0),
+                If(source.last,
+                    NextState("SOI")
                 )
             )
         )
 
 
-class EncoderRTPPacketizer(Packetizer):
-    def __init__(self):
-        Packetizer.__init__(self,
-            eth_rtp_description(8),
-            eth_udp_user_description(8),
-            rtp_header)
-
+class RTPJPEGStreamer(Module, AutoCSR):
+    def __init__(self, clk_freq, fifo_depth=2048):
+        self.sink = sink = stream.Endpoint([("data", 8)])
+        self.source = source = stream.Endpoint(eth_phy_description(8))
+        self.frame_start = Signal()
 
-class EncoderRTPSender(Module):
-    def __init__(self):
-        self.sink = sink = Sink(eth_rtp_user_description(8))
-        self.source = source = Source(eth_udp_user_description(8))
+        self.enable = CSRStorage()
+        self.dst_mac = CSRStorage(48)
+        self.dst_ip = CSRStorage(32)
+        self.dst_port = CSRStorage(16, reset=5004)
+        self.src_mac = CSRStorage(48)
+        self.src_ip = CSRStorage(32)
+        self.src_port = CSRStorage(16, reset=5004)
+        self.ssrc = CSRStorage(32, reset=0x48325553)
+        self.payload_size = CSRStorage(16, reset=1024)
+        self.jpeg_type = CSRStorage(8)
+        self.jpeg_q = CSRStorage(8, reset=255)
+        self.jpeg_width = CSRStorage(8)
+        self.jpeg_height = CSRStorage(8)
+        self.frames = CSRStatus(32)
+        self.packets = CSRStatus(32)
 
         # # #
 
-        timestamp = Signal(32)
-        self.sync += timestamp.eq(timestamp+1)
+        # 90kHz RTP clock
+        ts_acc = Signal(max=clk_freq + 90000)
+        ts_counter = Signal(32)
+        self.sync += \
+            If(ts_acc >= clk_freq - 90000,
+                ts_acc.eq(ts_acc + 90000 - clk_freq),
+                ts_counter.eq(ts_counter + 1)
+            ).Else(
+                ts_acc.eq(ts_acc + 90000)
+            )
+        # Capture timestamps of the frames in flight in the encoder.
+        self.submodules.ts_fifo = ts_fifo = stream.SyncFIFO([("data", 32)], 4)
+        self.comb += [
+            ts_fifo.sink.valid.eq(self.frame_start),
+            ts_fifo.sink.data.eq(ts_counter)
+        ]
 
-        sequence_number = Counter(16)
-        self.submodules += sequence_number
+        # JFIF -> scan data + quantization tables
+        self.submodules.extractor = extractor = JPEGScanExtractor()
+        self.comb += sink.connect(extractor.sink)
+
+        qt_mem = Memory(8, 128)
+        qt_write_port = qt_mem.get_port(write_capable=True)
+        qt_read_port = qt_mem.get_port(async_read=True)
+        self.specials += qt_mem, qt_write_port, qt_read_port
+        self.comb += [
+            qt_write_port.adr.eq(extractor.qt_adr),
+            qt_write_port.dat_w.eq(extractor.qt_dat),
+            qt_write_port.we.eq(extractor.qt_we)
+        ]
+
+        # Payload buffer. Only one end of frame can be buffered at a time:
+        # the extractor is paused until the last packet of a frame is sent,
+        # which also keeps the quantization tables stable.
+        self.submodules.fifo = fifo = stream.SyncFIFO([("data", 8)], fifo_depth)
+        level = fifo.fifo.level
+        eof_pending = Signal()
+        eof_sent = Signal()
+        self.comb += [
+            extractor.pause.eq(eof_pending),
+            extractor.source.connect(fifo.sink, omit={"first", "last"}),
+        ]
+        self.sync += \
+            If(extractor.source.valid & extractor.source.ready & extractor.source.last,
+                eof_pending.eq(1)
+            ).Elif(eof_sent,
+                eof_pending.eq(0)
+            )
+
+        # Per packet state (latched when a packet starts)
+        max_payload = self.payload_size.storage
+        length = Signal(16)
+        marker = Signal()
+        first_packet = Signal(reset=1)
+        with_qt = Signal()
+        sequence = Signal(16)
+        ip_id = Signal(16)
+        offset = Signal(24)
+        timestamp = Signal(32)
+        frames = self.frames.status
+        packets = self.packets.status
 
-        self.submodules.packetizer = packetizer = EncoderRTPPacketizer()
+        self.submodules.udp = udp = UDPHeader(
+            self.dst_mac.storage, self.src_mac.storage,
+            self.dst_ip.storage, self.src_ip.storage,
+            self.dst_port.storage, self.src_port.storage)
         self.comb += [
-            packetizer.sink.stb.eq(sink.stb),
-            packetizer.sink.sop.eq(sink.sop),
-            packetizer.sink.eop.eq(sink.eop),
-            sink.ack.eq(packetizer.sink.ack),
-            packetizer.sink.ver.eq(0x2),
-            packetizer.sink.p.eq(0),
-            packetizer.sink.x.eq(0),
-            packetizer.sink.cc.eq(0),
-            packetizer.sink.m.eq(0),
-            packetizer.sink.pt.eq(26), #JPEG
-            packetizer.sink.sequence_number.eq(sequence_number.value),
-            packetizer.sink.timestamp.eq(timestamp),
-            packetizer.sink.ssrc.eq(1),
-            packetizer.sink.data.eq(sink.data)
+            udp.length.eq(rtp_header_length + rtp_jpeg_main_header_length +
+                          Mux(with_qt, rtp_jpeg_qt_length, 0) + length),
+            udp.ip_id.eq(ip_id)
         ]
 
+        # Header bytes, in transmission order
+        header_fields = udp.fields + [
+            # RTP
+            (0x80, 1),
+            (Cat(Constant(RTP_PAYLOAD_TYPE_JPEG, 7), marker), 1),
+            (sequence, 2),
+            (timestamp, 4),
+            (self.ssrc.storage, 4),
+            # RTP/JPEG main header
+            (0x00, 1),
+            (offset, 3),
+            (self.jpeg_type.storage, 1),
+            (self.jpeg_q.storage, 1),
+            (self.jpeg_width.storage, 1),
+            (self.jpeg_height.storage, 1),
+            # Quantization table header (only sent with_qt)
+            (0x00, 1), (0x00, 1),
+            (128, 2),
+        ]
+        header = header_bytes(header_fields)
+        assert len(header) == rtp_jpeg_header_length + 4
+        header = Array(header)
+
+        counter = Signal(16)
+        header_end = Signal(16)
+        self.comb += header_end.eq(rtp_jpeg_header_length - 1 + Mux(with_qt, 4, 0))
+
         self.submodules.fsm = fsm = FSM(reset_state="IDLE")
         fsm.act("IDLE",
-            packetizer.source.ack.eq(1),
-            If(packetizer.source.stb & packetizer.source.sop,
-                packetizer.source.ack.eq(0),
-                NextState("SEND")
+            NextValue(counter, 0),
+            If(~self.enable.storage,
+                # Drop everything while disabled
+                fifo.source.ready.eq(1),
+                ts_fifo.source.ready.eq(1),
+                eof_sent.eq(eof_pending),
+                NextValue(first_packet, 1),
+                NextValue(offset, 0)
+            ).Elif(eof_pending & (level <= max_payload),
+                NextValue(length, level),
+                NextValue(marker, 1),
+                NextState("PREPARE")
+            ).Elif(level >= max_payload,
+                NextValue(length, max_payload),
+                NextValue(marker, 0),
+                NextState("PREPARE")
+            )
+        )
+        fsm.act("PREPARE",
+            # Let the checksum settle for a cycle.
+            NextValue(with_qt, first_packet),
+            If(first_packet,
+                If(ts_fifo.source.valid,
+                    NextValue(timestamp, ts_fifo.source.data)
+                ).Else(
+                    NextValue(timestamp, ts_counter)
+                )
+            ),
+            NextState("HEADER")
+        )
+        fsm.act("HEADER",
+            source.valid.eq(1),
+            source.data.eq(header[counter]),
+            If(source.ready,
+                NextValue(counter, counter + 1),
+                If(counter == header_end,
+                    NextValue(counter, 0),
+                    If(with_qt,
+                        NextState("QT")
+                    ).Else(
+                        NextState("PAYLOAD")
+                    )
+                )
             )
         )
-        fsm.act("SEND",
-            Record.connect(packetizer.source, source),
-            source.src_port.eq(sink.src_port),
-            source.dst_port.eq(sink.dst_port),
-            source.ip_address.eq(sink.ip_address),
-            source.length.eq(sink.length + rtp_header.length),
-            If(source.stb & source.eop & source.ack,
-                sequence_number.ce.eq(1),
-                NextState("IDLE"),
+        self.comb += qt_read_port.adr.eq(counter)
+        fsm.act("QT",
+            source.valid.eq(1),
+            source.data.eq(qt_read_port.dat_r),
+            If(source.ready,
+                NextValue(counter, counter + 1),
+                If(counter == 127,
+                    NextValue(counter, 0),
+                    NextState("PAYLOAD")
+                )
+            )
+        )
+        fsm.act("PAYLOAD",
+            source.valid.eq(fifo.source.valid),
+            source.data.eq(fifo.source.data),
+            source.last.eq(counter == length - 1),
+            source.last_be.eq(source.last),
+            fifo.source.ready.eq(source.ready),
+            If(source.valid & source.ready,
+                NextValue(counter, counter + 1),
+                If(source.last,
+                    NextState("DONE")
+                )
             )
-        )
\ No newline at end of file
+        )
+        fsm.act("DONE",
+            NextValue(sequence, sequence + 1),
+            NextValue(ip_id, ip_id + 1),
+            NextValue(packets, packets + 1),
+            NextValue(first_packet, marker),
+            If(marker,
+                eof_sent.eq(1),
+                ts_fifo.source.ready.eq(1),
+                NextValue(offset, 0),
+                NextValue(frames, frames + 1)
+            ).Else(
+                NextValue(offset, offset + length)
+            ),
+            NextState("IDLE")
+        )
@@ -0,0 +1,79 @@
+"""
+Ethernet/IPv4/UDP header generation shared by the hardware UDP streamers.
+
+The streamers build complete Ethernet frames byte by byte for a
+LiteEthMACSharedTX TX port; this module provides the header fields (in
+transmission order) and the IPv4 header checksum.
+"""
+
+from migen import *
+
+
+eth_header_length = 14
+ipv4_header_length = 20
+udp_header_length = 8
+udp_frame_header_length = eth_header_length + ipv4_header_length + udp_header_length
+
+
+class UDPHeader(Module):
+    """Header fields for a UDP datagram of `length` payload bytes.
+
+    `ip_id` must be stable for a cycle before the checksum bytes are sent:
+    the checksum is registered.
+    """
+    def __init__(self, dst_mac, src_mac, dst_ip, src_ip, dst_port, src_port):
+        self.length = Signal(16)
+        self.ip_id = Signal(16)
+
+        # # #
+
+        udp_length = Signal(16)
+        ip_length = Signal(16)
+        self.comb += [
+            udp_length.eq(udp_header_length + self.length),
+            ip_length.eq(ipv4_header_length + udp_length)
+        ]
+
+        # IPv4 header checksum (the other header fields are constants)
+        ttl_protocol = (64 << 8) | 17
+        checksum_sum = Signal(20)
+        checksum_fold = Signal(17)
+        checksum = Signal(16)
+        self.comb += [
+            checksum_sum.eq(0x4500 + ip_length + self.ip_id + 0x4000 + ttl_protocol +
+                            src_ip[16:] + src_ip[:16] + dst_ip[16:] + dst_ip[:16]),
+            checksum_fold.eq(checksum_sum[:16] + checksum_sum[16:]),
+        ]
+        self.sync += checksum.eq(~(checksum_fold[:16] + checksum_fold[16]))
+
+        self.fields = [
+            # Ethernet
+            (dst_mac, 6),
+            (src_mac, 6),
+            (0x0800, 2),
+            # IPv4 (don't fragment, TTL 64)
+            (0x45, 1), (0x00, 1),
+            (ip_length, 2),
+            (self.ip_id, 2),
+            (0x4000, 2),
+            (ttl_protocol, 2),
+            (checksum, 2),
+            (src_ip, 4),
+            (dst_ip, 4),
+            # UDP (no checksum)
+            (src_port, 2),
+            (dst_port, 2),
+            (udp_length, 2),
+            (0x0000, 2),
+        ]
+
+
+def header_bytes(fields):
+    """Flatten (value, nbytes) fields into big endian 8 bit values."""
+    r = []
+    for value, nbytes in fields:
+        if isinstance(value, int):
+            value = Constant(value, 8*nbytes)
+        for i in reversed(range(nbytes)):
+            r.append(value[8*i:8*(i+1)])
+    return r
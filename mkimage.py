@@ -8,6 +8,9 @@ import argparse
 
 import make
 
+# Firmware configuration store, see firmware/config.h
+CONFIG_STORE_SECTORS = 2
+
 
 def main():
     parser = argparse.ArgumentParser(description=__doc__)
@@ -74,6 +77,8 @@ def main():
     gateware_pos = 0
     bios_pos = platform.gateware_size
     firmware_pos = platform.gateware_size + bios_size
+    config_pos = platform.spiflash_total_size - (
+        CONFIG_STORE_SECTORS*platform.spiflash_sector_size)
 
     print()
     with open(output_file, "wb") as f:
@@ -123,9 +128,15 @@ def main():
         f.seek(firmware_pos)
         f.write(firmware_data)
 
+        # Firmware configuration, left erased: the firmware starts from
+        # its defaults.
+        assert firmware_pos+len(firmware_data) <= config_pos
+        print(("  Config @ 0x{:08x} ({:10} bytes)"
+               " - Firmware configuration store (not written)"
+               ).format(config_pos, platform.spiflash_total_size - config_pos))
+
         # Result
-        remain = platform.spiflash_total_size - (
-            firmware_pos+len(firmware_data))
+        remain = config_pos - (firmware_pos+len(firmware_data))
         print("-"*40)
         print(("       Remaining space {:10} bytes"
                " ({} Megabits, {:.2f} Megabytes)"
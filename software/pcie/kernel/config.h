@@ -6,8 +6,13 @@
 #define PCI_FPGA_DEVICE_ID 0x7022
 #define PCI_FPGA_BAR0_SIZE 0xa000
 
-/* dma */
+/* dma: defaults of the dma_buffer_count/dma_buffer_size module
+   parameters, and their limits (descriptor table depth, descriptor
+   length field) */
 #define DMA_BUFFER_COUNT 128
+#define DMA_BUFFER_SIZE 32768
+#define DMA_BUFFER_COUNT_MAX 256
+#define DMA_BUFFER_SIZE_MAX (8 * 1024 * 1024)
 
 
 #endif /* __HW_CONFIG_H */
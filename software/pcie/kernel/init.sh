@@ -1,7 +1,9 @@
 #!/bin/sh
 # TODO: use udev instead
+# Module parameters are passed through, e.g.:
+#   ./init.sh dma_buffer_count=16 dma_buffer_size=4194304
 
-insmod litepcie.ko
+insmod litepcie.ko "$@"
 
 major=$(awk '/ litepcie$/{print $1}' /proc/devices)
 mknod -m 666 /dev/litepcie0 c $major 0
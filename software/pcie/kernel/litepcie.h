@@ -18,6 +18,27 @@ struct litepcie_ioctl_mmap_info {
     unsigned long dma_rx_buf_offset;
     unsigned long dma_rx_buf_size;
     unsigned long dma_rx_buf_count;
+
+    unsigned long status_offset; /* struct litepcie_status */
+    unsigned long status_size;
+};
+
+/* mmap'able status page. The driver updates the hw counts on each DMA
+   interrupt (and when polled): they are the number of buffers the DMA
+   read (TX) or wrote (RX) since DMA_START, so a consumer can check for
+   progress with a memory load. Userspace publishes its own progress in
+   the user counts, which poll() compares to the hw counts: POLLIN when
+   rx_hw_count > rx_user_count, POLLOUT when tx_user_count - tx_hw_count <
+   tx_buf_count. */
+struct litepcie_status {
+    __u64 tx_hw_count;
+    __u64 tx_user_count; /* written by userspace: buffers filled */
+    __u64 rx_hw_count;
+    __u64 rx_user_count; /* written by userspace: buffers consumed */
+    __u32 tx_buf_num; /* index of the buffer in progress */
+    __u32 tx_buf_count; /* as passed to DMA_START */
+    __u32 rx_buf_num;
+    __u32 rx_buf_count;
 };
 
 struct litepcie_ioctl_dma_start {
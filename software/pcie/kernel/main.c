@@ -20,8 +20,14 @@
 #include <linux/slab.h>
 #include <linux/pci.h>
 #include <linux/pci_regs.h>
+#include <linux/dma-mapping.h>
 #include <linux/delay.h>
 #include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/version.h>
 
 #include "litepcie.h"
 #include "config.h"
@@ -31,12 +37,37 @@
 #define LITEPCIE_NAME "litepcie"
 #define LITEPCIE_MINOR_COUNT 4
 
-#define DMA_BUFFER_SIZE PAGE_ALIGN(32768)
-#define DMA_BUFFER_MAP_SIZE (DMA_BUFFER_SIZE * DMA_BUFFER_COUNT)
+/* mmap layout: TX buffers, RX buffers, BAR0, status page */
+#define LITEPCIE_REG_OFFSET(s) (2 * (s)->dma_buf_map_size)
+#define LITEPCIE_STATUS_OFFSET(s) (LITEPCIE_REG_OFFSET(s) + PAGE_ALIGN(PCI_FPGA_BAR0_SIZE))
+
+/* one MSI vector per interrupt source (DMA writer, DMA reader) if the
+   gateware, its PCIe PHY and the platform support it, a shared vector
+   otherwise: the 7-series PHY of the picoevb target advertises a single
+   MSI message, so it always gets one */
+#ifdef CSR_MSI_MULTIVECTOR_ADDR
+#define LITEPCIE_MSI_VECTORS_MAX 2
+#else
+#define LITEPCIE_MSI_VECTORS_MAX 1
+#endif
 
 #define IRQ_MASK_DMA_READER (1 << DMA_READER_INTERRUPT)
 #define IRQ_MASK_DMA_WRITER (1 << DMA_WRITER_INTERRUPT)
 
+static unsigned int dma_buffer_count = DMA_BUFFER_COUNT;
+module_param(dma_buffer_count, uint, 0444);
+MODULE_PARM_DESC(dma_buffer_count, "number of DMA buffers per direction");
+
+static unsigned int dma_buffer_size = DMA_BUFFER_SIZE;
+module_param(dma_buffer_size, uint, 0444);
+MODULE_PARM_DESC(dma_buffer_size, "size of each DMA buffer in bytes (rounded up to a page)");
+
+/* DMA descriptor table entry */
+typedef struct {
+    uint8_t *virt;
+    dma_addr_t addr;
+} LitePCIeDMABuffer;
+
 typedef struct {
     int minor;
     struct pci_dev *dev;
@@ -44,13 +75,53 @@ typedef struct {
     phys_addr_t bar0_phys_addr;
     uint8_t *bar0_addr; /* virtual address of BAR0 */
 
-    uint8_t *dma_tx_bufs[DMA_BUFFER_COUNT];
-    unsigned long dma_tx_bufs_addr[DMA_BUFFER_COUNT];
-    uint8_t *dma_rx_bufs[DMA_BUFFER_COUNT];
-    unsigned long dma_rx_bufs_addr[DMA_BUFFER_COUNT];
+    unsigned int dma_buf_size;
+    unsigned int dma_buf_count;
+    unsigned long dma_buf_map_size; /* size of the TX or RX mapping */
+    /* one coherent region per direction if possible, one allocation per
+       buffer otherwise */
+    LitePCIeDMABuffer *dma_tx_bufs;
+    LitePCIeDMABuffer *dma_rx_bufs;
+    uint8_t dma_tx_contiguous;
+    uint8_t dma_rx_contiguous;
     uint8_t tx_dma_started;
     uint8_t rx_dma_started;
-    wait_queue_head_t dma_waitqueue;
+    uint8_t dma_loopback; /* shared by both directions */
+    /* the file that started each direction (or is filling the TX ring),
+       whose release stops it */
+    struct file *tx_file;
+    struct file *rx_file;
+    wait_queue_head_t dma_tx_waitqueue;
+    wait_queue_head_t dma_rx_waitqueue;
+
+    struct litepcie_status *status; /* mmap'able status page */
+    spinlock_t status_lock;
+    uint32_t tx_loop; /* last DMA table loop counts */
+    uint32_t rx_loop;
+    uint64_t tx_loops; /* extended loop counts since DMA_START */
+    uint64_t rx_loops;
+    /* the driver's own copy of the status page, which userspace can
+       write: only these are used for indexing the rings */
+    uint32_t tx_buf_count; /* as passed to DMA_START */
+    uint32_t rx_buf_count;
+    uint32_t tx_buf_num;
+    uint32_t rx_buf_num;
+    uint64_t tx_hw_count;
+    uint64_t rx_hw_count;
+
+    /* read()/write() byte streams over the DMA rings */
+    struct mutex stream_lock;
+    unsigned int tx_buf_size; /* as passed to DMA_START */
+    unsigned int rx_buf_size;
+    uint64_t rx_read_buf; /* buffers consumed by read() since DMA_START */
+    unsigned int rx_read_offset; /* in bytes, in the current buffer */
+    uint64_t tx_write_buf; /* buffers filled by write() since DMA_START */
+    unsigned int tx_write_offset;
+    unsigned long rx_overflows; /* buffers lost because read() was late */
+    unsigned long tx_underflows; /* buffers sent before write() filled them */
+
+    int msi_vectors;
+    unsigned long irq_count[LITEPCIE_MSI_VECTORS_MAX]; /* per MSI vector */
 } LitePCIeState;
 
 static dev_t litepcie_cdev;
@@ -59,6 +130,8 @@ static LitePCIeState *litepcie_minor_table[LITEPCIE_MINOR_COUNT];
 
 static void litepcie_end(struct pci_dev *dev, LitePCIeState *s);
 static int litepcie_dma_stop(LitePCIeState *s);
+static void litepcie_dma_stop_tx(LitePCIeState *s);
+static void litepcie_dma_stop_rx(LitePCIeState *s);
 
 static inline uint32_t litepcie_readl(LitePCIeState *s, uint32_t addr)
 {
@@ -86,6 +159,40 @@ static void litepcie_disable_interrupt(LitePCIeState *s, int irq_num)
     litepcie_writel(s, CSR_MSI_ENABLE_ADDR, v);
 }
 
+/* Publish the DMA progress in the status page. The table loop status
+   holds a 16 bit loop count and the index of the buffer in progress; the
+   loop count is extended to 64 bits so that userspace gets buffer counts
+   since DMA_START. Called from the interrupt handler and the waiters. */
+static void litepcie_update_status(LitePCIeState *s)
+{
+    struct litepcie_status *st = s->status;
+    unsigned long flags;
+    uint32_t v;
+
+    spin_lock_irqsave(&s->status_lock, flags);
+    if (s->tx_dma_started) {
+        v = litepcie_readl(s, CSR_DMA_READER_TABLE_LOOP_STATUS_ADDR);
+        s->tx_loops += ((v >> 16) - s->tx_loop) & 0xffff;
+        s->tx_loop = v >> 16;
+        s->tx_buf_num = v & 0xffff;
+        WRITE_ONCE(s->tx_hw_count, s->tx_loops * s->tx_buf_count + s->tx_buf_num);
+        st->tx_buf_num = s->tx_buf_num;
+        smp_wmb();
+        WRITE_ONCE(st->tx_hw_count, s->tx_hw_count);
+    }
+    if (s->rx_dma_started) {
+        v = litepcie_readl(s, CSR_DMA_WRITER_TABLE_LOOP_STATUS_ADDR);
+        s->rx_loops += ((v >> 16) - s->rx_loop) & 0xffff;
+        s->rx_loop = v >> 16;
+        s->rx_buf_num = v & 0xffff;
+        WRITE_ONCE(s->rx_hw_count, s->rx_loops * s->rx_buf_count + s->rx_buf_num);
+        st->rx_buf_num = s->rx_buf_num;
+        smp_wmb();
+        WRITE_ONCE(st->rx_hw_count, s->rx_hw_count);
+    }
+    spin_unlock_irqrestore(&s->status_lock, flags);
+}
+
 static int litepcie_open(struct inode *inode, struct file *file)
 {
     LitePCIeState *s;
@@ -102,37 +209,68 @@ static int litepcie_open(struct inode *inode, struct file *file)
     return 0;
 }
 
+/* map the DMA buffers of one direction. A single coherent region is
+   mapped with dma_mmap_coherent(), which handles IOMMUs and remapped
+   coherent memory. Buffers allocated one by one are mapped by pfn at
+   their offset in the vma, which needs them in the linear mapping: where
+   the platform remaps coherent memory, mmap is refused and read()/write()
+   remain */
+static int litepcie_mmap_dma_buffers(LitePCIeState *s, struct vm_area_struct *vma,
+                                     LitePCIeDMABuffer *bufs, uint8_t contiguous)
+{
+    unsigned long pgoff = vma->vm_pgoff;
+    unsigned long pfn;
+    int i, ret;
+
+    if (contiguous) {
+        vma->vm_pgoff = 0;
+        ret = dma_mmap_coherent(&s->dev->dev, vma, bufs[0].virt, bufs[0].addr,
+                                s->dma_buf_map_size);
+        vma->vm_pgoff = pgoff;
+        return ret;
+    }
+
+    for(i = 0; i < s->dma_buf_count; i++) {
+        if (!virt_addr_valid(bufs[i].virt))
+            return -ENXIO;
+    }
+    for(i = 0; i < s->dma_buf_count; i++) {
+        pfn = page_to_pfn(virt_to_page(bufs[i].virt));
+        ret = remap_pfn_range(vma, vma->vm_start + (unsigned long)i * s->dma_buf_size,
+                              pfn, s->dma_buf_size, vma->vm_page_prot);
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
 /* mmap the DMA buffers and registers to user space */
 static int litepcie_mmap(struct file *file, struct vm_area_struct *vma)
 {
     LitePCIeState *s = file->private_data;
+    LitePCIeDMABuffer *bufs;
+    uint8_t contiguous;
     unsigned long pfn;
-    int is_tx, i;
+    int ret;
 
     if (vma->vm_pgoff == 0) {
-        if (vma->vm_end - vma->vm_start != DMA_BUFFER_MAP_SIZE)
+        if (vma->vm_end - vma->vm_start != s->dma_buf_map_size)
             return -EINVAL;
-        is_tx = 1;
-        goto remap_ram;
-    } else if (vma->vm_pgoff == (DMA_BUFFER_MAP_SIZE >> PAGE_SHIFT)) {
-        if (vma->vm_end - vma->vm_start != DMA_BUFFER_MAP_SIZE)
+        bufs = s->dma_tx_bufs;
+        contiguous = s->dma_tx_contiguous;
+        goto map_dma;
+    } else if (vma->vm_pgoff == (s->dma_buf_map_size >> PAGE_SHIFT)) {
+        if (vma->vm_end - vma->vm_start != s->dma_buf_map_size)
             return -EINVAL;
-        is_tx = 0;
-    remap_ram:
-        for(i = 0; i < DMA_BUFFER_COUNT; i++) {
-            if (is_tx)
-                pfn = __pa(s->dma_tx_bufs[i]) >> PAGE_SHIFT;
-            else
-                pfn = __pa(s->dma_rx_bufs[i]) >> PAGE_SHIFT;
-            /* Note: the memory is cached, so the user must explicitly
-               flush the CPU caches on architectures which require it. */
-            if (remap_pfn_range(vma, vma->vm_start + i * DMA_BUFFER_SIZE, pfn,
-                                DMA_BUFFER_SIZE, vma->vm_page_prot)) {
-                printk(KERN_ERR LITEPCIE_NAME " remap_pfn_range failed\n");
-                return -EAGAIN;
-            }
+        bufs = s->dma_rx_bufs;
+        contiguous = s->dma_rx_contiguous;
+    map_dma:
+        ret = litepcie_mmap_dma_buffers(s, vma, bufs, contiguous);
+        if (ret < 0) {
+            printk(KERN_ERR LITEPCIE_NAME " Failed to map the DMA buffers\n");
+            return ret;
         }
-    } else if (vma->vm_pgoff == ((2 * DMA_BUFFER_MAP_SIZE) >> PAGE_SHIFT)) {
+    } else if (vma->vm_pgoff == (LITEPCIE_REG_OFFSET(s) >> PAGE_SHIFT)) {
         if (vma->vm_end - vma->vm_start != PCI_FPGA_BAR0_SIZE)
             return -EINVAL;
         pfn = s->bar0_phys_addr >> PAGE_SHIFT;
@@ -145,6 +283,15 @@ static int litepcie_mmap(struct file *file, struct vm_area_struct *vma)
             printk(KERN_ERR LITEPCIE_NAME " io_remap_pfn_range failed\n");
             return -EAGAIN;
         }
+    } else if (vma->vm_pgoff == (LITEPCIE_STATUS_OFFSET(s) >> PAGE_SHIFT)) {
+        if (vma->vm_end - vma->vm_start != PAGE_SIZE)
+            return -EINVAL;
+        pfn = virt_to_phys(s->status) >> PAGE_SHIFT;
+        if (remap_pfn_range(vma, vma->vm_start, pfn, PAGE_SIZE,
+                            vma->vm_page_prot)) {
+            printk(KERN_ERR LITEPCIE_NAME " remap_pfn_range failed\n");
+            return -EAGAIN;
+        }
     } else {
         return -EINVAL;
     }
@@ -152,11 +299,18 @@ static int litepcie_mmap(struct file *file, struct vm_area_struct *vma)
     return 0;
 }
 
+/* stop the directions this file started, the others may belong to
+   another reader or writer */
 static int litepcie_release(struct inode *inode, struct file *file)
 {
     LitePCIeState *s = file->private_data;
 
-    litepcie_dma_stop(s); /* just in case: stop the DMA */
+    mutex_lock(&s->stream_lock);
+    if (s->tx_file == file)
+        litepcie_dma_stop_tx(s);
+    if (s->rx_file == file)
+        litepcie_dma_stop_rx(s);
+    mutex_unlock(&s->stream_lock);
     return 0;
 }
 
@@ -164,13 +318,26 @@ static irqreturn_t litepcie_interrupt(int irq, void *data)
 {
     LitePCIeState *s = data;
     uint32_t clear_mask, irq_vector;
+    int i;
+
+    for(i = 0; i < s->msi_vectors; i++) {
+        if (irq == pci_irq_vector(s->dev, i))
+            s->irq_count[i]++;
+    }
 
     irq_vector = litepcie_readl(s, CSR_MSI_VECTOR_ADDR);
     clear_mask = 0;
-    if (irq_vector & (IRQ_MASK_DMA_READER | IRQ_MASK_DMA_WRITER)) {
-        /* wake up processes waiting on dma_wait() */
-        wake_up_interruptible(&s->dma_waitqueue);
-        clear_mask |= (IRQ_MASK_DMA_READER | IRQ_MASK_DMA_WRITER);
+    if (irq_vector & (IRQ_MASK_DMA_READER | IRQ_MASK_DMA_WRITER))
+        litepcie_update_status(s);
+    /* wake up processes waiting on dma_wait() or poll() for that
+       direction only */
+    if (irq_vector & IRQ_MASK_DMA_READER) {
+        wake_up_interruptible(&s->dma_tx_waitqueue);
+        clear_mask |= IRQ_MASK_DMA_READER;
+    }
+    if (irq_vector & IRQ_MASK_DMA_WRITER) {
+        wake_up_interruptible(&s->dma_rx_waitqueue);
+        clear_mask |= IRQ_MASK_DMA_WRITER;
     }
 
     litepcie_writel(s, CSR_MSI_CLEAR_ADDR, clear_mask);
@@ -178,11 +345,16 @@ static irqreturn_t litepcie_interrupt(int irq, void *data)
     return IRQ_HANDLED;
 }
 
-static int litepcie_dma_start(LitePCIeState *s, struct litepcie_ioctl_dma_start *m)
+/* The directions are independent: each can be started while the other
+   runs, which is what read() and write() on separate files do. */
+static int litepcie_dma_start(LitePCIeState *s, struct litepcie_ioctl_dma_start *m,
+                              struct file *file)
 {
-    int i, val;
+    unsigned long flags;
+    int i, loopback;
 
-    if (s->tx_dma_started || s->rx_dma_started)
+    if ((m->tx_buf_size != 0 && s->tx_dma_started) ||
+        (m->rx_buf_size != 0 && s->rx_dma_started))
         return -EIO;
 
     if (m->tx_buf_size == 0 && m->rx_buf_size == 0)
@@ -190,18 +362,27 @@ static int litepcie_dma_start(LitePCIeState *s, struct litepcie_ioctl_dma_start
     /* check alignment (XXX: what is the exact constraint ?) */
     if ((m->tx_buf_size & 7) != 0 ||
         (m->rx_buf_size & 7) != 0 ||
-        m->tx_buf_size > DMA_BUFFER_SIZE ||
-        m->rx_buf_size > DMA_BUFFER_SIZE)
+        m->tx_buf_size > s->dma_buf_size ||
+        m->rx_buf_size > s->dma_buf_size)
         return -EINVAL;
 
     /* check buffer count */
-    if (m->tx_buf_count > DMA_BUFFER_COUNT)
-       return -EINVAL;
-    if (m->rx_buf_count > DMA_BUFFER_COUNT)
+    if (m->tx_buf_count > s->dma_buf_count ||
+        (m->tx_buf_size != 0 && m->tx_buf_count == 0))
+        return -EINVAL;
+    if (m->rx_buf_count > s->dma_buf_count ||
+        (m->rx_buf_size != 0 && m->rx_buf_count == 0))
         return -EINVAL;
 
-    val = ((m->dma_flags & DMA_LOOPBACK_ENABLE) != 0);
-    litepcie_writel(s, CSR_DMA_LOOPBACK_ENABLE_ADDR, val);
+    /* the loopback setting can only change when the DMA is idle */
+    loopback = ((m->dma_flags & DMA_LOOPBACK_ENABLE) != 0);
+    if (s->tx_dma_started || s->rx_dma_started) {
+        if (loopback != s->dma_loopback)
+            return -EBUSY;
+    } else {
+        litepcie_writel(s, CSR_DMA_LOOPBACK_ENABLE_ADDR, loopback);
+        s->dma_loopback = loopback;
+    }
 
     /* init DMA write */
     if (m->rx_buf_size != 0) {
@@ -211,7 +392,7 @@ static int litepcie_dma_start(LitePCIeState *s, struct litepcie_ioctl_dma_start
         for(i = 0; i < m->rx_buf_count; i++) {
             litepcie_writel(s, CSR_DMA_WRITER_TABLE_VALUE_ADDR, m->rx_buf_size);
             litepcie_writel(s, CSR_DMA_WRITER_TABLE_VALUE_ADDR + 4,
-                       s->dma_rx_bufs_addr[i]);
+                       lower_32_bits(s->dma_rx_bufs[i].addr));
             litepcie_writel(s, CSR_DMA_WRITER_TABLE_WE_ADDR, 1);
         }
         litepcie_writel(s, CSR_DMA_WRITER_TABLE_LOOP_PROG_N_ADDR, 1);
@@ -225,110 +406,441 @@ static int litepcie_dma_start(LitePCIeState *s, struct litepcie_ioctl_dma_start
         for(i = 0; i < m->tx_buf_count; i++) {
             litepcie_writel(s, CSR_DMA_READER_TABLE_VALUE_ADDR, m->tx_buf_size);
             litepcie_writel(s, CSR_DMA_READER_TABLE_VALUE_ADDR + 4,
-                       s->dma_tx_bufs_addr[i]);
+                       lower_32_bits(s->dma_tx_bufs[i].addr));
             litepcie_writel(s, CSR_DMA_READER_TABLE_WE_ADDR, 1);
         }
         litepcie_writel(s, CSR_DMA_READER_TABLE_LOOP_PROG_N_ADDR, 1);
     }
 
-    /* start DMA */
+    /* reset the status of the started directions, the interrupt of the
+       other one may be updating it */
     if (m->rx_buf_size != 0) {
-        litepcie_writel(s, CSR_DMA_WRITER_ENABLE_ADDR, 1);
+        spin_lock_irqsave(&s->status_lock, flags);
+        s->status->rx_hw_count = 0;
+        s->status->rx_user_count = 0;
+        s->status->rx_buf_num = 0;
+        s->status->rx_buf_count = m->rx_buf_count;
+        s->rx_loop = litepcie_readl(s, CSR_DMA_WRITER_TABLE_LOOP_STATUS_ADDR) >> 16;
+        s->rx_loops = 0;
+        s->rx_buf_count = m->rx_buf_count;
+        s->rx_buf_num = 0;
+        s->rx_hw_count = 0;
         s->rx_dma_started = 1;
+        spin_unlock_irqrestore(&s->status_lock, flags);
+        s->rx_buf_size = m->rx_buf_size;
+        s->rx_read_buf = 0;
+        s->rx_read_offset = 0;
+        s->rx_file = file;
     }
     if (m->tx_buf_size != 0) {
-        litepcie_writel(s, CSR_DMA_READER_ENABLE_ADDR, 1);
+        spin_lock_irqsave(&s->status_lock, flags);
+        s->status->tx_hw_count = 0;
+        s->status->tx_user_count = 0;
+        s->status->tx_buf_num = 0;
+        s->status->tx_buf_count = m->tx_buf_count;
+        s->tx_loop = litepcie_readl(s, CSR_DMA_READER_TABLE_LOOP_STATUS_ADDR) >> 16;
+        s->tx_loops = 0;
+        s->tx_buf_count = m->tx_buf_count;
+        s->tx_buf_num = 0;
+        s->tx_hw_count = 0;
         s->tx_dma_started = 1;
+        spin_unlock_irqrestore(&s->status_lock, flags);
+        s->tx_buf_size = m->tx_buf_size;
+        s->tx_write_buf = 0;
+        s->tx_write_offset = 0;
+        s->tx_file = file;
+    }
+
+    /* start DMA, the interrupts stay enabled until the DMA is stopped so
+       that the status page follows the DMA */
+    if (m->rx_buf_size != 0) {
+        litepcie_writel(s, CSR_DMA_WRITER_ENABLE_ADDR, 1);
+        litepcie_enable_interrupt(s, DMA_WRITER_INTERRUPT);
+    }
+    if (m->tx_buf_size != 0) {
+        litepcie_writel(s, CSR_DMA_READER_ENABLE_ADDR, 1);
+        litepcie_enable_interrupt(s, DMA_READER_INTERRUPT);
     }
 
     return 0;
 }
 
+static int litepcie_dma_wait_done(LitePCIeState *s,
+                                  struct litepcie_ioctl_dma_wait *m)
+{
+    litepcie_update_status(s);
+    if (m->tx_wait)
+        return s->tx_buf_num != m->tx_buf_num;
+    else
+        return s->rx_buf_num != m->rx_buf_num;
+}
+
 static int litepcie_dma_wait(LitePCIeState *s, struct litepcie_ioctl_dma_wait *m)
 {
-    unsigned long timeout;
-    int ret, last_buf_num;
-    DECLARE_WAITQUEUE(wait, current);
+    wait_queue_head_t *waitqueue;
+    long ret;
 
     if (m->tx_wait) {
         if (!s->tx_dma_started)
             return -EIO;
-        last_buf_num = m->tx_buf_num;
-        litepcie_enable_interrupt(s, DMA_READER_INTERRUPT);
+        waitqueue = &s->dma_tx_waitqueue;
     } else {
         if (!s->rx_dma_started)
             return -EIO;
-        last_buf_num = m->rx_buf_num;
-        litepcie_enable_interrupt(s, DMA_WRITER_INTERRUPT);
+        waitqueue = &s->dma_rx_waitqueue;
     }
 
-    add_wait_queue(&s->dma_waitqueue, &wait);
-
-    timeout = jiffies + msecs_to_jiffies(m->timeout);
-    for (;;) {
-        /* set current buffer */
-        if (s->tx_dma_started) {
-            m->tx_buf_num = (litepcie_readl(s, CSR_DMA_READER_TABLE_LOOP_STATUS_ADDR) & 0xffff);
-        } else {
-            m->tx_buf_num = 0;
-        }
-        if (s->rx_dma_started) {
-            m->rx_buf_num = (litepcie_readl(s, CSR_DMA_WRITER_TABLE_LOOP_STATUS_ADDR) & 0xffff);
-        } else {
-            m->rx_buf_num = 0;
-        }
-        if (m->tx_wait) {
-            if (m->tx_buf_num != last_buf_num)
-                break;
-        } else {
-            if (m->rx_buf_num != last_buf_num)
-                break;
-        }
-        if ((long)(jiffies - timeout) > 0) {
-            ret = -EAGAIN;
-            goto done;
-        }
-        set_current_state(TASK_INTERRUPTIBLE);
-        if (signal_pending(current)) {
-            ret = -EINTR;
-            goto done;
-        }
-        schedule();
-    }
-    ret = 0;
- done:
-    if (m->tx_wait) {
-        litepcie_disable_interrupt(s, DMA_READER_INTERRUPT);
-    } else {
-        litepcie_disable_interrupt(s, DMA_WRITER_INTERRUPT);
-    }
+    ret = wait_event_interruptible_timeout(*waitqueue,
+                                           litepcie_dma_wait_done(s, m),
+                                           msecs_to_jiffies(m->timeout));
+    if (ret < 0)
+        return -EINTR;
+    if (ret == 0)
+        return -EAGAIN;
+
+    /* set current buffer */
+    m->tx_buf_num = s->tx_dma_started ? s->tx_buf_num : 0;
+    m->rx_buf_num = s->rx_dma_started ? s->rx_buf_num : 0;
+    return 0;
+}
 
-    __set_current_state(TASK_RUNNING);
-    remove_wait_queue(&s->dma_waitqueue, &wait);
-    return ret;
+/* RX is readable when the DMA wrote buffers userspace has not consumed
+   yet, TX is writable when the DMA read buffers so that userspace has
+   room to fill. Userspace publishes its progress in the user counts of
+   the status page. */
+static unsigned int litepcie_poll(struct file *file, poll_table *wait)
+{
+    LitePCIeState *s = file->private_data;
+    struct litepcie_status *st = s->status;
+    unsigned int mask = 0;
+
+    poll_wait(file, &s->dma_rx_waitqueue, wait);
+    poll_wait(file, &s->dma_tx_waitqueue, wait);
+
+    litepcie_update_status(s);
+    if (s->rx_dma_started &&
+        READ_ONCE(s->rx_hw_count) > READ_ONCE(st->rx_user_count))
+        mask |= POLLIN | POLLRDNORM;
+    if (s->tx_dma_started &&
+        READ_ONCE(st->tx_user_count) - READ_ONCE(s->tx_hw_count) < s->tx_buf_count)
+        mask |= POLLOUT | POLLWRNORM;
+    return mask;
 }
 
-static int litepcie_dma_stop(LitePCIeState *s)
+static void litepcie_dma_stop_tx(LitePCIeState *s)
 {
-    /* just to be sure, we disable the interrupts */
+    /* just to be sure, we disable the interrupt */
     litepcie_disable_interrupt(s, DMA_READER_INTERRUPT);
-    litepcie_disable_interrupt(s, DMA_WRITER_INTERRUPT);
 
     s->tx_dma_started = 0;
+    s->tx_file = NULL;
     litepcie_writel(s, CSR_DMA_READER_TABLE_LOOP_PROG_N_ADDR, 0);
     litepcie_writel(s, CSR_DMA_READER_TABLE_FLUSH_ADDR, 1);
     udelay(100);
     litepcie_writel(s, CSR_DMA_READER_ENABLE_ADDR, 0);
 
+    s->tx_write_buf = 0; /* drop a partially filled write() ring */
+    s->tx_write_offset = 0;
+    wake_up_interruptible(&s->dma_tx_waitqueue);
+}
+
+static void litepcie_dma_stop_rx(LitePCIeState *s)
+{
+    litepcie_disable_interrupt(s, DMA_WRITER_INTERRUPT);
+
     s->rx_dma_started = 0;
+    s->rx_file = NULL;
     litepcie_writel(s, CSR_DMA_WRITER_TABLE_LOOP_PROG_N_ADDR, 0);
     litepcie_writel(s, CSR_DMA_WRITER_TABLE_FLUSH_ADDR, 1);
     udelay(100);
     litepcie_writel(s, CSR_DMA_WRITER_ENABLE_ADDR, 0);
 
+    wake_up_interruptible(&s->dma_rx_waitqueue);
+}
+
+static int litepcie_dma_stop(LitePCIeState *s)
+{
+    litepcie_dma_stop_tx(s);
+    litepcie_dma_stop_rx(s);
     return 0;
 }
 
+/* Byte stream view of the DMA rings. read() consumes the RX ring and
+   write() fills the TX ring in order, publishing their progress in the
+   user counts of the status page like mmap clients do. Without a prior
+   DMA_START, the first read() starts the DMA writer and the first write()
+   starts the DMA reader once the TX ring is full, both with all the
+   buffers of the module parameters, so that plain tools (dd, cat, ffmpeg)
+   can stream to/from the card; fsync() and close() send the rest (see
+   litepcie_stream_flush()). The data is copied out of/into the DMA
+   buffers; splice() does the same copy without going through user
+   space. */
+static int litepcie_stream_start(LitePCIeState *s, int is_tx, struct file *file)
+{
+    struct litepcie_ioctl_dma_start m;
+
+    memset(&m, 0, sizeof(m));
+    if (is_tx) {
+        m.tx_buf_size = s->dma_buf_size;
+        m.tx_buf_count = s->dma_buf_count;
+    } else {
+        m.rx_buf_size = s->dma_buf_size;
+        m.rx_buf_count = s->dma_buf_count;
+    }
+    return litepcie_dma_start(s, &m, file);
+}
+
+static int litepcie_rx_readable(LitePCIeState *s)
+{
+    litepcie_update_status(s);
+    return !s->rx_dma_started ||
+        READ_ONCE(s->rx_hw_count) != s->rx_read_buf;
+}
+
+static int litepcie_tx_writable(LitePCIeState *s)
+{
+    litepcie_update_status(s);
+    return !s->tx_dma_started ||
+        s->tx_write_buf - READ_ONCE(s->tx_hw_count) < s->tx_buf_count;
+}
+
+static ssize_t litepcie_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct file *file = iocb->ki_filp;
+    LitePCIeState *s = file->private_data;
+    struct litepcie_status *st = s->status;
+    uint64_t hw_count;
+    uint32_t index;
+    size_t copied, len, n;
+    ssize_t ret;
+
+    if (iov_iter_count(to) == 0)
+        return 0;
+    if (mutex_lock_interruptible(&s->stream_lock))
+        return -ERESTARTSYS;
+
+    ret = 0;
+    if (!s->rx_dma_started) {
+        ret = litepcie_stream_start(s, 0, file);
+        if (ret < 0)
+            goto done;
+    }
+
+    copied = 0;
+    while (iov_iter_count(to) > 0) {
+        litepcie_update_status(s);
+        hw_count = READ_ONCE(s->rx_hw_count);
+        if (hw_count - s->rx_read_buf >= s->rx_buf_count) {
+            /* the DMA lapped us: skip to the oldest complete buffer */
+            s->rx_overflows += hw_count - s->rx_read_buf - s->rx_buf_count + 1;
+            s->rx_read_buf = hw_count - s->rx_buf_count + 1;
+            s->rx_read_offset = 0;
+        }
+        if (s->rx_read_buf == hw_count) {
+            if (copied > 0)
+                break;
+            if ((file->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT)) {
+                ret = -EAGAIN;
+                break;
+            }
+            mutex_unlock(&s->stream_lock);
+            if (wait_event_interruptible(s->dma_rx_waitqueue,
+                                         litepcie_rx_readable(s)))
+                return -ERESTARTSYS;
+            if (mutex_lock_interruptible(&s->stream_lock))
+                return -ERESTARTSYS;
+            if (!s->rx_dma_started)
+                break; /* DMA stopped: end of file */
+            continue;
+        }
+
+        div_u64_rem(s->rx_read_buf, s->rx_buf_count, &index);
+        len = min_t(size_t, s->rx_buf_size - s->rx_read_offset,
+                    iov_iter_count(to));
+        n = copy_to_iter(s->dma_rx_bufs[index].virt + s->rx_read_offset,
+                         len, to);
+        if (n == 0) {
+            ret = -EFAULT;
+            break;
+        }
+        copied += n;
+        s->rx_read_offset += n;
+        if (s->rx_read_offset == s->rx_buf_size) {
+            s->rx_read_buf++;
+            s->rx_read_offset = 0;
+            WRITE_ONCE(st->rx_user_count, s->rx_read_buf);
+        }
+    }
+    if (copied > 0)
+        ret = copied;
+done:
+    mutex_unlock(&s->stream_lock);
+    return ret;
+}
+
+static ssize_t litepcie_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct file *file = iocb->ki_filp;
+    LitePCIeState *s = file->private_data;
+    struct litepcie_status *st = s->status;
+    uint64_t hw_count;
+    uint32_t index, buf_size;
+    size_t copied, len, n;
+    ssize_t ret;
+
+    if (iov_iter_count(from) == 0)
+        return 0;
+    if (mutex_lock_interruptible(&s->stream_lock))
+        return -ERESTARTSYS;
+
+    ret = 0;
+    copied = 0;
+    while (iov_iter_count(from) > 0) {
+        if (s->tx_dma_started) {
+            litepcie_update_status(s);
+            hw_count = READ_ONCE(s->tx_hw_count);
+            if (hw_count > s->tx_write_buf) {
+                /* the DMA sent buffers we had not filled yet */
+                s->tx_underflows += hw_count - s->tx_write_buf;
+                s->tx_write_buf = hw_count;
+                s->tx_write_offset = 0;
+                WRITE_ONCE(st->tx_user_count, s->tx_write_buf);
+            }
+            if (s->tx_write_buf - hw_count >= s->tx_buf_count) {
+                /* ring full */
+                if (copied > 0)
+                    break;
+                if ((file->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT)) {
+                    ret = -EAGAIN;
+                    break;
+                }
+                mutex_unlock(&s->stream_lock);
+                if (wait_event_interruptible(s->dma_tx_waitqueue,
+                                             litepcie_tx_writable(s)))
+                    return -ERESTARTSYS;
+                if (mutex_lock_interruptible(&s->stream_lock))
+                    return -ERESTARTSYS;
+                if (!s->tx_dma_started) {
+                    ret = -EIO; /* DMA stopped */
+                    break;
+                }
+                continue;
+            }
+            buf_size = s->tx_buf_size;
+            div_u64_rem(s->tx_write_buf, s->tx_buf_count, &index);
+        } else {
+            /* fill the ring before starting the DMA reader */
+            if (s->tx_write_buf == s->dma_buf_count) {
+                ret = litepcie_stream_start(s, 1, file);
+                if (ret < 0)
+                    break;
+                s->tx_write_buf = s->dma_buf_count;
+                WRITE_ONCE(st->tx_user_count, s->tx_write_buf);
+                continue;
+            }
+            buf_size = s->dma_buf_size;
+            index = s->tx_write_buf;
+            s->tx_file = file;
+        }
+
+        len = min_t(size_t, buf_size - s->tx_write_offset,
+                    iov_iter_count(from));
+        n = copy_from_iter(s->dma_tx_bufs[index].virt + s->tx_write_offset,
+                           len, from);
+        if (n == 0) {
+            ret = -EFAULT;
+            break;
+        }
+        copied += n;
+        s->tx_write_offset += n;
+        if (s->tx_write_offset == buf_size) {
+            s->tx_write_buf++;
+            s->tx_write_offset = 0;
+            if (s->tx_dma_started)
+                WRITE_ONCE(st->tx_user_count, s->tx_write_buf);
+        }
+    }
+    if (copied > 0)
+        ret = copied;
+    mutex_unlock(&s->stream_lock);
+    return ret;
+}
+
+static int litepcie_tx_flushed(LitePCIeState *s, uint64_t count)
+{
+    litepcie_update_status(s);
+    return !s->tx_dma_started || READ_ONCE(s->tx_hw_count) >= count;
+}
+
+/* Send what write() put in the TX ring and wait until the DMA read it:
+   a partially filled buffer is padded with zeros, and a ring write() did
+   not fill yet is started with only the buffers filled so far. The DMA
+   loops over the ring until it is stopped, so the link carries older
+   buffers again (counted in tx_underflows) until the next write() or
+   close(). */
+static int litepcie_stream_flush(LitePCIeState *s, struct file *file)
+{
+    struct litepcie_ioctl_dma_start m;
+    uint32_t index, buf_size;
+    uint64_t count;
+    int ret;
+
+    if (mutex_lock_interruptible(&s->stream_lock))
+        return -ERESTARTSYS;
+    if (s->tx_file != file) {
+        /* nothing written through this file */
+        mutex_unlock(&s->stream_lock);
+        return 0;
+    }
+
+    if (s->tx_write_offset != 0) {
+        if (s->tx_dma_started) {
+            buf_size = s->tx_buf_size;
+            div_u64_rem(s->tx_write_buf, s->tx_buf_count, &index);
+        } else {
+            buf_size = s->dma_buf_size;
+            index = s->tx_write_buf;
+        }
+        memset(s->dma_tx_bufs[index].virt + s->tx_write_offset, 0,
+               buf_size - s->tx_write_offset);
+        s->tx_write_buf++;
+        s->tx_write_offset = 0;
+        if (s->tx_dma_started)
+            WRITE_ONCE(s->status->tx_user_count, s->tx_write_buf);
+    }
+    if (!s->tx_dma_started && s->tx_write_buf > 0) {
+        count = s->tx_write_buf;
+        memset(&m, 0, sizeof(m));
+        m.tx_buf_size = s->dma_buf_size;
+        m.tx_buf_count = count;
+        ret = litepcie_dma_start(s, &m, file);
+        if (ret < 0) {
+            mutex_unlock(&s->stream_lock);
+            return ret;
+        }
+        s->tx_write_buf = count;
+        WRITE_ONCE(s->status->tx_user_count, s->tx_write_buf);
+    }
+    count = s->tx_write_buf;
+    mutex_unlock(&s->stream_lock);
+
+    if (wait_event_interruptible(s->dma_tx_waitqueue,
+                                 litepcie_tx_flushed(s, count)))
+        return -ERESTARTSYS;
+    return 0;
+}
+
+static int litepcie_fsync(struct file *file, loff_t start, loff_t end, int datasync)
+{
+    return litepcie_stream_flush(file->private_data, file);
+}
+
+/* called on each close(), before the release of the last one */
+static int litepcie_flush(struct file *file, fl_owner_t id)
+{
+    return litepcie_stream_flush(file->private_data, file);
+}
+
 static long litepcie_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
     LitePCIeState *s = file->private_data;
@@ -339,15 +851,18 @@ static long litepcie_ioctl(struct file *file, unsigned int cmd, unsigned long ar
         {
             struct litepcie_ioctl_mmap_info m;
             m.dma_tx_buf_offset = 0;
-            m.dma_tx_buf_size = DMA_BUFFER_SIZE;
-            m.dma_tx_buf_count = DMA_BUFFER_COUNT;
+            m.dma_tx_buf_size = s->dma_buf_size;
+            m.dma_tx_buf_count = s->dma_buf_count;
 
-            m.dma_rx_buf_offset = DMA_BUFFER_MAP_SIZE;
-            m.dma_rx_buf_size = DMA_BUFFER_SIZE;
-            m.dma_rx_buf_count = DMA_BUFFER_COUNT;
+            m.dma_rx_buf_offset = s->dma_buf_map_size;
+            m.dma_rx_buf_size = s->dma_buf_size;
+            m.dma_rx_buf_count = s->dma_buf_count;
 
-            m.reg_offset = 2 * DMA_BUFFER_MAP_SIZE;
+            m.reg_offset = LITEPCIE_REG_OFFSET(s);
             m.reg_size = PCI_FPGA_BAR0_SIZE;
+
+            m.status_offset = LITEPCIE_STATUS_OFFSET(s);
+            m.status_size = PAGE_SIZE;
             if (copy_to_user((void *)arg, &m, sizeof(m))) {
                 ret = -EFAULT;
                 break;
@@ -363,12 +878,17 @@ static long litepcie_ioctl(struct file *file, unsigned int cmd, unsigned long ar
                 ret = -EFAULT;
                 break;
             }
-            ret = litepcie_dma_start(s, &m);
+            /* serialized with read()/write(), which index the rings */
+            mutex_lock(&s->stream_lock);
+            ret = litepcie_dma_start(s, &m, file);
+            mutex_unlock(&s->stream_lock);
         }
         break;
     case LITEPCIE_IOCTL_DMA_STOP:
         {
+            mutex_lock(&s->stream_lock);
             ret = litepcie_dma_stop(s);
+            mutex_unlock(&s->stream_lock);
         }
         break;
     case LITEPCIE_IOCTL_DMA_WAIT:
@@ -401,14 +921,254 @@ static const struct file_operations litepcie_fops = {
 	.open = litepcie_open,
 	.release = litepcie_release,
     .mmap = litepcie_mmap,
+    .poll = litepcie_poll,
+    .read_iter = litepcie_read_iter,
+    .write_iter = litepcie_write_iter,
+    .fsync = litepcie_fsync,
+    .flush = litepcie_flush,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0)
+    .splice_read = copy_splice_read,
+#else
+    .splice_read = generic_file_splice_read,
+#endif
+    .splice_write = iter_file_splice_write,
 	.llseek = no_llseek,
 };
 
+static void litepcie_free_irqs(LitePCIeState *s)
+{
+    int i;
+
+    for(i = 0; i < s->msi_vectors; i++)
+        free_irq(pci_irq_vector(s->dev, i), s);
+    pci_free_irq_vectors(s->dev);
+    s->msi_vectors = 0;
+}
+
+/* MSI vector i carries interrupt source i (see interrupt_map in the
+   gateware), so with 2 vectors the DMA writer and reader are
+   separate. */
+static int litepcie_request_irqs(LitePCIeState *s)
+{
+    int ret, i;
+
+    ret = pci_alloc_irq_vectors(s->dev, 1, LITEPCIE_MSI_VECTORS_MAX, PCI_IRQ_MSI);
+    if (ret < 0) {
+        printk(KERN_ERR LITEPCIE_NAME " Failed to enable MSI\n");
+        return ret;
+    }
+    s->msi_vectors = ret;
+#ifdef CSR_MSI_MULTIVECTOR_ADDR
+    litepcie_writel(s, CSR_MSI_MULTIVECTOR_ADDR, s->msi_vectors > 1);
+#endif
+
+    for(i = 0; i < s->msi_vectors; i++) {
+        ret = request_irq(pci_irq_vector(s->dev, i), litepcie_interrupt,
+                          IRQF_SHARED, LITEPCIE_NAME, s);
+        if (ret < 0) {
+            printk(KERN_ERR LITEPCIE_NAME " Failed to allocate irq %d\n",
+                   pci_irq_vector(s->dev, i));
+            s->msi_vectors = i;
+            litepcie_free_irqs(s);
+            return ret;
+        }
+    }
+    printk(KERN_INFO LITEPCIE_NAME " %d MSI vector(s)\n", s->msi_vectors);
+    return 0;
+}
+
+#ifdef CSR_DMA_WRITER_IRQ_BASE
+/* the coalescing settings apply to both DMA directions */
+static void litepcie_set_irq_coalescing(LitePCIeState *s, uint32_t buffers,
+                                        uint32_t usecs)
+{
+    litepcie_writel(s, CSR_DMA_WRITER_IRQ_BUFFERS_ADDR, buffers);
+    litepcie_writel(s, CSR_DMA_WRITER_IRQ_USECS_ADDR, usecs);
+    litepcie_writel(s, CSR_DMA_READER_IRQ_BUFFERS_ADDR, buffers);
+    litepcie_writel(s, CSR_DMA_READER_IRQ_USECS_ADDR, usecs);
+}
+#endif
+
+/* sysfs attributes, in /sys/bus/pci/devices/<device>/ */
+static ssize_t msi_vectors_show(struct device *dev,
+                                struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%d\n", s->msi_vectors);
+}
+static DEVICE_ATTR_RO(msi_vectors);
+
+static ssize_t msi0_irq_count_show(struct device *dev,
+                                   struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%lu\n", s->irq_count[0]);
+}
+static DEVICE_ATTR_RO(msi0_irq_count);
+
+#if LITEPCIE_MSI_VECTORS_MAX > 1
+static ssize_t msi1_irq_count_show(struct device *dev,
+                                   struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%lu\n", s->irq_count[1]);
+}
+static DEVICE_ATTR_RO(msi1_irq_count);
+#endif
+
+static ssize_t rx_overflows_show(struct device *dev,
+                                 struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%lu\n", s->rx_overflows);
+}
+static DEVICE_ATTR_RO(rx_overflows);
+
+static ssize_t tx_underflows_show(struct device *dev,
+                                  struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%lu\n", s->tx_underflows);
+}
+static DEVICE_ATTR_RO(tx_underflows);
+
+#ifdef CSR_DMA_WRITER_IRQ_BASE
+/* interrupt after this many buffers (1: every buffer) */
+static ssize_t irq_coalesce_buffers_show(struct device *dev,
+                                         struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%u\n", litepcie_readl(s, CSR_DMA_WRITER_IRQ_BUFFERS_ADDR));
+}
+
+static ssize_t irq_coalesce_buffers_store(struct device *dev,
+                                          struct device_attribute *attr,
+                                          const char *buf, size_t count)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    unsigned int v;
+
+    if (kstrtouint(buf, 0, &v) || v == 0 || v > 0xffff)
+        return -EINVAL;
+    litepcie_set_irq_coalescing(s, v,
+                                litepcie_readl(s, CSR_DMA_WRITER_IRQ_USECS_ADDR));
+    return count;
+}
+static DEVICE_ATTR_RW(irq_coalesce_buffers);
+
+/* or this many microseconds after the first pending buffer (0: never) */
+static ssize_t irq_coalesce_usecs_show(struct device *dev,
+                                       struct device_attribute *attr, char *buf)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    return sprintf(buf, "%u\n", litepcie_readl(s, CSR_DMA_WRITER_IRQ_USECS_ADDR));
+}
+
+static ssize_t irq_coalesce_usecs_store(struct device *dev,
+                                        struct device_attribute *attr,
+                                        const char *buf, size_t count)
+{
+    LitePCIeState *s = pci_get_drvdata(to_pci_dev(dev));
+    unsigned int v;
+
+    if (kstrtouint(buf, 0, &v) || v > 0xffff)
+        return -EINVAL;
+    litepcie_set_irq_coalescing(s,
+                                litepcie_readl(s, CSR_DMA_WRITER_IRQ_BUFFERS_ADDR), v);
+    return count;
+}
+static DEVICE_ATTR_RW(irq_coalesce_usecs);
+#endif
+
+static struct attribute *litepcie_attrs[] = {
+    &dev_attr_msi_vectors.attr,
+    &dev_attr_msi0_irq_count.attr,
+#if LITEPCIE_MSI_VECTORS_MAX > 1
+    &dev_attr_msi1_irq_count.attr,
+#endif
+    &dev_attr_rx_overflows.attr,
+    &dev_attr_tx_underflows.attr,
+#ifdef CSR_DMA_WRITER_IRQ_BASE
+    &dev_attr_irq_coalesce_buffers.attr,
+    &dev_attr_irq_coalesce_usecs.attr,
+#endif
+    NULL,
+};
+
+static const struct attribute_group litepcie_attr_group = {
+    .attrs = litepcie_attrs,
+};
+
+/* Allocate the DMA buffers of one direction and fill its descriptor
+   table. Try a single coherent region first so that consecutive buffers
+   (e.g. a whole video frame) are contiguous for the device and the
+   IOMMU, and fall back to one coherent allocation per buffer. */
+static LitePCIeDMABuffer *litepcie_alloc_dma_buffers(LitePCIeState *s,
+                                                     uint8_t *contiguous)
+{
+    LitePCIeDMABuffer *bufs;
+    uint8_t *virt;
+    dma_addr_t addr;
+    int i;
+
+    bufs = kcalloc(s->dma_buf_count, sizeof(LitePCIeDMABuffer), GFP_KERNEL);
+    if (!bufs)
+        return NULL;
+
+    virt = dma_alloc_coherent(&s->dev->dev, s->dma_buf_map_size, &addr,
+                              GFP_KERNEL | __GFP_NOWARN);
+    if (virt) {
+        memset(virt, 0, s->dma_buf_map_size);
+        for(i = 0; i < s->dma_buf_count; i++) {
+            bufs[i].virt = virt + i * s->dma_buf_size;
+            bufs[i].addr = addr + i * s->dma_buf_size;
+        }
+        *contiguous = 1;
+        return bufs;
+    }
+
+    *contiguous = 0;
+    for(i = 0; i < s->dma_buf_count; i++) {
+        bufs[i].virt = dma_alloc_coherent(&s->dev->dev, s->dma_buf_size,
+                                          &bufs[i].addr, GFP_KERNEL);
+        if (!bufs[i].virt) {
+            printk(KERN_ERR LITEPCIE_NAME " Failed to allocate DMA buffer %d\n", i);
+            goto fail;
+        }
+        memset(bufs[i].virt, 0, s->dma_buf_size);
+    }
+    return bufs;
+ fail:
+    while (--i >= 0)
+        dma_free_coherent(&s->dev->dev, s->dma_buf_size, bufs[i].virt,
+                          bufs[i].addr);
+    kfree(bufs);
+    return NULL;
+}
+
+static void litepcie_free_dma_buffers(LitePCIeState *s, LitePCIeDMABuffer *bufs,
+                                      uint8_t contiguous)
+{
+    int i;
+
+    if (!bufs)
+        return;
+    if (contiguous) {
+        dma_free_coherent(&s->dev->dev, s->dma_buf_map_size, bufs[0].virt,
+                          bufs[0].addr);
+    } else {
+        for(i = 0; i < s->dma_buf_count; i++)
+            dma_free_coherent(&s->dev->dev, s->dma_buf_size, bufs[i].virt,
+                              bufs[i].addr);
+    }
+    kfree(bufs);
+}
+
 static int litepcie_pci_probe(struct pci_dev *dev, const struct pci_device_id *id)
 {
     LitePCIeState *s = NULL;
     uint8_t rev_id;
-    int ret, minor, i;
+    int ret, minor;
 
     printk(KERN_INFO LITEPCIE_NAME " Probing device\n");
 
@@ -431,6 +1191,11 @@ static int litepcie_pci_probe(struct pci_dev *dev, const struct pci_device_id *i
     }
     s->minor = minor;
     s->dev = dev;
+    spin_lock_init(&s->status_lock);
+    mutex_init(&s->stream_lock);
+    s->dma_buf_size = PAGE_ALIGN(dma_buffer_size);
+    s->dma_buf_count = dma_buffer_count;
+    s->dma_buf_map_size = (unsigned long)s->dma_buf_size * s->dma_buf_count;
     pci_set_drvdata(dev, s);
 
     ret = pci_enable_device(dev);
@@ -465,66 +1230,52 @@ static int litepcie_pci_probe(struct pci_dev *dev, const struct pci_device_id *i
     }
 
     pci_set_master(dev);
-    ret = pci_set_dma_mask(dev, DMA_BIT_MASK(32));
+    /* the descriptors of the LitePCIe DMA hold 32 bit addresses */
+    ret = dma_set_mask_and_coherent(&dev->dev, DMA_BIT_MASK(32));
     if (ret) {
         printk(KERN_ERR LITEPCIE_NAME " Failed to set DMA mask\n");
         goto fail4;
     };
 
-    ret = pci_enable_msi(dev);
-    if (ret) {
-        printk(KERN_ERR LITEPCIE_NAME " Failed to enable MSI\n");
+    if (litepcie_request_irqs(s) < 0)
         goto fail4;
-    }
 
-    if (request_irq(dev->irq, litepcie_interrupt, IRQF_SHARED, LITEPCIE_NAME, s) < 0) {
-        printk(KERN_ERR LITEPCIE_NAME " Failed to allocate irq %d\n", dev->irq);
-        goto fail5;
+    s->status = (struct litepcie_status *)get_zeroed_page(GFP_KERNEL);
+    if (!s->status) {
+        printk(KERN_ERR LITEPCIE_NAME " Failed to allocate status page\n");
+        goto fail6;
     }
 
     /* allocate DMA buffers */
-    for(i = 0; i < DMA_BUFFER_COUNT; i++) {
-        s->dma_tx_bufs[i] = kzalloc(DMA_BUFFER_SIZE, GFP_KERNEL | GFP_DMA32);
-        if (!s->dma_tx_bufs[i]) {
-            printk(KERN_ERR LITEPCIE_NAME " Failed to allocate dma_tx_buf\n");
-            goto fail6;
-        }
-        s->dma_tx_bufs_addr[i] = pci_map_single(dev, s->dma_tx_bufs[i],
-                                                DMA_BUFFER_SIZE,
-                                                DMA_TO_DEVICE);
-        if (!s->dma_tx_bufs_addr[i]) {
-            ret = -ENOMEM;
-            goto fail6;
-        }
+    s->dma_tx_bufs = litepcie_alloc_dma_buffers(s, &s->dma_tx_contiguous);
+    if (!s->dma_tx_bufs) {
+        printk(KERN_ERR LITEPCIE_NAME " Failed to allocate dma_tx_bufs\n");
+        goto fail6;
+    }
+    s->dma_rx_bufs = litepcie_alloc_dma_buffers(s, &s->dma_rx_contiguous);
+    if (!s->dma_rx_bufs) {
+        printk(KERN_ERR LITEPCIE_NAME " Failed to allocate dma_rx_bufs\n");
+        goto fail6;
     }
+    printk(KERN_INFO LITEPCIE_NAME " %u DMA buffers of %u bytes per direction (%s)\n",
+           s->dma_buf_count, s->dma_buf_size,
+           s->dma_tx_contiguous && s->dma_rx_contiguous ? "contiguous" : "scattered");
 
-    for(i = 0; i < DMA_BUFFER_COUNT; i++) {
-        s->dma_rx_bufs[i] = kzalloc(DMA_BUFFER_SIZE, GFP_KERNEL | GFP_DMA32);
-        if (!s->dma_rx_bufs[i]) {
-            printk(KERN_ERR LITEPCIE_NAME " Failed to allocate dma_rx_buf\n");
-            goto fail6;
-        }
+    init_waitqueue_head(&s->dma_tx_waitqueue);
+    init_waitqueue_head(&s->dma_rx_waitqueue);
 
-        s->dma_rx_bufs_addr[i] = pci_map_single(dev, s->dma_rx_bufs[i],
-                                                DMA_BUFFER_SIZE,
-                                                DMA_FROM_DEVICE);
-        if (!s->dma_rx_bufs_addr[i]) {
-            ret = -ENOMEM;
-            goto fail6;
-        }
+    if (sysfs_create_group(&dev->dev.kobj, &litepcie_attr_group) < 0) {
+        printk(KERN_ERR LITEPCIE_NAME " Failed to create sysfs attributes\n");
+        goto fail6;
     }
 
-    init_waitqueue_head(&s->dma_waitqueue);
-
     litepcie_minor_table[minor] = s;
     printk(KERN_INFO LITEPCIE_NAME " Assigned to minor %d\n", minor);
     return 0;
 
  fail6:
     litepcie_end(dev, s);
-    free_irq(dev->irq, s);
- fail5:
-    pci_disable_msi(dev);
+    litepcie_free_irqs(s);
  fail4:
     pci_iounmap(dev, s->bar0_addr);
  fail3:
@@ -540,23 +1291,12 @@ static int litepcie_pci_probe(struct pci_dev *dev, const struct pci_device_id *i
 
 static void litepcie_end(struct pci_dev *dev, LitePCIeState *s)
 {
-    int i;
-
-    for(i = 0; i < DMA_BUFFER_COUNT; i++) {
-        if (s->dma_tx_bufs_addr[i]) {
-            dma_unmap_single(&dev->dev, s->dma_tx_bufs_addr[i],
-                             DMA_BUFFER_SIZE, DMA_TO_DEVICE);
-        }
-        kfree(s->dma_tx_bufs[i]);
-    }
-
-    for(i = 0; i < DMA_BUFFER_COUNT; i++) {
-        if (s->dma_rx_bufs_addr[i]) {
-            dma_unmap_single(&dev->dev, s->dma_rx_bufs_addr[i],
-                             DMA_BUFFER_SIZE, DMA_FROM_DEVICE);
-        }
-        kfree(s->dma_rx_bufs[i]);
-    }
+    litepcie_free_dma_buffers(s, s->dma_tx_bufs, s->dma_tx_contiguous);
+    s->dma_tx_bufs = NULL;
+    litepcie_free_dma_buffers(s, s->dma_rx_bufs, s->dma_rx_contiguous);
+    s->dma_rx_bufs = NULL;
+    free_page((unsigned long)s->status);
+    s->status = NULL;
 }
 
 static void litepcie_pci_remove(struct pci_dev *dev)
@@ -566,9 +1306,9 @@ static void litepcie_pci_remove(struct pci_dev *dev)
     printk(KERN_INFO LITEPCIE_NAME " Removing device\n");
     litepcie_minor_table[s->minor] = NULL;
 
+    sysfs_remove_group(&dev->dev.kobj, &litepcie_attr_group);
     litepcie_end(dev, s);
-    free_irq(dev->irq, s);
-    pci_disable_msi(dev);
+    litepcie_free_irqs(s);
     pci_iounmap(dev, s->bar0_addr);
     pci_disable_device(dev);
     pci_release_regions(dev);
@@ -593,6 +1333,13 @@ static int __init litepcie_module_init(void)
 {
     int	ret;
 
+    if (dma_buffer_count == 0 || dma_buffer_count > DMA_BUFFER_COUNT_MAX ||
+        dma_buffer_size == 0 || dma_buffer_size > DMA_BUFFER_SIZE_MAX) {
+        printk(KERN_ERR LITEPCIE_NAME " Invalid DMA buffer count/size (max %d x %d bytes)\n",
+               DMA_BUFFER_COUNT_MAX, DMA_BUFFER_SIZE_MAX);
+        return -EINVAL;
+    }
+
     ret = pci_register_driver(&litepcie_pci_driver);
     if (ret < 0) {
         printk(KERN_ERR LITEPCIE_NAME " Error while registering PCI driver\n");
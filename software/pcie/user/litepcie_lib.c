@@ -12,6 +12,7 @@
 #include <sys/mman.h>
 #include <time.h>
 #include <errno.h>
+#include <poll.h>
 
 #include "litepcie.h"
 #include "cutils.h"
@@ -21,11 +22,6 @@
 
 #include "litepcie_lib.h"
 
-/*
-  TODO:
-  - DMA overflow/underflow detection
-*/
-
 void *litepcie_malloc(int size)
 {
     return malloc(size);
@@ -63,6 +59,14 @@ int64_t litepcie_get_time_ms(void)
     return (int64_t)ts.tv_sec * 1000 + (ts.tv_nsec / 1000000U);
 }
 
+/* in us */
+int64_t litepcie_get_time_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + (ts.tv_nsec / 1000U);
+}
+
 LitePCIeState *litepcie_open(const char *device_name)
 {
     LitePCIeState *s;
@@ -110,10 +114,20 @@ LitePCIeState *litepcie_open(const char *device_name)
         exit(1);
     }
 
+    /* map the status page */
+    s->status = mmap(NULL, s->mmap_info.status_size,
+                     PROT_READ | PROT_WRITE, MAP_SHARED, s->litepcie_fd,
+                     s->mmap_info.status_offset);
+    if (s->status == MAP_FAILED) {
+        perror("mmap3");
+        exit(1);
+    }
+
     s->dma_tx_buf_size = s->mmap_info.dma_tx_buf_size;
     s->dma_rx_buf_size = s->mmap_info.dma_rx_buf_size;
 
     pthread_mutex_init(&s->fifo_mutex, NULL);
+    pthread_cond_init(&s->fifo_cond, NULL);
 
     return s;
  fail:
@@ -125,8 +139,9 @@ void litepcie_dma_start(LitePCIeState *s, int buf_size, int buf_count, BOOL is_l
 {
     struct litepcie_ioctl_dma_start dma_start;
 
-    if (buf_count > DMA_BUFFER_COUNT) {
-        litepcie_log(s, "unsupported buf_count\n");
+    if (buf_count > s->mmap_info.dma_rx_buf_count ||
+        buf_size > s->mmap_info.dma_rx_buf_size) {
+        litepcie_log(s, "unsupported buf_count/buf_size\n");
         exit(1);
     }
 
@@ -152,6 +167,19 @@ void litepcie_dma_stop(LitePCIeState *s)
     }
 }
 
+/* Wait until the DMA wrote buffers beyond status->rx_user_count (RX) or
+   read buffers so that there is room after status->tx_user_count (TX).
+   'timeout' is in ms. Return > 0 if ready, 0 on timeout, < 0 on error. */
+int litepcie_dma_poll(LitePCIeState *s, BOOL is_tx, int timeout)
+{
+    struct pollfd pfd;
+
+    pfd.fd = s->litepcie_fd;
+    pfd.events = is_tx ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, timeout);
+}
+
 void litepcie_writel(LitePCIeState *s, uint32_t addr, uint32_t val)
 {
     *(volatile uint32_t *)(s->reg_buf + addr) = val;
@@ -162,10 +190,559 @@ uint32_t litepcie_readl(LitePCIeState *s, uint32_t addr)
     return *(volatile uint32_t *)(s->reg_buf + addr);
 }
 
+#ifdef CSR_FRAMES_BASE
+
+/* Start frame capture: 'fps' frames per second (0: as fast as
+   possible). The DMA uses the full buffer pitch so that frames spanning
+   several buffers are contiguous in the mmap'ed RX ring. Return 0 if
+   OK. */
+int litepcie_frame_start(LitePCIeState *s, int width, int height, int fps)
+{
+    struct litepcie_ioctl_dma_start dma_start;
+    unsigned int frame_size;
+
+    if (width <= 0 || (width & 3) != 0 || height <= 0) {
+        litepcie_log(s, "unsupported frame size %dx%d\n", width, height);
+        return -1;
+    }
+
+    s->rx_buf_size = s->dma_rx_buf_size;
+    s->rx_buf_count = s->mmap_info.dma_rx_buf_count;
+    frame_size = sizeof(LitePCIeFrameHeader) + width * height * 2;
+    if (frame_size > s->rx_buf_size * (s->rx_buf_count / 2)) {
+        litepcie_log(s, "frame does not fit in half of the DMA ring\n");
+        return -1;
+    }
+
+    litepcie_free(s->frame_buf);
+    s->frame_buf_size = frame_size;
+    s->frame_buf = litepcie_malloc(s->frame_buf_size);
+    if (!s->frame_buf)
+        return -1;
+
+    litepcie_writel(s, CSR_FRAMES_ENABLE_ADDR, 0);
+
+    dma_start.dma_flags = 0;
+    dma_start.tx_buf_size = 0;
+    dma_start.tx_buf_count = 0;
+    dma_start.rx_buf_size = s->rx_buf_size;
+    dma_start.rx_buf_count = s->rx_buf_count;
+    if (ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &dma_start) < 0) {
+        perror("LITEPCIE_IOCTL_DMA_START");
+        return -1;
+    }
+
+    s->rx_buf_total = 0;
+    s->has_frame_sequence = FALSE;
+    s->frame_drop_count = 0;
+    s->rx_overflow_count = 0;
+
+    litepcie_writel(s, CSR_FRAMES_WIDTH_ADDR, width);
+    litepcie_writel(s, CSR_FRAMES_HEIGHT_ADDR, height);
+    litepcie_writel(s, CSR_FRAMES_BUFFER_SIZE_ADDR, s->rx_buf_size);
+    litepcie_writel(s, CSR_FRAMES_FRAME_PERIOD_ADDR,
+                    fps > 0 ? SYSTEM_CLOCK_FREQUENCY / fps : 0);
+    litepcie_writel(s, CSR_FRAMES_ENABLE_ADDR, 1);
+    return 0;
+}
+
+/* Return in 'frame' the next complete frame. Frames are returned in
+   place (zero copy) unless they wrap around the end of the ring. Lost
+   frames are counted in s->frame_drop_count and DMA overruns in
+   s->rx_overflow_count. 'timeout' is in ms. Return 0 if OK, -1 if no
+   frame was received before the timeout. */
+int litepcie_frame_get(LitePCIeState *s, LitePCIeFrame *frame, int timeout)
+{
+    const LitePCIeFrameHeader *h;
+    unsigned int index, buf_count, first_len;
+    uint64_t hw_total;
+    int64_t end_time, t;
+
+    end_time = litepcie_get_time_ms() + timeout;
+    for(;;) {
+        hw_total = s->status->rx_hw_count;
+
+        /* the DMA lapped us: drop everything and resynchronize on the
+           next frame */
+        if (hw_total - s->rx_buf_total >= s->rx_buf_count) {
+            s->rx_overflow_count++;
+            s->rx_buf_total = hw_total;
+            s->has_frame_sequence = FALSE;
+        }
+
+        while (s->rx_buf_total < hw_total) {
+            index = s->rx_buf_total % s->rx_buf_count;
+            h = (const LitePCIeFrameHeader *)(s->dma_rx_buf +
+                                              index * s->dma_rx_buf_size);
+            if (h->magic != LITEPCIE_FRAME_MAGIC ||
+                h->header_size != sizeof(LitePCIeFrameHeader) ||
+                h->header_size + h->length > s->frame_buf_size) {
+                /* padding or partial frame */
+                s->rx_buf_total++;
+                continue;
+            }
+            buf_count = (h->header_size + h->length + s->rx_buf_size - 1) /
+                s->rx_buf_size;
+            if (hw_total - s->rx_buf_total < buf_count)
+                break; /* not complete yet */
+
+            frame->sequence = h->sequence;
+            frame->width = h->width;
+            frame->height = h->height;
+            frame->format = h->format;
+            frame->timestamp = h->timestamp;
+            frame->length = h->length;
+            frame->buf_total = s->rx_buf_total;
+            if (index + buf_count <= s->rx_buf_count) {
+                frame->data = (const uint8_t *)h + h->header_size;
+                frame->is_copy = FALSE;
+            } else {
+                first_len = (s->rx_buf_count - index) * s->rx_buf_size -
+                    h->header_size;
+                memcpy(s->frame_buf, (const uint8_t *)h + h->header_size,
+                       first_len);
+                memcpy(s->frame_buf + first_len, s->dma_rx_buf,
+                       h->length - first_len);
+                frame->data = s->frame_buf;
+                frame->is_copy = TRUE;
+            }
+
+            if (s->has_frame_sequence)
+                s->frame_drop_count += (uint32_t)(h->sequence - s->frame_sequence);
+            s->frame_sequence = h->sequence + 1;
+            s->has_frame_sequence = TRUE;
+            s->rx_buf_total += buf_count;
+            s->status->rx_user_count = s->rx_buf_total;
+            return 0;
+        }
+
+        /* sleep until the DMA writes another buffer */
+        s->status->rx_user_count = hw_total;
+        t = end_time - litepcie_get_time_ms();
+        if (t <= 0 || litepcie_dma_poll(s, FALSE, t) <= 0)
+            return -1;
+    }
+}
+
+/* Return TRUE if the data of a frame returned in place by
+   litepcie_frame_get() has not been overwritten by the DMA yet. Check
+   it after processing the frame to detect torn frames. */
+BOOL litepcie_frame_valid(LitePCIeState *s, const LitePCIeFrame *frame)
+{
+    if (frame->is_copy)
+        return TRUE;
+    /* the status page may lag the DMA by one buffer */
+    return s->status->rx_hw_count + 1 < frame->buf_total + s->rx_buf_count;
+}
+
+void litepcie_frame_stop(LitePCIeState *s)
+{
+    litepcie_writel(s, CSR_FRAMES_ENABLE_ADDR, 0);
+    litepcie_dma_stop(s);
+}
+
+#endif /* CSR_FRAMES_BASE */
+
+/* Buffer streaming
+
+   The DMA runs continuously over the rings, so buffers are numbered since
+   the start ('seq') and buffer seq lives at index seq % buf_count. One
+   thread per direction follows the DMA progress and hands buffer numbers
+   to the user through a lock-free SPSC queue (or calls the callback
+   directly):
+
+   - RX: received buffers, popped with litepcie_rx_pop(). A buffer the
+     DMA already overwrote is dropped and counted in rx_overflow_count.
+   - TX: buffers to fill, taken with litepcie_tx_get() and submitted in
+     order with litepcie_tx_push(). A buffer the DMA read before it was
+     pushed is counted in tx_underflow_count. The DMA starts once the
+     whole ring has been filled.
+
+   The queues only block the user when empty: fifo_mutex/fifo_cond are
+   used for sleeping, not for the data path. */
+
+static int litepcie_queue_init(LitePCIeQueue *q, int size)
+{
+    unsigned int n;
+
+    for(n = 1; n < size; n *= 2)
+        continue;
+    q->slots = litepcie_malloc(n * sizeof(uint64_t));
+    if (!q->slots)
+        return -1;
+    q->mask = n - 1;
+    q->head = 0;
+    q->tail = 0;
+    return 0;
+}
+
+static void litepcie_queue_end(LitePCIeQueue *q)
+{
+    litepcie_free(q->slots);
+    q->slots = NULL;
+}
+
+static BOOL litepcie_queue_push(LitePCIeQueue *q, uint64_t v)
+{
+    unsigned int head = q->head;
+
+    if (head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) > q->mask)
+        return FALSE; /* full */
+    q->slots[head & q->mask] = v;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+static BOOL litepcie_queue_pop(LitePCIeQueue *q, uint64_t *v)
+{
+    unsigned int tail = q->tail;
+
+    if (__atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == tail)
+        return FALSE; /* empty */
+    *v = q->slots[tail & q->mask];
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return TRUE;
+}
+
+/* wake up the users blocked in litepcie_queue_wait_pop(), called by the
+   producer after pushing */
+static void litepcie_queue_notify(LitePCIeState *s)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&s->fifo_waiters, __ATOMIC_RELAXED) == 0)
+        return;
+    pthread_mutex_lock(&s->fifo_mutex);
+    pthread_cond_broadcast(&s->fifo_cond);
+    pthread_mutex_unlock(&s->fifo_mutex);
+}
+
+/* pop, waiting up to 'timeout' ms (< 0: forever) */
+static BOOL litepcie_queue_wait_pop(LitePCIeState *s, LitePCIeQueue *q,
+                                    uint64_t *v, int timeout)
+{
+    struct timespec ts;
+    int64_t t;
+    BOOL ret;
+
+    if (litepcie_queue_pop(q, v))
+        return TRUE;
+    if (timeout == 0)
+        return FALSE;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    t = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + (int64_t)timeout * 1000000;
+    ts.tv_sec = t / 1000000000;
+    ts.tv_nsec = t % 1000000000;
+
+    pthread_mutex_lock(&s->fifo_mutex);
+    __atomic_fetch_add(&s->fifo_waiters, 1, __ATOMIC_SEQ_CST);
+    for(;;) {
+        ret = litepcie_queue_pop(q, v);
+        if (ret || s->stream_stop)
+            break;
+        if (timeout < 0) {
+            pthread_cond_wait(&s->fifo_cond, &s->fifo_mutex);
+        } else if (pthread_cond_timedwait(&s->fifo_cond, &s->fifo_mutex,
+                                          &ts) == ETIMEDOUT) {
+            ret = litepcie_queue_pop(q, v);
+            break;
+        }
+    }
+    __atomic_fetch_sub(&s->fifo_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&s->fifo_mutex);
+    return ret;
+}
+
+static void litepcie_get_buffer(LitePCIeState *s, BOOL is_tx, uint64_t seq,
+                                LitePCIeBuffer *buf)
+{
+    if (is_tx) {
+        buf->data = s->dma_tx_buf + (seq % s->tx_buf_count) * s->dma_tx_buf_size;
+        buf->size = s->tx_buf_size;
+    } else {
+        buf->data = s->dma_rx_buf + (seq % s->rx_buf_count) * s->dma_rx_buf_size;
+        buf->size = s->rx_buf_size;
+    }
+    buf->seq = seq;
+}
+
+/* the status page may lag the DMA by one buffer, so the buffer after
+   the last one reported is considered in use by the DMA */
+static BOOL litepcie_rx_overwritten(LitePCIeState *s, uint64_t seq)
+{
+    return s->status->rx_hw_count + 1 >= seq + s->rx_buf_count;
+}
+
+static BOOL litepcie_tx_late(LitePCIeState *s, uint64_t seq)
+{
+    return s->stream_running && seq <= s->status->tx_hw_count;
+}
+
+/* wait for DMA progress in one direction (at most 100 ms) */
+static void litepcie_stream_wait(LitePCIeState *s, BOOL is_tx)
+{
+    struct litepcie_ioctl_dma_wait dma_wait;
+
+    dma_wait.timeout = 100;
+    dma_wait.tx_wait = is_tx;
+    dma_wait.tx_buf_num = s->status->tx_buf_num;
+    dma_wait.rx_buf_num = s->status->rx_buf_num;
+    ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_WAIT, &dma_wait);
+}
+
+static void *litepcie_rx_thread(void *opaque)
+{
+    LitePCIeState *s = opaque;
+    LitePCIeBuffer buf;
+    uint64_t next, hw_count;
+
+    next = 0; /* next buffer to hand out */
+    while (!s->stream_stop) {
+        hw_count = s->status->rx_hw_count;
+        while (next < hw_count) {
+            if (litepcie_rx_overwritten(s, next)) {
+                __atomic_fetch_add(&s->rx_overflow_count, 1, __ATOMIC_RELAXED);
+            } else if (s->rx_cb) {
+                litepcie_get_buffer(s, FALSE, next, &buf);
+                s->rx_cb(s->cb_opaque, &buf);
+                litepcie_rx_release(s, &buf);
+            } else if (!litepcie_queue_push(&s->rx_queue, next)) {
+                break; /* the user is late, retry after the next buffer */
+            }
+            next++;
+        }
+        if (!s->rx_cb)
+            litepcie_queue_notify(s);
+        s->status->rx_user_count = next;
+        litepcie_stream_wait(s, FALSE);
+    }
+    return NULL;
+}
+
+static void *litepcie_tx_thread(void *opaque)
+{
+    LitePCIeState *s = opaque;
+    LitePCIeBuffer buf;
+    uint64_t next, hw_count;
+
+    next = s->tx_buf_count; /* next buffer to hand out, the first ring
+                               was filled before the DMA started */
+    while (!s->stream_stop) {
+        hw_count = s->status->tx_hw_count;
+        if (next <= hw_count) {
+            /* the DMA already read them: skip */
+            __atomic_fetch_add(&s->tx_underflow_count, hw_count + 1 - next,
+                               __ATOMIC_RELAXED);
+            next = hw_count + 1;
+        }
+        /* buffer hw_count + tx_buf_count shares the ring slot of the
+           buffer the DMA is reading */
+        while (next < hw_count + s->tx_buf_count) {
+            if (s->tx_cb) {
+                litepcie_get_buffer(s, TRUE, next, &buf);
+                s->tx_cb(s->cb_opaque, &buf);
+                litepcie_tx_push(s, &buf);
+            } else if (!litepcie_queue_push(&s->tx_queue, next)) {
+                break;
+            }
+            next++;
+        }
+        if (!s->tx_cb)
+            litepcie_queue_notify(s);
+        litepcie_stream_wait(s, TRUE);
+    }
+    return NULL;
+}
+
+/* start the DMA, then the threads following it */
+static int litepcie_stream_run(LitePCIeState *s)
+{
+    struct litepcie_ioctl_dma_start dma_start;
+    BOOL is_rx = (s->stream_flags & LITEPCIE_STREAM_RX) != 0;
+    BOOL is_tx = (s->stream_flags & LITEPCIE_STREAM_TX) != 0;
+
+    dma_start.dma_flags = (s->stream_flags & LITEPCIE_STREAM_LOOPBACK) ?
+        DMA_LOOPBACK_ENABLE : 0;
+    dma_start.tx_buf_size = is_tx ? s->tx_buf_size : 0;
+    dma_start.tx_buf_count = is_tx ? s->tx_buf_count : 0;
+    dma_start.rx_buf_size = is_rx ? s->rx_buf_size : 0;
+    dma_start.rx_buf_count = is_rx ? s->rx_buf_count : 0;
+    if (ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &dma_start) < 0) {
+        perror("LITEPCIE_IOCTL_DMA_START");
+        return -1;
+    }
+    if (is_tx)
+        s->status->tx_user_count = s->tx_buf_count; /* the ring is full */
+
+    s->stream_threads = 0;
+    s->stream_running = TRUE;
+    if (is_rx) {
+        if (pthread_create(&s->rx_thread, NULL, litepcie_rx_thread, s) != 0)
+            return -1;
+        s->stream_threads |= LITEPCIE_STREAM_RX;
+    }
+    if (is_tx) {
+        if (pthread_create(&s->tx_thread, NULL, litepcie_tx_thread, s) != 0)
+            return -1;
+        s->stream_threads |= LITEPCIE_STREAM_TX;
+    }
+    return 0;
+}
+
+/* Set up streaming for the directions in 'flags' (LITEPCIE_STREAM_x).
+   Buffers are passed to the callbacks if not NULL, otherwise they are
+   available with litepcie_rx_pop() and litepcie_tx_get().
+
+   The DMA reads the TX ring as soon as it starts, so with TX the whole
+   ring is filled first: with a callback it is called for the first
+   buf_count buffers before this function starts the DMA, otherwise the
+   DMA starts when the first buf_count buffers have been pushed. Return 0
+   if OK. */
+int litepcie_stream_start(LitePCIeState *s, int flags, int buf_size, int buf_count,
+                          LitePCIeBufferCB *rx_cb, LitePCIeBufferCB *tx_cb,
+                          void *opaque)
+{
+    LitePCIeBuffer buf;
+    BOOL is_rx = (flags & LITEPCIE_STREAM_RX) != 0;
+    BOOL is_tx = (flags & LITEPCIE_STREAM_TX) != 0;
+    int i;
+
+    if ((!is_rx && !is_tx) || s->stream_flags ||
+        buf_count > s->mmap_info.dma_rx_buf_count ||
+        buf_size > s->mmap_info.dma_rx_buf_size) {
+        litepcie_log(s, "unsupported stream configuration\n");
+        return -1;
+    }
+
+    s->tx_buf_size = s->rx_buf_size = buf_size;
+    s->tx_buf_count = s->rx_buf_count = buf_count;
+    s->rx_cb = rx_cb;
+    s->tx_cb = tx_cb;
+    s->cb_opaque = opaque;
+    s->stream_stop = FALSE;
+    s->stream_running = FALSE;
+    s->stream_threads = 0;
+    s->rx_overflow_count = 0;
+    s->tx_underflow_count = 0;
+    if (litepcie_queue_init(&s->rx_queue, buf_count) < 0 ||
+        litepcie_queue_init(&s->tx_queue, buf_count) < 0) {
+        litepcie_queue_end(&s->rx_queue);
+        litepcie_queue_end(&s->tx_queue);
+        return -1;
+    }
+    s->stream_flags = flags;
+
+    if (is_tx) {
+        for(i = 0; i < buf_count; i++) {
+            if (tx_cb) {
+                litepcie_get_buffer(s, TRUE, i, &buf);
+                tx_cb(opaque, &buf);
+            } else {
+                litepcie_queue_push(&s->tx_queue, i);
+            }
+        }
+        if (!tx_cb)
+            return 0; /* started by litepcie_tx_push() */
+    }
+    if (litepcie_stream_run(s) < 0) {
+        litepcie_stream_stop(s);
+        return -1;
+    }
+    return 0;
+}
+
+void litepcie_stream_stop(LitePCIeState *s)
+{
+    s->stream_stop = TRUE;
+    pthread_mutex_lock(&s->fifo_mutex);
+    pthread_cond_broadcast(&s->fifo_cond);
+    pthread_mutex_unlock(&s->fifo_mutex);
+    if (s->stream_threads & LITEPCIE_STREAM_RX)
+        pthread_join(s->rx_thread, NULL);
+    if (s->stream_threads & LITEPCIE_STREAM_TX)
+        pthread_join(s->tx_thread, NULL);
+    if (s->stream_running)
+        litepcie_dma_stop(s);
+    litepcie_queue_end(&s->rx_queue);
+    litepcie_queue_end(&s->tx_queue);
+    s->stream_threads = 0;
+    s->stream_running = FALSE;
+    s->stream_flags = 0;
+}
+
+/* Get the next received buffer, waiting up to 'timeout' ms (< 0:
+   forever). Buffers come in order; the ones overwritten by the DMA
+   before being popped are skipped. Return 0 if OK, -1 on timeout. */
+int litepcie_rx_pop(LitePCIeState *s, LitePCIeBuffer *buf, int timeout)
+{
+    uint64_t seq;
+
+    for(;;) {
+        if (!litepcie_queue_wait_pop(s, &s->rx_queue, &seq, timeout))
+            return -1;
+        if (!litepcie_rx_overwritten(s, seq))
+            break;
+        __atomic_fetch_add(&s->rx_overflow_count, 1, __ATOMIC_RELAXED);
+    }
+    litepcie_get_buffer(s, FALSE, seq, buf);
+    return 0;
+}
+
+/* Done with a received buffer. Return FALSE (and count an overflow) if
+   the DMA overwrote it while it was in use. */
+BOOL litepcie_rx_release(LitePCIeState *s, LitePCIeBuffer *buf)
+{
+    if (litepcie_rx_overwritten(s, buf->seq)) {
+        __atomic_fetch_add(&s->rx_overflow_count, 1, __ATOMIC_RELAXED);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Get the next TX buffer to fill, waiting up to 'timeout' ms (< 0:
+   forever). Return 0 if OK, -1 on timeout. */
+int litepcie_tx_get(LitePCIeState *s, LitePCIeBuffer *buf, int timeout)
+{
+    uint64_t seq;
+
+    for(;;) {
+        if (!litepcie_queue_wait_pop(s, &s->tx_queue, &seq, timeout))
+            return -1;
+        if (!litepcie_tx_late(s, seq))
+            break;
+        __atomic_fetch_add(&s->tx_underflow_count, 1, __ATOMIC_RELAXED);
+    }
+    litepcie_get_buffer(s, TRUE, seq, buf);
+    return 0;
+}
+
+/* Submit a filled TX buffer, in the order of litepcie_tx_get(). Return
+   FALSE (and count an underflow) if the DMA already read it. */
+BOOL litepcie_tx_push(LitePCIeState *s, LitePCIeBuffer *buf)
+{
+    if (!s->stream_running) {
+        /* the last buffer of the initial ring starts the DMA */
+        if (buf->seq == s->tx_buf_count - 1 && litepcie_stream_run(s) < 0)
+            return FALSE;
+        return TRUE;
+    }
+    s->status->tx_user_count = buf->seq + 1;
+    if (litepcie_tx_late(s, buf->seq)) {
+        __atomic_fetch_add(&s->tx_underflow_count, 1, __ATOMIC_RELAXED);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 void litepcie_close(LitePCIeState *s)
 {
+    if (s->stream_flags)
+        litepcie_stream_stop(s);
+    pthread_cond_destroy(&s->fifo_cond);
     pthread_mutex_destroy(&s->fifo_mutex);
 
+    litepcie_free(s->frame_buf);
+
     if (s->dma_tx_buf) {
         munmap(s->dma_tx_buf, s->mmap_info.dma_tx_buf_size *
                s->mmap_info.dma_tx_buf_count);
@@ -176,6 +753,8 @@ void litepcie_close(LitePCIeState *s)
     }
     if (s->reg_buf)
         munmap(s->reg_buf, s->mmap_info.reg_size);
+    if (s->status)
+        munmap((void *)s->status, s->mmap_info.status_size);
     if (s->litepcie_fd >= 0)
         close(s->litepcie_fd);
     litepcie_free(s);
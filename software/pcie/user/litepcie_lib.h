@@ -10,6 +10,29 @@
 
 #define LITEPCIE_FILENAME "/dev/litepcie0"
 
+/* lock-free single producer, single consumer queue of buffer numbers */
+typedef struct {
+    uint64_t *slots;
+    unsigned int mask; /* number of slots - 1, a power of 2 */
+    unsigned int head; /* written by the producer only */
+    unsigned int tail; /* written by the consumer only */
+} LitePCIeQueue;
+
+/* a DMA buffer handed out by the streaming API (litepcie_stream_*) */
+typedef struct {
+    uint8_t *data;
+    unsigned int size; /* in bytes */
+    uint64_t seq; /* buffer number since litepcie_stream_start() */
+} LitePCIeBuffer;
+
+/* called from the RX thread with a received buffer, or from the TX thread
+   with a buffer to fill */
+typedef void LitePCIeBufferCB(void *opaque, LitePCIeBuffer *buf);
+
+#define LITEPCIE_STREAM_RX       (1 << 0)
+#define LITEPCIE_STREAM_TX       (1 << 1)
+#define LITEPCIE_STREAM_LOOPBACK (1 << 2)
+
 typedef struct {
     int litepcie_fd;
     struct litepcie_ioctl_mmap_info mmap_info;
@@ -18,6 +41,7 @@ typedef struct {
     uint8_t *dma_rx_buf;
     int dma_rx_buf_size;
     uint8_t *reg_buf;
+    volatile struct litepcie_status *status; /* DMA progress, see litepcie.h */
 
     unsigned int tx_buf_size; /* in bytes */
     unsigned int tx_buf_count; /* number of buffers */
@@ -36,18 +60,84 @@ typedef struct {
 
     int64_t tx_underflow_count; /* TX too late */
     int64_t rx_overflow_count; /* RX too late */
+
+    /* frame capture (litepcie_frame_*) */
+    uint64_t rx_buf_total; /* number of RX buffers consumed */
+    uint8_t *frame_buf; /* copy of frames wrapping around the ring */
+    unsigned int frame_buf_size;
+    BOOL has_frame_sequence; /* true if received at least one frame */
+    uint32_t frame_sequence; /* sequence number of the next frame */
+    int64_t frame_drop_count; /* frames lost (sequence gaps) */
+
+    /* buffer streaming (litepcie_stream_*) */
+    int stream_flags; /* LITEPCIE_STREAM_x, 0 if not started */
+    BOOL stream_running; /* DMA started */
+    int stream_threads; /* LITEPCIE_STREAM_RX/TX: threads to join */
+    LitePCIeQueue rx_queue; /* received buffers, RX thread -> user */
+    LitePCIeQueue tx_queue; /* buffers to fill, TX thread -> user */
+    pthread_t rx_thread;
+    pthread_t tx_thread;
+    int stream_stop; /* tells the threads to exit */
+    pthread_cond_t fifo_cond; /* signalled when a queue gets a buffer */
+    int fifo_waiters; /* users blocked in a pop */
+    LitePCIeBufferCB *rx_cb;
+    LitePCIeBufferCB *tx_cb;
+    void *cb_opaque;
 } LitePCIeState;
 
+/* Frame header written by the gateware at the start of a DMA buffer (see
+   gateware/streamer/pcie.py). */
+#define LITEPCIE_FRAME_MAGIC 0x4d524648 /* "HFRM" */
+#define LITEPCIE_FRAME_FORMAT_YCBCR422 1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint16_t width;
+    uint16_t height;
+    uint16_t format;
+    uint16_t header_size;
+    uint32_t length; /* payload length in bytes */
+    uint32_t reserved;
+    uint64_t timestamp; /* FPGA clock cycles */
+} LitePCIeFrameHeader;
+
+typedef struct {
+    uint32_t sequence;
+    int width;
+    int height;
+    int format;
+    uint64_t timestamp; /* FPGA clock cycles */
+    const uint8_t *data; /* valid until the DMA wraps around the ring */
+    unsigned int length; /* in bytes */
+    BOOL is_copy; /* data wrapped around the ring and was copied */
+    uint64_t buf_total; /* internal: position of the frame in the ring */
+} LitePCIeFrame;
+
 void *litepcie_malloc(int size);
 void *litepcie_mallocz(int size);
 void litepcie_free(void *ptr);
 void __attribute__((format(printf, 2, 3))) litepcie_log(LitePCIeState *s, const char *fmt, ...);
 int64_t litepcie_get_time_ms(void);
+int64_t litepcie_get_time_us(void);
 LitePCIeState *litepcie_open(const char *device_name);
 void litepcie_close(LitePCIeState *s);
 void litepcie_dma_start(LitePCIeState *s, int buf_size, int buf_count, BOOL is_loopback);
 void litepcie_dma_stop(LitePCIeState *s);
+int litepcie_dma_poll(LitePCIeState *s, BOOL is_tx, int timeout);
 void litepcie_writel(LitePCIeState *s, uint32_t addr, uint32_t val);
 uint32_t litepcie_readl(LitePCIeState *s, uint32_t addr);
+int litepcie_frame_start(LitePCIeState *s, int width, int height, int fps);
+int litepcie_frame_get(LitePCIeState *s, LitePCIeFrame *frame, int timeout);
+BOOL litepcie_frame_valid(LitePCIeState *s, const LitePCIeFrame *frame);
+void litepcie_frame_stop(LitePCIeState *s);
+int litepcie_stream_start(LitePCIeState *s, int flags, int buf_size, int buf_count,
+                          LitePCIeBufferCB *rx_cb, LitePCIeBufferCB *tx_cb,
+                          void *opaque);
+void litepcie_stream_stop(LitePCIeState *s);
+int litepcie_rx_pop(LitePCIeState *s, LitePCIeBuffer *buf, int timeout);
+BOOL litepcie_rx_release(LitePCIeState *s, LitePCIeBuffer *buf);
+int litepcie_tx_get(LitePCIeState *s, LitePCIeBuffer *buf, int timeout);
+BOOL litepcie_tx_push(LitePCIeState *s, LitePCIeBuffer *buf);
 
 #endif /* LITEPCIE_LIB_H */
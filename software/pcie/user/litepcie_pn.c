@@ -0,0 +1,253 @@
+/*
+ * PN data generator and checker
+ *
+ * Consecutive words differ by PN_MUL, so a vector of N words is advanced
+ * with a single add of N * PN_MUL. The SSE2 and AVX2 versions are built
+ * with the GCC target attribute and selected at runtime.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "cutils.h"
+#include "litepcie_pn.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PN_X86
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    const char *name;
+    void (*write)(uint32_t *dst, int count, uint32_t data);
+    int (*check)(const uint32_t *tab, int count, uint32_t data);
+} PNImpl;
+
+/* scalar */
+
+static void pn_write_scalar(uint32_t *dst, int count, uint32_t data)
+{
+    int i;
+
+    for(i = 0; i < count; i++) {
+        dst[i] = data;
+        data += PN_MUL;
+    }
+}
+
+static int pn_check_scalar(const uint32_t *tab, int count, uint32_t data)
+{
+    int i, errors;
+
+    errors = 0;
+    for(i = 0; i < count; i++) {
+        errors += (tab[i] != data);
+        data += PN_MUL;
+    }
+    return errors;
+}
+
+#ifdef PN_X86
+
+/* SSE2: 4 words per step */
+
+__attribute__((target("sse2")))
+static void pn_write_sse2(uint32_t *dst, int count, uint32_t data)
+{
+    __m128i v, inc;
+    int i;
+
+    v = _mm_setr_epi32(data, data + PN_MUL, data + 2 * PN_MUL, data + 3 * PN_MUL);
+    inc = _mm_set1_epi32(4 * PN_MUL);
+    for(i = 0; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+        v = _mm_add_epi32(v, inc);
+    }
+    pn_write_scalar(dst + i, count - i, data + i * PN_MUL);
+}
+
+/* matching words count -1 in 'ok': the 32 bit lanes cannot overflow on
+   DMA buffer sizes (count < 2^31) */
+__attribute__((target("sse2")))
+static int pn_check_sse2(const uint32_t *tab, int count, uint32_t data)
+{
+    __m128i v, inc, ok;
+    uint32_t lanes[4];
+    int i, errors;
+
+    v = _mm_setr_epi32(data, data + PN_MUL, data + 2 * PN_MUL, data + 3 * PN_MUL);
+    inc = _mm_set1_epi32(4 * PN_MUL);
+    ok = _mm_setzero_si128();
+    for(i = 0; i + 4 <= count; i += 4) {
+        ok = _mm_add_epi32(ok, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(tab + i)), v));
+        v = _mm_add_epi32(v, inc);
+    }
+    _mm_storeu_si128((__m128i *)lanes, ok);
+    errors = i + (int32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    return errors + pn_check_scalar(tab + i, count - i, data + i * PN_MUL);
+}
+
+/* AVX2: 8 words per step, two vectors in flight when checking */
+
+__attribute__((target("avx2")))
+static void pn_write_avx2(uint32_t *dst, int count, uint32_t data)
+{
+    __m256i v, inc;
+    int i;
+
+    v = _mm256_add_epi32(_mm256_set1_epi32(data),
+                         _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                            _mm256_set1_epi32(PN_MUL)));
+    inc = _mm256_set1_epi32(8 * PN_MUL);
+    for(i = 0; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+        v = _mm256_add_epi32(v, inc);
+    }
+    pn_write_scalar(dst + i, count - i, data + i * PN_MUL);
+}
+
+__attribute__((target("avx2")))
+static int pn_check_avx2(const uint32_t *tab, int count, uint32_t data)
+{
+    __m256i v0, v1, inc, ok0, ok1;
+    uint32_t lanes[8];
+    int i, errors;
+
+    v0 = _mm256_add_epi32(_mm256_set1_epi32(data),
+                          _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                             _mm256_set1_epi32(PN_MUL)));
+    v1 = _mm256_add_epi32(v0, _mm256_set1_epi32(8 * PN_MUL));
+    inc = _mm256_set1_epi32(16 * PN_MUL);
+    ok0 = _mm256_setzero_si256();
+    ok1 = _mm256_setzero_si256();
+    for(i = 0; i + 16 <= count; i += 16) {
+        ok0 = _mm256_add_epi32(ok0, _mm256_cmpeq_epi32(
+                                   _mm256_loadu_si256((const __m256i *)(tab + i)), v0));
+        ok1 = _mm256_add_epi32(ok1, _mm256_cmpeq_epi32(
+                                   _mm256_loadu_si256((const __m256i *)(tab + i + 8)), v1));
+        v0 = _mm256_add_epi32(v0, inc);
+        v1 = _mm256_add_epi32(v1, inc);
+    }
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(ok0, ok1));
+    errors = i + (int32_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+                           lanes[4] + lanes[5] + lanes[6] + lanes[7]);
+    return errors + pn_check_scalar(tab + i, count - i, data + i * PN_MUL);
+}
+
+#endif /* PN_X86 */
+
+static const PNImpl pn_impls[PN_IMPL_COUNT] = {
+    [PN_IMPL_SCALAR] = { "scalar", pn_write_scalar, pn_check_scalar },
+#ifdef PN_X86
+    [PN_IMPL_SSE2] = { "sse2", pn_write_sse2, pn_check_sse2 },
+    [PN_IMPL_AVX2] = { "avx2", pn_write_avx2, pn_check_avx2 },
+#else
+    [PN_IMPL_SSE2] = { "sse2", NULL, NULL },
+    [PN_IMPL_AVX2] = { "avx2", NULL, NULL },
+#endif
+};
+
+static int pn_impl = PN_IMPL_AUTO;
+
+BOOL pn_impl_supported(int impl)
+{
+    if (impl < 0 || impl >= PN_IMPL_COUNT || !pn_impls[impl].write)
+        return FALSE;
+#ifdef PN_X86
+    __builtin_cpu_init();
+    if (impl == PN_IMPL_SSE2)
+        return __builtin_cpu_supports("sse2");
+    if (impl == PN_IMPL_AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return TRUE;
+}
+
+int pn_select(int impl)
+{
+    if (impl == PN_IMPL_AUTO) {
+        for(impl = PN_IMPL_COUNT - 1; impl > PN_IMPL_SCALAR; impl--) {
+            if (pn_impl_supported(impl))
+                break;
+        }
+    } else if (!pn_impl_supported(impl)) {
+        return -1;
+    }
+    pn_impl = impl;
+    return 0;
+}
+
+int pn_get_impl(void)
+{
+    if (pn_impl == PN_IMPL_AUTO)
+        pn_select(PN_IMPL_AUTO);
+    return pn_impl;
+}
+
+const char *pn_impl_name(int impl)
+{
+    if (impl < 0 || impl >= PN_IMPL_COUNT)
+        return "?";
+    return pn_impls[impl].name;
+}
+
+void pn_write(uint32_t *dst, int count, uint32_t *pseed)
+{
+    pn_impls[pn_get_impl()].write(dst, count, pn_seed_to_data(*pseed));
+    *pseed += count;
+}
+
+int pn_check(const uint32_t *tab, int count, uint32_t *pseed)
+{
+    int errors;
+
+    errors = pn_impls[pn_get_impl()].check(tab, count, pn_seed_to_data(*pseed));
+    *pseed += count;
+    return errors;
+}
+
+/* PN_MUL = 2 * m with m odd, so data - 1 = seed * PN_MUL gives the seed
+   modulo 2^31: seed = ((data - 1) / 2) * m^-1. Seeds differing by 2^31
+   give the same data. */
+static uint32_t pn_solve_seed(uint32_t data, uint32_t hint)
+{
+    uint32_t m, inv, seed;
+    int i;
+
+    m = PN_MUL >> 1;
+    inv = m; /* Newton iteration, each step doubles the correct bits */
+    for(i = 0; i < 5; i++)
+        inv *= 2 - m * inv;
+    seed = (((data - 1) >> 1) * inv) & 0x7fffffff;
+    /* of the two equivalent seeds, return the closest to 'hint' */
+    seed |= hint & 0x80000000;
+    if ((int32_t)(seed - hint) > 0x3fffffff)
+        seed -= 0x80000000;
+    else if ((int32_t)(seed - hint) < -0x40000000)
+        seed += 0x80000000;
+    return seed;
+}
+
+#define PN_FIND_SEED_TRIES 16
+
+int pn_find_seed(const uint32_t *tab, int count, uint32_t *pseed)
+{
+    uint32_t seed, s;
+    int i, errors;
+
+    /* each candidate comes from one word, so up to PN_FIND_SEED_TRIES - 1
+       leading corrupted words are skipped */
+    for(i = 0; i < count && i < PN_FIND_SEED_TRIES; i++) {
+        if ((tab[i] & 1) != 1)
+            continue; /* not PN data */
+        seed = pn_solve_seed(tab[i], *pseed + i) - i;
+        s = seed;
+        errors = pn_check(tab, count, &s);
+        if (errors <= count / 2) {
+            *pseed = s;
+            return errors;
+        }
+    }
+    return -1;
+}
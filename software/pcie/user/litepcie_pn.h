@@ -0,0 +1,42 @@
+/*
+ * PN data used to test the DMA: word n of the stream started at 'seed'
+ * is (seed + n) * PN_MUL + 1.
+ *
+ */
+#ifndef LITEPCIE_PN_H
+#define LITEPCIE_PN_H
+
+#include <stdint.h>
+
+#define PN_MUL 0x31415976u
+
+enum {
+    PN_IMPL_AUTO = -1,
+    PN_IMPL_SCALAR,
+    PN_IMPL_SSE2,
+    PN_IMPL_AVX2,
+    PN_IMPL_COUNT,
+};
+
+static inline uint32_t pn_seed_to_data(uint32_t seed)
+{
+    return seed * PN_MUL + 1;
+}
+
+/* select the implementation, PN_IMPL_AUTO for the fastest supported by
+   the CPU. Return -1 if not supported. */
+int pn_select(int impl);
+int pn_get_impl(void);
+const char *pn_impl_name(int impl);
+BOOL pn_impl_supported(int impl);
+
+/* write 'count' words and advance *pseed */
+void pn_write(uint32_t *dst, int count, uint32_t *pseed);
+/* check 'count' words, advance *pseed and return the number of errors */
+int pn_check(const uint32_t *tab, int count, uint32_t *pseed);
+/* find the seed of a buffer from its data: *pseed is updated to the seed
+   of the word after the buffer. Return the number of errors or -1 if
+   more than half of the words are wrong. */
+int pn_find_seed(const uint32_t *tab, int count, uint32_t *pseed);
+
+#endif /* LITEPCIE_PN_H */
@@ -11,6 +11,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <time.h>
+#include <poll.h>
 
 #include "litepcie.h"
 #include "cutils.h"
@@ -18,49 +19,7 @@
 #include "csr.h"
 #include "flags.h"
 #include "litepcie_lib.h"
-
-static inline uint32_t seed_to_data(uint32_t seed)
-{
-#if 1
-    /* more random but slower */
-    return seed * 0x31415976 + 1;
-#else
-    /* simplify debug: just copy the counter */
-    return seed;
-#endif
-}
-
-static void write_pn_data(uint32_t *dst, int count, uint32_t *pseed)
-{
-    int i;
-    uint32_t seed;
-
-    seed = *pseed;
-    for(i = 0; i < count; i++) {
-        dst[i] = seed_to_data(seed);
-        seed++;
-    }
-    *pseed = seed;
-}
-
-/* Return the number of errors */
-static int check_pn_data(const uint32_t *tab, int count,
-                         uint32_t *pseed)
-{
-    int i, errors;
-    uint32_t seed;
-
-    errors = 0;
-    seed = *pseed;
-    for(i = 0; i < count; i++) {
-        if (tab[i] != seed_to_data(seed)) {
-            errors++;
-        }
-        seed++;
-    }
-    *pseed = seed;
-    return errors;
-}
+#include "litepcie_pn.h"
 
 #define MAX_SHIFT_OFFSET 128
 
@@ -125,9 +84,9 @@ void dma_test(LitePCIeState *s, int buf_size, int buf_count, BOOL is_loopback)
                 tx_underflows++;
             }
 
-            write_pn_data((uint32_t *)(s->dma_tx_buf +
-                                       tx_buf_num * s->dma_tx_buf_size),
-                          s->tx_buf_size >> 2, &tx_seed);
+            pn_write((uint32_t *)(s->dma_tx_buf +
+                                  tx_buf_num * s->dma_tx_buf_size),
+                     s->tx_buf_size >> 2, &tx_seed);
 
             if (buf_rx_count >= 4*buf_count/10) {
                 const uint32_t *rx_buf;
@@ -139,26 +98,22 @@ void dma_test(LitePCIeState *s, int buf_size, int buf_count, BOOL is_loopback)
                 if (first_rx_buf) {
                     uint32_t seed;
 
-                    /* find the initial shift */
-                    for(shift = 0; shift < 2 * MAX_SHIFT_OFFSET; shift++) {
-                        seed = rx_seed + shift;
-                        rx_errors = check_pn_data(rx_buf, rx_buf_len, &seed);
-                        if (rx_errors <= (rx_buf_len / 2)) {
-                            rx_seed = seed;
-                            break;
-                        }
-                    }
-                    if (shift == 2 * MAX_SHIFT_OFFSET) {
+                    /* find the initial shift from the data */
+                    seed = rx_seed;
+                    rx_errors = pn_find_seed(rx_buf, rx_buf_len, &seed);
+                    shift = seed - rx_buf_len - rx_seed;
+                    if (rx_errors < 0 || shift < 0 || shift >= 2 * MAX_SHIFT_OFFSET) {
                         printf("Cannot find initial data\n");
                         exit(1);
                     } else {
                         printf("RX shift = %d\n",
                                -(shift - MAX_SHIFT_OFFSET));
+                        rx_seed = seed;
                     }
                     first_rx_buf = 0;
                 } else {
                     /* count the number of errors */
-                    rx_errors += check_pn_data(rx_buf, rx_buf_len, &rx_seed);
+                    rx_errors += pn_check(rx_buf, rx_buf_len, &rx_seed);
                 }
             } else {
                 buf_rx_count++;
@@ -194,11 +149,400 @@ void dma_loopback_test(void)
         fprintf(stderr, "Could not init driver\n");
         exit(1);
     }
-    dma_test(s, 16*1024, DMA_BUFFER_COUNT, TRUE);
+    dma_test(s, 16*1024, s->mmap_info.dma_rx_buf_count, TRUE);
 
     litepcie_close(s);
 }
 
+enum {
+    BENCH_TX,
+    BENCH_RX,
+    BENCH_BIDIR,
+};
+
+static const char *bench_mode_names[] = { "tx", "rx", "bidir" };
+
+#define BENCH_MAX_SAMPLES (1 << 20)
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int64_t percentile(const int64_t *tab, int n, int p)
+{
+    if (n == 0)
+        return 0;
+    return tab[(int64_t)(n - 1) * p / 100];
+}
+
+/* Run one benchmark configuration for 'duration' ms. The per buffer
+   latency is the time from the submission of a buffer to the DMA to its
+   completion, as seen by a consumer woken up by poll(): TX buffers are
+   submitted when the user count publishes them and complete when the
+   DMA read them; RX buffers are submitted when the user count releases
+   them and complete when the DMA wrote them; in loopback, buffers are
+   submitted on TX and complete on RX. Buffers the DMA took before they
+   were submitted (TX underflows, RX overruns) and completions only seen
+   after a poll() timeout are counted, not sampled. Return -1 if the DMA
+   did not move. */
+static int dma_bench_run(LitePCIeState *s, int mode, int buf_size,
+                         int buf_count, int duration, int64_t *samples,
+                         FILE *csv)
+{
+    struct litepcie_ioctl_dma_start dma_start;
+    volatile struct litepcie_status *st = s->status;
+    struct pollfd pfd;
+    uint64_t count, last_count, submitted, end, i;
+    uint64_t underflows, timeouts;
+    int64_t start_time, now;
+    int64_t *submit_time;
+    int n_samples, ret;
+    double gbps;
+
+    submit_time = malloc(buf_count * sizeof(int64_t));
+    if (!submit_time) {
+        fprintf(stderr, "Could not allocate memory\n");
+        return -1;
+    }
+
+    dma_start.dma_flags = (mode == BENCH_BIDIR) ? DMA_LOOPBACK_ENABLE : 0;
+    dma_start.tx_buf_size = (mode == BENCH_RX) ? 0 : buf_size;
+    dma_start.tx_buf_count = (mode == BENCH_RX) ? 0 : buf_count;
+    dma_start.rx_buf_size = (mode == BENCH_TX) ? 0 : buf_size;
+    dma_start.rx_buf_count = (mode == BENCH_TX) ? 0 : buf_count;
+    if (ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &dma_start) < 0) {
+        perror("LITEPCIE_IOCTL_DMA_START");
+        free(submit_time);
+        return -1;
+    }
+#ifdef CSR_FRAMES_BASE
+    /* the frame streamer is the RX data source when not looping back */
+    if (mode == BENCH_RX) {
+        litepcie_writel(s, CSR_FRAMES_BUFFER_SIZE_ADDR, buf_size);
+        litepcie_writel(s, CSR_FRAMES_FRAME_PERIOD_ADDR, 0);
+        litepcie_writel(s, CSR_FRAMES_ENABLE_ADDR, 1);
+    }
+#endif
+
+    pfd.fd = s->litepcie_fd;
+    pfd.events = (mode == BENCH_TX) ? POLLOUT : POLLIN;
+    n_samples = 0;
+    count = 0;
+    last_count = 0;
+    submitted = 0;
+    underflows = 0;
+    timeouts = 0;
+    start_time = now = litepcie_get_time_us();
+    for(;;) {
+        /* keep the ring full: a buffer is submitted once the previous
+           use of its slot completed */
+        for(; submitted < last_count + buf_count; submitted++)
+            submit_time[submitted % buf_count] = now;
+        st->tx_user_count = submitted;
+        st->rx_user_count = last_count;
+        ret = poll(&pfd, 1, 100);
+        if (ret < 0) {
+            perror("poll");
+            break;
+        }
+        now = litepcie_get_time_us();
+        count = (mode == BENCH_TX) ? st->tx_hw_count : st->rx_hw_count;
+        /* only the buffers submitted before the DMA took them have a
+           latency */
+        end = count;
+        if (end > submitted) {
+            underflows += end - submitted;
+            end = submitted;
+        }
+        /* woken up by the timeout, not by a completion */
+        if (ret == 0) {
+            timeouts++;
+            end = last_count;
+        }
+        for(i = last_count; i < end && n_samples < BENCH_MAX_SAMPLES; i++)
+            samples[n_samples++] = now - submit_time[i % buf_count];
+        last_count = count;
+        if (submitted < last_count)
+            submitted = last_count;
+        if (now - start_time >= (int64_t)duration * 1000)
+            break;
+    }
+
+#ifdef CSR_FRAMES_BASE
+    if (mode == BENCH_RX)
+        litepcie_writel(s, CSR_FRAMES_ENABLE_ADDR, 0);
+#endif
+    litepcie_dma_stop(s);
+
+    gbps = (double)count * buf_size * (mode == BENCH_BIDIR ? 2 : 1) /
+        ((double)(now - start_time) * 1e3);
+    qsort(samples, n_samples, sizeof(int64_t), cmp_int64);
+    printf("%-5s %8d x %-4d %10" PRIu64 " bufs %7.3f GB/s "
+           "latency us n=%d p50=%" PRId64 " p90=%" PRId64 " p99=%" PRId64 " max=%" PRId64
+           " underflows=%" PRIu64 " timeouts=%" PRIu64 "\n",
+           bench_mode_names[mode], buf_size, buf_count, count, gbps, n_samples,
+           percentile(samples, n_samples, 50), percentile(samples, n_samples, 90),
+           percentile(samples, n_samples, 99), percentile(samples, n_samples, 100),
+           underflows, timeouts);
+    if (csv) {
+        fprintf(csv, "%s,%d,%d,%" PRId64 ",%" PRIu64 ",%.6f,%d,%" PRId64 ",%" PRId64
+                ",%" PRId64 ",%" PRId64 ",%" PRIu64 ",%" PRIu64 "\n",
+                bench_mode_names[mode], buf_size, buf_count,
+                (now - start_time) / 1000, count, gbps, n_samples,
+                percentile(samples, n_samples, 50), percentile(samples, n_samples, 90),
+                percentile(samples, n_samples, 99), percentile(samples, n_samples, 100),
+                underflows, timeouts);
+        fflush(csv);
+    }
+    free(submit_time);
+    return count > 0 ? 0 : -1;
+}
+
+/* Sweep buffer sizes (4 KB to the driver buffer size) and counts for
+   the selected modes. 'modes' is "tx", "rx", "bidir" or "all". */
+void dma_bench(const char *modes, int duration, const char *filename)
+{
+    static const int counts[] = { 8, 32, 0 /* all */ };
+    LitePCIeState *s;
+    FILE *csv;
+    int64_t *samples;
+    int mode, buf_size, i, buf_count, max_count, errors;
+
+    s = litepcie_open(LITEPCIE_FILENAME);
+    if (!s) {
+        fprintf(stderr, "Could not init driver\n");
+        exit(1);
+    }
+
+    csv = NULL;
+    if (filename) {
+        csv = fopen(filename, "w");
+        if (!csv) {
+            perror(filename);
+            exit(1);
+        }
+        fprintf(csv, "mode,buf_size,buf_count,duration_ms,buffers,gbytes_per_sec,"
+                "latency_samples,latency_p50_us,latency_p90_us,latency_p99_us,latency_max_us,"
+                "underflows,timeouts\n");
+    }
+
+    samples = litepcie_malloc(BENCH_MAX_SAMPLES * sizeof(int64_t));
+    if (!samples) {
+        fprintf(stderr, "Could not allocate memory\n");
+        exit(1);
+    }
+
+    max_count = s->mmap_info.dma_rx_buf_count;
+    errors = 0;
+    for(mode = BENCH_TX; mode <= BENCH_BIDIR; mode++) {
+        if (strcmp(modes, "all") && strcmp(modes, bench_mode_names[mode]))
+            continue;
+#ifndef CSR_FRAMES_BASE
+        if (mode == BENCH_RX) {
+            printf("rx: skipped, the gateware has no RX data source\n");
+            continue;
+        }
+#endif
+        for(buf_size = 4096; buf_size <= s->mmap_info.dma_rx_buf_size; buf_size *= 2) {
+            for(i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+                buf_count = counts[i] ? counts[i] : max_count;
+                if (buf_count > max_count || (counts[i] && buf_count == max_count))
+                    continue;
+                if (dma_bench_run(s, mode, buf_size, buf_count, duration,
+                                  samples, csv) < 0)
+                    errors++;
+            }
+        }
+    }
+
+    litepcie_free(samples);
+    if (csv)
+        fclose(csv);
+    litepcie_close(s);
+    if (errors) {
+        fprintf(stderr, "%d configuration(s) did not transfer any data\n", errors);
+        exit(1);
+    }
+}
+
+#ifdef CSR_FRAMES_BASE
+/* receive frames, print statistics and optionally write them to
+   'filename' (raw YCbCr 4:2:2, one frame after the other). */
+void frame_capture(int width, int height, int fps, int count,
+                   const char *filename)
+{
+    LitePCIeState *s;
+    LitePCIeFrame frame;
+    FILE *f;
+    int n, stats_count, torn;
+    int64_t last_time, duration;
+
+    s = litepcie_open(LITEPCIE_FILENAME);
+    if (!s) {
+        fprintf(stderr, "Could not init driver\n");
+        exit(1);
+    }
+
+    f = NULL;
+    if (filename) {
+        f = fopen(filename, "wb");
+        if (!f) {
+            perror(filename);
+            exit(1);
+        }
+    }
+
+    if (litepcie_frame_start(s, width, height, fps) < 0) {
+        fprintf(stderr, "Could not start frame capture\n");
+        exit(1);
+    }
+
+    stats_count = 0;
+    torn = 0;
+    last_time = litepcie_get_time_ms();
+    for(n = 0; count <= 0 || n < count; n++) {
+        if (litepcie_frame_get(s, &frame, 1000) < 0) {
+            fprintf(stderr, "Timeout waiting for a frame\n");
+            break;
+        }
+        if (f)
+            fwrite(frame.data, 1, frame.length, f);
+        if (!litepcie_frame_valid(s, &frame))
+            torn++;
+
+        if (++stats_count == 60) {
+            duration = litepcie_get_time_ms() - last_time;
+            printf("frame %u %dx%d %0.1f fps %0.1f MB/sec dropped=%" PRId64
+                   " overflows=%" PRId64 " torn=%d\n",
+                   frame.sequence, frame.width, frame.height,
+                   (double)stats_count * 1000 / (double)duration,
+                   (double)stats_count * frame.length / ((double)duration * 1e3),
+                   s->frame_drop_count, s->rx_overflow_count, torn);
+            last_time = litepcie_get_time_ms();
+            stats_count = 0;
+        }
+    }
+
+    litepcie_frame_stop(s);
+    if (f)
+        fclose(f);
+    litepcie_close(s);
+}
+#endif
+
+#define PN_BENCH_WORDS (32768 / 4) /* one DMA buffer */
+#define PN_BENCH_ERRORS 37
+
+/* the shift search used before pn_find_seed(), for comparison */
+static int pn_find_seed_linear(const uint32_t *tab, int count, uint32_t *pseed)
+{
+    uint32_t seed;
+    int shift, errors;
+
+    for(shift = 0; shift < 2 * MAX_SHIFT_OFFSET; shift++) {
+        seed = *pseed + shift;
+        errors = pn_check(tab, count, &seed);
+        if (errors <= count / 2) {
+            *pseed = seed;
+            return errors;
+        }
+    }
+    return -1;
+}
+
+/* time 'n' calls of 'op', return the throughput in GB/s */
+static double pn_bench_op(int op, uint32_t *buf, int n)
+{
+    uint32_t seed;
+    int64_t t;
+    int i;
+
+    t = litepcie_get_time_us();
+    for(i = 0; i < n; i++) {
+        seed = 2 * MAX_SHIFT_OFFSET - 1;
+        switch(op) {
+        case 0:
+            pn_write(buf, PN_BENCH_WORDS, &seed);
+            break;
+        case 1:
+            pn_check(buf, PN_BENCH_WORDS, &seed);
+            break;
+        case 2:
+            seed = 0;
+            pn_find_seed_linear(buf, PN_BENCH_WORDS, &seed);
+            break;
+        default:
+            seed = 0;
+            pn_find_seed(buf, PN_BENCH_WORDS, &seed);
+            break;
+        }
+    }
+    t = litepcie_get_time_us() - t;
+    return (double)n * PN_BENCH_WORDS * 4 / ((double)t * 1e3);
+}
+
+/* check that all the PN implementations agree and compare their speed */
+void pn_bench(void)
+{
+    static const char *op_names[] = { "write", "check", "find_seed", "find_seed" };
+    uint32_t *buf, *ref, seed;
+    int impl, op, i, errors, ret;
+
+    buf = litepcie_malloc(PN_BENCH_WORDS * 4);
+    ref = litepcie_malloc(PN_BENCH_WORDS * 4);
+    if (!buf || !ref) {
+        fprintf(stderr, "Could not allocate memory\n");
+        exit(1);
+    }
+
+    /* reference: scalar data, with errors at known places */
+    pn_select(PN_IMPL_SCALAR);
+    seed = 2 * MAX_SHIFT_OFFSET - 1;
+    pn_write(ref, PN_BENCH_WORDS, &seed);
+    for(i = 0; i < PN_BENCH_ERRORS; i++)
+        ref[(i * 7919) % PN_BENCH_WORDS] ^= 1 << (i % 32);
+
+    ret = 0;
+    for(impl = 0; impl < PN_IMPL_COUNT; impl++) {
+        if (pn_select(impl) < 0) {
+            printf("%-6s not supported\n", pn_impl_name(impl));
+            continue;
+        }
+        /* odd lengths and offsets exercise the scalar tails */
+        for(i = 0; i < 16; i++) {
+            uint32_t s1 = i, s2 = i;
+            pn_write(buf + i, PN_BENCH_WORDS - 2 * i, &s1);
+            if (pn_check(buf + i, PN_BENCH_WORDS - 2 * i, &s2) != 0 || s1 != s2) {
+                printf("%-6s write/check mismatch\n", pn_impl_name(impl));
+                ret = 1;
+            }
+        }
+        seed = 2 * MAX_SHIFT_OFFSET - 1;
+        errors = pn_check(ref, PN_BENCH_WORDS, &seed);
+        seed = 0;
+        if (errors != PN_BENCH_ERRORS ||
+            pn_find_seed(ref, PN_BENCH_WORDS, &seed) != PN_BENCH_ERRORS ||
+            seed != 2 * MAX_SHIFT_OFFSET - 1 + PN_BENCH_WORDS) {
+            printf("%-6s wrong error count or seed\n", pn_impl_name(impl));
+            ret = 1;
+        }
+
+        for(op = 0; op < 4; op++) {
+            printf("%-6s %-9s%s %8.2f GB/s\n", pn_impl_name(impl), op_names[op],
+                   op == 2 ? " (linear)" : op == 3 ? " (solve) " : "         ",
+                   pn_bench_op(op, op == 0 ? buf : ref, op == 2 ? 20 : 20000));
+        }
+    }
+    pn_select(PN_IMPL_AUTO);
+
+    litepcie_free(buf);
+    litepcie_free(ref);
+    if (ret)
+        exit(1);
+}
+
 void dump_version(void)
 {
     LitePCIeState *s;
@@ -219,11 +563,21 @@ void dump_version(void)
 
 void help(void)
 {
-    printf("usage: litepcie_util cmd [args...]\n"
+    printf("usage: litepcie_util [-p impl] cmd [args...]\n"
+           "\n"
+           "options:\n"
+           "-p impl                          PN data implementation for the DMA tests:\n"
+           "                                 scalar, sse2 or avx2 (default: fastest)\n"
            "\n"
            "available commands:\n"
            "dma_loopback_test                test DMA loopback operation\n"
            "version                          return fpga version\n"
+           "pn_bench                         check and time the PN data implementations\n"
+           "dma_bench [mode [ms [csv]]]      sweep DMA buffer size/count, mode is\n"
+           "                                 tx, rx, bidir or all (default all 1000)\n"
+#ifdef CSR_FRAMES_BASE
+           "frame_capture [w h fps n file]   receive frames (default 1280 720 60 0)\n"
+#endif
            );
     exit(1);
 }
@@ -231,16 +585,26 @@ void help(void)
 int main(int argc, char **argv)
 {
     const char *cmd;
-    int c;
+    int c, impl;
 
     for(;;) {
-        c = getopt(argc, argv, "h");
+        c = getopt(argc, argv, "hp:");
         if (c == -1)
             break;
         switch(c) {
         case 'h':
             help();
             break;
+        case 'p':
+            for(impl = 0; impl < PN_IMPL_COUNT; impl++) {
+                if (!strcmp(optarg, pn_impl_name(impl)))
+                    break;
+            }
+            if (pn_select(impl) < 0) {
+                fprintf(stderr, "PN implementation '%s' not supported\n", optarg);
+                exit(1);
+            }
+            break;
         default:
             exit(1);
         }
@@ -254,6 +618,24 @@ int main(int argc, char **argv)
         dma_loopback_test();
     } else if (!strcmp(cmd, "version")) {
         dump_version();
+    } else if (!strcmp(cmd, "pn_bench")) {
+        pn_bench();
+    } else if (!strcmp(cmd, "dma_bench")) {
+        const char *modes;
+        int duration;
+        modes = optind < argc ? argv[optind++] : "all";
+        duration = optind < argc ? atoi(argv[optind++]) : 1000;
+        dma_bench(modes, duration, optind < argc ? argv[optind] : NULL);
+#ifdef CSR_FRAMES_BASE
+    } else if (!strcmp(cmd, "frame_capture")) {
+        int width, height, fps, count;
+        width = optind < argc ? atoi(argv[optind++]) : 1280;
+        height = optind < argc ? atoi(argv[optind++]) : 720;
+        fps = optind < argc ? atoi(argv[optind++]) : 60;
+        count = optind < argc ? atoi(argv[optind++]) : 0;
+        frame_capture(width, height, fps, count,
+                      optind < argc ? argv[optind] : NULL);
+#endif
     } else {
         help();
     }
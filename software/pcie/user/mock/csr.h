@@ -0,0 +1,34 @@
+/*
+ * Register map of the LitePCIe device model (litepcie_mock.c).
+ *
+ * Used instead of the csr.h generated with the gateware when building
+ * the mock binaries ('make check'), so litepcie_lib and litepcie_util can
+ * be tested without the card. Only the registers used by userspace and
+ * the model are defined.
+ */
+#ifndef __GENERATED_CSR_H
+#define __GENERATED_CSR_H
+
+/* dma */
+#define CSR_DMA_WRITER_TABLE_LOOP_STATUS_ADDR 0x0000
+#define CSR_DMA_READER_TABLE_LOOP_STATUS_ADDR 0x0004
+#define CSR_DMA_LOOPBACK_ENABLE_ADDR 0x0008
+
+/* frames */
+#define CSR_FRAMES_BASE 0x1000
+#define CSR_FRAMES_ENABLE_ADDR 0x1000
+#define CSR_FRAMES_WIDTH_ADDR 0x1004
+#define CSR_FRAMES_HEIGHT_ADDR 0x1008
+#define CSR_FRAMES_BUFFER_SIZE_ADDR 0x100c
+#define CSR_FRAMES_FRAME_PERIOD_ADDR 0x1010
+#define CSR_FRAMES_FRAMES_ADDR 0x1014
+#define CSR_FRAMES_SKIPPED_ADDR 0x1018
+
+#define IDENTIFIER_MEM_BASE 0x2000
+
+/* constants */
+#define SYSTEM_CLOCK_FREQUENCY 125000000
+#define DMA_WRITER_INTERRUPT 0
+#define DMA_READER_INTERRUPT 1
+
+#endif
@@ -0,0 +1,551 @@
+/*
+ * LitePCIe device model
+ *
+ * Emulates /dev/litepcie* in userspace: the binaries are linked with
+ * -Wl,--wrap for open/close/ioctl/mmap/munmap/poll (see the Makefile) and
+ * every call on a /dev/litepcie* file is handled here, other files go to
+ * the C library. A thread plays the role of the DMA engine:
+ *
+ * - TX: the reader consumes the TX ring.
+ * - RX: in loopback mode the writer copies each TX buffer to the RX
+ *   buffer with the same index, otherwise it emulates the frame streamer
+ *   of gateware/streamer/pcie.py (header, pattern, padding).
+ *
+ * Progress is published like the driver does, in the table loop status
+ * registers and in the status page, and poll()/DMA_WAIT block on it.
+ *
+ * Environment:
+ *   LITEPCIE_MOCK_BUF_SIZE   DMA buffer size (default 32768)
+ *   LITEPCIE_MOCK_BUF_COUNT  DMA buffer count (default 128)
+ *   LITEPCIE_MOCK_RATE       DMA rate in bytes/s per direction (default
+ *                            400e6, about a PCIe gen2 x1 link)
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "litepcie.h"
+#include "cutils.h"
+#include "config.h"
+#include "csr.h"
+#include "flags.h"
+#include "litepcie_lib.h"
+
+#define MOCK_PAGE_SIZE 4096
+#define MOCK_PERIOD_US 100
+#define MOCK_MAX_BURST_US 1000
+
+int __real_open(const char *pathname, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long request, ...);
+void *__real_mmap(void *addr, size_t length, int prot, int flags, int fd,
+                  off_t offset);
+int __real_munmap(void *addr, size_t length);
+int __real_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+typedef struct {
+    int fd;
+    unsigned int buf_size;
+    unsigned int buf_count;
+    double rate; /* bytes/s */
+
+    uint8_t *tx_bufs;
+    uint8_t *rx_bufs;
+    uint8_t *regs;
+    struct litepcie_status *status;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    BOOL thread_running;
+    BOOL tx_started;
+    BOOL rx_started;
+    BOOL loopback;
+    unsigned int tx_size, rx_size; /* as passed to DMA_START */
+    unsigned int tx_count, rx_count; /* the status page is user-writable */
+    double tx_credit, rx_credit; /* bytes the DMA may move */
+    uint64_t tx_done, rx_done; /* buffers completed */
+
+    /* frame streamer */
+    uint32_t frame_sequence;
+    unsigned int frame_offset; /* in the current frame, 0: idle */
+    unsigned int frame_len;
+    int64_t next_frame_time; /* in us */
+} MockDevice;
+
+static MockDevice mock = { .fd = -1 };
+
+static unsigned long mock_map_size(void)
+{
+    return (unsigned long)mock.buf_size * mock.buf_count;
+}
+
+static unsigned long mock_reg_offset(void)
+{
+    return 2 * mock_map_size();
+}
+
+static unsigned long mock_status_offset(void)
+{
+    return mock_reg_offset() +
+        ((PCI_FPGA_BAR0_SIZE + MOCK_PAGE_SIZE - 1) & ~(MOCK_PAGE_SIZE - 1));
+}
+
+static uint32_t mock_readl(uint32_t addr)
+{
+    return *(volatile uint32_t *)(mock.regs + addr);
+}
+
+static void mock_writel(uint32_t addr, uint32_t val)
+{
+    *(volatile uint32_t *)(mock.regs + addr) = val;
+}
+
+static unsigned int env_int(const char *name, unsigned int default_value)
+{
+    const char *v = getenv(name);
+    return v ? strtoul(v, NULL, 0) : default_value;
+}
+
+/* emulate the frame streamer: fill one RX buffer. Return FALSE if no
+   frame is ready to start (the DMA writer then waits for data) */
+static BOOL mock_frame_fill(uint8_t *buf, unsigned int size, int64_t now)
+{
+    LitePCIeFrameHeader *h;
+    unsigned int i, n, period;
+
+    if (mock.frame_offset == 0) {
+        if (!mock_readl(CSR_FRAMES_ENABLE_ADDR))
+            return FALSE;
+        if (now < mock.next_frame_time)
+            return FALSE;
+        period = mock_readl(CSR_FRAMES_FRAME_PERIOD_ADDR);
+        mock.next_frame_time = now +
+            (int64_t)period * 1000000 / SYSTEM_CLOCK_FREQUENCY;
+
+        h = (LitePCIeFrameHeader *)buf;
+        memset(h, 0, sizeof(*h));
+        h->magic = LITEPCIE_FRAME_MAGIC;
+        h->sequence = mock.frame_sequence;
+        h->width = mock_readl(CSR_FRAMES_WIDTH_ADDR);
+        h->height = mock_readl(CSR_FRAMES_HEIGHT_ADDR);
+        h->format = LITEPCIE_FRAME_FORMAT_YCBCR422;
+        h->header_size = sizeof(LitePCIeFrameHeader);
+        h->length = h->width * h->height * 2;
+        h->timestamp = now * (SYSTEM_CLOCK_FREQUENCY / 1000000);
+        mock.frame_len = sizeof(LitePCIeFrameHeader) + h->length;
+        mock.frame_offset = sizeof(LitePCIeFrameHeader);
+        i = mock.frame_offset;
+    } else {
+        i = 0;
+    }
+
+    /* payload byte n of frame s is (s + n) & 0xff */
+    n = mock.frame_len - mock.frame_offset;
+    if (n > size - i)
+        n = size - i;
+    for(; n > 0; n--, i++, mock.frame_offset++)
+        buf[i] = mock.frame_sequence +
+            (mock.frame_offset - sizeof(LitePCIeFrameHeader));
+    memset(buf + i, 0, size - i); /* padding */
+
+    if (mock.frame_offset == mock.frame_len) {
+        mock.frame_offset = 0;
+        mock.frame_sequence++;
+        mock_writel(CSR_FRAMES_FRAMES_ADDR, mock_readl(CSR_FRAMES_FRAMES_ADDR) + 1);
+    }
+    return TRUE;
+}
+
+/* the loop status registers hold the last completed buffer, the status
+   counts are derived from them as in litepcie_update_status() */
+static uint32_t mock_loop_status(uint64_t done, unsigned int count)
+{
+    if (done == 0)
+        return 0;
+    done--;
+    return (((done / count) & 0xffff) << 16) | (done % count);
+}
+
+static void mock_publish(void)
+{
+    struct litepcie_status *st = mock.status;
+    uint32_t v;
+
+    if (mock.tx_started) {
+        v = mock_loop_status(mock.tx_done, mock.tx_count);
+        mock_writel(CSR_DMA_READER_TABLE_LOOP_STATUS_ADDR, v);
+        st->tx_buf_num = v & 0xffff;
+        st->tx_hw_count = mock.tx_done ? mock.tx_done - 1 : 0;
+    }
+    if (mock.rx_started) {
+        v = mock_loop_status(mock.rx_done, mock.rx_count);
+        mock_writel(CSR_DMA_WRITER_TABLE_LOOP_STATUS_ADDR, v);
+        st->rx_buf_num = v & 0xffff;
+        st->rx_hw_count = mock.rx_done ? mock.rx_done - 1 : 0;
+    }
+    pthread_cond_broadcast(&mock.cond);
+}
+
+static void *mock_dma_thread(void *opaque)
+{
+    int64_t last, now;
+    unsigned int index;
+    BOOL moved;
+
+    last = litepcie_get_time_us();
+    pthread_mutex_lock(&mock.mutex);
+    while (mock.thread_running) {
+        pthread_mutex_unlock(&mock.mutex);
+        usleep(MOCK_PERIOD_US);
+        pthread_mutex_lock(&mock.mutex);
+
+        now = litepcie_get_time_us();
+        if (mock.tx_started)
+            mock.tx_credit += (now - last) * mock.rate / 1e6;
+        if (mock.rx_started)
+            mock.rx_credit += (now - last) * mock.rate / 1e6;
+        last = now;
+        /* a late thread must not burst a whole ring at once, the link
+           does not either */
+        if (mock.tx_credit > mock.rate * MOCK_MAX_BURST_US / 1e6)
+            mock.tx_credit = mock.rate * MOCK_MAX_BURST_US / 1e6;
+        if (mock.rx_credit > mock.rate * MOCK_MAX_BURST_US / 1e6)
+            mock.rx_credit = mock.rate * MOCK_MAX_BURST_US / 1e6;
+
+        moved = FALSE;
+        for(;;) {
+            if (mock.loopback) {
+                /* TX buffer n is written back to RX buffer n, nothing
+                   moves until both directions run */
+                if (!mock.tx_started || !mock.rx_started ||
+                    mock.tx_credit < mock.tx_size || mock.rx_credit < mock.rx_size)
+                    break;
+                memcpy(mock.rx_bufs + (mock.rx_done % mock.rx_count) * mock.buf_size,
+                       mock.tx_bufs + (mock.tx_done % mock.tx_count) * mock.buf_size,
+                       mock.rx_size < mock.tx_size ? mock.rx_size : mock.tx_size);
+                mock.tx_credit -= mock.tx_size;
+                mock.rx_credit -= mock.rx_size;
+                mock.tx_done++;
+                mock.rx_done++;
+            } else if (mock.tx_started && mock.tx_credit >= mock.tx_size) {
+                mock.tx_credit -= mock.tx_size;
+                mock.tx_done++;
+            } else if (mock.rx_started && mock.rx_credit >= mock.rx_size) {
+                index = mock.rx_done % mock.rx_count;
+                if (!mock_frame_fill(mock.rx_bufs + index * mock.buf_size,
+                                     mock.rx_size, now)) {
+                    mock.rx_credit = 0; /* no data: the link idles */
+                    break;
+                }
+                mock.rx_credit -= mock.rx_size;
+                mock.rx_done++;
+            } else {
+                break;
+            }
+            moved = TRUE;
+        }
+        if (moved)
+            mock_publish();
+    }
+    pthread_mutex_unlock(&mock.mutex);
+    return NULL;
+}
+
+static void mock_dma_stop(void)
+{
+    pthread_mutex_lock(&mock.mutex);
+    mock.tx_started = mock.rx_started = FALSE;
+    mock.loopback = FALSE;
+    mock.frame_offset = 0;
+    pthread_cond_broadcast(&mock.cond);
+    pthread_mutex_unlock(&mock.mutex);
+}
+
+static int mock_dma_start(struct litepcie_ioctl_dma_start *m)
+{
+    struct litepcie_status *st = mock.status;
+    BOOL loopback;
+
+    if ((m->tx_buf_size != 0 && mock.tx_started) ||
+        (m->rx_buf_size != 0 && mock.rx_started))
+        return -EIO;
+    if (m->tx_buf_size == 0 && m->rx_buf_size == 0)
+        return -EINVAL;
+    if ((m->tx_buf_size & 7) != 0 || (m->rx_buf_size & 7) != 0 ||
+        m->tx_buf_size > mock.buf_size || m->rx_buf_size > mock.buf_size ||
+        m->tx_buf_count > mock.buf_count || m->rx_buf_count > mock.buf_count ||
+        (m->tx_buf_size != 0 && m->tx_buf_count == 0) ||
+        (m->rx_buf_size != 0 && m->rx_buf_count == 0))
+        return -EINVAL;
+    /* the directions start independently, the loopback setting is
+       shared */
+    loopback = (m->dma_flags & DMA_LOOPBACK_ENABLE) != 0;
+    if ((mock.tx_started || mock.rx_started) && loopback != mock.loopback)
+        return -EBUSY;
+
+    pthread_mutex_lock(&mock.mutex);
+    if (m->tx_buf_size != 0) {
+        st->tx_hw_count = st->tx_user_count = 0;
+        st->tx_buf_num = 0;
+        st->tx_buf_count = m->tx_buf_count;
+        mock.tx_count = m->tx_buf_count;
+        mock.tx_size = m->tx_buf_size;
+        mock.tx_credit = 0;
+        mock.tx_done = 0;
+        mock.tx_started = TRUE;
+    }
+    if (m->rx_buf_size != 0) {
+        st->rx_hw_count = st->rx_user_count = 0;
+        st->rx_buf_num = 0;
+        st->rx_buf_count = m->rx_buf_count;
+        mock.rx_count = m->rx_buf_count;
+        mock.rx_size = m->rx_buf_size;
+        mock.rx_credit = 0;
+        mock.rx_done = 0;
+        mock.rx_started = TRUE;
+        mock.next_frame_time = 0;
+    }
+    mock.loopback = loopback;
+    mock_writel(CSR_DMA_LOOPBACK_ENABLE_ADDR, mock.loopback);
+    mock_publish();
+    pthread_mutex_unlock(&mock.mutex);
+    return 0;
+}
+
+/* wait with the mutex held until 'done' returns TRUE, -EAGAIN on
+   timeout */
+static int mock_wait(BOOL (*done)(void *), void *opaque, int timeout)
+{
+    struct timespec ts;
+    int64_t t;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    t = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec + (int64_t)timeout * 1000000;
+    ts.tv_sec = t / 1000000000;
+    ts.tv_nsec = t % 1000000000;
+    while (!done(opaque)) {
+        if (timeout >= 0 &&
+            pthread_cond_timedwait(&mock.cond, &mock.mutex, &ts) == ETIMEDOUT)
+            return done(opaque) ? 0 : -EAGAIN;
+        if (timeout < 0)
+            pthread_cond_wait(&mock.cond, &mock.mutex);
+    }
+    return 0;
+}
+
+static BOOL mock_dma_wait_done(void *opaque)
+{
+    struct litepcie_ioctl_dma_wait *m = opaque;
+
+    if (m->tx_wait)
+        return !mock.tx_started || mock.status->tx_buf_num != m->tx_buf_num;
+    return !mock.rx_started || mock.status->rx_buf_num != m->rx_buf_num;
+}
+
+static int mock_dma_wait(struct litepcie_ioctl_dma_wait *m)
+{
+    int ret;
+
+    if ((m->tx_wait && !mock.tx_started) || (!m->tx_wait && !mock.rx_started))
+        return -EIO;
+    pthread_mutex_lock(&mock.mutex);
+    ret = mock_wait(mock_dma_wait_done, m, m->timeout);
+    m->tx_buf_num = mock.tx_started ? mock.status->tx_buf_num : 0;
+    m->rx_buf_num = mock.rx_started ? mock.status->rx_buf_num : 0;
+    pthread_mutex_unlock(&mock.mutex);
+    return ret;
+}
+
+static short mock_poll_events(void)
+{
+    struct litepcie_status *st = mock.status;
+    short events = 0;
+
+    if (mock.rx_started && st->rx_hw_count > st->rx_user_count)
+        events |= POLLIN | POLLRDNORM;
+    if (mock.tx_started && st->tx_user_count - st->tx_hw_count < mock.tx_count)
+        events |= POLLOUT | POLLWRNORM;
+    return events;
+}
+
+static BOOL mock_poll_done(void *opaque)
+{
+    struct pollfd *pfd = opaque;
+
+    pfd->revents = mock_poll_events() & pfd->events;
+    return pfd->revents != 0;
+}
+
+static int mock_open(void)
+{
+    static const char ident[] = "LitePCIe device model";
+    unsigned long size;
+    int i;
+
+    if (mock.fd >= 0) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    mock.buf_size = env_int("LITEPCIE_MOCK_BUF_SIZE", DMA_BUFFER_SIZE);
+    mock.buf_count = env_int("LITEPCIE_MOCK_BUF_COUNT", DMA_BUFFER_COUNT);
+    mock.rate = getenv("LITEPCIE_MOCK_RATE") ?
+        atof(getenv("LITEPCIE_MOCK_RATE")) : 400e6;
+
+    size = mock_status_offset() + MOCK_PAGE_SIZE;
+    mock.tx_bufs = __real_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mock.tx_bufs == MAP_FAILED)
+        return -1;
+    mock.rx_bufs = mock.tx_bufs + mock_map_size();
+    mock.regs = mock.tx_bufs + mock_reg_offset();
+    mock.status = (struct litepcie_status *)(mock.tx_bufs + mock_status_offset());
+    /* the identifier is read one character per 32 bit word */
+    for(i = 0; ident[i] != '\0'; i++)
+        mock_writel(IDENTIFIER_MEM_BASE + 4 * (i + 1), ident[i]);
+    mock_writel(CSR_FRAMES_WIDTH_ADDR, 1280);
+    mock_writel(CSR_FRAMES_HEIGHT_ADDR, 720);
+    mock_writel(CSR_FRAMES_BUFFER_SIZE_ADDR, 32768);
+
+    pthread_mutex_init(&mock.mutex, NULL);
+    pthread_cond_init(&mock.cond, NULL);
+    mock.thread_running = TRUE;
+    if (pthread_create(&mock.thread, NULL, mock_dma_thread, NULL) != 0)
+        return -1;
+
+    mock.fd = __real_open("/dev/null", O_RDWR);
+    return mock.fd;
+}
+
+static void mock_close(void)
+{
+    mock_dma_stop();
+    pthread_mutex_lock(&mock.mutex);
+    mock.thread_running = FALSE;
+    pthread_mutex_unlock(&mock.mutex);
+    pthread_join(mock.thread, NULL);
+    pthread_cond_destroy(&mock.cond);
+    pthread_mutex_destroy(&mock.mutex);
+    __real_munmap(mock.tx_bufs, mock_status_offset() + MOCK_PAGE_SIZE);
+    mock.fd = -1;
+}
+
+int __wrap_open(const char *pathname, int flags, ...)
+{
+    va_list ap;
+    int mode;
+
+    if (!strncmp(pathname, "/dev/litepcie", 13))
+        return mock_open();
+    va_start(ap, flags);
+    mode = va_arg(ap, int);
+    va_end(ap);
+    return __real_open(pathname, flags, mode);
+}
+
+int __wrap_close(int fd)
+{
+    if (fd >= 0 && fd == mock.fd)
+        mock_close();
+    return __real_close(fd);
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+    int ret;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+    if (fd < 0 || fd != mock.fd)
+        return __real_ioctl(fd, request, arg);
+
+    switch(request) {
+    case LITEPCIE_IOCTL_GET_MMAP_INFO:
+        {
+            struct litepcie_ioctl_mmap_info *m = arg;
+            m->dma_tx_buf_offset = 0;
+            m->dma_tx_buf_size = mock.buf_size;
+            m->dma_tx_buf_count = mock.buf_count;
+            m->dma_rx_buf_offset = mock_map_size();
+            m->dma_rx_buf_size = mock.buf_size;
+            m->dma_rx_buf_count = mock.buf_count;
+            m->reg_offset = mock_reg_offset();
+            m->reg_size = PCI_FPGA_BAR0_SIZE;
+            m->status_offset = mock_status_offset();
+            m->status_size = MOCK_PAGE_SIZE;
+            ret = 0;
+        }
+        break;
+    case LITEPCIE_IOCTL_DMA_START:
+        ret = mock_dma_start(arg);
+        break;
+    case LITEPCIE_IOCTL_DMA_STOP:
+        mock_dma_stop();
+        ret = 0;
+        break;
+    case LITEPCIE_IOCTL_DMA_WAIT:
+        ret = mock_dma_wait(arg);
+        break;
+    default:
+        ret = -ENOTTY;
+        break;
+    }
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return ret;
+}
+
+void *__wrap_mmap(void *addr, size_t length, int prot, int flags, int fd,
+                  off_t offset)
+{
+    if (fd < 0 || fd != mock.fd)
+        return __real_mmap(addr, length, prot, flags, fd, offset);
+
+    if ((offset == 0 || offset == mock_map_size()) && length == mock_map_size())
+        return mock.tx_bufs + offset;
+    if (offset == mock_reg_offset() && length == PCI_FPGA_BAR0_SIZE)
+        return mock.regs;
+    if (offset == mock_status_offset() && length == MOCK_PAGE_SIZE)
+        return mock.status;
+    errno = EINVAL;
+    return MAP_FAILED;
+}
+
+int __wrap_munmap(void *addr, size_t length)
+{
+    uint8_t *p = addr;
+
+    if (mock.fd >= 0 && p >= mock.tx_bufs &&
+        p < mock.tx_bufs + mock_status_offset() + MOCK_PAGE_SIZE)
+        return 0; /* released on close */
+    return __real_munmap(addr, length);
+}
+
+int __wrap_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    int ret;
+
+    if (nfds != 1 || fds[0].fd < 0 || fds[0].fd != mock.fd)
+        return __real_poll(fds, nfds, timeout);
+
+    pthread_mutex_lock(&mock.mutex);
+    ret = mock_wait(mock_poll_done, &fds[0], timeout);
+    pthread_mutex_unlock(&mock.mutex);
+    return ret == 0 ? 1 : 0;
+}
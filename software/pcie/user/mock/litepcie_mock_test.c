@@ -0,0 +1,283 @@
+/*
+ * litepcie_lib tests against the device model (litepcie_mock.c)
+ *
+ * Run by 'make check'. Exit status is 0 if all tests pass.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+
+#include "litepcie.h"
+#include "cutils.h"
+#include "config.h"
+#include "csr.h"
+#include "flags.h"
+#include "litepcie_lib.h"
+
+static int errors;
+
+#define CHECK(cond, ...) do {                   \
+    if (!(cond)) {                              \
+        printf("FAIL: " __VA_ARGS__);           \
+        errors++;                               \
+    }                                           \
+} while (0)
+
+/* word i of TX buffer b is (b << 16) | i: every RX buffer must hold the
+   TX buffer with the same index */
+static void test_loopback(LitePCIeState *s)
+{
+    const int buf_size = 4096, buf_count = 16;
+    uint64_t rx_total;
+    uint32_t *p;
+    int b, i, bad;
+
+    for(b = 0; b < buf_count; b++) {
+        p = (uint32_t *)(s->dma_tx_buf + b * s->dma_tx_buf_size);
+        for(i = 0; i < buf_size / 4; i++)
+            p[i] = (b << 16) | i;
+    }
+
+    litepcie_dma_start(s, buf_size, buf_count, TRUE);
+    rx_total = 0;
+    bad = 0;
+    while (rx_total < 4 * buf_count) {
+        if (litepcie_dma_poll(s, FALSE, 1000) <= 0) {
+            CHECK(0, "loopback: timeout after %" PRIu64 " buffers\n", rx_total);
+            break;
+        }
+        for(; rx_total < s->status->rx_hw_count; rx_total++) {
+            b = rx_total % buf_count;
+            p = (uint32_t *)(s->dma_rx_buf + b * s->dma_rx_buf_size);
+            for(i = 0; i < buf_size / 4; i++) {
+                if (p[i] != ((b << 16) | i)) {
+                    bad++;
+                    break;
+                }
+            }
+        }
+        s->status->rx_user_count = rx_total;
+        s->status->tx_user_count = s->status->tx_hw_count + buf_count;
+    }
+    CHECK(bad == 0, "loopback: %d corrupted buffers\n", bad);
+    CHECK((litepcie_readl(s, CSR_DMA_WRITER_TABLE_LOOP_STATUS_ADDR) & 0xffff) ==
+          s->status->rx_buf_num, "loopback: loop status register\n");
+    litepcie_dma_stop(s);
+    printf("loopback: %" PRIu64 " buffers\n", rx_total);
+}
+
+/* each direction starts on its own, as read() and write() on separate
+   files do; a running direction or an empty ring is refused */
+static void test_start_directions(LitePCIeState *s)
+{
+    struct litepcie_ioctl_dma_start m;
+    struct litepcie_ioctl_dma_wait w;
+    const int buf_size = 4096, buf_count = 16;
+
+    memset(&m, 0, sizeof(m));
+    m.tx_buf_size = buf_size;
+    CHECK(ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &m) < 0 && errno == EINVAL,
+          "directions: TX without buffers\n");
+    m.tx_buf_count = buf_count;
+    CHECK(ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &m) == 0,
+          "directions: TX start\n");
+    CHECK(ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &m) < 0 && errno == EIO,
+          "directions: TX started twice\n");
+
+    memset(&m, 0, sizeof(m));
+    m.rx_buf_size = buf_size;
+    m.rx_buf_count = buf_count;
+    CHECK(ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_START, &m) == 0,
+          "directions: RX start while TX runs\n");
+
+    memset(&w, 0, sizeof(w));
+    w.timeout = 1000;
+    w.tx_wait = 1;
+    w.tx_buf_num = s->status->tx_buf_num;
+    CHECK(ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_WAIT, &w) == 0,
+          "directions: TX stalled\n");
+    ioctl(s->litepcie_fd, LITEPCIE_IOCTL_DMA_STOP);
+    printf("directions: ok\n");
+}
+
+/* frames must come in order, with the model payload: byte n of frame
+   'seq' is (seq + n) & 0xff */
+static void test_frames(LitePCIeState *s)
+{
+    const int width = 320, height = 240, count = 30;
+    LitePCIeFrame frame;
+    uint32_t first_seq = 0;
+    unsigned int i;
+    int n, bad;
+
+    if (litepcie_frame_start(s, width, height, 120) < 0) {
+        CHECK(0, "frames: start\n");
+        return;
+    }
+    bad = 0;
+    for(n = 0; n < count; n++) {
+        if (litepcie_frame_get(s, &frame, 1000) < 0) {
+            CHECK(0, "frames: timeout after %d frames\n", n);
+            break;
+        }
+        if (n == 0)
+            first_seq = frame.sequence;
+        CHECK(frame.sequence == first_seq + n, "frames: sequence %u, expected %u\n",
+              frame.sequence, first_seq + n);
+        CHECK(frame.width == width && frame.height == height &&
+              frame.length == width * height * 2, "frames: geometry\n");
+        for(i = 0; i < frame.length; i++) {
+            if (frame.data[i] != (uint8_t)(frame.sequence + i)) {
+                bad++;
+                break;
+            }
+        }
+        CHECK(litepcie_frame_valid(s, &frame), "frames: frame %u overwritten\n",
+              frame.sequence);
+    }
+    CHECK(bad == 0, "frames: %d corrupted frames\n", bad);
+    CHECK(s->frame_drop_count == 0, "frames: %" PRId64 " dropped\n",
+          s->frame_drop_count);
+    litepcie_frame_stop(s);
+    printf("frames: %d frames\n", n);
+}
+
+/* streaming in loopback: TX buffer seq is tagged with seq, RX buffer seq
+   must carry the same tag, unless the library reported an underflow or
+   an overflow (a thread may be late on a loaded machine) */
+#define STREAM_BUF_SIZE 4096
+#define STREAM_BUF_COUNT 128
+#define STREAM_BUFS 2000
+
+typedef struct {
+    int rx_count;
+    int rx_bad;
+} StreamTest;
+
+static void stream_tx_fill(void *opaque, LitePCIeBuffer *buf)
+{
+    uint32_t *p = (uint32_t *)buf->data;
+    unsigned int i;
+
+    for(i = 0; i < buf->size / 4; i++)
+        p[i] = buf->seq + i;
+}
+
+static BOOL stream_rx_check(const LitePCIeBuffer *buf)
+{
+    const uint32_t *p = (const uint32_t *)buf->data;
+    unsigned int i;
+
+    for(i = 0; i < buf->size / 4; i++) {
+        if (p[i] != (uint32_t)(buf->seq + i))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static void stream_rx_cb(void *opaque, LitePCIeBuffer *buf)
+{
+    StreamTest *t = opaque;
+
+    if (!stream_rx_check(buf))
+        t->rx_bad++;
+    __atomic_fetch_add(&t->rx_count, 1, __ATOMIC_RELEASE);
+}
+
+static void stream_check_errors(LitePCIeState *s, int bad)
+{
+    int64_t reported = s->tx_underflow_count + s->rx_overflow_count;
+
+    CHECK(bad <= reported, "stream: %d corrupted RX buffers, %" PRId64
+          " reported\n", bad, reported);
+    printf("stream: rx_overflows=%" PRId64 " tx_underflows=%" PRId64 "\n",
+           s->rx_overflow_count, s->tx_underflow_count);
+}
+
+/* TX callback, RX blocking pops */
+static void test_stream_rx_pop(LitePCIeState *s)
+{
+    LitePCIeBuffer buf;
+    uint64_t last_seq = 0;
+    int n, bad;
+
+    if (litepcie_stream_start(s, LITEPCIE_STREAM_RX | LITEPCIE_STREAM_TX |
+                              LITEPCIE_STREAM_LOOPBACK,
+                              STREAM_BUF_SIZE, STREAM_BUF_COUNT,
+                              NULL, stream_tx_fill, NULL) < 0) {
+        CHECK(0, "stream: start\n");
+        return;
+    }
+    bad = 0;
+    for(n = 0; n < STREAM_BUFS; n++) {
+        if (litepcie_rx_pop(s, &buf, 1000) < 0) {
+            CHECK(0, "stream: RX timeout after %d buffers\n", n);
+            break;
+        }
+        CHECK(n == 0 || buf.seq > last_seq, "stream: RX out of order\n");
+        last_seq = buf.seq;
+        if (!stream_rx_check(&buf))
+            bad++;
+        litepcie_rx_release(s, &buf);
+    }
+    litepcie_stream_stop(s);
+    stream_check_errors(s, bad);
+    printf("stream (rx pop): %d buffers\n", n);
+}
+
+/* TX blocking get/push, RX callback */
+static void test_stream_tx_push(LitePCIeState *s)
+{
+    StreamTest t;
+    LitePCIeBuffer buf;
+    int n;
+
+    memset(&t, 0, sizeof(t));
+    if (litepcie_stream_start(s, LITEPCIE_STREAM_RX | LITEPCIE_STREAM_TX |
+                              LITEPCIE_STREAM_LOOPBACK,
+                              STREAM_BUF_SIZE, STREAM_BUF_COUNT,
+                              stream_rx_cb, NULL, &t) < 0) {
+        CHECK(0, "stream: start\n");
+        return;
+    }
+    for(n = 0; __atomic_load_n(&t.rx_count, __ATOMIC_ACQUIRE) < STREAM_BUFS; n++) {
+        if (litepcie_tx_get(s, &buf, 1000) < 0) {
+            CHECK(0, "stream: TX timeout after %d buffers\n", n);
+            break;
+        }
+        stream_tx_fill(NULL, &buf);
+        litepcie_tx_push(s, &buf);
+    }
+    litepcie_stream_stop(s);
+    stream_check_errors(s, t.rx_bad);
+    printf("stream (tx push): %d buffers\n", t.rx_count);
+}
+
+int main(int argc, char **argv)
+{
+    LitePCIeState *s;
+
+    s = litepcie_open(LITEPCIE_FILENAME);
+    if (!s) {
+        fprintf(stderr, "Could not init driver\n");
+        exit(1);
+    }
+
+    test_loopback(s);
+    test_start_directions(s);
+    test_frames(s);
+    test_stream_rx_pop(s);
+    test_stream_tx_push(s);
+
+    litepcie_close(s);
+
+    if (errors) {
+        printf("%d error(s)\n", errors);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
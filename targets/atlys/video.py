@@ -1,6 +1,7 @@
-from litevideo.input import HDMIIn
 from litevideo.output import VideoOut
 
+from gateware.hdmi_in import HDMIIn
+
 from targets.utils import csr_map_update
 from targets.atlys.base import BaseSoC
 
@@ -1,10 +1,11 @@
-from litevideo.input import HDMIIn
 from litevideo.output import VideoOut
 
 from litex.soc.cores.frequency_meter import FrequencyMeter
 
 from litescope import LiteScopeAnalyzer
 
+from gateware.hdmi_in import HDMIIn
+
 from targets.utils import csr_map_update, period_ns
 from targets.mimas_a7.net import NetSoC as BaseSoC
 
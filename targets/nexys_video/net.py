@@ -1,9 +1,10 @@
 from litex.soc.integration.soc_core import mem_decoder
 from litex.soc.integration.soc_sdram import *
 
-from liteeth.core.mac import LiteEthMAC
 from liteeth.phy.s7rgmii import LiteEthPHYRGMII
 
+from gateware.ethmac import LiteEthMACSharedTX
+
 from targets.utils import csr_map_update
 from targets.nexys_video.base import SoC as BaseSoC
 
@@ -30,8 +31,8 @@ class NetSoC(BaseSoC):
         self.submodules.ethphy = LiteEthPHYRGMII(
             platform.request("eth_clocks"),
             platform.request("eth"))
-        self.submodules.ethmac = LiteEthMAC(
-            phy=self.ethphy, dw=32, interface="wishbone")
+        self.submodules.ethmac = LiteEthMACSharedTX(
+            phy=self.ethphy, dw=32)
         self.add_wb_slave(mem_decoder(self.mem_map["ethmac"]), self.ethmac.bus)
         self.add_memory_region("ethmac",
             self.mem_map["ethmac"] | self.shadow_base, 0x2000)
@@ -1,10 +1,12 @@
-from litevideo.input import HDMIIn
 from litevideo.output import VideoOut
 
 from litex.soc.cores.frequency_meter import FrequencyMeter
 
 from litescope import LiteScopeAnalyzer
 
+from gateware.hdmi_in import HDMIIn
+from gateware.streamer import RawVideoUDPStreamer
+
 from targets.utils import csr_map_update, period_ns
 from targets.nexys_video.net import NetSoC as BaseSoC
 
@@ -15,6 +17,7 @@ class VideoSoC(BaseSoC):
         "hdmi_in0",
         "hdmi_in0_freq",
         "hdmi_in0_edid_mem",
+        "rawvideo",
     )
     csr_map_update(BaseSoC.csr_map, csr_peripherals)
 
@@ -87,6 +90,12 @@ class VideoSoC(BaseSoC):
             self.hdmi_out0.driver.clocking.cd_pix.clk,
             self.hdmi_out0.driver.clocking.cd_pix5x.clk)
 
+        # raw video over UDP
+        self.submodules.rawvideo = RawVideoUDPStreamer(
+            self.sdram.crossbar.get_port(mode="read"))
+        self.comb += self.rawvideo.source.connect(
+            self.ethmac.get_tx_port(dw=32))
+
         for name, value in sorted(self.platform.hdmi_infos.items()):
             self.add_constant(name, value)
 
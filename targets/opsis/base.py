@@ -16,7 +16,10 @@ from litedram.core import ControllerSettings
 
 from gateware import i2c
 from gateware import info
+from gateware.dram_monitor import DRAMMonitor
+from gateware.dram_qos import DRAMQoS, PriorityDRAMCore
 from gateware import opsis_i2c
+from gateware.rebind import rebind
 from gateware import shared_uart
 from gateware import tofe
 from gateware import spi_flash
@@ -221,6 +224,8 @@ class BaseSoC(SoCSDRAM):
         "tofe",
         "opsis_i2c",
         "uart",
+        "dram_monitor",
+        "dram_qos",
     )
     csr_map_update(SoCSDRAM.csr_map, csr_peripherals)
 
@@ -288,6 +293,15 @@ class BaseSoC(SoCSDRAM):
             self.ddrphy.clk8x_wr_strb.eq(self.crg.clk8x_wr_strb),
             self.ddrphy.clk8x_rd_strb.eq(self.crg.clk8x_rd_strb),
         ]
+        # frame buffers are staggered over the banks (firmware/framebuffer.h)
+        geom = sdram_module.geom_settings
+        self.add_constant("SDRAM_BANKS", 2**geom.bankbits)
+        self.add_constant("SDRAM_ROW_BYTES",
+            2**geom.colbits*(self.ddrphy.settings.dfi_databits//2)//8)
+        # the crossbar ports made so far are the CPU's
+        self.dram_ports = [("cpu", port) for port in self.sdram.crossbar.masters]
+        # urgency (see gateware/dram_qos.py) of the ports, by name
+        self.dram_urgency = {}
 
         if tofe_board_name:
             if tofe_board_name == 'lowspeedio':
@@ -297,5 +311,43 @@ class BaseSoC(SoCSDRAM):
 
         self.add_interrupt("uart")
 
+    def register_sdram(self, *args, **kwargs):
+        """SoCSDRAM's, building a PriorityDRAMCore for priority arbitration
+        of the ports (see gateware/dram_qos.py)"""
+        register_sdram = rebind(SoCSDRAM.register_sdram,
+            LiteDRAMCore=PriorityDRAMCore)
+        register_sdram(self, *args, **kwargs)
+
+    def get_dram_port(self, name, **kwargs):
+        """Crossbar port, monitored by dram_monitor under this name"""
+        port = self.sdram.crossbar.get_port(**kwargs)
+        self.dram_ports.append((name, self.sdram.crossbar.masters[-1]))
+        return port
+
+    def do_finalize(self):
+        # all the ports are known now
+        ports = [port for name, port in self.dram_ports]
+        self.submodules.dram_monitor = DRAMMonitor(ports)
+        self.add_constant("DRAM_MONITOR_PORTS", len(self.dram_ports))
+        for i, (name, port) in enumerate(self.dram_ports):
+            self.add_constant("DRAM_MONITOR_PORT{}_NAME".format(i), name)
+        self.add_constant("DRAM_MONITOR_PORT_BYTES", self.sdram.crossbar.masters[0].dw//8)
+        self.add_constant("DRAM_MONITOR_PERIOD_BITS", 24)
+
+        # the crossbar builds its bank arbiters when finalized, over its
+        # masters in order: they must be the ports named above
+        masters = self.sdram.crossbar.masters
+        assert len(ports) == len(masters) and all(p is m for p, m in zip(ports, masters))
+        self.submodules.dram_qos = DRAMQoS(ports, window_bits=10)
+        self.add_constant("DRAM_QOS_WINDOW_BITS", 10)
+        for i, (name, port) in enumerate(self.dram_ports):
+            if name in self.dram_urgency:
+                self.comb += self.dram_qos.urgency[i].eq(self.dram_urgency[name])
+        # the crossbar may already be finalized with the SoC's submodules
+        self.sdram.crossbar.finalize()
+        self.comb += [level.eq(qos_level) for level, qos_level
+            in zip(self.sdram.crossbar.levels, self.dram_qos.levels)]
+        SoCSDRAM.do_finalize(self)
+
 
 SoC = BaseSoC
@@ -23,7 +23,7 @@ class EncoderSoC(BaseSoC):
     def __init__(self, platform, *args, **kwargs):
         BaseSoC.__init__(self, platform, *args, **kwargs)
 
-        encoder_port = self.sdram.crossbar.get_port()
+        encoder_port = self.get_dram_port("encoder")
         self.submodules.encoder_reader = EncoderDMAReader(encoder_port)
         encoder_cdc = stream.AsyncFIFO([("data", 128)], 4)
         encoder_cdc = ClockDomainsRenamer({"write": "sys",
@@ -0,0 +1,60 @@
+from migen.fhdl.decorators import ClockDomainsRenamer
+from litex.soc.integration.soc_core import mem_decoder
+from litex.soc.interconnect import stream
+
+from gateware.encoder import EncoderDMAReader, EncoderBuffer, Encoder
+from gateware.streamer import RTPJPEGStreamer
+
+from targets.utils import csr_map_update
+from targets.opsis.video import SoC as BaseSoC
+
+
+class HDMI2EthSoC(BaseSoC):
+    csr_peripherals = (
+        "encoder_reader",
+        "encoder",
+        "rtp",
+    )
+    csr_map_update(BaseSoC.csr_map, csr_peripherals)
+    mem_map = {
+        "encoder": 0x50000000,  # (shadow @0xd0000000)
+    }
+    mem_map.update(BaseSoC.mem_map)
+
+    def __init__(self, platform, *args, **kwargs):
+        BaseSoC.__init__(self, platform, *args, **kwargs)
+
+        encoder_port = self.get_dram_port("encoder")
+        self.submodules.encoder_reader = EncoderDMAReader(encoder_port)
+        encoder_cdc = stream.AsyncFIFO([("data", 128)], 4)
+        encoder_cdc = ClockDomainsRenamer({"write": "sys",
+                                           "read": "encoder"})(encoder_cdc)
+        encoder_buffer = ClockDomainsRenamer("encoder")(EncoderBuffer())
+        encoder = Encoder(platform)
+        rtp_cdc = stream.AsyncFIFO([("data", 8)], 16)
+        rtp_cdc = ClockDomainsRenamer({"write": "encoder",
+                                       "read": "sys"})(rtp_cdc)
+        self.submodules += encoder_cdc, encoder_buffer, encoder, rtp_cdc
+        self.submodules.rtp = RTPJPEGStreamer(self.clk_freq)
+
+        self.comb += [
+            self.encoder_reader.source.connect(encoder_cdc.sink),
+            encoder_cdc.source.connect(encoder_buffer.sink),
+            encoder_buffer.source.connect(encoder.sink),
+            encoder.source.connect(rtp_cdc.sink),
+            rtp_cdc.source.connect(self.rtp.sink),
+            self.rtp.source.connect(self.ethmac.get_tx_port()),
+            # Timestamp frames when their capture starts.
+            self.rtp.frame_start.eq(self.encoder_reader.start.re)
+        ]
+        self.add_wb_slave(mem_decoder(self.mem_map["encoder"]), encoder.bus)
+        self.add_memory_region("encoder",
+            self.mem_map["encoder"] + self.shadow_base, 0x2000)
+
+        self.crg.cd_encoder.clk.attr.add("keep")
+        self.platform.add_false_path_constraints(
+            self.crg.cd_sys.clk,
+            self.crg.cd_encoder.clk)
+
+
+SoC = HDMI2EthSoC
@@ -1,8 +1,7 @@
 from litex.soc.integration.soc_core import mem_decoder
 from litex.soc.integration.soc_sdram import *
 
-from liteeth.core.mac import LiteEthMAC
-
+from gateware.ethmac import LiteEthMACSharedTX
 from gateware.s6rgmii import LiteEthPHYRGMII
 
 from targets.utils import csr_map_update
@@ -32,8 +31,8 @@ class NetSoC(BaseSoC):
             platform.request("eth_clocks"),
             platform.request("eth"))
         self.platform.add_source("gateware/rgmii_if.vhd")
-        self.submodules.ethmac = LiteEthMAC(
-            phy=self.ethphy, dw=32, interface="wishbone")
+        self.submodules.ethmac = LiteEthMACSharedTX(
+            phy=self.ethphy, dw=32)
         self.add_wb_slave(mem_decoder(self.mem_map["ethmac"]), self.ethmac.bus)
         self.add_memory_region("ethmac",
             self.mem_map["ethmac"] | self.shadow_base, 0x2000)
@@ -1,8 +1,9 @@
-from litevideo.input import HDMIIn
-from litevideo.output import VideoOut
-
+from gateware.hdmi_in import HDMIIn
+from gateware.hdmi_out import VideoOut
 from gateware import freq_measurement
 from gateware import i2c
+from gateware.scaler import FramebufferScaler
+from gateware.streamer import RawVideoUDPStreamer
 
 from targets.utils import csr_map_update, period_ns
 from targets.opsis.net import NetSoC as BaseSoC
@@ -18,6 +19,8 @@ class VideoSoC(BaseSoC):
         "hdmi_in1",
         "hdmi_in1_freq",
         "hdmi_in1_edid_mem",
+        "rawvideo",
+        "scaler",
     )
     csr_map_update(BaseSoC.csr_map, csr_peripherals)
 
@@ -37,8 +40,9 @@ class VideoSoC(BaseSoC):
 
         self.submodules.hdmi_in0 = HDMIIn(
             hdmi_in0_pads,
-            self.sdram.crossbar.get_port(mode="write"),
+            self.get_dram_port("hdmi_in0", mode="write"),
             fifo_depth=512,
+            compression=True,
             )
 
         self.submodules.hdmi_in0_freq = freq_measurement.FrequencyMeasurement(
@@ -49,8 +53,9 @@ class VideoSoC(BaseSoC):
 
         self.submodules.hdmi_in1 = HDMIIn(
             hdmi_in1_pads,
-            self.sdram.crossbar.get_port(mode="write"),
+            self.get_dram_port("hdmi_in1", mode="write"),
             fifo_depth=512,
+            compression=True,
         )
 
         self.submodules.hdmi_in1_freq = freq_measurement.FrequencyMeasurement(
@@ -61,7 +66,8 @@ class VideoSoC(BaseSoC):
         # hdmi out 0
         hdmi_out0_pads = platform.request("hdmi_out", 0)
 
-        hdmi_out0_dram_port = self.sdram.crossbar.get_port(
+        hdmi_out0_dram_port = self.get_dram_port(
+            "hdmi_out0",
             mode="read",
             data_width=dw,
             clock_domain="hdmi_out0_pix",
@@ -77,11 +83,13 @@ class VideoSoC(BaseSoC):
         )
 
         self.hdmi_out0.submodules.i2c = i2c.I2C(hdmi_out0_pads)
+        self.dram_urgency["hdmi_out0"] = self.hdmi_out0.urgency
 
         # hdmi out 1 : Share clocking with hdmi_out0 since no PLL_ADV left.
         hdmi_out1_pads = platform.request("hdmi_out", 1)
 
-        hdmi_out1_dram_port = self.sdram.crossbar.get_port(
+        hdmi_out1_dram_port = self.get_dram_port(
+            "hdmi_out1",
             mode="read",
             data_width=dw,
             clock_domain="hdmi_out1_pix",
@@ -98,6 +106,7 @@ class VideoSoC(BaseSoC):
         )
 
         self.hdmi_out1.submodules.i2c = i2c.I2C(hdmi_out1_pads)
+        self.dram_urgency["hdmi_out1"] = self.hdmi_out1.urgency
 
         # all PLL_ADV are used: router needs help...
         platform.add_platform_command("""INST crg_pll_adv LOC=PLL_ADV_X0Y0;""")
@@ -120,6 +129,28 @@ NET "{pix1_clk}" TNM_NET = "GRPpix1_clk";
             self.hdmi_out0.driver.clocking.cd_pix.clk,
             self.hdmi_out1.driver.clocking.cd_pix.clk)
 
+        # raw video over UDP
+        self.submodules.rawvideo = RawVideoUDPStreamer(
+            self.get_dram_port("rawvideo", mode="read"))
+        self.comb += self.rawvideo.source.connect(
+            self.ethmac.get_tx_port(dw=32))
+
+        # frame buffer scaler, 16 bit ports like VideoOut
+        self.submodules.scaler = FramebufferScaler(
+            self.get_dram_port(
+                "scaler_rd",
+                mode="read",
+                data_width=16,
+                reverse=True,
+            ),
+            self.get_dram_port(
+                "scaler_wr",
+                mode="write",
+                data_width=16,
+                reverse=True,
+            ),
+        )
+
         for name, value in sorted(self.platform.hdmi_infos.items()):
             self.add_constant(name, value)
 
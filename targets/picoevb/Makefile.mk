@@ -0,0 +1,59 @@
+# picoevb targets
+
+ifneq ($(PLATFORM),picoevb)
+	$(error "Platform should be picoevb when using this file!?")
+endif
+
+# Settings
+DEFAULT_TARGET = capture
+TARGET ?= $(DEFAULT_TARGET)
+
+# Image
+image-flash-$(PLATFORM): image-flash-py
+	@true
+
+.PHONY: image-flash-$(PLATFORM)
+
+# Gateware
+gateware-load-$(PLATFORM):
+	@echo "Unsupported, use gateware-flash and reboot the host."
+	@false
+
+gateware-flash-$(PLATFORM): gateware-flash-py
+	@true
+
+.PHONY: gateware-load-$(PLATFORM) gateware-flash-$(PLATFORM)
+
+# Firmware
+firmware-load-$(PLATFORM):
+	@echo "Unsupported, the $(PLATFORM) targets are host driven (software/pcie)."
+	@false
+
+firmware-flash-$(PLATFORM):
+	@echo "Unsupported, the $(PLATFORM) targets are host driven (software/pcie)."
+	@false
+
+firmware-connect-$(PLATFORM):
+	@echo "Unsupported."
+	@false
+
+.PHONY: firmware-load-$(PLATFORM) firmware-flash-$(PLATFORM) firmware-connect-$(PLATFORM)
+
+# Bios
+bios-flash-$(PLATFORM):
+	@echo "Unsupported."
+	@false
+
+.PHONY: bios-flash-$(PLATFORM)
+
+# Extra commands
+help-$(PLATFORM):
+	@echo " The $(PLATFORM) targets have no soft CPU. After loading the"
+	@echo " gateware, build and load the driver from"
+	@echo " $(TARGET_BUILD_DIR)/software/pcie/kernel (csr.h is generated there)."
+
+reset-$(PLATFORM):
+	@echo "Unsupported."
+	@false
+
+.PHONY: help-$(PLATFORM) reset-$(PLATFORM)
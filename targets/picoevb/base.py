@@ -0,0 +1,102 @@
+# Support for the RHS Research PicoEVB (M.2 2230 PCIe x1 card)
+from migen import *
+from migen.genlib.resetsync import AsyncResetSynchronizer
+
+from litex.soc.integration.soc_core import *
+from litex.soc.integration.builder import *
+
+from litepcie.phy.s7pciephy import S7PCIEPHY
+from litepcie.core import LitePCIeEndpoint
+from litepcie.frontend.dma import LitePCIeDMA
+from litepcie.frontend.wishbone import LitePCIeWishboneBridge
+
+from gateware import info
+from gateware.pcie_irq import IRQCoalescer, LitePCIeMSIMultiVector
+
+from targets.utils import csr_map_update, period_ns
+
+
+class _CRG(Module):
+    def __init__(self, platform):
+        self.clock_domains.cd_sys = ClockDomain()
+
+        # sys is the 125MHz PCIe user clock, generated by the PHY.
+        self.comb += self.cd_sys.clk.eq(ClockSignal("pcie"))
+        self.specials += AsyncResetSynchronizer(self.cd_sys, ResetSignal("pcie"))
+
+
+class BaseSoC(SoCCore):
+    """Host driven SoC: no soft CPU, the CSRs are accessed from the host
+    through BAR0 and the LitePCIe DMA is driven by software/pcie."""
+    csr_peripherals = (
+        "pcie_phy",
+        "dma",
+        "msi",
+        "dma_writer_irq",
+        "dma_reader_irq",
+        "info",
+    )
+    csr_map_update(SoCCore.csr_map, csr_peripherals)
+
+    interrupt_map = {
+        "dma_writer": 0,
+        "dma_reader": 1,
+    }
+
+    def __init__(self, platform, **kwargs):
+        kwargs['cpu_type'] = None
+        kwargs['integrated_rom_size'] = 0
+        kwargs['integrated_sram_size'] = 0
+        kwargs['with_uart'] = False
+        kwargs['with_timer'] = False
+        kwargs['csr_data_width'] = 32
+        kwargs['shadow_base'] = 0x00000000
+
+        clk_freq = int(125e6)
+        SoCCore.__init__(self, platform, clk_freq, **kwargs)
+
+        # PCIe endpoint
+        self.submodules.pcie_phy = S7PCIEPHY(platform, platform.request("pcie_x1"))
+        self.submodules.crg = _CRG(platform)
+        self.platform.add_period_constraint(self.crg.cd_sys.clk, period_ns(clk_freq))
+        self.submodules.pcie_endpoint = LitePCIeEndpoint(self.pcie_phy)
+
+        # PCIe wishbone bridge (BAR0 -> CSRs)
+        self.submodules.pcie_bridge = LitePCIeWishboneBridge(self.pcie_endpoint, lambda a: 1)
+        self.add_wb_master(self.pcie_bridge.wishbone)
+
+        # PCIe DMA, loopback is used by litepcie_util dma_loopback_test
+        self.submodules.dma = LitePCIeDMA(self.pcie_phy, self.pcie_endpoint, with_loopback=True)
+
+        # PCIe MSI, with per direction interrupt coalescing. The MSI
+        # controller can send one vector per DMA direction, but the S7
+        # PCIe core of litepcie advertises a single MSI message (Multiple
+        # Message Capable = 1), which S7PCIEPHY does not configure: the
+        # host always allocates one vector here, and coalescing is the
+        # only control of the interrupt rate.
+        self.submodules.msi = LitePCIeMSIMultiVector()
+        self.comb += self.msi.source.connect(self.pcie_phy.msi)
+        self.submodules.dma_writer_irq = IRQCoalescer(clk_freq)
+        self.submodules.dma_reader_irq = IRQCoalescer(clk_freq)
+        self.comb += [
+            self.dma_writer_irq.i.eq(self.dma.writer.irq),
+            self.dma_reader_irq.i.eq(self.dma.reader.irq)
+        ]
+        interrupts = {
+            "dma_writer": self.dma_writer_irq.o,
+            "dma_reader": self.dma_reader_irq.o,
+        }
+        for name, irq in sorted(interrupts.items()):
+            self.comb += self.msi.irqs[self.interrupt_map[name]].eq(irq)
+            self.add_constant(name.upper() + "_INTERRUPT", self.interrupt_map[name])
+
+        # Basic peripherals
+        self.submodules.info = info.Info(platform, self.__class__.__name__)
+
+        # Heartbeat on the first LED, the other ones are free for targets.
+        counter = Signal(27)
+        self.sync += counter.eq(counter + 1)
+        self.comb += platform.request("user_led", 0).eq(counter[26])
+
+
+SoC = BaseSoC
@@ -0,0 +1,38 @@
+from gateware.streamer import FramePatternGenerator, PCIeFrameStreamer
+
+from targets.utils import csr_map_update
+from targets.picoevb.base import SoC as BaseSoC
+
+
+class CaptureSoC(BaseSoC):
+    """Streams whole frames to host memory through the PCIe DMA writer.
+
+    The PicoEVB has no DRAM and no video input, so frames come from an
+    on-chip colour bar generator; any 64 bit YCbCr 4:2:2 stream can replace
+    it. Use litepcie_frame_start()/litepcie_frame_get() from
+    software/pcie/user/litepcie_lib.h to receive them.
+    """
+    csr_peripherals = (
+        "frames",
+    )
+    csr_map_update(BaseSoC.csr_map, csr_peripherals)
+
+    def __init__(self, platform, *args, **kwargs):
+        BaseSoC.__init__(self, platform, *args, **kwargs)
+
+        self.submodules.pattern = pattern = FramePatternGenerator()
+        self.submodules.frames = frames = PCIeFrameStreamer()
+        self.comb += [
+            pattern.start.eq(frames.frame_start),
+            pattern.width.eq(frames.frame_width),
+            pattern.sequence.eq(frames.sequence),
+            pattern.source.connect(frames.sink),
+            frames.source.connect(self.dma.sink),
+            # Nothing consumes host to card data, drain it so TX DMA
+            # benchmarks (litepcie_util dma_bench tx) can run.
+            self.dma.source.ready.eq(1),
+            platform.request("user_led", 1).eq(frames.enable.storage)
+        ]
+
+
+SoC = CaptureSoC
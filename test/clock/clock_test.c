@@ -0,0 +1,106 @@
+/*
+ * Host test of the pixel clock settings of firmware/clock.c: for every
+ * pixel clock from 20MHz to 200MHz (10kHz steps), the setting must be
+ * within the limits of clock.h and as close as the best one found by an
+ * exhaustive search.
+ *
+ * Run by 'make check'. Exit status is 0 if all tests pass.
+ */
+#include <stdio.h>
+
+#include "clock.h"
+
+#define PIXEL_CLOCK_MIN 2000
+#define PIXEL_CLOCK_MAX 20000
+
+static double error(double frequency, unsigned int pixel_clock)
+{
+	double e = frequency - pixel_clock/100.0;
+
+	return e < 0 ? -e : e;
+}
+
+static int check_clkgen(unsigned int pixel_clock)
+{
+	struct clock_setting s;
+	unsigned int m, d;
+	double e, best = -1;
+
+	for(d = 1; d <= 256; d++)
+		for(m = 2; m <= 256; m++) {
+			e = error(50.0*m/d, pixel_clock);
+			if(best < 0 || e < best)
+				best = e;
+		}
+
+	if(!clock_clkgen_setting(pixel_clock, &s)) {
+		printf("FAIL: clkgen %u: no setting\n", pixel_clock);
+		return 1;
+	}
+	if(s.m < 2 || s.m > 256 || s.d < 1 || s.d > 256 || s.o != 1) {
+		printf("FAIL: clkgen %u: m %u d %u o %u out of limits\n",
+			pixel_clock, s.m, s.d, s.o);
+		return 1;
+	}
+	e = error(50.0*s.m/s.d, pixel_clock);
+	if(e > best + 1e-9) {
+		printf("FAIL: clkgen %u: m %u d %u, error %fMHz, best %fMHz\n",
+			pixel_clock, s.m, s.d, e, best);
+		return 1;
+	}
+	return 0;
+}
+
+static int check_mmcm(unsigned int pixel_clock)
+{
+	struct clock_setting s;
+	unsigned int m, d, o;
+	double vco, e, best = -1;
+
+	for(o = 5; o <= 125; o += 5)
+		for(d = 1; d <= 10; d++)
+			for(m = 2; m <= 64; m++) {
+				vco = 100.0*m/d;
+				if(vco < 600 || vco > 1200)
+					continue;
+				e = error(vco/o, pixel_clock);
+				if(best < 0 || e < best)
+					best = e;
+			}
+
+	if(!clock_mmcm_setting(pixel_clock, &s)) {
+		printf("FAIL: mmcm %u: no setting\n", pixel_clock);
+		return 1;
+	}
+	vco = 100.0*s.m/s.d;
+	if(s.m < 2 || s.m > 64 || s.d < 1 || s.d > 10 || s.o % 5 || s.o > 125 ||
+	   vco < 600 || vco > 1200) {
+		printf("FAIL: mmcm %u: m %u d %u o %u out of limits\n",
+			pixel_clock, s.m, s.d, s.o);
+		return 1;
+	}
+	e = error(vco/s.o, pixel_clock);
+	if(e > best + 1e-9) {
+		printf("FAIL: mmcm %u: m %u d %u o %u, error %fMHz, best %fMHz\n",
+			pixel_clock, s.m, s.d, s.o, e, best);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	unsigned int pixel_clock;
+	int errors = 0;
+
+	for(pixel_clock = PIXEL_CLOCK_MIN; pixel_clock <= PIXEL_CLOCK_MAX; pixel_clock++) {
+		errors += check_clkgen(pixel_clock);
+		errors += check_mmcm(pixel_clock);
+	}
+	if(errors) {
+		printf("%d error(s)\n", errors);
+		return 1;
+	}
+	printf("OK\n");
+	return 0;
+}
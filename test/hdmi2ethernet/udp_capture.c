@@ -0,0 +1,795 @@
+/*
+ * Capture RTP/JPEG (RFC 2435) video streams sent by the hdmi2eth gateware,
+ * or raw YCbCr 4:2:2 streams sent by the rawvideo gateware (-r).
+ *
+ * Datagrams are received in batches with recvmmsg(), reassembled into
+ * frames using the RTP sequence number, timestamp, marker bit and JPEG
+ * fragment offset (or the raw video frame/line/offset header), and each
+ * complete frame is written as soon as it is received. Frames with missing
+ * fragments are dropped and counted. Live statistics are printed once per
+ * second.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define DEFAULT_PORT 5004
+#define DEFAULT_RAW_PORT 6000
+#define DEFAULT_BATCH 64
+#define MAX_BATCH 1024
+#define MAX_DATAGRAM 9216
+#define MAX_FRAME_SIZE (8*1024*1024)
+#define SOCKET_BUFFER_SIZE (16*1024*1024)
+
+#define RTP_HEADER_LENGTH 12
+#define RTP_PAYLOAD_TYPE_JPEG 26
+#define RTP_JPEG_HEADER_LENGTH 8
+
+#define RAW_VIDEO_HEADER_LENGTH 14
+#define RAW_VIDEO_FLAG_LAST 0x0001
+
+/* Default tables from the JPEG specification (Annex K), natural order */
+static const uint8_t jpeg_luma_quantizer[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61,
+	12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56,
+	14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77,
+	24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101,
+	72, 92, 95, 98, 112, 100, 103, 99
+};
+
+static const uint8_t jpeg_chroma_quantizer[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99,
+	18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99,
+	47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99
+};
+
+static const uint8_t jpeg_zigzag[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const uint8_t lum_dc_codelens[16] = {
+	0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0
+};
+
+static const uint8_t lum_dc_symbols[12] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+
+static const uint8_t lum_ac_codelens[16] = {
+	0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d
+};
+
+static const uint8_t lum_ac_symbols[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+	0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+	0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+	0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+	0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+	0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+	0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+	0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+	0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+	0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+	0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+static const uint8_t chm_dc_codelens[16] = {
+	0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
+};
+
+static const uint8_t chm_dc_symbols[12] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+
+static const uint8_t chm_ac_codelens[16] = {
+	0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77
+};
+
+static const uint8_t chm_ac_symbols[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+	0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+	0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+	0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+	0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+	0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+	0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+	0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+	0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+	0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+	0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+
+struct frame {
+	int active;
+	int corrupt;
+	uint32_t timestamp;
+	uint8_t type;
+	uint8_t q;
+	uint16_t width;
+	uint16_t height;
+	uint16_t dri;
+	int have_qt;
+	uint8_t qt[128];
+	size_t length;
+	uint8_t *data;
+};
+
+struct raw_frame {
+	int active;
+	uint32_t number;
+	uint16_t width;
+	uint16_t height;
+	size_t received;
+	uint64_t packets;
+	size_t max_payload;
+	uint8_t *data;
+};
+
+struct stats {
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t lost;
+	uint64_t reordered;
+	uint64_t frames;
+	uint64_t dropped;
+	uint64_t invalid;
+};
+
+static volatile sig_atomic_t stop;
+
+static void handle_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static void make_tables(int q, uint8_t *qt)
+{
+	int factor = q;
+
+	if(q < 1) factor = 1;
+	if(q > 99) factor = 99;
+	if(q < 50)
+		factor = 5000/factor;
+	else
+		factor = 200 - factor*2;
+
+	for(int i = 0; i < 64; i++) {
+		int lq = (jpeg_luma_quantizer[jpeg_zigzag[i]]*factor + 50)/100;
+		int cq = (jpeg_chroma_quantizer[jpeg_zigzag[i]]*factor + 50)/100;
+		qt[i] = lq < 1 ? 1 : (lq > 255 ? 255 : lq);
+		qt[64 + i] = cq < 1 ? 1 : (cq > 255 ? 255 : cq);
+	}
+}
+
+static uint8_t *make_quant_header(uint8_t *p, const uint8_t *qt, int table)
+{
+	*p++ = 0xff;
+	*p++ = 0xdb;
+	*p++ = 0;
+	*p++ = 64 + 3;
+	*p++ = table;
+	memcpy(p, qt, 64);
+	return p + 64;
+}
+
+static uint8_t *make_huffman_header(uint8_t *p, const uint8_t *codelens, int ncodes,
+	const uint8_t *symbols, int nsymbols, int table, int class)
+{
+	*p++ = 0xff;
+	*p++ = 0xc4;
+	*p++ = 0;
+	*p++ = 3 + ncodes + nsymbols;
+	*p++ = (class << 4) | table;
+	memcpy(p, codelens, ncodes);
+	p += ncodes;
+	memcpy(p, symbols, nsymbols);
+	return p + nsymbols;
+}
+
+/* Rebuild the JFIF headers stripped by the sender (RFC 2435 appendix A) */
+static size_t make_headers(uint8_t *p, const struct frame *f)
+{
+	uint8_t *start = p;
+
+	*p++ = 0xff;
+	*p++ = 0xd8;
+	p = make_quant_header(p, f->qt, 0);
+	p = make_quant_header(p, f->qt + 64, 1);
+
+	if(f->dri != 0) {
+		*p++ = 0xff;
+		*p++ = 0xdd;
+		*p++ = 0;
+		*p++ = 4;
+		*p++ = f->dri >> 8;
+		*p++ = f->dri & 0xff;
+	}
+
+	*p++ = 0xff;
+	*p++ = 0xc0;
+	*p++ = 0;
+	*p++ = 17;
+	*p++ = 8;
+	*p++ = f->height >> 8;
+	*p++ = f->height & 0xff;
+	*p++ = f->width >> 8;
+	*p++ = f->width & 0xff;
+	*p++ = 3;
+	*p++ = 0;
+	*p++ = (f->type & 0x3f) == 0 ? 0x21 : 0x22;
+	*p++ = 0;
+	*p++ = 1;
+	*p++ = 0x11;
+	*p++ = 1;
+	*p++ = 2;
+	*p++ = 0x11;
+	*p++ = 1;
+
+	p = make_huffman_header(p, lum_dc_codelens, sizeof(lum_dc_codelens),
+		lum_dc_symbols, sizeof(lum_dc_symbols), 0, 0);
+	p = make_huffman_header(p, lum_ac_codelens, sizeof(lum_ac_codelens),
+		lum_ac_symbols, sizeof(lum_ac_symbols), 0, 1);
+	p = make_huffman_header(p, chm_dc_codelens, sizeof(chm_dc_codelens),
+		chm_dc_symbols, sizeof(chm_dc_symbols), 1, 0);
+	p = make_huffman_header(p, chm_ac_codelens, sizeof(chm_ac_codelens),
+		chm_ac_symbols, sizeof(chm_ac_symbols), 1, 1);
+
+	*p++ = 0xff;
+	*p++ = 0xda;
+	*p++ = 0;
+	*p++ = 12;
+	*p++ = 3;
+	*p++ = 0;
+	*p++ = 0;
+	*p++ = 1;
+	*p++ = 0x11;
+	*p++ = 2;
+	*p++ = 0x11;
+	*p++ = 0;
+	*p++ = 63;
+	*p++ = 0;
+
+	return p - start;
+}
+
+static int write_frame(const char *dir, unsigned int index, const struct frame *f)
+{
+	char filename[4096];
+	uint8_t header[1024];
+	static const uint8_t eoi[2] = {0xff, 0xd9};
+	size_t header_length;
+	FILE *fp;
+	int ret = 0;
+
+	snprintf(filename, sizeof(filename), "%s/frame_%06u.jpg", dir, index);
+	fp = fopen(filename, "wb");
+	if(!fp) {
+		perror(filename);
+		return -1;
+	}
+	header_length = make_headers(header, f);
+	if(fwrite(header, 1, header_length, fp) != header_length ||
+	   fwrite(f->data, 1, f->length, fp) != f->length)
+		ret = -1;
+	/* The hardware keeps the EOI marker, other senders may not */
+	if(f->length < 2 || f->data[f->length - 2] != 0xff || f->data[f->length - 1] != 0xd9)
+		if(fwrite(eoi, 1, sizeof(eoi), fp) != sizeof(eoi))
+			ret = -1;
+	if(fclose(fp) != 0)
+		ret = -1;
+	if(ret < 0)
+		perror(filename);
+	return ret;
+}
+
+static void frame_reset(struct frame *f)
+{
+	f->active = 0;
+	f->corrupt = 0;
+	f->have_qt = 0;
+	f->length = 0;
+}
+
+static void frame_complete(struct frame *f, struct stats *st, const char *dir)
+{
+	if(f->corrupt || !f->have_qt) {
+		st->dropped++;
+	} else {
+		if(dir)
+			write_frame(dir, st->frames, f);
+		st->frames++;
+	}
+	frame_reset(f);
+}
+
+static void handle_packet(const uint8_t *p, size_t len, struct frame *f,
+	struct stats *st, const char *dir)
+{
+	static int have_seq;
+	static uint16_t expected_seq;
+	uint16_t seq;
+	uint32_t timestamp;
+	uint32_t offset;
+	int marker;
+	size_t header_length;
+	uint8_t type, q;
+
+	st->packets++;
+	st->bytes += len;
+
+	if(len < RTP_HEADER_LENGTH + RTP_JPEG_HEADER_LENGTH || (p[0] >> 6) != 2 ||
+	   (p[1] & 0x7f) != RTP_PAYLOAD_TYPE_JPEG) {
+		st->invalid++;
+		return;
+	}
+
+	marker = p[1] >> 7;
+	seq = (p[2] << 8) | p[3];
+	timestamp = ((uint32_t)p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+	header_length = RTP_HEADER_LENGTH + 4*(p[0] & 0x0f);
+	if(p[0] & 0x10) {
+		if(len < header_length + 4) {
+			st->invalid++;
+			return;
+		}
+		header_length += 4 + 4*((p[header_length + 2] << 8) | p[header_length + 3]);
+	}
+	if(p[0] & 0x20) {
+		/* Padding count, including itself, within the payload */
+		if(len < header_length || p[len - 1] == 0 || p[len - 1] > len - header_length) {
+			st->invalid++;
+			return;
+		}
+		len -= p[len - 1];
+	}
+
+	/* Sequence gap detection */
+	if(have_seq && seq != expected_seq) {
+		uint16_t gap = seq - expected_seq;
+		if(gap < 0x8000) {
+			st->lost += gap;
+			/* Between frames, a next frame missing its start is
+			   caught by its offset */
+			if(f->active)
+				f->corrupt = 1;
+		} else {
+			/* Late or duplicate packet, already accounted as lost */
+			st->reordered++;
+			return;
+		}
+	}
+	have_seq = 1;
+	expected_seq = seq + 1;
+
+	if(len < header_length + RTP_JPEG_HEADER_LENGTH) {
+		st->invalid++;
+		return;
+	}
+	p += header_length;
+	len -= header_length;
+
+	offset = (p[1] << 16) | (p[2] << 8) | p[3];
+	type = p[4];
+	q = p[5];
+
+	/* Timestamp changed without a marker: the end of the previous frame was lost */
+	if(f->active && timestamp != f->timestamp)
+		frame_complete(f, st, NULL);
+
+	if(!f->active) {
+		f->active = 1;
+		f->timestamp = timestamp;
+		f->type = type;
+		f->q = q;
+		f->width = p[6]*8;
+		f->height = p[7]*8;
+		f->dri = 0;
+		if(offset != 0)
+			f->corrupt = 1;
+	}
+	p += RTP_JPEG_HEADER_LENGTH;
+	len -= RTP_JPEG_HEADER_LENGTH;
+
+	/* Restart marker header */
+	if(type >= 64 && type < 128) {
+		if(len < 4) {
+			st->invalid++;
+			return;
+		}
+		f->dri = (p[0] << 8) | p[1];
+		p += 4;
+		len -= 4;
+	}
+
+	if(offset == 0) {
+		if(q >= 128) {
+			/* Quantization table header, only in the first packet */
+			size_t qt_length;
+			if(len < 4) {
+				st->invalid++;
+				return;
+			}
+			qt_length = (p[2] << 8) | p[3];
+			if(p[1] != 0 || qt_length != 128 || len < 4 + qt_length) {
+				st->invalid++;
+				f->corrupt = 1;
+			} else {
+				memcpy(f->qt, p + 4, 128);
+				f->have_qt = 1;
+			}
+			p += 4 + qt_length;
+			len -= 4 + qt_length;
+		} else {
+			make_tables(q, f->qt);
+			f->have_qt = 1;
+		}
+	}
+
+	if(offset != f->length || offset + len > MAX_FRAME_SIZE) {
+		f->corrupt = 1;
+	} else {
+		memcpy(f->data + offset, p, len);
+		f->length = offset + len;
+	}
+
+	if(marker)
+		frame_complete(f, st, dir);
+}
+
+static int write_raw_frame(const char *dir, unsigned int index, const struct raw_frame *f)
+{
+	char filename[4096];
+	size_t size = (size_t)f->width*f->height*2;
+	FILE *fp;
+
+	snprintf(filename, sizeof(filename), "%s/frame_%06u_%ux%u.yuv", dir, index,
+		f->width, f->height);
+	fp = fopen(filename, "wb");
+	if(!fp || fwrite(f->data, 1, size, fp) != size || fclose(fp) != 0) {
+		perror(filename);
+		return -1;
+	}
+	return 0;
+}
+
+static void raw_frame_complete(struct raw_frame *f, struct stats *st, const char *dir)
+{
+	size_t size = (size_t)f->width*f->height*2;
+
+	if(f->received == size) {
+		if(dir)
+			write_raw_frame(dir, st->frames, f);
+		st->frames++;
+	} else {
+		/* Estimate the lost datagrams from the largest payload seen */
+		size_t line_packets = (2*f->width + f->max_payload - 1)/f->max_payload;
+		uint64_t expected = (uint64_t)line_packets*f->height;
+		if(expected > f->packets)
+			st->lost += expected - f->packets;
+		st->dropped++;
+	}
+	f->active = 0;
+}
+
+static void handle_raw_packet(const uint8_t *p, size_t len, struct raw_frame *f,
+	struct stats *st, const char *dir)
+{
+	uint32_t number;
+	uint16_t line, offset, width, height, flags;
+
+	st->packets++;
+	st->bytes += len;
+
+	if(len < RAW_VIDEO_HEADER_LENGTH) {
+		st->invalid++;
+		return;
+	}
+	number = ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	line = (p[4] << 8) | p[5];
+	offset = (p[6] << 8) | p[7];
+	width = (p[8] << 8) | p[9];
+	height = (p[10] << 8) | p[11];
+	flags = (p[12] << 8) | p[13];
+	p += RAW_VIDEO_HEADER_LENGTH;
+	len -= RAW_VIDEO_HEADER_LENGTH;
+
+	if(line >= height || (size_t)offset + len > 2*(size_t)width ||
+	   (size_t)width*height*2 > MAX_FRAME_SIZE) {
+		st->invalid++;
+		return;
+	}
+
+	if(f->active && number != f->number)
+		raw_frame_complete(f, st, NULL);
+	if(!f->active) {
+		f->active = 1;
+		f->number = number;
+		f->width = width;
+		f->height = height;
+		f->received = 0;
+		f->packets = 0;
+		f->max_payload = 0;
+	}
+	if(width != f->width || height != f->height) {
+		st->invalid++;
+		return;
+	}
+
+	memcpy(f->data + (size_t)line*2*width + offset, p, len);
+	f->received += len;
+	f->packets++;
+	if(len > f->max_payload)
+		f->max_payload = len;
+
+	if(flags & RAW_VIDEO_FLAG_LAST)
+		raw_frame_complete(f, st, dir);
+}
+
+static void print_stats(const struct stats *st, const struct stats *last, double interval)
+{
+	uint64_t packets = st->packets - last->packets;
+	uint64_t lost = st->lost - last->lost;
+
+	fprintf(stderr, "%8.2f Mbps %6.2f fps | frames %llu dropped %llu | packets %llu lost %llu (%.3f%%)\n",
+		(st->bytes - last->bytes)*8/interval/1e6,
+		(st->frames - last->frames)/interval,
+		(unsigned long long)st->frames,
+		(unsigned long long)st->dropped,
+		(unsigned long long)st->packets,
+		(unsigned long long)st->lost,
+		packets + lost ? 100.0*lost/(packets + lost) : 0.0);
+}
+
+static void help(void)
+{
+	printf("usage: udp_capture [options]\n"
+		"\n"
+		"Capture an RTP/JPEG stream and write each frame as a JPEG file, or a\n"
+		"raw YCbCr 4:2:2 stream and write each frame as a .yuv file.\n"
+		"\n"
+		"options:\n"
+		"  -p port      UDP port to listen on (default %d)\n"
+		"  -g group     join a multicast group\n"
+		"  -o dir       write frames to dir (default: don't write)\n"
+		"  -n frames    stop after capturing this many frames\n"
+		"  -t seconds   stop after this many seconds\n"
+		"  -b batch     datagrams per recvmmsg() call (default %d)\n"
+		"  -r           raw video stream (default port %d)\n"
+		"  -q           don't print live statistics\n",
+		DEFAULT_PORT, DEFAULT_BATCH, DEFAULT_RAW_PORT);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int port = 0;
+	int raw = 0;
+	const char *group = NULL;
+	const char *dir = NULL;
+	unsigned long max_frames = 0;
+	double duration = 0;
+	int batch = DEFAULT_BATCH;
+	int quiet = 0;
+	int c, fd, rcvbuf;
+	struct sockaddr_in addr;
+	struct mmsghdr *msgs;
+	struct iovec *iovecs;
+	uint8_t *buffers;
+	struct frame frame;
+	struct raw_frame raw_frame;
+	struct stats st, last;
+	double start, last_time;
+
+	while((c = getopt(argc, argv, "p:g:o:n:t:b:rqh")) != -1) {
+		switch(c) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'g':
+			group = optarg;
+			break;
+		case 'o':
+			dir = optarg;
+			break;
+		case 'n':
+			max_frames = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = atof(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			if(batch < 1 || batch > MAX_BATCH)
+				help();
+			break;
+		case 'r':
+			raw = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			help();
+		}
+	}
+
+	if(port == 0)
+		port = raw ? DEFAULT_RAW_PORT : DEFAULT_PORT;
+
+	if(dir && mkdir(dir, 0755) < 0 && errno != EEXIST) {
+		perror(dir);
+		return 1;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	rcvbuf = SOCKET_BUFFER_SIZE;
+	if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		return 1;
+	}
+
+	if(group) {
+		struct ip_mreq mreq;
+		memset(&mreq, 0, sizeof(mreq));
+		if(inet_pton(AF_INET, group, &mreq.imr_multiaddr) != 1) {
+			fprintf(stderr, "invalid multicast group %s\n", group);
+			return 1;
+		}
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		if(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			perror("IP_ADD_MEMBERSHIP");
+			return 1;
+		}
+	}
+
+	{
+		/* Wake up regularly to print statistics and check the time limit */
+		struct timeval tv = {0, 100000};
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	}
+
+	msgs = calloc(batch, sizeof(*msgs));
+	iovecs = calloc(batch, sizeof(*iovecs));
+	buffers = malloc((size_t)batch*MAX_DATAGRAM);
+	frame.data = malloc(MAX_FRAME_SIZE);
+	raw_frame.data = malloc(MAX_FRAME_SIZE);
+	if(!msgs || !iovecs || !buffers || !frame.data || !raw_frame.data) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	for(int i = 0; i < batch; i++) {
+		iovecs[i].iov_base = buffers + (size_t)i*MAX_DATAGRAM;
+		iovecs[i].iov_len = MAX_DATAGRAM;
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	frame_reset(&frame);
+	raw_frame.active = 0;
+	memset(&st, 0, sizeof(st));
+	memset(&last, 0, sizeof(last));
+
+	signal(SIGINT, handle_signal);
+	signal(SIGTERM, handle_signal);
+
+	start = last_time = now();
+	while(!stop) {
+		double t;
+		int n;
+
+		n = recvmmsg(fd, msgs, batch, MSG_WAITFORONE, NULL);
+		if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			perror("recvmmsg");
+			break;
+		}
+		for(int i = 0; i < n; i++) {
+			if(raw)
+				handle_raw_packet(iovecs[i].iov_base, msgs[i].msg_len, &raw_frame, &st, dir);
+			else
+				handle_packet(iovecs[i].iov_base, msgs[i].msg_len, &frame, &st, dir);
+			if(max_frames && st.frames >= max_frames) {
+				stop = 1;
+				break;
+			}
+		}
+
+		t = now();
+		if(duration > 0 && t - start >= duration)
+			stop = 1;
+		if(!quiet && t - last_time >= 1.0) {
+			print_stats(&st, &last, t - last_time);
+			last = st;
+			last_time = t;
+		}
+	}
+
+	memset(&last, 0, sizeof(last));
+	printf("captured %llu frames, dropped %llu, %llu packets, lost %llu, reordered %llu, invalid %llu\n",
+		(unsigned long long)st.frames,
+		(unsigned long long)st.dropped,
+		(unsigned long long)st.packets,
+		(unsigned long long)st.lost,
+		(unsigned long long)st.reordered,
+		(unsigned long long)st.invalid);
+	if(!quiet)
+		print_stats(&st, &last, now() - start);
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+Local RTP/JPEG (RFC 2435) and raw video replay source for testing udp_capture.
+
+Packetizes JPEG files (or deterministic synthetic frames) the same way as
+the hdmi2eth gateware: JFIF headers stripped, quantization tables in-band
+in the first packet, EOI kept, marker bit on the last packet. With --raw,
+sends synthetic YCbCr 4:2:2 frames like the rawvideo gateware.
+
+    ./udp_replay.py --frames 100 --rate 30 127.0.0.1
+    ./udp_replay.py --verify captures/ --frames 100
+    ./udp_replay.py --raw --port 6000 --frames 100
+"""
+
+import argparse
+import os
+import random
+import socket
+import struct
+import sys
+import time
+
+
+def jpeg_scan(data):
+    """Return (luma/chroma tables, width, height, scan data) from a JFIF file."""
+    assert data[:2] == b"\xff\xd8", "not a JPEG file"
+    tables = {}
+    width = height = 0
+    i = 2
+    while i < len(data):
+        assert data[i] == 0xff
+        marker = data[i+1]
+        length = struct.unpack(">H", data[i+2:i+4])[0]
+        segment = data[i+4:i+2+length]
+        if marker == 0xdb:
+            j = 0
+            while j < len(segment):
+                assert segment[j] >> 4 == 0, "16 bit tables are not supported"
+                tables[segment[j] & 0xf] = segment[j+1:j+65]
+                j += 65
+        elif marker == 0xc0:
+            height, width = struct.unpack(">HH", segment[1:5])
+        elif marker == 0xda:
+            return tables[0] + tables[1], width, height, data[i+2+length:]
+        i += 2 + length
+    raise ValueError("no scan found")
+
+
+def synthetic_frame(index, size):
+    """Deterministic frame: index followed by pseudo random stuffed data."""
+    rng = random.Random(index)
+    scan = bytearray(struct.pack(">I", index))
+    while len(scan) < size:
+        b = rng.randrange(256)
+        scan.append(b)
+        if b == 0xff:
+            scan.append(0x00)
+    scan += b"\xff\xd9"
+    tables = bytes(range(1, 129))
+    return tables, 1280, 720, bytes(scan)
+
+
+def packetize(tables, width, height, scan, seq, timestamp, ssrc, payload_size,
+              jpeg_type=0):
+    packets = []
+    offset = 0
+    while offset < len(scan):
+        payload = scan[offset:offset+payload_size]
+        marker = offset + len(payload) == len(scan)
+        rtp = struct.pack(">BBHII", 0x80, (marker << 7) | 26, seq & 0xffff,
+                          timestamp & 0xffffffff, ssrc)
+        jpeg = struct.pack(">I", offset) + bytes([jpeg_type, 255,
+                                                  width//8, height//8])
+        qt = b""
+        if offset == 0:
+            qt = struct.pack(">BBH", 0, 0, len(tables)) + tables
+        packets.append(rtp + jpeg + qt + payload)
+        offset += len(payload)
+        seq += 1
+    return packets, seq
+
+
+def synthetic_raw_frame(index, width, height):
+    """Deterministic raw frame: index followed by pseudo random pixels."""
+    rng = random.Random(index)
+    data = struct.pack(">I", index) + bytes(rng.getrandbits(8) for _ in range(2*width*height - 4))
+    return data
+
+
+def packetize_raw(data, index, width, height, payload_size):
+    packets = []
+    line_bytes = 2*width
+    for line in range(height):
+        for offset in range(0, line_bytes, payload_size):
+            payload = data[line*line_bytes+offset:line*line_bytes+min(offset+payload_size, line_bytes)]
+            last = line == height - 1 and offset + len(payload) == line_bytes
+            header = struct.pack(">IHHHHH", index, line, offset, width, height,
+                                 (1 << 8) | last)
+            packets.append(header + payload)
+    return packets
+
+
+def frames(args):
+    if args.files:
+        for i in range(args.frames):
+            name = args.files[i % len(args.files)]
+            yield jpeg_scan(open(name, "rb").read())
+    else:
+        for i in range(args.frames):
+            yield synthetic_frame(i, args.frame_size)
+
+
+def replay(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_SNDBUF, 4*1024*1024)
+    if args.ttl:
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, args.ttl)
+
+    seq = 0
+    sent = dropped = 0
+    jpeg_frames = frames(args)
+    start = time.time()
+    for i in range(args.frames):
+        if args.raw:
+            packets = packetize_raw(synthetic_raw_frame(i, args.width, args.height),
+                                    i, args.width, args.height, args.payload_size)
+        else:
+            tables, width, height, scan = next(jpeg_frames)
+            timestamp = int(i*90000/args.rate) if args.rate else i*3000
+            packets, seq = packetize(tables, width, height, scan, seq, timestamp,
+                                     0x48325553, args.payload_size)
+        for packet in packets:
+            sent += 1
+            if args.drop and sent % args.drop == 0:
+                dropped += 1
+                continue
+            sock.sendto(packet, (args.destination, args.port))
+        if args.rate:
+            delay = start + (i + 1)/args.rate - time.time()
+            if delay > 0:
+                time.sleep(delay)
+    print("sent {} frames, {} packets ({} dropped)".format(
+        args.frames, sent - dropped, dropped))
+
+
+def verify(args):
+    """Check captured synthetic frames against the expected scan data."""
+    errors = 0
+    extension = ".yuv" if args.raw else ".jpg"
+    names = sorted(n for n in os.listdir(args.verify) if n.endswith(extension))
+    for name in names:
+        data = open(os.path.join(args.verify, name), "rb").read()
+        if args.raw:
+            index = struct.unpack(">I", data[:4])[0]
+            expected = synthetic_raw_frame(index, args.width, args.height)
+        else:
+            data = jpeg_scan(data)[3]
+            index = struct.unpack(">I", data[:4])[0]
+            expected = synthetic_frame(index, args.frame_size)[3]
+        if data != expected:
+            print("{}: frame {} mismatch".format(name, index))
+            errors += 1
+    print("verified {} frames, {} errors".format(len(names), errors))
+    return errors == 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("destination", nargs="?", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=5004)
+    parser.add_argument("--frames", type=int, default=100)
+    parser.add_argument("--rate", type=float, default=30,
+                        help="frames per second (0: as fast as possible)")
+    parser.add_argument("--payload-size", type=int, default=1024)
+    parser.add_argument("--frame-size", type=int, default=100000,
+                        help="synthetic frame scan size in bytes")
+    parser.add_argument("--drop", type=int, default=0,
+                        help="drop every Nth packet to exercise loss detection")
+    parser.add_argument("--ttl", type=int, default=0,
+                        help="multicast TTL")
+    parser.add_argument("--raw", action="store_true",
+                        help="send raw YCbCr 4:2:2 frames")
+    parser.add_argument("--width", type=int, default=320,
+                        help="raw frame width")
+    parser.add_argument("--height", type=int, default=240,
+                        help="raw frame height")
+    parser.add_argument("--verify", metavar="DIR",
+                        help="verify synthetic frames captured in DIR")
+    parser.add_argument("--file", dest="files", action="append", default=[],
+                        help="JPEG file to replay instead of synthetic frames")
+    args = parser.parse_args()
+
+    if args.verify:
+        sys.exit(0 if verify(args) else 1)
+    replay(args)
+
+
+if __name__ == "__main__":
+    main()
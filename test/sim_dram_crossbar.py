@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""
+Priority arbitration of the DRAM crossbar with real traffic, in simulation.
+
+gateware/dram_qos.py's PriorityDRAMCore, as the Opsis target builds it
+(MT41J128M16 behind a quarter rate DDR3 PHY, litedram's model standing
+for the PHY and the chips), serves three users. Each one writes a region
+of its own with a pattern of its user number, pass and offset, then
+reads it back and checks it, over and over, through a write port and a
+read port of the crossbar. The regions span all the banks, so the users
+contend for each of them. For each scenario, the levels of the ports of
+each user are set and the commands accepted for each user are counted:
+
+    equal       all the users at the same level: round-robin, a third each
+    high        the first user one level above: it gets the most commands
+    low         the last user at level 0, as a port over its budget: it
+                gets the fewest commands
+
+Exit status is 0 if no word read back differs from the one written and
+the commands are shared as expected.
+
+Usage: ./test/sim_dram_crossbar.py [--cycles N]
+"""
+
+import argparse
+import os
+import sys
+from fractions import Fraction
+
+from migen import *
+
+from litedram.common import PhySettings
+from litedram.modules import MT41J128M16
+from litedram.phy.model import SDRAMPHYModel
+from litedram.core.controller import ControllerSettings
+from litedram.frontend.dma import LiteDRAMDMAReader, LiteDRAMDMAWriter
+
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from gateware.dram_qos import PriorityDRAMCore
+
+
+USERS = 3
+# words of a port per region: a row of each bank
+WORDS = 1024
+
+
+# the model stores the whole memory: only keep the rows used
+class BenchModule(MT41J128M16):
+    nrows = 256
+
+
+class User(Module):
+    """Writes words pattern(n, pass, offset) from base on through
+    write_port, then reads them back through read_port and checks them,
+    over and over"""
+    def __init__(self, n, write_port, read_port, base, words):
+        self.commands = Signal(32)
+        self.checked = Signal(32)
+        self.errors = Signal(32)
+
+        # # #
+
+        writer = LiteDRAMDMAWriter(write_port)
+        reader = LiteDRAMDMAReader(read_port)
+        self.submodules += writer, reader
+
+        npass = Signal(8)
+        offset = Signal(max=words)
+        written = Signal(max=words + 1)
+        received = Signal(max=words)
+
+        def pattern(offset):
+            word = Cat(offset, npass, C(n, 8))
+            return Cat(*[word]*(write_port.dw//len(word)))
+
+        # commands
+        self.submodules.fsm = fsm = FSM(reset_state="WRITE")
+        fsm.act("WRITE",
+            writer.sink.valid.eq(1),
+            If(writer.sink.ready & (offset == words - 1),
+                NextState("WRITTEN")
+            )
+        )
+        # the reads must not overtake the last writes
+        fsm.act("WRITTEN",
+            If(written == words,
+                NextState("READ")
+            )
+        )
+        fsm.act("READ",
+            reader.sink.valid.eq(1),
+            If(reader.sink.ready & (offset == words - 1),
+                NextState("READ_DONE")
+            )
+        )
+        fsm.act("READ_DONE",
+            If(reader.source.valid & reader.source.ready & (received == words - 1),
+                NextState("WRITE")
+            )
+        )
+        self.comb += [
+            writer.sink.address.eq(base + offset),
+            writer.sink.data.eq(pattern(offset)),
+            reader.sink.address.eq(base + offset)
+        ]
+        self.sync += [
+            If((writer.sink.valid & writer.sink.ready) |
+               (reader.sink.valid & reader.sink.ready),
+                self.commands.eq(self.commands + 1),
+                If(offset == words - 1,
+                    offset.eq(0)
+                ).Else(
+                    offset.eq(offset + 1)
+                )
+            ),
+            If(write_port.wdata.valid & write_port.wdata.ready,
+                written.eq(written + 1)
+            ),
+            If(fsm.ongoing("READ"),
+                written.eq(0)
+            )
+        ]
+
+        # checks
+        self.comb += reader.source.ready.eq(1)
+        self.sync += \
+            If(reader.source.valid,
+                self.checked.eq(self.checked + 1),
+                If(reader.source.data != pattern(received),
+                    self.errors.eq(self.errors + 1)
+                ),
+                If(received == words - 1,
+                    received.eq(0),
+                    npass.eq(npass + 1)
+                ).Else(
+                    received.eq(received + 1)
+                )
+            )
+
+
+class Bench(Module):
+    def __init__(self, levels):
+        clk_freq = (83 + Fraction(1, 3))*1000*1000
+        module = BenchModule(clk_freq, "1:4")
+        phy_settings = PhySettings(
+            memtype="DDR3",
+            dfi_databits=2*16,
+            nphases=4,
+            rdphase=0,
+            wrphase=1,
+            rdcmdphase=1,
+            wrcmdphase=0,
+            cl=7,
+            cwl=6,
+            read_latency=7,
+            write_latency=2
+        )
+        self.submodules.phy = SDRAMPHYModel(module, phy_settings)
+        self.submodules.core = PriorityDRAMCore(self.phy,
+            module.geom_settings,
+            module.timing_settings,
+            ControllerSettings(with_refresh=False))
+
+        crossbar = self.core.crossbar
+        self.users = []
+        for n in range(USERS):
+            write_port = crossbar.get_port(mode="write")
+            read_port = crossbar.get_port(mode="read")
+            user = User(n, write_port, read_port, n*WORDS, WORDS)
+            self.submodules += user
+            self.users.append(user)
+
+        # the levels of the masters, two per user, exist once finalized
+        crossbar.finalize()
+        for nm, level in enumerate(crossbar.levels):
+            self.comb += level.eq(levels[nm//2])
+
+
+def run(scenario, levels, cycles):
+    dut = Bench(levels)
+    results = {}
+
+    def generator():
+        # controller in charge of the DFI
+        control = dut.core.dfii._control
+        yield getattr(control, "storage_full", control.storage).eq(0b1)
+        for i in range(cycles):
+            yield
+        for n, user in enumerate(dut.users):
+            results[n] = ((yield user.commands), (yield user.checked), (yield user.errors))
+
+    run_simulation(dut, generator())
+
+    print("{} (levels {}):".format(scenario, ", ".join(str(level) for level in levels)))
+    total = max(sum(commands for commands, checked, errors in results.values()), 1)
+    for n in range(USERS):
+        commands, checked, errors = results[n]
+        print("  user{} {:6d} commands {:5.1f}%, {:6d} words checked, {} errors".format(
+            n, commands, 100*commands/total, checked, errors))
+    return [results[n] for n in range(USERS)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--cycles", type=int, default=20000,
+        help="system clock cycles simulated per scenario")
+    args = parser.parse_args()
+
+    errors = 0
+
+    def check(scenario, results):
+        nonlocal errors
+        if any(checked == 0 for commands, checked, e in results):
+            print("FAIL: {}: a user read nothing back".format(scenario))
+            errors += 1
+        if any(e for commands, checked, e in results):
+            print("FAIL: {}: words read back differ from the ones written".format(scenario))
+            errors += 1
+        return [commands for commands, checked, e in results]
+
+    commands = check("equal", run("equal", [1, 1, 1], args.cycles))
+    if min(commands) < 0.8*max(commands):
+        print("FAIL: users at the same level are not served round-robin")
+        errors += 1
+
+    commands = check("high", run("high", [2, 1, 1], args.cycles))
+    if commands[0] <= max(commands[1:]):
+        print("FAIL: the user of the highest level does not get the most commands")
+        errors += 1
+
+    commands = check("low", run("low", [1, 1, 0], args.cycles))
+    if commands[-1] >= min(commands[:-1]):
+        print("FAIL: the user at level 0 does not get the fewest commands")
+        errors += 1
+
+    if errors:
+        sys.exit(1)
+    print("OK")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""
+DRAM port arbitration under contention, in simulation.
+
+Three ports request a bank on every cycle, as the crossbar sees them when
+the CPU, an HDMI input and an HDMI output all stream to the same bank.
+Their levels come from gateware/dram_qos.py's DRAMQoS and one
+PriorityRoundRobin arbitrates them, granting a command per cycle. For
+each scenario, the grants of each port are counted:
+
+    idle        no urgency, no priority: round-robin, a third each
+    urgent      the output is urgent: it gets all the grants
+    budget      the output is urgent but over a budget of 64 commands per
+                1024 cycle window: past it, the others share the bank
+
+Exit status is 0 if the grants are shared as expected.
+
+Usage: ./test/sim_dram_qos.py [--cycles N]
+"""
+
+import argparse
+import os
+import sys
+
+from migen import *
+from migen.genlib import roundrobin
+
+sys.path.append(os.path.join(os.path.dirname(__file__), ".."))
+from gateware.dram_qos import DRAMQoS, PriorityRoundRobin
+
+
+PORTS = ["cpu", "hdmi_in0", "hdmi_out0"]
+OUTPUT = PORTS.index("hdmi_out0")
+WINDOW_BITS = 10
+
+
+class Port:
+    def __init__(self):
+        self.cmd = Record([("valid", 1), ("ready", 1)])
+
+
+class Bench(Module):
+    def __init__(self):
+        n = len(PORTS)
+        self.ports = [Port() for i in range(n)]
+        self.grants = [Signal(32) for i in range(n)]
+
+        self.submodules.qos = DRAMQoS(self.ports, window_bits=WINDOW_BITS)
+        self.submodules.arbiter = PriorityRoundRobin(n, roundrobin.SP_CE)
+
+        self.comb += [
+            self.arbiter.request.eq(Cat(*[port.cmd.valid for port in self.ports])),
+            self.arbiter.ce.eq(1)
+        ]
+        for i, port in enumerate(self.ports):
+            self.comb += [
+                port.cmd.valid.eq(1),
+                port.cmd.ready.eq(self.arbiter.grant == i),
+                self.arbiter.levels[i].eq(self.qos.levels[i])
+            ]
+            self.sync += If(port.cmd.ready, self.grants[i].eq(self.grants[i] + 1))
+
+
+def run(scenario, urgency, budget, cycles):
+    dut = Bench()
+    results = {}
+
+    def generator():
+        # configure the output port
+        yield dut.qos.sel.storage.eq(OUTPUT)
+        yield dut.qos.priority.storage.eq(0)
+        yield dut.qos.budget.storage.eq(budget)
+        yield dut.qos.write.re.eq(1)
+        yield
+        yield dut.qos.write.re.eq(0)
+        yield dut.qos.urgency[OUTPUT].eq(urgency)
+        yield
+        start = []
+        for i in range(len(PORTS)):
+            start.append((yield dut.grants[i]))
+        for i in range(cycles):
+            yield
+        for i, name in enumerate(PORTS):
+            results[name] = (yield dut.grants[i]) - start[i]
+
+    run_simulation(dut, generator())
+
+    print("{}:".format(scenario))
+    for name in PORTS:
+        print("  {:10s} {:6d} grants {:5.1f}%".format(
+            name, results[name], 100*results[name]/cycles))
+    return [results[name]/cycles for name in PORTS]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--cycles", type=int, default=4*2**WINDOW_BITS,
+        help="cycles simulated per scenario")
+    args = parser.parse_args()
+
+    errors = 0
+    shares = run("idle", 0, 0, args.cycles)
+    if any(abs(share - 1/len(PORTS)) > 0.01 for share in shares):
+        print("FAIL: idle ports are not served round-robin")
+        errors += 1
+
+    shares = run("urgent", 3, 0, args.cycles)
+    if shares[OUTPUT] < 0.99:
+        print("FAIL: the urgent port does not win")
+        errors += 1
+
+    shares = run("budget", 3, 64, args.cycles)
+    expected = 64/2**WINDOW_BITS
+    if abs(shares[OUTPUT] - expected) > 0.01:
+        print("FAIL: the urgent port gets {:.1f}% over its budget of {:.1f}%".format(
+            100*shares[OUTPUT], 100*expected))
+        errors += 1
+
+    if errors:
+        sys.exit(1)
+    print("OK")
+
+
+if __name__ == "__main__":
+    main()
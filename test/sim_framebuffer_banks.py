@@ -0,0 +1,209 @@
+#!/usr/bin/env python3
+"""
+DRAM row hit rate of concurrent frame buffer streams, in simulation.
+
+Two HDMI inputs capture into their next frame buffer while two HDMI
+outputs read their last one, all four streams at the same line, as when
+the outputs show the inputs with the same timing. The streams go through
+the Opsis DRAM controller (MT41J128M16 behind a quarter rate DDR3 PHY,
+litedram's model standing for the PHY and the chips), with the frame
+buffers of firmware/framebuffer.h staggered over FRAMEBUFFER_STAGGERS
+banks: 1 keeps them all aligned on a 4MB boundary (bank 0, no stagger
+offset), the default of the firmware (7 on the Opsis) spreads them.
+
+For each placement, the DFI commands are counted: row hit rate is the
+proportion of reads and writes which did not need to open a row first.
+The rates of all the placements are summed up at the end.
+
+Usage: ./test/sim_framebuffer_banks.py [--cycles N] [--staggers N [N ...]]
+"""
+
+import argparse
+from fractions import Fraction
+
+from migen import *
+
+from litedram.common import PhySettings
+from litedram.modules import MT41J128M16
+from litedram.phy.model import SDRAMPHYModel
+from litedram.core import LiteDRAMCore
+from litedram.core.controller import ControllerSettings
+from litedram.frontend.dma import LiteDRAMDMAReader, LiteDRAMDMAWriter
+
+
+# firmware/framebuffer.h
+FRAMEBUFFER_OFFSET = 0x01000000
+FRAMEBUFFER_SIZE = 0x400000
+FRAMEBUFFER_COUNT = 4
+FRAMEBUFFER_PATTERNS = 1
+FRAMEBUFFER_USED = 1920*1080*2 + 1080*32
+
+
+def framebuffer_staggers(row_bytes, banks):
+    return min((FRAMEBUFFER_SIZE - FRAMEBUFFER_USED)//row_bytes + 1, banks)
+
+
+def framebuffer(x, fb, row_bytes, staggers):
+    """Byte address of frame buffer fb of slot x, FRAMEBUFFER(x, fb)"""
+    n = x*FRAMEBUFFER_COUNT + fb
+    return (x + 1)*FRAMEBUFFER_OFFSET + fb*FRAMEBUFFER_SIZE + (n % staggers)*row_bytes
+
+
+# the model stores the whole memory: only keep the rows used by the
+# frame buffers of the inputs
+class BenchModule(MT41J128M16):
+    nrows = 4096
+
+
+class Stream(Module):
+    """Reads or writes words from base on and on, as fast as the port
+    allows"""
+    def __init__(self, port, base, words, write):
+        self.transfers = Signal(32)
+
+        # # #
+
+        if write:
+            dma = LiteDRAMDMAWriter(port)
+        else:
+            dma = LiteDRAMDMAReader(port)
+            self.comb += dma.source.ready.eq(1)
+        self.submodules += dma
+
+        offset = Signal(max=words)
+        self.comb += [
+            dma.sink.valid.eq(1),
+            dma.sink.address.eq(base + offset)
+        ]
+        if write:
+            self.comb += dma.sink.data.eq(offset)
+        self.sync += \
+            If(dma.sink.valid & dma.sink.ready,
+                self.transfers.eq(self.transfers + 1),
+                If(offset == words - 1,
+                    offset.eq(0)
+                ).Else(
+                    offset.eq(offset + 1)
+                )
+            )
+
+
+class CommandCounter(Module):
+    def __init__(self, dfi):
+        self.activates = Signal(32)
+        self.reads = Signal(32)
+        self.writes = Signal(32)
+
+        # # #
+
+        activates = []
+        reads = []
+        writes = []
+        for phase in dfi.phases:
+            cmd = Signal(4)
+            self.comb += cmd.eq(Cat(phase.we_n, phase.cas_n, phase.ras_n, phase.cs_n))
+            activates.append(cmd == 0b0011)
+            reads.append(cmd == 0b0101)
+            writes.append(cmd == 0b0100)
+        self.sync += [
+            self.activates.eq(self.activates + sum(activates)),
+            self.reads.eq(self.reads + sum(reads)),
+            self.writes.eq(self.writes + sum(writes))
+        ]
+
+
+class Bench(Module):
+    def __init__(self, staggers, hres=1280, vres=720):
+        clk_freq = (83 + Fraction(1, 3))*1000*1000
+        module = BenchModule(clk_freq, "1:4")
+        phy_settings = PhySettings(
+            memtype="DDR3",
+            dfi_databits=2*16,
+            nphases=4,
+            rdphase=0,
+            wrphase=1,
+            rdcmdphase=1,
+            wrcmdphase=0,
+            cl=7,
+            cwl=6,
+            read_latency=7,
+            write_latency=2
+        )
+        self.submodules.phy = SDRAMPHYModel(module, phy_settings)
+        self.submodules.core = LiteDRAMCore(self.phy,
+            module.geom_settings,
+            module.timing_settings,
+            ControllerSettings(with_refresh=False))
+        self.submodules.counter = CommandCounter(self.phy.dfi)
+
+        geom = module.geom_settings
+        row_bytes = 2**geom.colbits*(phy_settings.dfi_databits//2)//8
+
+        self.streams = []
+        for name, x, fb, write in [("hdmi_in0", 0, 1, True),
+                                   ("hdmi_out0", 0, 0, False),
+                                   ("hdmi_in1", 1, 1, True),
+                                   ("hdmi_out1", 1, 0, False)]:
+            port = self.core.crossbar.get_port(mode="write" if write else "read")
+            port_bytes = port.dw//8
+            base = framebuffer(FRAMEBUFFER_PATTERNS + x, fb, row_bytes, staggers)
+            stream = Stream(port, base//port_bytes, hres*vres*2//port_bytes, write)
+            self.submodules += stream
+            self.streams.append((name, base, stream))
+
+
+def run(staggers, cycles):
+    dut = Bench(staggers)
+    results = {}
+
+    def generator():
+        # controller in charge of the DFI
+        control = dut.core.dfii._control
+        yield getattr(control, "storage_full", control.storage).eq(0b1)
+        for i in range(cycles):
+            yield
+        results["activates"] = (yield dut.counter.activates)
+        results["reads"] = (yield dut.counter.reads)
+        results["writes"] = (yield dut.counter.writes)
+        for name, base, stream in dut.streams:
+            results[name] = (yield stream.transfers)
+
+    run_simulation(dut, generator())
+
+    print("FRAMEBUFFER_STAGGERS {}{}:".format(staggers, " (aligned)" if staggers == 1 else ""))
+    for name, base, stream in dut.streams:
+        print("  {:10s} 0x{:08x} {:8d} words".format(name, base, results[name]))
+    accesses = results["reads"] + results["writes"]
+    hits = accesses - results["activates"]
+    print("  reads {}, writes {}, activates {}".format(
+        results["reads"], results["writes"], results["activates"]))
+    rate = 100*hits/max(accesses, 1)
+    print("  row hit rate {:.1f}%".format(rate))
+    print()
+    return rate
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--cycles", type=int, default=20000,
+        help="system clock cycles simulated per placement")
+    parser.add_argument("--staggers", type=int, nargs="+",
+        help="FRAMEBUFFER_STAGGERS values to compare (default: 1, the "
+             "aligned frame buffers, and the firmware's)")
+    args = parser.parse_args()
+    if args.staggers and min(args.staggers) < 1:
+        parser.error("FRAMEBUFFER_STAGGERS is at least 1")
+
+    # a row of the x16 chip, as SDRAM_ROW_BYTES of the Opsis target
+    row_bytes = BenchModule.ncols*16//8
+    staggers = args.staggers or [1, framebuffer_staggers(row_bytes, BenchModule.nbanks)]
+
+    rates = [(n, run(n, args.cycles)) for n in staggers]
+    print("row hit rate by FRAMEBUFFER_STAGGERS:")
+    for n, rate in rates:
+        print("  {:2d} {:5.1f}%".format(n, rate))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+
+"""
+Poll the firmware telemetry block (firmware/telemetry.h) over Etherbone.
+
+The whole block is read with a single burst at the start of sram.
+"""
+
+import time
+
+from common import *
+
+TELEMETRY_MAGIC = 0x544c4d59
+TELEMETRY_VERSION = 3
+TELEMETRY_INPUTS = 4  # HDMI_IN_MAX
+TELEMETRY_OUTPUTS = 2
+
+# Layout of struct telemetry, one 32 bit word per field
+INPUT_FIELDS = ["flags", "hres", "vres", "freq_khz",
+                "wer0", "wer1", "wer2", "phase0", "phase1", "phase2",
+                "frames", "fps", "overflows", "dropped", "partial", "resized"]
+OUTPUT_FIELDS = ["flags", "hres", "vres", "refresh", "source", "underflows"]
+ENCODER_FIELDS = ["flags", "fps", "target_fps", "quality", "frame_size"]
+NETWORK_FIELDS = ["rx_packets", "rx_bytes", "tx_packets", "tx_bytes",
+                  "rtp_frames", "rtp_packets",
+                  "rawvideo_frames", "rawvideo_packets"]
+SIGNED_FIELDS = ["phase0", "phase1", "phase2"]
+
+LAYOUT = (
+    [("magic", None), ("version", None), ("size", None),
+     ("sequence", None), ("uptime", None)] +
+    [("input{}".format(i), INPUT_FIELDS) for i in range(TELEMETRY_INPUTS)] +
+    [("output{}".format(i), OUTPUT_FIELDS) for i in range(TELEMETRY_OUTPUTS)] +
+    [("encoder", ENCODER_FIELDS), ("network", NETWORK_FIELDS),
+     ("sequence_end", None)])
+
+TELEMETRY_WORDS = sum(1 if f is None else len(f) for _, f in LAYOUT)
+
+PRESENT = 0x01
+ENABLED = 0x02
+
+
+def decode(words):
+    t = {}
+    i = 0
+    for name, fields in LAYOUT:
+        if fields is None:
+            t[name] = words[i]
+            i += 1
+            continue
+        d = {}
+        for f in fields:
+            v = words[i]
+            if f in SIGNED_FIELDS and v & 0x80000000:
+                v -= 1 << 32
+            d[f] = v
+            i += 1
+        t[name] = d
+    return t
+
+
+def read_telemetry(wb, base, retries=10):
+    for _ in range(retries):
+        t = decode(wb.read(base, TELEMETRY_WORDS))
+        assert t["magic"] == TELEMETRY_MAGIC, \
+            "No telemetry at 0x{:08x} (firmware too old?)".format(base)
+        assert t["version"] == TELEMETRY_VERSION, \
+            "Unsupported telemetry version {}".format(t["version"])
+        if t["sequence"] == t["sequence_end"] and not t["sequence"] & 1:
+            return t
+    raise IOError("Telemetry keeps changing during the read")
+
+
+def format_telemetry(t):
+    s = ["uptime: {}s".format(t["uptime"])]
+    for i in range(TELEMETRY_INPUTS):
+        d = t["input{}".format(i)]
+        if not d["flags"] & PRESENT:
+            continue
+        s.append("input{}: {}x{} {:.2f}MHz {} fps WER:{} {} {} ph:{} {} {} overflows:{} dropped:{} partial:{} resized:{}{}".format(
+            i, d["hres"], d["vres"], d["freq_khz"]/1000, d["fps"],
+            d["wer0"], d["wer1"], d["wer2"], d["phase0"], d["phase1"], d["phase2"],
+            d["overflows"], d["dropped"], d["partial"], d["resized"],
+            "" if d["flags"] & ENABLED else " (disabled)"))
+    for i in range(TELEMETRY_OUTPUTS):
+        d = t["output{}".format(i)]
+        if not d["flags"] & PRESENT:
+            continue
+        if d["flags"] & ENABLED:
+            s.append("output{}: {}x{}@{:.2f}Hz from {} underflows:{}".format(
+                i, d["hres"], d["vres"], d["refresh"]/100, d["source"], d["underflows"]))
+        else:
+            s.append("output{}: off".format(i))
+    d = t["encoder"]
+    if d["flags"] & PRESENT:
+        s.append("encoder: {} fps (target {}) q{} {} bytes{}".format(
+            d["fps"], d["target_fps"], d["quality"], d["frame_size"],
+            "" if d["flags"] & ENABLED else " (disabled)"))
+    d = t["network"]
+    s.append("network: rx {} pkts/{} bytes tx {} pkts/{} bytes rtp {}/{} rawvideo {}/{}".format(
+        d["rx_packets"], d["rx_bytes"], d["tx_packets"], d["tx_bytes"],
+        d["rtp_frames"], d["rtp_packets"], d["rawvideo_frames"], d["rawvideo_packets"]))
+    return "\n".join(s)
+
+
+def add_args(parser):
+    parser.add_argument(
+        "--rate",
+        default=10,
+        type=float,
+        help="Number of reads per second.")
+
+    parser.add_argument(
+        "--count",
+        default=0,
+        type=int,
+        help="Number of reads, 0 to run forever.")
+
+
+def main():
+    args, wb = connect(__doc__, add_args=add_args)
+    base = wb.mems.sram.base
+    print("Telemetry @ 0x{:08x} ({} words)".format(base, TELEMETRY_WORDS))
+
+    n = 0
+    while args.count == 0 or n < args.count:
+        start = time.time()
+        t = read_telemetry(wb, base)
+        print("-"*75)
+        print("sequence {} ({:.1f}ms)".format(t["sequence"], (time.time() - start)*1000))
+        print(format_telemetry(t))
+        n += 1
+        time.sleep(max(0, 1/args.rate - (time.time() - start)))
+
+    wb.close()
+
+
+if __name__ == "__main__":
+    main()